@@ -48,6 +48,7 @@
 #include "ticks.h"
 #include "commonutil.h"
 #include "crc16.h"
+#include "dlwindowed.h"
 
 #ifdef WITH_LCD
 #include "LCD.h"
@@ -2008,6 +2009,14 @@ static void PacketReceived(PacketCommandNG *packet) {
             break;
         }
 #endif
+        case CMD_DOWNLOAD_WINDOWED: {
+            DownloadWindowed((download_windowed_t *)packet->data.asBytes);
+            break;
+        }
+        case CMD_DOWNLOAD_WINDOWED_ACK: {
+            // late acknowledge of a windowed download which is already finished or aborted
+            break;
+        }
         case CMD_DOWNLOAD_EML_BIGBUF: {
             LED_B_ON();
             uint8_t *mem = BigBuf_get_EM_addr();
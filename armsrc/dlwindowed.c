@@ -0,0 +1,282 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Windowed, resumable bulk download of BigBuf / emulator / flash / SPIFFS memory
+//
+// Memory is sent in numbered chunks, each with its own CRC and optionally
+// LZ4 compressed.  After a window of chunks the device waits for the client to
+// acknowledge them, and resends only the ones the client reports as missing.
+//-----------------------------------------------------------------------------
+#include "dlwindowed.h"
+
+#include "proxmark3_arm.h"
+#include "cmd.h"
+#include "dbprint.h"
+#include "util.h"
+#include "ticks.h"
+#include "BigBuf.h"
+#include "crc16.h"
+#include "lfsampling.h"
+#include "lz4.h"
+
+#ifdef WITH_FLASH
+#include "flashmem.h"
+#include "pmflash.h"
+#include "spiffs.h"
+#endif
+
+#define DL_ACK_TIMEOUT_MS   1000
+#define DL_MAX_RETRIES      5
+
+typedef struct {
+    uint8_t *mem;           // NULL when reading from flash
+    uint32_t start_index;
+    uint32_t bytes;
+    uint8_t flags;
+    uint8_t *readbuf;       // flash only
+} dl_ctx_t;
+
+static bool dl_send_chunk(dl_ctx_t *ctx, uint32_t seq) {
+
+    uint8_t frame[PM3_CMD_DATA_SIZE];
+    download_windowed_chunk_t *chunk = (download_windowed_chunk_t *)frame;
+
+    uint32_t offset = seq * DL_WINDOWED_CHUNK_SIZE;
+    uint16_t raw_len = MIN(ctx->bytes - offset, DL_WINDOWED_CHUNK_SIZE);
+
+    uint8_t *raw = ctx->mem + offset;
+#ifdef WITH_FLASH
+    if (ctx->mem == NULL) {
+        Flash_CheckBusy(BUSY_TIMEOUT);
+        if (Flash_ReadDataCont(ctx->start_index + offset, ctx->readbuf, raw_len) != raw_len) {
+            Dbprintf("reading flash memory failed ::  | bytes between %d - %d", offset, raw_len);
+        }
+        raw = ctx->readbuf;
+    }
+#endif
+
+    chunk->seq = seq;
+    chunk->raw_len = raw_len;
+    chunk->flags = 0;
+
+    uint8_t a = 0, b = 0;
+    compute_crc(CRC_14443_A, raw, raw_len, &a, &b);
+    chunk->crc = (a << 8 | b);
+
+    int clen = 0;
+    if (ctx->flags & DL_WINDOWED_FLAG_LZ4) {
+        // only keep the compressed data when it is actually smaller
+        clen = LZ4_compress_default((const char *)raw, (char *)chunk->data, raw_len, raw_len - 1);
+    }
+
+    if (clen > 0) {
+        chunk->flags |= DL_WINDOWED_FLAG_LZ4;
+        chunk->len = clen;
+    } else {
+        memcpy(chunk->data, raw, raw_len);
+        chunk->len = raw_len;
+    }
+
+    return reply_ng(CMD_DOWNLOADED_WINDOWED, PM3_SUCCESS, frame, sizeof(download_windowed_chunk_t) + chunk->len) == PM3_SUCCESS;
+}
+
+// waits for the client acknowledge of the current window.
+// When the client didn't hear from us for a while it sends the download request again, with the first chunk
+// it misses.  Then *resumed is set and ack->next holds that chunk.
+static int dl_wait_ack(const download_windowed_t *req, download_windowed_ack_t *ack, bool *resumed) {
+    PacketCommandNG rx;
+    *resumed = false;
+    uint32_t start = GetTickCount();
+    while (GetTickCountDelta(start) < DL_ACK_TIMEOUT_MS) {
+
+        WDT_HIT();
+
+        if (BUTTON_PRESS())
+            return PM3_EOPABORTED;
+
+        if (data_available() == false)
+            continue;
+
+        if (receive_ng(&rx) != PM3_SUCCESS)
+            continue;
+
+        if (rx.cmd == CMD_DOWNLOAD_WINDOWED_ACK && rx.length == sizeof(download_windowed_ack_t)) {
+            memcpy(ack, rx.data.asBytes, sizeof(download_windowed_ack_t));
+            return PM3_SUCCESS;
+        }
+
+        if (rx.cmd == CMD_DOWNLOAD_WINDOWED && rx.length == sizeof(download_windowed_t)) {
+            download_windowed_t *again = (download_windowed_t *)rx.data.asBytes;
+            // a download of some other memory, the client gave up on this one
+            if (again->memtype != req->memtype || again->start_index != req->start_index || again->bytes != req->bytes)
+                return PM3_EOPABORTED;
+
+            ack->next = again->first_chunk;
+            ack->bitmap = 0;
+            *resumed = true;
+            return PM3_SUCCESS;
+        }
+
+        // client gave up on this transfer and sent something else
+        if (rx.cmd == CMD_BREAK_LOOP)
+            return PM3_EOPABORTED;
+    }
+    return PM3_ETIMEOUT;
+}
+
+void DownloadWindowed(download_windowed_t *req) {
+
+    LED_B_ON();
+
+    dl_ctx_t ctx = {
+        .mem = NULL,
+        .start_index = req->start_index,
+        .bytes = req->bytes,
+        .flags = req->flags,
+        .readbuf = NULL,
+    };
+
+    int res = PM3_SUCCESS;
+#ifdef WITH_FLASH
+    bool flash_on = false;
+#endif
+    uint64_t end = (uint64_t)req->start_index + req->bytes;
+    switch (req->memtype) {
+        case DL_WINDOWED_MEM_BIGBUF: {
+            if (end > BigBuf_get_size()) {
+                res = PM3_EOUTOFBOUND;
+                break;
+            }
+            ctx.mem = BigBuf_get_addr() + req->start_index;
+            break;
+        }
+        case DL_WINDOWED_MEM_EML: {
+            if (end > CARD_MEMORY_SIZE) {
+                res = PM3_EOUTOFBOUND;
+                break;
+            }
+            ctx.mem = BigBuf_get_EM_addr() + req->start_index;
+            break;
+        }
+#ifdef WITH_FLASH
+        case DL_WINDOWED_MEM_FLASH: {
+            if (end > FLASH_MEM_MAX_SIZE) {
+                res = PM3_EOVFLOW;
+                break;
+            }
+            ctx.readbuf = BigBuf_malloc(DL_WINDOWED_CHUNK_SIZE);
+            if (ctx.readbuf == NULL) {
+                res = PM3_EMALLOC;
+                break;
+            }
+            if (FlashInit() == false) {
+                res = PM3_EFLASH;
+                break;
+            }
+            flash_on = true;
+            break;
+        }
+        case DL_WINDOWED_MEM_SPIFFS: {
+            req->filename[sizeof(req->filename) - 1] = 0;
+            if (DBGLEVEL >= DBG_DEBUG) Dbprintf("Filename received for spiffs dump : %s", req->filename);
+            // the whole file is read into BigBuf first, BigBuf_malloc takes 16 bits
+            if (req->bytes > 0xFFFF) {
+                res = PM3_EOVFLOW;
+                break;
+            }
+            ctx.mem = BigBuf_malloc(req->bytes);
+            if (ctx.mem == NULL) {
+                res = PM3_EMALLOC;
+                break;
+            }
+            ctx.start_index = 0;
+            break;
+        }
+#endif
+        default: {
+            res = PM3_ENOTIMPL;
+            break;
+        }
+    }
+
+    download_windowed_start_t start = {
+        .total_chunks = (req->bytes + DL_WINDOWED_CHUNK_SIZE - 1) / DL_WINDOWED_CHUNK_SIZE,
+        .chunk_size = DL_WINDOWED_CHUNK_SIZE,
+        .window = MIN(MAX(req->window, 1), DL_WINDOWED_MAX_WINDOW),
+    };
+    // answer right away, the client uses it to detect firmwares without windowed download
+    reply_ng(CMD_DOWNLOAD_WINDOWED, res, (uint8_t *)&start, sizeof(start));
+    if (res != PM3_SUCCESS)
+        goto out;
+
+#ifdef WITH_FLASH
+    if (req->memtype == DL_WINDOWED_MEM_SPIFFS) {
+        rdv40_spiffs_read_as_filetype((char *)req->filename, ctx.mem, req->bytes, RDV40_SPIFFS_SAFETY_SAFE);
+    }
+#endif
+
+    uint32_t base = req->first_chunk;
+    uint32_t received = 0;  // bitmap relative to base, from the last ack
+    uint8_t retries = 0;
+
+    while (base < start.total_chunks) {
+
+        uint32_t count = MIN(start.window, start.total_chunks - base);
+        for (uint32_t i = 0; i < count; i++) {
+            if ((received & (1u << i)) == 0) {
+                dl_send_chunk(&ctx, base + i);
+            }
+        }
+
+        // end of window, ask client what it got
+        download_windowed_ack_t eow = { .next = base, .bitmap = (count == 32) ? 0xFFFFFFFF : ((1u << count) - 1) };
+        reply_ng(CMD_DOWNLOAD_WINDOWED_ACK, PM3_SUCCESS, (uint8_t *)&eow, sizeof(eow));
+
+        download_windowed_ack_t ack;
+        bool resumed;
+        res = dl_wait_ack(req, &ack, &resumed);
+        if (res == PM3_ETIMEOUT) {
+            if (++retries > DL_MAX_RETRIES) {
+                Dbprintf("transfer to client failed :: no acknowledge for chunks %u - %u", base, base + count - 1);
+                goto out;
+            }
+            received = 0;
+            continue;
+        }
+        if (res != PM3_SUCCESS)
+            goto out;
+
+        retries = 0;
+        if (resumed) {
+            // answer the request like a new one and continue from the chunk the client asks for
+            reply_ng(CMD_DOWNLOAD_WINDOWED, PM3_SUCCESS, (uint8_t *)&start, sizeof(start));
+            base = MIN(ack.next, start.total_chunks);
+            received = 0;
+            continue;
+        }
+        if (ack.next < base || ack.next > start.total_chunks) {
+            received = 0;
+            continue;
+        }
+        base = ack.next;
+        received = ack.bitmap;
+    }
+
+    // Trigger a finish downloading signal with an ACK frame, same as the legacy download commands
+    if (req->memtype == DL_WINDOWED_MEM_BIGBUF) {
+        reply_mix(CMD_ACK, 1, 0, BigBuf_get_traceLen(), getSamplingConfig(), sizeof(sample_config));
+    } else {
+        reply_mix(CMD_ACK, 1, 0, 0, 0, 0);
+    }
+
+out:
+#ifdef WITH_FLASH
+    if (flash_on)
+        FlashStop();
+    if (req->memtype == DL_WINDOWED_MEM_FLASH || req->memtype == DL_WINDOWED_MEM_SPIFFS)
+        BigBuf_free();
+#endif
+    LED_B_OFF();
+}
@@ -0,0 +1,16 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Windowed, resumable bulk download of BigBuf / emulator / flash / SPIFFS memory
+//-----------------------------------------------------------------------------
+#ifndef __DLWINDOWED_H
+#define __DLWINDOWED_H
+
+#include "common.h"
+#include "pm3_cmd.h"
+
+void DownloadWindowed(download_windowed_t *req);
+
+#endif
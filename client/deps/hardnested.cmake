@@ -104,6 +104,26 @@ if ("${CMAKE_SYSTEM_PROCESSOR}" IN_LIST X86_CPUS)
             $<TARGET_OBJECTS:pm3rrg_rdv4_hardnested_avx>
             $<TARGET_OBJECTS:pm3rrg_rdv4_hardnested_avx2>
             $<TARGET_OBJECTS:pm3rrg_rdv4_hardnested_avx512>)
+elseif ("${CMAKE_SYSTEM_PROCESSOR}" MATCHES "^(aarch64|arm64|ARM64)$")
+    message(STATUS "Building optimised AArch64 binaries")
+
+    ## the plain C core also carries the dispatcher
+    target_compile_definitions(pm3rrg_rdv4_hardnested_nosimd PRIVATE NOSIMD_BUILD)
+
+    ## AArch64 / NEON
+    add_library(pm3rrg_rdv4_hardnested_neon OBJECT
+            hardnested/hardnested_bf_core.c)
+
+    target_compile_options(pm3rrg_rdv4_hardnested_neon PRIVATE -Wall -Werror -O3)
+    set_property(TARGET pm3rrg_rdv4_hardnested_neon PROPERTY POSITION_INDEPENDENT_CODE ON)
+
+    target_include_directories(pm3rrg_rdv4_hardnested_neon PRIVATE
+            ../../common
+            ../../include
+            ../src)
+
+    set(SIMD_TARGETS
+            $<TARGET_OBJECTS:pm3rrg_rdv4_hardnested_neon>)
 else ()
     message(STATUS "Not building optimised targets")
     set(SIMD_TARGETS)
@@ -61,6 +61,11 @@ THE SOFTWARE.
 #  endif
 #endif
 
+// NEON is part of the AArch64 base instruction set, no runtime check needed
+#if defined (__aarch64__)
+#  define COMPILER_HAS_NEON
+#endif
+
 typedef enum {
     SIMD_AUTO,
 #if defined(COMPILER_HAS_SIMD_AVX512)
@@ -71,11 +76,17 @@ typedef enum {
     SIMD_AVX,
     SIMD_SSE2,
     SIMD_MMX,
+#endif
+#if defined(COMPILER_HAS_NEON)
+    SIMD_NEON,
 #endif
     SIMD_NONE,
 } SIMDExecInstr;
 void SetSIMDInstr(SIMDExecInstr instr);
+SIMDExecInstr GetSIMDInstrSetting(void);
 SIMDExecInstr GetSIMDInstrAuto(void);
+bool SIMDInstrSupported(SIMDExecInstr instr);
+const char *GetSIMDInstrName(SIMDExecInstr instr);
 
 uint64_t crack_states_bitsliced(uint32_t cuid, uint8_t *best_first_bytes, statelist_t *p, uint32_t *keys_found, uint64_t *num_keys_tested, uint32_t nonces_to_bruteforce, uint8_t *bf_test_nonce_2nd_byte, noncelist_t *nonces);
 void bitslice_test_nonces(uint32_t nonces_to_bruteforce, uint32_t *bf_test_nonce, uint8_t *bf_test_nonce_par);
@@ -55,6 +55,9 @@ THE SOFTWARE.
 #include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
+#if defined (_WIN32)
+#include <malloc.h>
+#endif
 
 #include "common.h"
 #include "proxmark3.h"
@@ -72,6 +75,8 @@ THE SOFTWARE.
 #define DEFAULT_BRUTE_FORCE_RATE        (120000000.0) // if benchmark doesn't succeed
 #define TEST_BENCH_SIZE                 (6000)        // number of odd and even states for brute force benchmark
 #define TEST_BENCH_FILENAME             "hardnested_bf_bench_data.bin"
+#define TILE_ODD_STATES                 (1024)        // buckets are cut into tiles of at most odd x even states,
+#define TILE_EVEN_STATES                (1 << 16)     // a multiple of the largest number of bitslices
 //#define WRITE_BENCH_FILE
 
 // debugging options
@@ -89,6 +94,41 @@ static uint8_t bf_test_nonce_2nd_byte[256];
 static uint8_t bf_test_nonce_par[256];
 static uint32_t bucket_count = 0;
 static statelist_t *buckets[128];
+static uint32_t bucket_first_tile[128 + 1];
+static uint32_t bucket_odd_tiles[128];
+
+// Every thread owns a range of tiles, packed into one word so that it can be updated with a single CAS:
+// the owner takes tiles from the front, idle threads steal the back half of the largest range left.
+typedef struct {
+    uint64_t range;     // first tile << 32 | end tile
+    uint8_t padding[56];
+} __attribute__((aligned(64))) tile_range_t;
+static tile_range_t *tile_ranges = NULL;
+static uint32_t num_tile_ranges = 0;
+
+// calloc only aligns to 16 bytes, the ranges must each have a cache line of their own
+static tile_range_t *tile_ranges_alloc(uint32_t count) {
+    size_t size = count * sizeof(tile_range_t);
+    void *mem;
+#if defined (_WIN32)
+    mem = _aligned_malloc(size, __alignof__(tile_range_t));
+    if (mem == NULL)
+        return NULL;
+#else
+    if (posix_memalign(&mem, __alignof__(tile_range_t), size))
+        return NULL;
+#endif
+    memset(mem, 0, size);
+    return (tile_range_t *)mem;
+}
+
+static void tile_ranges_free(tile_range_t *ranges) {
+#if defined (_WIN32)
+    _aligned_free(ranges);
+#else
+    free(ranges);
+#endif
+}
 static uint32_t keys_found = 0;
 static uint64_t num_keys_tested;
 static uint64_t found_bs_key = 0;
@@ -140,6 +180,67 @@ bool verify_key(uint32_t cuid, noncelist_t *nonces, uint8_t *best_first_bytes, u
     }
     return true;
 }
+static uint32_t range_size(uint64_t range) {
+    uint32_t first = range >> 32, end = range;
+    return end > first ? end - first : 0;
+}
+
+static bool next_tile(uint32_t thread_id, uint32_t *tile) {
+    tile_range_t *own = &tile_ranges[thread_id];
+    uint64_t range = __atomic_load_n(&own->range, __ATOMIC_ACQUIRE);
+    while (range_size(range)) {
+        if (__atomic_compare_exchange_n(&own->range, &range, range + (1ull << 32), false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *tile = range >> 32;
+            return true;
+        }
+    }
+
+    // own range is empty, steal from the thread with the most tiles left
+    while (__atomic_load_n(&keys_found, __ATOMIC_RELAXED) == 0) {
+        uint32_t victim = num_tile_ranges;
+        uint32_t victim_size = 0;
+        for (uint32_t i = 0; i < num_tile_ranges; i++) {
+            uint32_t size = range_size(__atomic_load_n(&tile_ranges[i].range, __ATOMIC_RELAXED));
+            if (size > victim_size) {
+                victim = i;
+                victim_size = size;
+            }
+        }
+        if (victim == num_tile_ranges)
+            return false;
+
+        range = __atomic_load_n(&tile_ranges[victim].range, __ATOMIC_ACQUIRE);
+        uint32_t size = range_size(range);
+        if (size == 0)
+            continue;
+        uint32_t end = range;
+        uint32_t split = end - (size + 1) / 2;
+        uint64_t rest = (range & 0xFFFFFFFF00000000ull) | split;
+        if (__atomic_compare_exchange_n(&tile_ranges[victim].range, &range, rest, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // keep the first stolen tile, the others go to the own range where they can be stolen again
+            *tile = split;
+            __atomic_store_n(&own->range, (uint64_t)(split + 1) << 32 | end, __ATOMIC_RELEASE);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void get_tile(uint32_t tile, statelist_t *t) {
+    uint32_t bucket = 0;
+    while (tile >= bucket_first_tile[bucket + 1])
+        bucket++;
+
+    statelist_t *p = buckets[bucket];
+    uint32_t odd_tile = (tile - bucket_first_tile[bucket]) % bucket_odd_tiles[bucket];
+    uint32_t even_tile = (tile - bucket_first_tile[bucket]) / bucket_odd_tiles[bucket];
+    t->states[ODD_STATE] = p->states[ODD_STATE] + odd_tile * TILE_ODD_STATES;
+    t->len[ODD_STATE] = MIN(p->len[ODD_STATE] - odd_tile * TILE_ODD_STATES, TILE_ODD_STATES);
+    t->states[EVEN_STATE] = p->states[EVEN_STATE] + even_tile * TILE_EVEN_STATES;
+    t->len[EVEN_STATE] = MIN(p->len[EVEN_STATE] - even_tile * TILE_EVEN_STATES, TILE_EVEN_STATES);
+    t->next = NULL;
+}
+
 static void *
 #ifdef __has_attribute
 #if __has_attribute(force_align_arg_pointer)
@@ -159,36 +260,34 @@ crack_states_thread(void *x) {
 
     thread_arg = (struct arg *)x;
     const int thread_id = thread_arg->thread_ID;
-    uint32_t current_bucket = thread_id;
-    while (current_bucket < bucket_count) {
-        statelist_t *bucket = buckets[current_bucket];
-        if (bucket) {
+    uint32_t current_tile;
+    while (next_tile(thread_id, &current_tile)) {
+        statelist_t tile;
+        get_tile(current_tile, &tile);
 #if defined (DEBUG_BRUTE_FORCE)
-            PrintAndLogEx(INFO, "Thread %u starts working on bucket %u\n", thread_id, current_bucket);
+        PrintAndLogEx(INFO, "Thread %u starts working on tile %u\n", thread_id, current_tile);
 #endif
-            const uint64_t key = crack_states_bitsliced(thread_arg->cuid, thread_arg->best_first_bytes, bucket, &keys_found, &num_keys_tested, nonces_to_bruteforce, bf_test_nonce_2nd_byte, thread_arg->nonces);
-            if (key != -1) {
-                __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
-                __atomic_fetch_add(&found_bs_key, key, __ATOMIC_SEQ_CST);
-
+        const uint64_t key = crack_states_bitsliced(thread_arg->cuid, thread_arg->best_first_bytes, &tile, &keys_found, &num_keys_tested, nonces_to_bruteforce, bf_test_nonce_2nd_byte, thread_arg->nonces);
+        if (key != -1) {
+            __atomic_fetch_add(&keys_found, 1, __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&found_bs_key, key, __ATOMIC_SEQ_CST);
+
+            char progress_text[80];
+            char keystr[19];
+            sprintf(keystr, "%012" PRIx64 "  ", key);
+            sprintf(progress_text, "Brute force phase completed.  Key found: " _YELLOW_("%s"), keystr);
+            hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, 0.0, 0);
+            break;
+        } else if (keys_found) {
+            break;
+        } else {
+            if (!thread_arg->silent) {
                 char progress_text[80];
-                char keystr[19];
-                sprintf(keystr, "%012" PRIx64 "  ", key);
-                sprintf(progress_text, "Brute force phase completed.  Key found: " _YELLOW_("%s"), keystr);
-                hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, 0.0, 0);
-                break;
-            } else if (keys_found) {
-                break;
-            } else {
-                if (!thread_arg->silent) {
-                    char progress_text[80];
-                    sprintf(progress_text, "Brute force phase: %6.02f%%\t", 100.0 * (float)num_keys_tested / (float)(thread_arg->maximum_states));
-                    float remaining_bruteforce = thread_arg->nonces[thread_arg->best_first_bytes[0]].expected_num_brute_force - (float)num_keys_tested / 2;
-                    hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, remaining_bruteforce, 5000);
-                }
+                sprintf(progress_text, "Brute force phase: %6.02f%%\t", 100.0 * (float)num_keys_tested / (float)(thread_arg->maximum_states));
+                float remaining_bruteforce = thread_arg->nonces[thread_arg->best_first_bytes[0]].expected_num_brute_force - (float)num_keys_tested / 2;
+                hardnested_print_progress(thread_arg->num_acquired_nonces, progress_text, remaining_bruteforce, 5000);
             }
         }
-        current_bucket += NUM_BRUTE_FORCE_THREADS;
     }
     return NULL;
 }
@@ -308,12 +407,17 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
 
     // count number of states to go
     bucket_count = 0;
+    bucket_first_tile[0] = 0;
     for (statelist_t *p = candidates; p != NULL; p = p->next) {
-        if (p->states[ODD_STATE] != NULL && p->states[EVEN_STATE] != NULL) {
+        if (p->states[ODD_STATE] != NULL && p->states[EVEN_STATE] != NULL && p->len[ODD_STATE] && p->len[EVEN_STATE]) {
             buckets[bucket_count] = p;
+            bucket_odd_tiles[bucket_count] = (p->len[ODD_STATE] + TILE_ODD_STATES - 1) / TILE_ODD_STATES;
+            uint32_t even_tiles = (p->len[EVEN_STATE] + TILE_EVEN_STATES - 1) / TILE_EVEN_STATES;
+            bucket_first_tile[bucket_count + 1] = bucket_first_tile[bucket_count] + bucket_odd_tiles[bucket_count] * even_tiles;
             bucket_count++;
         }
     }
+    uint32_t tile_count = bucket_first_tile[bucket_count];
 
     uint64_t start_time = msclock();
 
@@ -322,6 +426,19 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
         return false;
 #endif
 
+    // hand out the tiles in equal ranges, in bucket order
+    num_tile_ranges = NUM_BRUTE_FORCE_THREADS;
+    tile_ranges = tile_ranges_alloc(num_tile_ranges);
+    if (tile_ranges == NULL) {
+        PrintAndLogEx(WARNING, "Out of memory error in brute_force_bs(). Aborting...");
+        return false;
+    }
+    for (uint32_t i = 0; i < num_tile_ranges; i++) {
+        uint64_t first = (uint64_t)tile_count * i / num_tile_ranges;
+        uint64_t end = (uint64_t)tile_count * (i + 1) / num_tile_ranges;
+        tile_ranges[i].range = first << 32 | end;
+    }
+
     pthread_t threads[NUM_BRUTE_FORCE_THREADS];
     struct args {
         bool silent;
@@ -346,6 +463,8 @@ bool brute_force_bs(float *bf_rate, statelist_t *candidates, uint32_t cuid, uint
     for (uint32_t i = 0; i < NUM_BRUTE_FORCE_THREADS; i++) {
         pthread_join(threads[i], 0);
     }
+    tile_ranges_free(tile_ranges);
+    tile_ranges = NULL;
 
     uint64_t elapsed_time = msclock() - start_time;
 
@@ -19,6 +19,9 @@
 #include "ui.h"           // PrintAndLog
 #include "crc.h"
 #include "crc16.h"        // crc16 ccitt
+#include "crc32.h"
+#include "crc64.h"
+#include "util_posix.h"   // msclock
 #include "tea.h"
 #include "legic_prng.h"
 #include "cmddata.h"      // demodbuffer
@@ -254,26 +257,183 @@ static int CmdAnalyseLCR(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+// crc types of the table driven engines, with the parameters of the bit looped reference
+typedef struct {
+    const char *name;
+    CrcType_t type;
+    uint16_t init;
+    uint16_t poly;
+    bool refin;
+    bool refout;
+    uint16_t xorout;
+} crc16_param_t;
+
+static const crc16_param_t crc16_params[] = {
+    {"ISO14443 A", CRC_14443_A,  0xC6C6, CRC16_POLY_CCITT, true,  true,  0x0000},
+    {"ISO14443 B", CRC_14443_B,  0xFFFF, CRC16_POLY_CCITT, true,  true,  0xFFFF},
+    {"ISO15693",   CRC_15693,    0xFFFF, CRC16_POLY_CCITT, true,  true,  0xFFFF},
+    {"iCLASS",     CRC_ICLASS,   0x4807, CRC16_POLY_CCITT, true,  true,  0x0000},
+    {"FeliCa",     CRC_FELICA,   0x0000, CRC16_POLY_CCITT, false, false, 0x0000},
+    {"CCITT",      CRC_CCITT,    0xFFFF, CRC16_POLY_CCITT, false, false, 0x0000},
+    {"KERMIT",     CRC_KERMIT,   0x0000, CRC16_POLY_CCITT, true,  true,  0x0000},
+    {"XMODEM",     CRC_XMODEM,   0x0000, CRC16_POLY_CCITT, false, false, 0x0000},
+    {"ISO11784",   CRC_11784,    0x0000, CRC16_POLY_CCITT, false, true,  0x0000},
+    {"CryptoRF",   CRC_CRYPTORF, 0xFFFF, CRC16_POLY_CCITT, true,  true,  0xFFFF},
+    {"LEGIC",      CRC_LEGIC,    0x7878, CRC16_POLY_LEGIC, true,  true,  0x0000},
+};
+
+// at least 3 bytes
+static uint16_t crc16_param_calc(const crc16_param_t *p, const uint8_t *d, size_t n) {
+    if (p->type == CRC_LEGIC)
+        return crc16_legic(d, n, p->init & 0xFF);
+    return Crc16ex(p->type, d, n);
+}
+
+static uint32_t crc32_bits(const uint8_t *d, size_t n, uint32_t crc) {
+    while (n--) {
+        crc ^= *d++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+    return crc;
+}
+
+static uint64_t crc64_bits(const uint8_t *d, size_t n, uint64_t crc) {
+    while (n--) {
+        crc ^= (uint64_t) * d++ << 56;
+        for (int i = 0; i < 8; i++)
+            crc = (crc << 1) ^ ((crc >> 63) ? 0x42F0E1EBA9EA3693 : 0);
+    }
+    return crc;
+}
+
+// the table driven engines against the bit looped ones, random lengths and alignments
+static bool crc_selftest(const uint8_t *buf, size_t len) {
+    bool ok = true;
+    for (int i = 0; i < 500; i++) {
+        size_t n = 3 + rand() % 300;
+        const uint8_t *d = buf + rand() % (len - n);
+
+        for (size_t j = 0; j < ARRAYLEN(crc16_params); j++) {
+            const crc16_param_t *p = &crc16_params[j];
+            uint16_t expected = Crc16(d, n, p->init, p->poly, p->refin, p->refout) ^ p->xorout;
+            if (crc16_param_calc(p, d, n) != expected) {
+                PrintAndLogEx(FAILED, "%s crc mismatch, %zu bytes", p->name, n);
+                ok = false;
+            }
+        }
+
+        if (crc32_fast(d, n, 0xFFFFFFFF) != crc32_bits(d, n, 0xFFFFFFFF)) {
+            PrintAndLogEx(FAILED, "CRC32 mismatch, %zu bytes", n);
+            ok = false;
+        }
+
+        uint64_t crc = 0;
+        crc64(d, n, &crc);
+        if (crc != crc64_bits(d, n, 0)) {
+            PrintAndLogEx(FAILED, "CRC64 mismatch, %zu bytes", n);
+            ok = false;
+        }
+        if (ok == false)
+            break;
+    }
+    return ok;
+}
+
+#define CRC_BENCH_MS        100
+#define CRC_BENCH_FRAME     16
+
+// keeps the timed crcs from being optimised away
+static volatile uint64_t crc_bench_sink;
+
+// bytes/s of one crc type over frames and over the whole buffer
+static void crc_bench_type(const char *name, int idx, const uint8_t *buf, size_t len) {
+    double rate[2];
+
+    for (int bulk = 0; bulk < 2; bulk++) {
+        size_t n = bulk ? len : CRC_BENCH_FRAME;
+        uint64_t bytes = 0;
+        uint64_t start = msclock(), elapsed;
+        do {
+            for (size_t off = 0; off + n <= len; off += n) {
+                const uint8_t *d = buf + off;
+                if (idx < (int)ARRAYLEN(crc16_params)) {
+                    crc_bench_sink += crc16_param_calc(&crc16_params[idx], d, n);
+                } else if (idx == (int)ARRAYLEN(crc16_params)) {
+                    crc_bench_sink += crc32_fast(d, n, 0xFFFFFFFF);
+                } else {
+                    uint64_t crc = 0;
+                    crc64(d, n, &crc);
+                    crc_bench_sink += crc;
+                }
+                bytes += n;
+            }
+            elapsed = msclock() - start;
+        } while (elapsed < CRC_BENCH_MS);
+
+        rate[bulk] = bytes * 1000.0 / elapsed;
+    }
+
+    PrintAndLogEx(SUCCESS, " %-11s | %10.1f | %10.1f", name, rate[0] / 1e6, rate[1] / 1e6);
+}
+
+static int crc_bench(void) {
+    size_t len = 64 * 1024;
+    uint8_t *buf = calloc(len, sizeof(uint8_t));
+    if (buf == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+    for (size_t i = 0; i < len; i++)
+        buf[i] = rand() & 0xFF;
+
+    bool ok = crc_selftest(buf, len);
+    PrintAndLogEx((ok) ? SUCCESS : FAILED, "CRC self test ( %s )", (ok) ? _GREEN_("ok") : _RED_("fail"));
+    if (ok == false) {
+        free(buf);
+        return PM3_ESOFT;
+    }
+
+    PrintAndLogEx(INFO, "");
+    PrintAndLogEx(INFO, " CRC type    | MB/s %2d B  | MB/s %2zu kB", CRC_BENCH_FRAME, len / 1024);
+    PrintAndLogEx(INFO, "-------------+------------+------------");
+    for (size_t i = 0; i < ARRAYLEN(crc16_params); i++)
+        crc_bench_type(crc16_params[i].name, i, buf, len);
+
+    crc_bench_type("CRC32", ARRAYLEN(crc16_params), buf, len);
+    crc_bench_type("CRC64 ECMA", ARRAYLEN(crc16_params) + 1, buf, len);
+
+    free(buf);
+    return PM3_SUCCESS;
+}
+
 static int CmdAnalyseCRC(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "analyse crc",
                   "A stub method to test different crc implementations inside the PM3 sourcecode.\n"
-                  "Just because you figured out the poly, doesn't mean you get the desired output",
-                  "analyse crc -d 137AF00A0A0D"
+                  "Just because you figured out the poly, doesn't mean you get the desired output\n"
+                  "With `--bench` the table driven crc engines are checked against bit looped ones and timed",
+                  "analyse crc -d 137AF00A0A0D\n"
+                  "analyse crc --bench"
                  );
 
     void *argtable[] = {
         arg_param_begin,
-        arg_str1("d", "data", "<hex>", "bytes to calc crc"),
+        arg_str0("d", "data", "<hex>", "bytes to calc crc"),
+        arg_lit0(NULL, "bench", "self test and bytes/s of each crc type"),
         arg_param_end
     };
-    CLIExecWithReturn(ctx, Cmd, argtable, true);
+    CLIExecWithReturn(ctx, Cmd, argtable, false);
     int dlen = 0;
     uint8_t data[1024] = {0x00};
     int res = CLIParamHexToBuf(arg_get_str(ctx, 1), data, sizeof(data), &dlen);
+    bool bench = arg_get_lit(ctx, 2);
     CLIParserFree(ctx);
 
-    if (res) {
+    if (bench)
+        return crc_bench();
+
+    if (res || dlen == 0) {
         PrintAndLogEx(FAILED, "Error parsing bytes");
         return PM3_EINVARG;
     }
@@ -282,10 +442,8 @@ static int CmdAnalyseCRC(const char *Cmd) {
 
     // 51  f5  7a  d6
     uint8_t uid[] = {0x51, 0xf5, 0x7a, 0xd6}; //12 34 56
-    init_table(CRC_LEGIC);
     uint8_t legic8 = CRC8Legic(uid, sizeof(uid));
     PrintAndLogEx(INFO, "Legic 16 | %X (EF6F expected) [legic8 = %02x]", crc16_legic(data, dlen, legic8), legic8);
-    init_table(CRC_FELICA);
     PrintAndLogEx(INFO, "FeliCa | %X ", crc16_xmodem(data, dlen));
 
     PrintAndLogEx(INFO, "\nTests of reflection. Current methods in source code");
@@ -27,13 +27,9 @@
 #include "fileutils.h"           // searchFile
 #include "mifare/ndef.h"
 #include "cliparser.h"
+#include "cmdmain.h"             // getCurrentCommand
 #include "cmdlft55xx.h"          // print...
 
-uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
-size_t DemodBufferLen = 0;
-int32_t g_DemodStartIdx = 0;
-int g_DemodClock = 0;
-
 static int CmdHelp(const char *Cmd);
 
 static int usage_data_printdemodbuf(void) {
@@ -366,25 +362,23 @@ static double compute_autoc(const int *data, size_t n, int lag) {
 
 // option '1' to save DemodBuffer any other to restore
 void save_restoreDB(uint8_t saveOpt) {
-    static uint8_t SavedDB[MAX_DEMOD_BUF_LEN];
-    static size_t SavedDBlen;
-    static bool DB_Saved = false;
-    static size_t savedDemodStartIdx = 0;
-    static int savedDemodClock = 0;
+    demod_ctx_t *ctx = g_demod;
 
     if (saveOpt == GRAPH_SAVE) { //save
+        if (ctx->saved_demod == NULL)
+            ctx->saved_demod = calloc(MAX_DEMOD_BUF_LEN, sizeof(uint8_t));
+        if (ctx->saved_demod == NULL)
+            return;
 
-        memcpy(SavedDB, DemodBuffer, sizeof(DemodBuffer));
-        SavedDBlen = DemodBufferLen;
-        DB_Saved = true;
-        savedDemodStartIdx = g_DemodStartIdx;
-        savedDemodClock = g_DemodClock;
-    } else if (DB_Saved) { //restore
-
-        memcpy(DemodBuffer, SavedDB, sizeof(DemodBuffer));
-        DemodBufferLen = SavedDBlen;
-        g_DemodClock = savedDemodClock;
-        g_DemodStartIdx = savedDemodStartIdx;
+        memcpy(ctx->saved_demod, DemodBuffer, MAX_DEMOD_BUF_LEN);
+        ctx->saved_demod_len = DemodBufferLen;
+        ctx->saved_demod_start_idx = g_DemodStartIdx;
+        ctx->saved_demod_clock = g_DemodClock;
+    } else if (ctx->saved_demod) { //restore
+        memcpy(DemodBuffer, ctx->saved_demod, MAX_DEMOD_BUF_LEN);
+        DemodBufferLen = ctx->saved_demod_len;
+        g_DemodClock = ctx->saved_demod_clock;
+        g_DemodStartIdx = ctx->saved_demod_start_idx;
     }
 }
 
@@ -675,7 +669,11 @@ static int Cmdmandecoderaw(const char *Cmd) {
 
     if (DemodBufferLen == 0) return PM3_ESOFT;
 
-    uint8_t bits[MAX_DEMOD_BUF_LEN] = {0};
+    uint8_t *bits = calloc(MAX_DEMOD_BUF_LEN, sizeof(uint8_t));
+    if (bits == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
 
     for (; i < DemodBufferLen; ++i) {
         if (DemodBuffer[i] > high)
@@ -687,6 +685,7 @@ static int Cmdmandecoderaw(const char *Cmd) {
 
     if (high > 7 || low < 0) {
         PrintAndLogEx(ERR, "Error: please raw demod the wave first then manchester raw decode");
+        free(bits);
         return PM3_ESOFT;
     }
 
@@ -696,6 +695,7 @@ static int Cmdmandecoderaw(const char *Cmd) {
     errCnt = manrawdecode(bits, &size, invert, &alignPos);
     if (errCnt >= maxErr) {
         PrintAndLogEx(ERR, "Too many errors: %u", errCnt);
+        free(bits);
         return PM3_ESOFT;
     }
 
@@ -712,6 +712,7 @@ static int Cmdmandecoderaw(const char *Cmd) {
             printEM410x(hi, id, false);
         }
     }
+    free(bits);
     return PM3_SUCCESS;
 }
 
@@ -736,17 +737,26 @@ static int CmdBiphaseDecodeRaw(const char *Cmd) {
         return PM3_ESOFT;
     }
 
-    uint8_t bits[MAX_DEMOD_BUF_LEN] = {0};
-    size = sizeof(bits);
-    if (!getDemodBuff(bits, &size)) return PM3_ESOFT;
+    uint8_t *bits = calloc(MAX_DEMOD_BUF_LEN, sizeof(uint8_t));
+    if (bits == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+    size = MAX_DEMOD_BUF_LEN;
+    if (!getDemodBuff(bits, &size)) {
+        free(bits);
+        return PM3_ESOFT;
+    }
 
     errCnt = BiphaseRawDecode(bits, &size, &offset, invert);
     if (errCnt < 0) {
         PrintAndLogEx(ERR, "Error during decode:%d", errCnt);
+        free(bits);
         return PM3_ESOFT;
     }
     if (errCnt > maxErr) {
         PrintAndLogEx(ERR, "Too many errors attempting to decode: %d", errCnt);
+        free(bits);
         return PM3_ESOFT;
     }
 
@@ -755,6 +765,7 @@ static int CmdBiphaseDecodeRaw(const char *Cmd) {
 
     PrintAndLogEx(NORMAL, "Biphase Decoded using offset: %d - # invert:%d - data:", offset, invert);
     PrintAndLogEx(NORMAL, "%s", sprint_bin_break(bits, size, 32));
+    free(bits);
 
     //remove first bit from raw demod
     if (offset)
@@ -769,10 +780,16 @@ static int CmdBiphaseDecodeRaw(const char *Cmd) {
 int ASKbiphaseDemod(int offset, int clk, int invert, int maxErr, bool verbose) {
     //ask raw demod GraphBuffer first
 
-    uint8_t BitStream[MAX_DEMOD_BUF_LEN];
+    // the graph holds up to MAX_GRAPH_TRACE_LEN samples
+    uint8_t *BitStream = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    if (BitStream == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
     size_t size = getFromGraphBuf(BitStream);
     if (size == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: no data in graphbuf");
+        free(BitStream);
         return PM3_ESOFT;
     }
     int startIdx = 0;
@@ -780,6 +797,7 @@ int ASKbiphaseDemod(int offset, int clk, int invert, int maxErr, bool verbose) {
     int errCnt = askdemod_ext(BitStream, &size, &clk, &invert, maxErr, 0, 0, &startIdx);
     if (errCnt < 0 || errCnt > maxErr) {
         PrintAndLogEx(DEBUG, "DEBUG: no data or error found %d, clock: %d", errCnt, clk);
+        free(BitStream);
         return PM3_ESOFT;
     }
 
@@ -787,15 +805,18 @@ int ASKbiphaseDemod(int offset, int clk, int invert, int maxErr, bool verbose) {
     errCnt = BiphaseRawDecode(BitStream, &size, &offset, invert);
     if (errCnt < 0) {
         if (g_debugMode || verbose) PrintAndLogEx(DEBUG, "DEBUG: Error BiphaseRawDecode: %d", errCnt);
+        free(BitStream);
         return PM3_ESOFT;
     }
     if (errCnt > maxErr) {
         if (g_debugMode || verbose) PrintAndLogEx(DEBUG, "DEBUG: Error BiphaseRawDecode too many errors: %d", errCnt);
+        free(BitStream);
         return PM3_ESOFT;
     }
 
     //success set DemodBuffer and return
     setDemodBuff(BitStream, size, 0);
+    free(BitStream);
     setClockGrid(clk, startIdx + clk * offset / 2);
     if (g_debugMode || verbose) {
         PrintAndLogEx(DEBUG, "Biphase Decoded using offset %d | clock %d | #errors %d | start index %d\ndata\n", offset, clk, errCnt, (startIdx + clk * offset / 2));
@@ -836,6 +857,113 @@ static int Cmdaskrawdemod(const char *Cmd) {
     return ASKDemod_ext(clk, invert, maxErr, maxLen, amplify, true, false, 0, &st);
 }
 
+static bool fft_alloc(autocorr_buf_t *ab, size_t n) {
+    if (n == ab->fft_size)
+        return true;
+
+    free(ab->fft_re);
+    free(ab->fft_im);
+    free(ab->fft_cos);
+    free(ab->fft_sin);
+    ab->fft_re = calloc(n, sizeof(double));
+    ab->fft_im = calloc(n, sizeof(double));
+    ab->fft_cos = calloc(n / 2, sizeof(double));
+    ab->fft_sin = calloc(n / 2, sizeof(double));
+    if (ab->fft_re == NULL || ab->fft_im == NULL || ab->fft_cos == NULL || ab->fft_sin == NULL) {
+        free(ab->fft_re);
+        free(ab->fft_im);
+        free(ab->fft_cos);
+        free(ab->fft_sin);
+        ab->fft_re = ab->fft_im = ab->fft_cos = ab->fft_sin = NULL;
+        ab->fft_size = 0;
+        return false;
+    }
+
+    for (size_t i = 0; i < n / 2; i++) {
+        ab->fft_cos[i] = cos(2 * M_PI * i / n);
+        ab->fft_sin[i] = sin(2 * M_PI * i / n);
+    }
+    ab->fft_size = n;
+    return true;
+}
+
+// iterative radix-2 FFT of fft_re/fft_im in place, the inverse isn't scaled by 1/n
+static void fft_radix2(autocorr_buf_t *ab, bool inverse) {
+    size_t n = ab->fft_size;
+    double *re = ab->fft_re, *im = ab->fft_im;
+
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j) {
+            double t = re[i];
+            re[i] = re[j];
+            re[j] = t;
+            t = im[i];
+            im[i] = im[j];
+            im[j] = t;
+        }
+    }
+
+    for (size_t half = 1; half < n; half <<= 1) {
+        size_t step = n / (2 * half);
+        for (size_t i = 0; i < n; i += 2 * half) {
+            for (size_t k = 0; k < half; k++) {
+                double wr = ab->fft_cos[k * step];
+                double wi = (inverse) ? ab->fft_sin[k * step] : -ab->fft_sin[k * step];
+                size_t a = i + k, b = a + half;
+                double tr = re[b] * wr - im[b] * wi;
+                double ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+// sums[i] = sum of (in[j] - mean) * (in[j + i] - mean) for the lags i < lags.  Through
+// the power spectrum unless the lags are few enough to sum them directly.
+static void autocorr_sums(autocorr_buf_t *ab, const int *in, size_t len, size_t lags, double mean, double *sums) {
+    size_t n = 1;
+    uint32_t bits = 0;
+    // no wrap around for the lags used
+    while (n < len + lags) {
+        n <<= 1;
+        bits++;
+    }
+
+    double direct = (double)lags * len - (double)lags * lags / 2;
+    if (direct < 8.0 * n * bits || fft_alloc(ab, n) == false) {
+        for (size_t i = 0; i < lags; i++) {
+            double sum = 0.0;
+            for (size_t j = 0; j < (len - i); j++) {
+                sum += (in[j] - mean) * (in[j + i] - mean);
+            }
+            sums[i] = sum;
+        }
+        return;
+    }
+
+    double *re = ab->fft_re, *im = ab->fft_im;
+    for (size_t i = 0; i < n; i++) {
+        re[i] = (i < len) ? in[i] - mean : 0.0;
+        im[i] = 0.0;
+    }
+    fft_radix2(ab, false);
+    for (size_t i = 0; i < n; i++) {
+        re[i] = re[i] * re[i] + im[i] * im[i];
+        im[i] = 0.0;
+    }
+    fft_radix2(ab, true);
+    for (size_t i = 0; i < lags; i++) {
+        sums[i] = re[i] / n;
+    }
+}
+
 int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveGrph, bool verbose) {
     // sanity check
     if (window > len) window = len;
@@ -852,13 +980,34 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
     // Computed variance
     double variance = compute_variance(in, len);
 
-    int *correl_buf = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+    // only the lags up to the window are correlated
+    size_t lags = len - window;
 
-    for (size_t i = 0; i < len - window; ++i) {
+    // the buffers of the calling thread's context, kept for the next call
+    autocorr_buf_t *ab = &g_demod->autocorr;
+    if (ab->correl_size < len + 1) {
+        free(ab->correl);
+        ab->correl = calloc(len + 1, sizeof(int));
+        ab->correl_size = (ab->correl == NULL) ? 0 : len + 1;
+    }
+    if (ab->sums_size < lags + 1) {
+        free(ab->sums);
+        ab->sums = calloc(lags + 1, sizeof(double));
+        ab->sums_size = (ab->sums == NULL) ? 0 : lags + 1;
+    }
+    if (ab->correl == NULL || ab->sums == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+    int *correl_buf = ab->correl;
+    double *sums = ab->sums;
+    memset(correl_buf, 0, (len + 1) * sizeof(int));
 
-        for (size_t j = 0; j < (len - i); j++) {
-            autocv += (in[j] - mean) * (in[j + i] - mean);
-        }
+    autocorr_sums(ab, in, len, lags, mean, sums);
+
+    for (size_t i = 0; i < lags; ++i) {
+
+        autocv += sums[i];
         autocv = (1.0 / (len - i)) * autocv;
 
         correl_buf[i] = autocv;
@@ -918,7 +1067,6 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
         DemodBufferLen = 0;
         RepaintGraphWindow();
     }
-    free(correl_buf);
     return retval;
 }
 
@@ -992,6 +1140,46 @@ static int CmdBuffClear(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+// acquisition details of the samples in the graph window, saved with them in binary graph files.
+// They hold for the samples they came with only: resampling adjusts them, any other change of
+// the graph drops them (see graph_info_get).
+static graph_file_info_t graph_info;
+static size_t graph_info_len = 0;
+static uint64_t graph_info_hash = 0;
+
+static uint64_t graph_samples_hash(void) {
+    const uint8_t *p = (const uint8_t *)GraphBuffer;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < GraphTraceLen * sizeof(int); i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// the details of the samples now in the graph window
+static void graph_info_set(const graph_file_info_t *info) {
+    graph_info = *info;
+    graph_info_len = GraphTraceLen;
+    graph_info_hash = graph_samples_hash();
+}
+
+// NULL when the graph was changed since
+static const graph_file_info_t *graph_info_get(void) {
+    if (graph_info_len != GraphTraceLen || graph_info_hash != graph_samples_hash())
+        return NULL;
+    return &graph_info;
+}
+
+// the graph was resampled to num / den times the samples, with the details valid before
+static void graph_info_resample(uint32_t num, uint32_t den) {
+    graph_file_info_t info = graph_info;
+    info.sample_rate = (uint64_t)info.sample_rate * num / den;
+    uint32_t decimation = info.decimation * den;
+    info.decimation = (decimation % num == 0 && decimation / num <= 0xFF) ? decimation / num : 0;
+    graph_info_set(&info);
+}
+
 static int CmdDecimate(const char *Cmd) {
 
     CLIParserContext *ctx;
@@ -1010,10 +1198,14 @@ static int CmdDecimate(const char *Cmd) {
     int n = arg_get_int_def(ctx, 1, 2);
     CLIParserFree(ctx);
 
+    bool had_info = (graph_info_get() != NULL);
+
     for (size_t i = 0; i < (GraphTraceLen / n); ++i)
         GraphBuffer[i] = GraphBuffer[i * n];
 
     GraphTraceLen /= n;
+    if (had_info)
+        graph_info_resample(1, n);
     PrintAndLogEx(SUCCESS, "decimated by " _GREEN_("%u"), n);
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -1042,8 +1234,14 @@ static int CmdUndecimate(const char *Cmd) {
     int factor = arg_get_int_def(ctx, 1, 2);
     CLIParserFree(ctx);
 
+    bool had_info = (graph_info_get() != NULL);
+
     //We have memory, don't we?
-    int swap[MAX_GRAPH_TRACE_LEN] = {0};
+    int *swap = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+    if (swap == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
     uint32_t g_index = 0, s_index = 0;
     while (g_index < GraphTraceLen && s_index + factor < MAX_GRAPH_TRACE_LEN) {
         int count = 0;
@@ -1058,7 +1256,10 @@ static int CmdUndecimate(const char *Cmd) {
     }
 
     memcpy(GraphBuffer, swap, s_index * sizeof(int));
+    free(swap);
     GraphTraceLen = s_index;
+    if (had_info)
+        graph_info_resample(factor, 1);
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
@@ -1139,29 +1340,15 @@ static int CmdDetectClockRate(const char *Cmd) {
     return clock1;
 }
 
-static char *GetFSKType(uint8_t fchigh, uint8_t fclow, uint8_t invert) {
-    static char fType[8];
-    memset(fType, 0x00, 8);
-    char *fskType = fType;
-
-    if (fchigh == 10 && fclow == 8) {
-
-        if (invert)
-            memcpy(fskType, "FSK2a", 5);
-        else
-            memcpy(fskType, "FSK2", 4);
-
-    } else if (fchigh == 8 && fclow == 5) {
+static const char *GetFSKType(uint8_t fchigh, uint8_t fclow, uint8_t invert) {
+    // literals, the lf search workers call this concurrently
+    if (fchigh == 10 && fclow == 8)
+        return (invert) ? "FSK2a" : "FSK2";
 
-        if (invert)
-            memcpy(fskType, "FSK1", 4);
-        else
-            memcpy(fskType, "FSK1a", 5);
+    if (fchigh == 8 && fclow == 5)
+        return (invert) ? "FSK1" : "FSK1a";
 
-    } else {
-        memcpy(fskType, "FSK??", 5);
-    }
-    return fskType;
+    return "FSK??";
 }
 
 //by marshmellow
@@ -1443,6 +1630,10 @@ void setClockGrid(uint32_t clk, int offset) {
     else
         PrintAndLogEx(DEBUG, "DEBUG: (setClockGrid) demodoffset %d, clk %d", offset, clk);
 
+    // the grid is the plot window's
+    if (g_demod->plot == false)
+        return;
+
     if (offset > clk) offset %= clk;
     if (offset < 0) offset += clk;
 
@@ -1530,13 +1721,18 @@ static int CmdHide(const char *Cmd) {
 //zero mean GraphBuffer
 int CmdHpf(const char *Cmd) {
     (void)Cmd; // Cmd is not used so far
-    uint8_t bits[GraphTraceLen];
+    uint8_t *bits = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    if (bits == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
     size_t size = getFromGraphBuf(bits);
     removeSignalOffset(bits, size);
     // push it back to graph
     setGraphBuf(bits, size);
     // set signal properties low/high/mean/amplitude and is_noise detection
     computeSignalProperties(bits, size);
+    free(bits);
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -1592,11 +1788,19 @@ int getSamplesEx(uint32_t start, uint32_t end, bool verbose) {
 
     uint8_t bits_per_sample = 8;
 
+    graph_file_info_t info;
+    memset(&info, 0, sizeof(info));
+    strncpy(info.source, getCurrentCommand(), sizeof(info.source) - 1);
+
     //Old devices without this feature would send 0 at arg[0]
     if (response.oldarg[0] > 0) {
         sample_config *sc = (sample_config *) response.data.asBytes;
         if (verbose) PrintAndLogEx(INFO, "Samples @ " _YELLOW_("%d") " bits/smpl, decimation 1:%d ", sc->bits_per_sample, sc->decimation);
         bits_per_sample = sc->bits_per_sample;
+        info.bits_per_sample = sc->bits_per_sample;
+        info.decimation = sc->decimation;
+        if (sc->decimation > 0)
+            info.sample_rate = LF_DIV2FREQ(sc->divisor) * 1000 / sc->decimation;
     }
 
     if (bits_per_sample < 8) {
@@ -1619,11 +1823,10 @@ int getSamplesEx(uint32_t start, uint32_t end, bool verbose) {
         }
         GraphTraceLen = n;
     }
+    graph_info_set(&info);
 
-    uint8_t bits[GraphTraceLen];
-    size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeGraphSignalProperties();
 
     setClockGrid(0, 0);
     DemodBufferLen = 0;
@@ -1810,40 +2013,14 @@ int CmdTuneSamples(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
-static int CmdLoad(const char *Cmd) {
-
-    CLIParserContext *ctx;
-    CLIParserInit(&ctx, "data load",
-                  "This command loads the contents of a pm3 file into graph window\n",
-                  "data load -f myfilename"
-                 );
-
-    void *argtable[] = {
-        arg_param_begin,
-        arg_strx0("f", "file", "<filename>", "file to load"),
-        arg_param_end
-    };
-    CLIExecWithReturn(ctx, Cmd, argtable, false);
-
-    int fnlen = 0;
-    char filename[FILE_PATH_SIZE] = {0};
-    CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
-    CLIParserFree(ctx);
-
-    char *path = NULL;
-    if (searchFile(&path, TRACES_SUBDIR, filename, ".pm3", true) != PM3_SUCCESS) {
-        if (searchFile(&path, TRACES_SUBDIR, filename, "", false) != PM3_SUCCESS) {
-            return PM3_EFILE;
-        }
-    }
-
+// text files, one sample per line
+static int loadGraphText(const char *path, bool verbose) {
     FILE *f = fopen(path, "r");
     if (!f) {
-        PrintAndLogEx(WARNING, "couldn't open '%s'", path);
-        free(path);
+        if (verbose)
+            PrintAndLogEx(WARNING, "couldn't open '%s'", path);
         return PM3_EFILE;
     }
-    free(path);
 
     GraphTraceLen = 0;
     char line[80];
@@ -1855,15 +2032,53 @@ static int CmdLoad(const char *Cmd) {
             break;
     }
     fclose(f);
+    return PM3_SUCCESS;
+}
+
+// loads a pm3 capture, binary or text, into the graph of the current demod context
+int loadGraphFile(const char *path, bool verbose) {
+    graph_file_info_t info;
+    memset(&info, 0, sizeof(info));
+
+    if (!fileExists(path)) {
+        if (verbose)
+            PrintAndLogEx(WARNING, "couldn't open '%s'", path);
+        return PM3_EFILE;
+    }
+
+    size_t len = 0;
+    int res = loadFileGraph(path, GraphBuffer, MAX_GRAPH_TRACE_LEN, &len, &info);
+    if (res == PM3_SUCCESS) {
+        GraphTraceLen = len;
+    } else if (res == PM3_ENODATA) {
+        res = loadGraphText(path, verbose);
+    }
+    if (res != PM3_SUCCESS)
+        return res;
 
-    PrintAndLogEx(SUCCESS, "loaded " _YELLOW_("%zu") " samples", GraphTraceLen);
+    if (verbose) {
+        PrintAndLogEx(SUCCESS, "loaded " _YELLOW_("%zu") " samples", GraphTraceLen);
+        if (info.source[0] != '\0')
+            PrintAndLogEx(INFO, "acquired by " _YELLOW_("%s"), info.source);
+        if (info.sample_rate > 0)
+            PrintAndLogEx(INFO, "%.1f kHz, %u bits/smpl, decimation 1:%u", info.sample_rate / 1000.0, info.bits_per_sample, info.decimation);
+    }
 
-    uint8_t bits[GraphTraceLen];
+    uint8_t *bits = calloc(MAX_GRAPH_TRACE_LEN, sizeof(uint8_t));
+    if (bits == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
     size_t size = getFromGraphBuf(bits);
 
     removeSignalOffset(bits, size);
     setGraphBuf(bits, size);
     computeSignalProperties(bits, size);
+    free(bits);
+
+    // the plot's samples only, batch decoding loads into private buffers
+    if (g_demod->plot)
+        graph_info_set(&info);
 
     setClockGrid(0, 0);
     DemodBufferLen = 0;
@@ -1871,6 +2086,42 @@ static int CmdLoad(const char *Cmd) {
     return PM3_SUCCESS;
 }
 
+static int CmdLoad(const char *Cmd) {
+
+    CLIParserContext *ctx;
+    CLIParserInit(&ctx, "data load",
+                  "This command loads the contents of a pm3 file into graph window\n"
+                  "Text files (.pm3) and binary graph files (.pm3b) are both accepted",
+                  "data load -f myfilename\n"
+                  "data load -f myfilename.pm3b"
+                 );
+
+    void *argtable[] = {
+        arg_param_begin,
+        arg_strx0("f", "file", "<filename>", "file to load"),
+        arg_param_end
+    };
+    CLIExecWithReturn(ctx, Cmd, argtable, false);
+
+    int fnlen = 0;
+    char filename[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
+    CLIParserFree(ctx);
+
+    char *path = NULL;
+    if (searchFile(&path, TRACES_SUBDIR, filename, ".pm3", true) != PM3_SUCCESS) {
+        if (searchFile(&path, TRACES_SUBDIR, filename, ".pm3b", true) != PM3_SUCCESS) {
+            if (searchFile(&path, TRACES_SUBDIR, filename, "", false) != PM3_SUCCESS) {
+                return PM3_EFILE;
+            }
+        }
+    }
+
+    int res = loadGraphFile(path, true);
+    free(path);
+    return res;
+}
+
 // trim graph from the end
 int CmdLtrim(const char *Cmd) {
 
@@ -1936,10 +2187,8 @@ int CmdNorm(const char *Cmd) {
         }
     }
 
-    uint8_t bits[GraphTraceLen];
-    size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeGraphSignalProperties();
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -1957,15 +2206,21 @@ int CmdSave(const char *Cmd) {
     CLIParserInit(&ctx, "data save",
                   "Save trace from graph window , i.e. the GraphBuffer\n"
                   "This is a text file with number -127 to 127.  With the option `w` you can save it as wave file\n"
+                  "With the option `b` it is saved as binary graph file, keeping sample rate, decimation and the acquiring command,\n"
+                  "optionally LZ4 compressed. `data load` reads both, so loading a binary file and saving it again converts it\n"
                   "Filename should be without file extension",
                   "data save -f myfilename         -> save graph buffer to file\n"
-                  "data save --wave -f myfilename  -> save graph buffer to wave file"
+                  "data save --wave -f myfilename  -> save graph buffer to wave file\n"
+                  "data save -b -f myfilename      -> save graph buffer to binary graph file (.pm3b)\n"
+                  "data save -bz -f myfilename     -> save graph buffer to LZ4 compressed binary graph file"
                  );
 
     void *argtable[] = {
         arg_param_begin,
         arg_lit0("w", "wave", "save as wave format (.wav)"),
         arg_str1("f", "file", "<fn w/o ext>", "save file name"),
+        arg_lit0("b", "bin", "save as binary graph file (.pm3b)"),
+        arg_lit0("z", "lz4", "LZ4 compress the binary graph file"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -1977,10 +2232,23 @@ int CmdSave(const char *Cmd) {
     // CLIGetStrWithReturn(ctx, 2, (uint8_t *)filename, &fnlen);
     CLIParamStrToBuf(arg_get_str(ctx, 2), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
 
+    bool as_bin = arg_get_lit(ctx, 3);
+    bool compress = arg_get_lit(ctx, 4);
     CLIParserFree(ctx);
 
+    if (as_wave && (as_bin || compress)) {
+        PrintAndLogEx(WARNING, "select either wave or binary graph file");
+        return PM3_EINVARG;
+    }
+
     if (as_wave)
         return saveFileWAVE(filename, GraphBuffer, GraphTraceLen);
+    else if (as_bin || compress) {
+        const graph_file_info_t *info = graph_info_get();
+        if (info == NULL && (graph_info.source[0] != '\0' || graph_info.sample_rate > 0))
+            PrintAndLogEx(INFO, "graph changed since it was acquired, saving without acquisition details");
+        return saveFileGraph(filename, GraphBuffer, GraphTraceLen, info, compress);
+    }
     else
         return saveFilePM3(filename, GraphBuffer, GraphTraceLen);
 }
@@ -2053,11 +2321,8 @@ static int CmdDirectionalThreshold(const char *Cmd) {
 
     directionalThreshold(GraphBuffer, GraphBuffer, GraphTraceLen, up, down);
 
-    // set signal properties low/high/mean/amplitude and isnoice detection
-    uint8_t bits[GraphTraceLen];
-    size_t size = getFromGraphBuf(bits);
-    // set signal properties low/high/mean/amplitude and is_noice detection
-    computeSignalProperties(bits, size);
+    // set signal properties low/high/mean/amplitude and is_noise detection
+    computeGraphSignalProperties();
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -2086,10 +2351,8 @@ static int CmdZerocrossings(const char *Cmd) {
         }
     }
 
-    uint8_t bits[GraphTraceLen];
-    size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeGraphSignalProperties();
 
     RepaintGraphWindow();
     return PM3_SUCCESS;
@@ -2339,10 +2602,8 @@ static int CmdDataIIR(const char *Cmd) {
     //iceIIR_Butterworth(GraphBuffer, GraphTraceLen);
     iceSimple_Filter(GraphBuffer, GraphTraceLen, k);
 
-    uint8_t bits[GraphTraceLen];
-    size_t size = getFromGraphBuf(bits);
     // set signal properties low/high/mean/amplitude and is_noise detection
-    computeSignalProperties(bits, size);
+    computeGraphSignalProperties();
     RepaintGraphWindow();
     return PM3_SUCCESS;
 }
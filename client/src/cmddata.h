@@ -12,6 +12,7 @@
 #define CMDDATA_H__
 
 #include "common.h"
+#include "graph.h"      // DemodBuffer
 
 #ifdef __cplusplus
 extern "C" {
@@ -77,18 +78,12 @@ int AutoCorrelate(const int *in, int *out, size_t len, size_t window, bool SaveG
 
 int getSamples(uint32_t n, bool verbose);
 int getSamplesEx(uint32_t start, uint32_t end, bool verbose);
+int loadGraphFile(const char *path, bool verbose);
 
 void setClockGrid(uint32_t clk, int offset);
 int directionalThreshold(const int *in, int *out, size_t len, int8_t up, int8_t down);
 int AskEdgeDetect(const int *in, int *out, int len, int threshold);
 
-#define MAX_DEMOD_BUF_LEN (1024*128)
-extern uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
-extern size_t DemodBufferLen;
-
-extern int g_DemodClock;
-extern int32_t g_DemodStartIdx;
-
 #ifdef __cplusplus
 }
 #endif
@@ -2075,8 +2075,13 @@ static int CmdHFiClass_loclass(const char *Cmd) {
                   "  <8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>\n"
                   "  <8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>\n"
                   "  <8 byte CSN><8 byte CC><4 byte NR><4 byte MAC>\n"
-                  "   ... totalling N*24 bytes",
+                  "   ... totalling N*24 bytes\n"
+                  "  With a progress file an interrupted run resumes where it stopped.\n"
+                  "  Several processes can share the search, each running one part and\n"
+                  "  using the same progress file name, which gets the part appended",
                   "hf iclass loclass -f iclass-dump.bin\n"
+                  "hf iclass loclass -f iclass-dump.bin --progress loclass.bin\n"
+                  "hf iclass loclass -f iclass-dump.bin --progress loclass.bin --part 1 --parts 2\n"
                   "hf iclass loclass --test");
 
     void *argtable[] = {
@@ -2084,6 +2089,9 @@ static int CmdHFiClass_loclass(const char *Cmd) {
         arg_str0("f", "file", "<filename>", "filename of Bruteforce iclass dumpfile"),
         arg_lit0(NULL, "test",              "Perform self-test"),
         arg_lit0(NULL, "long",              "Perform self-test, including long ones"),
+        arg_str0(NULL, "progress", "<fn>",  "progress file to resume from and update"),
+        arg_int0(NULL, "part", "<dec>",     "part of the search to run, 1 .. parts (def 1)"),
+        arg_int0(NULL, "parts", "<dec>",    "number of processes sharing the search (def 1)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -2095,6 +2103,13 @@ static int CmdHFiClass_loclass(const char *Cmd) {
     bool test = arg_get_lit(ctx, 2);
     bool longtest = arg_get_lit(ctx, 3);
 
+    int pfnlen = 0;
+    char progress[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 4), (uint8_t *)progress, FILE_PATH_SIZE, &pfnlen);
+
+    int part = arg_get_int_def(ctx, 5, 1);
+    int parts = arg_get_int_def(ctx, 6, 1);
+
     CLIParserFree(ctx);
 
     if (test || longtest) {
@@ -2109,7 +2124,18 @@ static int CmdHFiClass_loclass(const char *Cmd) {
         return PM3_ESOFT;
     }
 
-    return bruteforceFileNoKeys(filename);
+    if (parts < 1 || parts > 0xFFFF || part < 1 || part > parts) {
+        PrintAndLogEx(ERR, "part must be 1 .. parts");
+        return PM3_EINVARG;
+    }
+
+    if (parts > 1 && pfnlen == 0) {
+        PrintAndLogEx(ERR, "sharing the search needs a progress file");
+        return PM3_EINVARG;
+    }
+
+    uint16_t keytable[128] = {0};
+    return bruteforceFileEx(filename, keytable, (pfnlen) ? progress : NULL, part - 1, parts);
 }
 
 void printIclassDumpContents(uint8_t *iclass_dump, uint8_t startblock, uint8_t endblock, size_t filesize) {
@@ -3065,19 +3091,24 @@ static void *bf_generate_mac(void *thread_arg) {
     memcpy(csn, targ->csn, sizeof(csn));
     memcpy(cc_nr, targ->cc_nr, sizeof(cc_nr));
 
-    uint8_t key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-    uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t div_keys[MAC_BS_LANES * 8];
+    uint8_t macs[MAC_BS_LANES * 4];
 
-    for (uint32_t i = idx; i < keycnt; i += iclass_tc) {
+    // each thread takes every iclass_tc-th block of keys, the MACs of a block are bitsliced
+    for (uint32_t first = idx * MAC_BS_LANES; first < keycnt; first += iclass_tc * MAC_BS_LANES) {
 
-        memcpy(key, keys + 8 * i, 8);
+        uint32_t n = MIN(MAC_BS_LANES, keycnt - first);
+        for (uint32_t i = 0; i < n; i++) {
+            if (use_raw)
+                memcpy(div_keys + 8 * i, keys + 8 * (first + i), 8);
+            else
+                HFiClassCalcDivKey(csn, keys + 8 * (first + i), div_keys + 8 * i, use_elite);
+        }
 
-        if (use_raw)
-            memcpy(div_key, key, 8);
-        else
-            HFiClassCalcDivKey(csn, key, div_key, use_elite);
+        doMAC_batch(cc_nr, div_keys, n, macs);
 
-        doMAC(cc_nr, div_key, list[i].mac);
+        for (uint32_t i = 0; i < n; i++)
+            memcpy(list[first + i].mac, macs + 4 * i, 4);
     }
     return NULL;
 }
@@ -3130,18 +3161,25 @@ static void *bf_generate_mackey(void *thread_arg) {
     memcpy(csn, targ->csn, sizeof(csn));
     memcpy(cc_nr, targ->cc_nr, sizeof(cc_nr));
 
-    uint8_t div_key[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t div_keys[MAC_BS_LANES * 8];
+    uint8_t macs[MAC_BS_LANES * 4];
 
-    for (uint32_t i = idx; i < keycnt; i += iclass_tc) {
+    for (uint32_t first = idx * MAC_BS_LANES; first < keycnt; first += iclass_tc * MAC_BS_LANES) {
 
-        memcpy(list[i].key, keys + 8 * i, 8);
+        uint32_t n = MIN(MAC_BS_LANES, keycnt - first);
+        for (uint32_t i = 0; i < n; i++) {
+            memcpy(list[first + i].key, keys + 8 * (first + i), 8);
 
-        if (use_raw)
-            memcpy(div_key, list[i].key, 8);
-        else
-            HFiClassCalcDivKey(csn, list[i].key, div_key, use_elite);
+            if (use_raw)
+                memcpy(div_keys + 8 * i, list[first + i].key, 8);
+            else
+                HFiClassCalcDivKey(csn, list[first + i].key, div_keys + 8 * i, use_elite);
+        }
+
+        doMAC_batch(cc_nr, div_keys, n, macs);
 
-        doMAC(cc_nr, div_key, list[i].mac);
+        for (uint32_t i = 0; i < n; i++)
+            memcpy(list[first + i].mac, macs + 4 * i, 4);
     }
     return NULL;
 }
@@ -21,6 +21,7 @@
 #include "ui.h"
 #include "crc16.h"
 #include "crapto1/crapto1.h"
+#include "crapto1/crypto1_bs.h"
 #include "protocols.h"
 #include "cmdhficlass.h"
 
@@ -209,7 +210,6 @@ int applyIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize) {
             break;
         case ISO14443A_CMD_HALT:
             snprintf(exp, size, "HALT");
-            MifareAuthState = masNone;
             break;
         case ISO14443A_CMD_RATS:
             snprintf(exp, size, "RATS");
@@ -235,7 +235,6 @@ int applyIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize) {
         case MIFARE_AUTH_KEYA: {
             if (cmdsize > 3) {
                 snprintf(exp, size, "AUTH-A(%d)", cmd[1]);
-                MifareAuthState = masNt;
             } else {
                 // case MIFARE_ULEV1_VERSION :  both 0x60.
                 snprintf(exp, size, "EV1 VERSION");
@@ -243,7 +242,6 @@ int applyIso14443a(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize) {
             break;
         }
         case MIFARE_AUTH_KEYB: {
-            MifareAuthState = masNt;
             snprintf(exp, size, "AUTH-B(%d)", cmd[1]);
             break;
         }
@@ -1330,8 +1328,549 @@ void annotateMifare(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize, uint8
     }
 
     if (!isResponse && ((MifareAuthState == masNone) || (MifareAuthState == masError)))
-        annotateIso14443a(exp, size, cmd, cmdsize);
+        annotateMifarePlain(exp, size, cmd, cmdsize);
+
+}
+
+// A plain reader command, sent in the clear or decrypted, may start an authentication.
+// annotateIso14443a keeps no state so the other protocols can be annotated in parallel.
+void annotateMifarePlain(char *exp, size_t size, uint8_t *cmd, uint8_t cmdsize) {
+    annotateIso14443a(exp, size, cmd, cmdsize);
+
+    switch (cmd[0]) {
+        case ISO14443A_CMD_HALT:
+            MifareAuthState = masNone;
+            break;
+        case MIFARE_AUTH_KEYA:
+            if (cmdsize > 3)
+                MifareAuthState = masNt;
+            break;
+        case MIFARE_AUTH_KEYB:
+            MifareAuthState = masNt;
+            break;
+        default:
+            break;
+    }
+}
+
+static uint64_t mfLastKey;
+
+//-----------------------------------------------------------------------------
+// Offline key recovery for the authentications of a whole trace.
+// Nested authentications are encrypted, the state machine above only sees them after the
+// previous session is decrypted.  So they are collected by their frame pattern instead,
+// reader 4 bytes, tag 4 bytes, reader 8 bytes, tag 4 bytes.  Then the dictionary sweep
+// runs on all threads for all of them, and the nested searches run in trace order, each on
+// all threads.  Results are cached per authentication, listing the same trace again only
+// looks them up.  Whatever the scan misses is searched for while printing, as before.
+//-----------------------------------------------------------------------------
+#define MF_TRACE_DIC_CHUNK      CRYPTO1_BS_LANES
+#define MF_TRACE_NESTED_WINDOW  65536
+#define MF_TRACE_NESTED_CHUNK   1024
+
+typedef struct {
+    TAuthData ad;               // ad.nt is the tag nonce known when collected
+    uint8_t cmd[32];            // first encrypted frame, verifies a key
+    uint8_t cmdsize;
+    uint8_t parity[4];
+    bool first;                 // first authentication of a session, key known
+    uint32_t dic_index;         // lowest matching dictionary index, UINT32_MAX for none
+} mf_trace_auth_t;
+
+typedef struct {
+    bool used;
+    bool first;
+    uint32_t uid;
+    uint32_t nt;                // nt_enc for nested authentications
+    uint32_t nr_enc;
+    uint32_t ar_enc;
+    uint32_t at_enc;
+    uint32_t dic_hash;          // a miss is only valid for the same dictionary,
+    uint32_t miss_nt;           // tag nonce the nested search started from
+    uint64_t miss_last_key;     // and last used key
+    bool found;
+    uint64_t key;
+    uint32_t key_nt;
+    uint32_t ks2;
+    uint32_t ks3;
+} mf_auth_cache_t;
+
+static mf_trace_auth_t *mf_auths = NULL;
+static uint32_t mf_auths_count = 0;
+static uint32_t mf_auths_size = 0;
+
+static struct {
+    TAuthData ad;
+    uint8_t step;               // frames of the authentication seen so far
+} mf_scan;
+
+static mf_auth_cache_t *mf_cache = NULL;
+static uint32_t mf_cache_mask = 0;
+static uint32_t mf_cache_count = 0;
+static uint32_t mf_cache_dic_hash = 0;   // dictionary the cache was filled with
+
+static void mf_cache_free(void) {
+    free(mf_cache);
+    mf_cache = NULL;
+    mf_cache_mask = 0;
+    mf_cache_count = 0;
+}
+
+static uint32_t mf_dic_hash(const uint64_t *dicKeys, uint32_t dicKeysCount) {
+    uint32_t h = 0x811C9DC5 ^ dicKeysCount;
+    for (uint32_t i = 0; dicKeys != NULL && i < dicKeysCount; i++) {
+        h = (h ^ (uint32_t)dicKeys[i]) * 0x01000193;
+        h = (h ^ (uint32_t)(dicKeys[i] >> 32)) * 0x01000193;
+    }
+    return h;
+}
+
+static uint32_t mf_cache_slot(bool first, const TAuthData *ad) {
+    uint32_t nt = first ? ad->nt : ad->nt_enc;
+    uint64_t h = ((uint64_t)ad->uid << 32 | nt) * UINT64_C(0x9E3779B97F4A7C15);
+    h ^= ((uint64_t)ad->ar_enc << 32 | ad->at_enc) * UINT64_C(0xC2B2AE3D27D4EB4F);
+    h ^= ad->nr_enc;
+    return (uint32_t)(h >> 32) & mf_cache_mask;
+}
+
+static bool mf_cache_match(const mf_auth_cache_t *e, bool first, const TAuthData *ad) {
+    return e->first == first
+           && e->uid == ad->uid
+           && e->nt == (first ? ad->nt : ad->nt_enc)
+           && e->nr_enc == ad->nr_enc
+           && e->ar_enc == ad->ar_enc
+           && e->at_enc == ad->at_enc;
+}
+
+static mf_auth_cache_t *mf_cache_find(bool first, const TAuthData *ad) {
+    if (mf_cache == NULL)
+        return NULL;
+
+    for (uint32_t slot = mf_cache_slot(first, ad); mf_cache[slot].used; slot = (slot + 1) & mf_cache_mask) {
+        if (mf_cache_match(&mf_cache[slot], first, ad))
+            return &mf_cache[slot];
+    }
+    return NULL;
+}
+
+static mf_auth_cache_t *mf_cache_add(bool first, const TAuthData *ad) {
+    mf_auth_cache_t *e = mf_cache_find(first, ad);
+    if (e)
+        return e;
+
+    // keep the load under one half
+    if (mf_cache == NULL || (mf_cache_count + 1) * 2 > mf_cache_mask + 1) {
+        uint32_t size = (mf_cache == NULL) ? 256 : (mf_cache_mask + 1) * 2;
+        mf_auth_cache_t *old = mf_cache;
+        uint32_t old_size = (old == NULL) ? 0 : mf_cache_mask + 1;
+
+        mf_auth_cache_t *cache = calloc(size, sizeof(mf_auth_cache_t));
+        if (cache == NULL)
+            return NULL;
+
+        mf_cache = cache;
+        mf_cache_mask = size - 1;
+        for (uint32_t i = 0; i < old_size; i++) {
+            if (old[i].used == false)
+                continue;
+            TAuthData k = { .uid = old[i].uid, .nt = old[i].nt, .nt_enc = old[i].nt, .nr_enc = old[i].nr_enc, .ar_enc = old[i].ar_enc, .at_enc = old[i].at_enc };
+            uint32_t slot = mf_cache_slot(old[i].first, &k);
+            while (mf_cache[slot].used)
+                slot = (slot + 1) & mf_cache_mask;
+            mf_cache[slot] = old[i];
+        }
+        free(old);
+    }
+
+    uint32_t slot = mf_cache_slot(first, ad);
+    while (mf_cache[slot].used)
+        slot = (slot + 1) & mf_cache_mask;
+
+    e = &mf_cache[slot];
+    memset(e, 0, sizeof(*e));
+    e->used = true;
+    e->first = first;
+    e->uid = ad->uid;
+    e->nt = first ? ad->nt : ad->nt_enc;
+    e->nr_enc = ad->nr_enc;
+    e->ar_enc = ad->ar_enc;
+    e->at_enc = ad->at_enc;
+    mf_cache_count++;
+    return e;
+}
+
+// thread safe part of NestedCheckKey
+static bool nested_check_key(uint64_t key, const TAuthData *ad, const uint8_t *cmd, uint8_t cmdsize, const uint8_t *parity, uint32_t *nt, uint32_t *ks2, uint32_t *ks3) {
+    uint8_t buf[32] = {0};
+    struct Crypto1State pcs;
+
+    crypto1_init(&pcs, key);
+    uint32_t nt1 = crypto1_word(&pcs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
+    uint32_t ar = prng_successor(nt1, 64);
+    uint32_t at = prng_successor(nt1, 96);
+
+    crypto1_word(&pcs, ad->nr_enc, 1);
+    uint32_t ar1 = crypto1_word(&pcs, 0, 0) ^ ad->ar_enc;
+    uint32_t at1 = crypto1_word(&pcs, 0, 0) ^ ad->at_enc;
+
+    if (!(ar == ar1 && at == at1 && NTParityChk((TAuthData *)ad, nt1)))
+        return false;
+
+    memcpy(buf, cmd, cmdsize);
+    mf_crypto1_decrypt(&pcs, buf, cmdsize, 0);
+
+    if (!CheckCrypto1Parity((uint8_t *)cmd, cmdsize, buf, (uint8_t *)parity))
+        return false;
+
+    if (!check_crc(CRC_14443_A, buf, cmdsize))
+        return false;
+
+    *nt = nt1;
+    *ks2 = ad->ar_enc ^ ar;
+    *ks3 = ad->at_enc ^ at;
+    return true;
+}
+
+// decrypts the frame with the state recovered from a tag nonce guess
+static bool nested_check_nonce(uint32_t ntx, const TAuthData *ad, const uint8_t *cmd, uint8_t cmdsize, const uint8_t *parity) {
+    uint8_t buf[32] = {0};
+    uint32_t ks2 = ad->ar_enc ^ prng_successor(ntx, 64);
+    uint32_t ks3 = ad->at_enc ^ prng_successor(ntx, 96);
+    struct Crypto1State *pcs = lfsr_recovery64(ks2, ks3);
+    memcpy(buf, cmd, cmdsize);
+    mf_crypto1_decrypt(pcs, buf, cmdsize, 0);
+    crypto1_destroy(pcs);
+
+    return CheckCrypto1Parity((uint8_t *)cmd, cmdsize, buf, (uint8_t *)parity) && check_crc(CRC_14443_A, buf, cmdsize);
+}
+
+static void atomic_min_u32(uint32_t *p, uint32_t v) {
+    uint32_t cur = __atomic_load_n(p, __ATOMIC_RELAXED);
+    while (v < cur && __atomic_compare_exchange_n(p, &cur, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) == false) {
+    }
+}
+
+typedef struct {
+    mf_trace_auth_t **auths;
+    uint32_t count;
+    const uint64_t *keys;
+    uint32_t keys_count;
+    uint32_t chunks_per_auth;
+    uint32_t next;
+} mf_dic_sweep_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+mf_dic_sweep_thread(void *arg) {
+    mf_dic_sweep_t *sw = arg;
+    uint32_t total = sw->count * sw->chunks_per_auth;
+
+    for (uint32_t w = __atomic_fetch_add(&sw->next, 1, __ATOMIC_RELAXED); w < total; w = __atomic_fetch_add(&sw->next, 1, __ATOMIC_RELAXED)) {
+        mf_trace_auth_t *a = sw->auths[w / sw->chunks_per_auth];
+        uint32_t first = (w % sw->chunks_per_auth) * MF_TRACE_DIC_CHUNK;
+        uint32_t last = MIN(first + MF_TRACE_DIC_CHUNK, sw->keys_count);
+
+        // the parity of the encrypted tag nonce rejects 15 of 16 keys, bitsliced over the
+        // whole chunk.  The rest gets the full check.
+        crypto1_bs_word_t nt_word = {
+            .in = a->ad.nt_enc ^ a->ad.uid,
+            .is_encrypted = 1,
+            .enc = a->ad.nt_enc,
+            .par = a->ad.nt_enc_par >> 4,
+            .par_mask = 0x0f,
+        };
+        size_t found[MF_TRACE_DIC_CHUNK];
+        size_t n = crypto1_bs_test_keys(&sw->keys[first], last - first, &nt_word, 1, found, ARRAYLEN(found));
+
+        for (size_t j = 0; j < n; j++) {
+            uint32_t i = first + found[j];
+
+            // an earlier key already matched, the first match wins like in the sequential order
+            if (i >= __atomic_load_n(&a->dic_index, __ATOMIC_RELAXED))
+                break;
+
+            uint32_t nt, ks2, ks3;
+            if (nested_check_key(sw->keys[i], &a->ad, a->cmd, a->cmdsize, a->parity, &nt, &ks2, &ks3)) {
+                atomic_min_u32(&a->dic_index, i);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    const mf_trace_auth_t *auth;
+    uint32_t nt;                // nonce the search window starts after
+    uint32_t best;              // lowest matching offset in the window
+    uint32_t next;
+} mf_nested_search_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+mf_nested_search_thread(void *arg) {
+    mf_nested_search_t *ns = arg;
+    const mf_trace_auth_t *a = ns->auth;
+
+    for (uint32_t c = __atomic_fetch_add(&ns->next, 1, __ATOMIC_RELAXED); c < MF_TRACE_NESTED_WINDOW / MF_TRACE_NESTED_CHUNK; c = __atomic_fetch_add(&ns->next, 1, __ATOMIC_RELAXED)) {
+        uint32_t first = c * MF_TRACE_NESTED_CHUNK;
+        uint32_t ntx = prng_successor(ns->nt, 90 + first);
+
+        for (uint32_t i = first; i < first + MF_TRACE_NESTED_CHUNK; i++) {
+            if (i >= __atomic_load_n(&ns->best, __ATOMIC_RELAXED))
+                return NULL;
+
+            ntx = prng_successor(ntx, 1);
+            if (NTParityChk((TAuthData *)&a->ad, ntx) && nested_check_nonce(ntx, &a->ad, a->cmd, a->cmdsize, a->parity)) {
+                atomic_min_u32(&ns->best, i);
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void mf_run_threads(void *(*fn)(void *), void *arg) {
+    int n = MAX(num_CPUs(), 1);
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    int started = 0;
+    for (; threads != NULL && started < n - 1; started++) {
+        if (pthread_create(&threads[started], NULL, fn, arg) != 0)
+            break;
+    }
+    // the caller works too
+    fn(arg);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+}
 
+void mfTraceAuthCollectStart(void) {
+    memset(&mf_scan, 0, sizeof(mf_scan));
+    mf_scan.ad.first_auth = true;
+    mf_auths_count = 0;
+}
+
+static void mf_trace_add_auth(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity) {
+    if (mf_auths_count == mf_auths_size) {
+        uint32_t size = mf_auths_size ? mf_auths_size * 2 : 64;
+        mf_trace_auth_t *auths = realloc(mf_auths, size * sizeof(mf_trace_auth_t));
+        if (auths == NULL)
+            return;
+        mf_auths = auths;
+        mf_auths_size = size;
+    }
+
+    TAuthData *ad = &mf_scan.ad;
+    mf_trace_auth_t *a = &mf_auths[mf_auths_count++];
+    memset(a, 0, sizeof(*a));
+    a->first = ad->first_auth;
+    a->dic_index = UINT32_MAX;
+
+    if (ad->first_auth) {
+        ad->ks2 = ad->ar_enc ^ prng_successor(ad->nt, 64);
+        ad->ks3 = ad->at_enc ^ prng_successor(ad->nt, 96);
+        ad->first_auth = false;
+    } else {
+        memcpy(a->cmd, cmd, cmdsize);
+        a->cmdsize = cmdsize;
+        memcpy(a->parity, parity, (cmdsize + 7) / 8);
+    }
+    a->ad = *ad;
+}
+
+void mfTraceAuthCollect(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isResponse) {
+    TAuthData *ad = &mf_scan.ad;
+
+    if (isResponse == false) {
+        if (cmdsize == 1 && (cmd[0] == ISO14443A_CMD_WUPA || cmd[0] == ISO14443A_CMD_REQA)) {
+            mf_scan.step = 0;
+            return;
+        }
+        if (cmdsize == 9 && cmd[1] == 0x70 && (cmd[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT || cmd[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT_2 || cmd[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT_3)) {
+            ad->uid = bytes_to_num(&cmd[2], 4);
+            ad->nt = 0;
+            ad->first_auth = true;
+            mf_scan.step = 0;
+            return;
+        }
+    }
+
+    switch (mf_scan.step) {
+        case 1:
+            if (cmdsize == 4 && isResponse) {
+                if (ad->first_auth) {
+                    ad->nt = bytes_to_num(cmd, 4);
+                } else {
+                    ad->nt_enc = bytes_to_num(cmd, 4);
+                    ad->nt_enc_par = parity[0];
+                }
+                mf_scan.step = 2;
+                return;
+            }
+            break;
+        case 2:
+            if (cmdsize == 8 && isResponse == false) {
+                ad->nr_enc = bytes_to_num(cmd, 4);
+                ad->ar_enc = bytes_to_num(&cmd[4], 4);
+                ad->ar_enc_par = parity[0] << 4;
+                mf_scan.step = 3;
+                return;
+            }
+            break;
+        case 3:
+            if (cmdsize == 4 && isResponse) {
+                ad->at_enc = bytes_to_num(cmd, 4);
+                ad->at_enc_par = parity[0];
+                mf_scan.step = 4;
+                return;
+            }
+            break;
+        case 4:
+            // the first frame after the authentication verifies the key
+            if (cmdsize > 32)
+                return;
+            mf_trace_add_auth(cmd, cmdsize, parity);
+            mf_scan.step = 0;
+            return;
+        default:
+            break;
+    }
+
+    // a reader frame of 4 bytes may start an authentication, plain or encrypted
+    mf_scan.step = (cmdsize == 4 && isResponse == false) ? 1 : 0;
+}
+
+void mfTraceAuthCollectEnd(const uint64_t *dicKeys, uint32_t dicKeysCount) {
+    if (mf_auths_count == 0)
+        return;
+
+    uint32_t dic_hash = mf_dic_hash(dicKeys, dicKeysCount);
+
+    // another dictionary, start over
+    if (mf_cache != NULL && mf_cache_dic_hash != dic_hash)
+        mf_cache_free();
+    mf_cache_dic_hash = dic_hash;
+
+    // what the cache already knows
+    mf_trace_auth_t **todo = calloc(mf_auths_count, sizeof(mf_trace_auth_t *));
+    if (todo == NULL)
+        return;
+
+    uint32_t ntodo = 0;
+    for (uint32_t i = 0; i < mf_auths_count; i++) {
+        mf_trace_auth_t *a = &mf_auths[i];
+        mf_auth_cache_t *e = mf_cache_find(a->first, &a->ad);
+        // a miss with this dictionary needs no sweep, but may still be found by a different nested search below
+        if (a->first == false && (e == NULL || (e->found == false && e->dic_hash != dic_hash)))
+            todo[ntodo++] = a;
+    }
+
+    // dictionary sweep over all the unknown nested authentications at once
+    if (ntodo && dicKeys != NULL && dicKeysCount > 0) {
+        mf_dic_sweep_t sw = {
+            .auths = todo,
+            .count = ntodo,
+            .keys = dicKeys,
+            .keys_count = dicKeysCount,
+            .chunks_per_auth = (dicKeysCount + MF_TRACE_DIC_CHUNK - 1) / MF_TRACE_DIC_CHUNK,
+            .next = 0,
+        };
+        mf_run_threads(mf_dic_sweep_thread, &sw);
+    }
+    free(todo);
+
+    // then in trace order, the last used key and the nested search depend on what came before
+    uint64_t last_key = mfLastKey;
+    uint32_t session_nt = 0;
+    bool have_session_nt = false;
+    for (uint32_t i = 0; i < mf_auths_count; i++) {
+        mf_trace_auth_t *a = &mf_auths[i];
+
+        if (a->first) {
+            mf_auth_cache_t *e = mf_cache_find(true, &a->ad);
+            if (e == NULL) {
+                e = mf_cache_add(true, &a->ad);
+                if (e == NULL)
+                    break;
+                e->found = true;
+                e->key = GetCrypto1ProbableKey(&a->ad);
+            }
+            last_key = e->key;
+            have_session_nt = false;
+            continue;
+        }
+
+        // the nested search starts after the last tag nonce known in this session
+        TAuthData ad = a->ad;
+        if (have_session_nt)
+            ad.nt = session_nt;
+
+        mf_auth_cache_t *e = mf_cache_find(false, &a->ad);
+        bool known = (e != NULL) && (e->found || (e->dic_hash == dic_hash && e->miss_nt == ad.nt && e->miss_last_key == last_key));
+        if (known == false) {
+            e = mf_cache_add(false, &a->ad);
+            if (e == NULL)
+                break;
+            e->dic_hash = dic_hash;
+            uint32_t nt = 0, ks2 = 0, ks3 = 0;
+
+            if (last_key && nested_check_key(last_key, &ad, a->cmd, a->cmdsize, a->parity, &nt, &ks2, &ks3)) {
+                e->found = true;
+                e->key = last_key;
+            } else if (a->dic_index != UINT32_MAX && nested_check_key(dicKeys[a->dic_index], &ad, a->cmd, a->cmdsize, a->parity, &nt, &ks2, &ks3)) {
+                e->found = true;
+                e->key = dicKeys[a->dic_index];
+            } else if (validate_prng_nonce(ad.nt)) {
+                mf_nested_search_t ns = { .auth = a, .nt = ad.nt, .best = MF_TRACE_NESTED_WINDOW, .next = 0 };
+                mf_run_threads(mf_nested_search_thread, &ns);
+
+                if (ns.best < MF_TRACE_NESTED_WINDOW) {
+                    nt = prng_successor(ad.nt, 91 + ns.best);
+                    ks2 = ad.ar_enc ^ prng_successor(nt, 64);
+                    ks3 = ad.at_enc ^ prng_successor(nt, 96);
+                    ad.nt = nt;
+                    ad.ks2 = ks2;
+                    ad.ks3 = ks3;
+                    e->found = true;
+                    e->key = GetCrypto1ProbableKey(&ad);
+                }
+            }
+
+            if (e->found) {
+                e->key_nt = nt;
+                e->ks2 = ks2;
+                e->ks3 = ks3;
+            } else {
+                e->miss_nt = ad.nt;
+                e->miss_last_key = last_key;
+            }
+        }
+
+        if (e != NULL && e->found) {
+            last_key = e->key;
+            session_nt = e->key_nt;
+            have_session_nt = true;
+        }
+    }
+}
+
+// the recovered keys stay for listing the same trace again, until another trace is loaded
+void mfTraceAuthFree(void) {
+    free(mf_auths);
+    mf_auths = NULL;
+    mf_auths_count = 0;
+    mf_auths_size = 0;
+
+    mf_cache_free();
 }
 
 bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isResponse, uint8_t *mfData, size_t *mfDataLen, const uint64_t *dicKeys, uint32_t dicKeysCount) {
@@ -1353,12 +1892,12 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
         return false;
 
     if (MifareAuthState == masFirstData) {
-        static uint64_t mfLastKey;
         if (AuthData.first_auth) {
             AuthData.ks2 = AuthData.ar_enc ^ prng_successor(AuthData.nt, 64);
             AuthData.ks3 = AuthData.at_enc ^ prng_successor(AuthData.nt, 96);
 
-            mfLastKey = GetCrypto1ProbableKey(&AuthData);
+            mf_auth_cache_t *e = mf_cache_find(true, &AuthData);
+            mfLastKey = (e != NULL) ? e->key : GetCrypto1ProbableKey(&AuthData);
             PrintAndLogEx(NORMAL, "            |            |  *  |%49s " _GREEN_("%012" PRIX64) " prng %s |     |",
                           "key",
                           mfLastKey,
@@ -1373,8 +1912,38 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
                 traceCrypto1 = NULL;
             }
 
+            // recovered up front, print it the way the search below would have found it
+            mf_auth_cache_t *e = mf_cache_find(false, &AuthData);
+            if (e != NULL && e->found == false) {
+                if (e->dic_hash != mf_dic_hash(dicKeys, dicKeysCount) || e->miss_nt != AuthData.nt || e->miss_last_key != mfLastKey)
+                    e = NULL;
+            }
+
+            if (e != NULL && e->found) {
+                AuthData.nt = e->key_nt;
+                AuthData.ks2 = e->ks2;
+                AuthData.ks3 = e->ks3;
+
+                bool in_dic = false;
+                for (uint32_t i = 0; dicKeys != NULL && i < dicKeysCount && in_dic == false; i++)
+                    in_dic = (dicKeys[i] == e->key);
+
+                if (mfLastKey && mfLastKey == e->key) {
+                    PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "last used key", e->key);
+                } else if (in_dic) {
+                    PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "key", e->key);
+                } else {
+                    PrintAndLogEx(NORMAL, "            |            |  *  | nested probable key: " _GREEN_("%012" PRIX64) "     ks2:%08x ks3:%08x |     |",
+                                  e->key,
+                                  AuthData.ks2,
+                                  AuthData.ks3);
+                }
+                mfLastKey = e->key;
+                traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
+            }
+
             // check last used key
-            if (mfLastKey) {
+            if (e == NULL && mfLastKey) {
                 if (NestedCheckKey(mfLastKey, &AuthData, cmd, cmdsize, parity)) {
                     PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "last used key", mfLastKey);
                     traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
@@ -1382,7 +1951,7 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
             }
 
             // check default keys
-            if (!traceCrypto1 && dicKeys != NULL && dicKeysCount > 0) {
+            if (e == NULL && !traceCrypto1 && dicKeys != NULL && dicKeysCount > 0) {
                 for (int i = 0; i < dicKeysCount; i++) {
                     if (NestedCheckKey(dicKeys[i], &AuthData, cmd, cmdsize, parity)) {
                         PrintAndLogEx(NORMAL, "            |            |  *  |%60s " _GREEN_("%012" PRIX64) "|     |", "key", dicKeys[i]);
@@ -1395,7 +1964,7 @@ bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isRes
             }
 
             // nested
-            if (!traceCrypto1 && validate_prng_nonce(AuthData.nt)) {
+            if (e == NULL && !traceCrypto1 && validate_prng_nonce(AuthData.nt)) {
                 uint32_t ntx = prng_successor(AuthData.nt, 90);
                 for (int i = 0; i <= 65535; i++) {
                     ntx = prng_successor(ntx, 1);
@@ -1495,40 +2064,16 @@ bool NTParityChk(TAuthData *ad, uint32_t ntx) {
 }
 
 bool NestedCheckKey(uint64_t key, TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity) {
-    uint8_t buf[32] = {0};
-    struct Crypto1State *pcs;
-
     AuthData.ks2 = 0;
     AuthData.ks3 = 0;
 
-    pcs = crypto1_create(key);
-    uint32_t nt1 = crypto1_word(pcs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
-    uint32_t ar = prng_successor(nt1, 64);
-    uint32_t at = prng_successor(nt1, 96);
-
-    crypto1_word(pcs, ad->nr_enc, 1);
-//   uint32_t nr1 = crypto1_word(pcs, ad->nr_enc, 1) ^ ad->nr_enc;  // if needs deciphered nr
-    uint32_t ar1 = crypto1_word(pcs, 0, 0) ^ ad->ar_enc;
-    uint32_t at1 = crypto1_word(pcs, 0, 0) ^ ad->at_enc;
-
-    if (!(ar == ar1 && at == at1 && NTParityChk(ad, nt1))) {
-        crypto1_destroy(pcs);
-        return false;
-    }
-
-    memcpy(buf, cmd, cmdsize);
-    mf_crypto1_decrypt(pcs, buf, cmdsize, 0);
-    crypto1_destroy(pcs);
-
-    if (!CheckCrypto1Parity(cmd, cmdsize, buf, parity))
-        return false;
-
-    if (!check_crc(CRC_14443_A, buf, cmdsize))
+    uint32_t nt1, ks2, ks3;
+    if (nested_check_key(key, ad, cmd, cmdsize, parity, &nt1, &ks2, &ks3) == false)
         return false;
 
     AuthData.nt = nt1;
-    AuthData.ks2 = AuthData.ar_enc ^ ar;
-    AuthData.ks3 = AuthData.at_enc ^ at;
+    AuthData.ks2 = ks2;
+    AuthData.ks3 = ks3;
     return true;
 }
 
@@ -154,8 +154,9 @@ static int usage_hf14_staticnested(void) {
 static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "Usage:");
     PrintAndLogEx(NORMAL, "      hf mf hardnested <block number> <key A|B> <key (12 hex symbols)>");
-    PrintAndLogEx(NORMAL, "                       <target block number> <target key A|B> [known target key (12 hex symbols)] [w] [s]");
+    PrintAndLogEx(NORMAL, "                       <target block number> <target key A|B> [known target key (12 hex symbols)] [w] [s] [m <targets>]");
     PrintAndLogEx(NORMAL, "  or  hf mf hardnested r [known target key]");
+    PrintAndLogEx(NORMAL, "  or  hf mf hardnested b");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Options:");
     PrintAndLogEx(NORMAL, "      h         this help");
@@ -165,6 +166,9 @@ static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "      u <UID>   read/write hf-mf-<UID>-nonces.bin instead of default name");
     PrintAndLogEx(NORMAL, "      f <name>  read/write <name> instead of default name");
     PrintAndLogEx(NORMAL, "      t         tests?");
+    PrintAndLogEx(NORMAL, "      b         brute force benchmark of every SIMD core supported by this CPU");
+    PrintAndLogEx(NORMAL, "      m <list>  more targets, comma separated block number and key type. Nonces of all targets are acquired");
+    PrintAndLogEx(NORMAL, "                first and written to hf-mf-<UID>-<block><key>-nonces.bin, then the keys are cracked cheapest first");
     PrintAndLogEx(NORMAL, "      i <X>     set type of SIMD instructions. Without this flag programs autodetect it.");
 #if defined(COMPILER_HAS_SIMD_AVX512)
     PrintAndLogEx(NORMAL, "        i 5   = AVX512");
@@ -174,6 +178,9 @@ static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, "        i a   = AVX");
     PrintAndLogEx(NORMAL, "        i s   = SSE2");
     PrintAndLogEx(NORMAL, "        i m   = MMX");
+#endif
+#if defined(COMPILER_HAS_NEON)
+    PrintAndLogEx(NORMAL, "        i e   = NEON");
 #endif
     PrintAndLogEx(NORMAL, "        i n   = none (use CPU regular instruction set)");
     PrintAndLogEx(NORMAL, "");
@@ -181,6 +188,7 @@ static int usage_hf14_hardnested(void) {
     PrintAndLogEx(NORMAL, _YELLOW_("      hf mf hardnested 0 A FFFFFFFFFFFF 4 A"));
     PrintAndLogEx(NORMAL, _YELLOW_("      hf mf hardnested 0 A FFFFFFFFFFFF 4 A w"));
     PrintAndLogEx(NORMAL, _YELLOW_("      hf mf hardnested 0 A FFFFFFFFFFFF 4 A f nonces.bin w s"));
+    PrintAndLogEx(NORMAL, _YELLOW_("      hf mf hardnested 0 A FFFFFFFFFFFF 4 A m 4B,8A,8B"));
     PrintAndLogEx(NORMAL, _YELLOW_("      hf mf hardnested r"));
     PrintAndLogEx(NORMAL, _YELLOW_("      hf mf hardnested r a0a1a2a3a4a5"));
     PrintAndLogEx(NORMAL, "");
@@ -221,6 +229,9 @@ static int usage_hf14_autopwn(void) {
     PrintAndLogEx(NORMAL, "        i s   = SSE2");
 #endif
     PrintAndLogEx(NORMAL, "        i m   = MMX");
+#if defined(COMPILER_HAS_NEON)
+    PrintAndLogEx(NORMAL, "        i e   = NEON");
+#endif
     PrintAndLogEx(NORMAL, "        i n   = none (use CPU regular instruction set)");
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(NORMAL, "Examples:");
@@ -1806,6 +1817,8 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     char filename[FILE_PATH_SIZE] = {0};
     char szTemp[FILE_PATH_SIZE - 20];
     char ctmp;
+    hardnested_target_t *targets = NULL;
+    uint8_t num_targets = 0;
 
     bool know_target_key = false;
     bool nonce_file_read = false;
@@ -1831,6 +1844,8 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
             cmdp++;
             break;
         }
+        case 'b':
+            return mfnestedhard_benchmark();
         case 't':
             tests = param_get32ex(Cmd, cmdp + 1, 100, 10);
             if (!param_gethex(Cmd, cmdp + 2, trgkey, 12)) {
@@ -1906,6 +1921,38 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                 strncpy(filename, szTemp, FILE_PATH_SIZE - 20);
                 cmdp++;
                 break;
+            case 'm':
+                param_getstr(Cmd, cmdp + 1, szTemp, FILE_PATH_SIZE - 20);
+                free(targets);
+                targets = calloc(HARDNESTED_MAX_TARGETS, sizeof(hardnested_target_t));
+                if (targets == NULL) {
+                    PrintAndLogEx(WARNING, "Failed to allocate memory");
+                    return PM3_EMALLOC;
+                }
+                // the target given in front comes first
+                targets[0].blockno = trgBlockNo;
+                targets[0].keytype = trgKeyType;
+                num_targets = 1;
+                for (char *tok = strtok(szTemp, ","); tok != NULL; tok = strtok(NULL, ",")) {
+                    char *end = NULL;
+                    unsigned long blk = strtoul(tok, &end, 10);
+                    char kt = tolower(*end);
+                    if (end == tok || blk > 0xFF || (kt != 'a' && kt != 'b') || end[1] != 0x00) {
+                        PrintAndLogEx(WARNING, "Target must be a block number followed by A or B, got '%s'", tok);
+                        free(targets);
+                        return 1;
+                    }
+                    if (num_targets == HARDNESTED_MAX_TARGETS) {
+                        PrintAndLogEx(WARNING, "Too many targets, max %d", HARDNESTED_MAX_TARGETS);
+                        free(targets);
+                        return 1;
+                    }
+                    targets[num_targets].blockno = blk;
+                    targets[num_targets].keytype = (kt == 'b');
+                    num_targets++;
+                }
+                cmdp++;
+                break;
             case 'i':
                 SetSIMDInstr(SIMD_AUTO);
                 ctmp = tolower(param_getchar(Cmd, cmdp + 1));
@@ -1928,12 +1975,18 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                     case 'm':
                         SetSIMDInstr(SIMD_MMX);
                         break;
+#endif
+#if defined(COMPILER_HAS_NEON)
+                    case 'e':
+                        SetSIMDInstr(SIMD_NEON);
+                        break;
 #endif
                     case 'n':
                         SetSIMDInstr(SIMD_NONE);
                         break;
                     default:
                         PrintAndLogEx(WARNING, "Unknown SIMD type. %c", ctmp);
+                        free(targets);
                         return 1;
                 }
                 cmdp += 2;
@@ -1941,17 +1994,38 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
             default:
                 PrintAndLogEx(WARNING, "Unknown parameter '%c'\n", ctmp);
                 usage_hf14_hardnested();
+                free(targets);
                 return 1;
         }
         cmdp++;
     }
 
+    if (num_targets) {
+        if (nonce_file_read || tests || know_target_key) {
+            PrintAndLogEx(WARNING, "More targets can't be combined with r, t or a known target key");
+            free(targets);
+            return 1;
+        }
+        for (uint8_t i = 0; i < num_targets; i++) {
+            char suffix[24];
+            sprintf(suffix, "-%03u%c-nonces.bin", targets[i].blockno, targets[i].keytype ? 'B' : 'A');
+            char *fptr = GenerateFilename("hf-mf-", suffix);
+            if (fptr == NULL) {
+                free(targets);
+                return 1;
+            }
+            strncpy(targets[i].filename, fptr, FILE_PATH_SIZE - 1);
+            free(fptr);
+        }
+    }
+
     if (!know_target_key && nonce_file_read == false) {
 
         // check if tag doesn't have static nonce
         if (detect_classic_static_nonce() == NONCE_STATIC) {
             PrintAndLogEx(WARNING, "Static nonce detected. Quitting...");
             PrintAndLogEx(HINT, "\tTry use `" _YELLOW_("hf mf staticnested") "`");
+            free(targets);
             return PM3_EOPABORTED;
         }
 
@@ -1959,6 +2033,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
         // check if we can authenticate to sector
         if (mfCheckKeys(blockNo, keyType, true, 1, key, &key64) != PM3_SUCCESS) {
             PrintAndLogEx(WARNING, "Key is wrong. Can't authenticate to block: %3d  key type: %c", blockNo, keyType ? 'B' : 'A');
+            free(targets);
             return 3;
         }
     }
@@ -1975,7 +2050,25 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
                   tests);
 
     uint64_t foundkey = 0;
-    int16_t isOK = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, know_target_key ? trgkey : NULL, nonce_file_read, nonce_file_write, slow, tests, &foundkey, filename);
+    int16_t isOK;
+    if (num_targets) {
+        isOK = mfnestedhard_batch(blockNo, keyType, key, targets, num_targets, slow);
+
+        PrintAndLogEx(NORMAL, "");
+        PrintAndLogEx(SUCCESS, "|-----|-----|--------------|");
+        PrintAndLogEx(SUCCESS, "| blk | key |     found    |");
+        PrintAndLogEx(SUCCESS, "|-----|-----|--------------|");
+        for (uint8_t i = 0; i < num_targets; i++) {
+            if (targets[i].found)
+                PrintAndLogEx(SUCCESS, "| %03u |  %c  | " _GREEN_("%012" PRIx64) " |", targets[i].blockno, targets[i].keytype ? 'B' : 'A', targets[i].key);
+            else
+                PrintAndLogEx(SUCCESS, "| %03u |  %c  | " _RED_("------------") " |", targets[i].blockno, targets[i].keytype ? 'B' : 'A');
+        }
+        PrintAndLogEx(SUCCESS, "|-----|-----|--------------|");
+        free(targets);
+    } else {
+        isOK = mfnestedhard(blockNo, keyType, key, trgBlockNo, trgKeyType, know_target_key ? trgkey : NULL, nonce_file_read, nonce_file_write, slow, tests, &foundkey, filename);
+    }
 
     if ((tests == 0) && IfPm3Iso14443a()) {
         DropField();
@@ -1997,7 +2090,7 @@ static int CmdHF14AMfNestedHard(const char *Cmd) {
     return 0;
 }
 
-static int CmdHF14AMfAutoPWN(const char *Cmd) {
+static int mf_autopwn(const char *Cmd) {
     // Nested and Hardnested parameter
     uint8_t blockNo = 0;
     uint8_t keyType = 0;
@@ -2118,6 +2211,11 @@ static int CmdHF14AMfAutoPWN(const char *Cmd) {
                     case 'm':
                         SetSIMDInstr(SIMD_MMX);
                         break;
+#endif
+#if defined(COMPILER_HAS_NEON)
+                    case 'e':
+                        SetSIMDInstr(SIMD_NEON);
+                        break;
 #endif
                     case 'n':
                         SetSIMDInstr(SIMD_NONE);
@@ -2734,6 +2832,14 @@ all_found:
     return PM3_SUCCESS;
 }
 
+static int CmdHF14AMfAutoPWN(const char *Cmd) {
+    // keep the hardnested tables for all sectors of the card
+    hardnested_session_start();
+    int res = mf_autopwn(Cmd);
+    hardnested_session_end();
+    return res;
+}
+
 /*
 static int randInRange(int min, int max) {
     return min + (int)(rand() / (double)(RAND_MAX) * (max - min + 1));
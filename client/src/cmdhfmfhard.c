@@ -24,6 +24,12 @@
 #include <math.h>
 #include <time.h> // MingW
 #include <bzlib.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "commonutil.h"  // ARRAYLEN
 #include "comms.h"
@@ -37,6 +43,7 @@
 #include "hardnested_bf_core.h"
 #include "hardnested_bitarray_core.h"
 #include "fileutils.h"
+#include "mifare/mifarehost.h"
 
 #define NUM_CHECK_BITFLIPS_THREADS      (num_CPUs())
 #define NUM_REDUCTION_WORKING_THREADS   (num_CPUs())
@@ -73,40 +80,9 @@ static uint32_t test_state[2] = {0, 0};
 static float brute_force_per_second;
 
 
-static void get_SIMD_instruction_set(char *instruction_set) {
-    switch (GetSIMDInstrAuto()) {
-#if defined(COMPILER_HAS_SIMD_AVX512)
-        case SIMD_AVX512:
-            strcpy(instruction_set, "AVX512F");
-            break;
-#endif
-#if defined(COMPILER_HAS_SIMD)
-        case SIMD_AVX2:
-            strcpy(instruction_set, "AVX2");
-            break;
-        case SIMD_AVX:
-            strcpy(instruction_set, "AVX");
-            break;
-        case SIMD_SSE2:
-            strcpy(instruction_set, "SSE2");
-            break;
-        case SIMD_MMX:
-            strcpy(instruction_set, "MMX");
-            break;
-#endif
-        case SIMD_AUTO:
-        case SIMD_NONE:
-            strcpy(instruction_set, "no");
-            break;
-    }
-}
-
-
 static void print_progress_header(void) {
     char progress_text[80];
-    char instr_set[12] = "";
-    get_SIMD_instruction_set(instr_set);
-    sprintf(progress_text, "Start using %d threads and %s SIMD core", num_CPUs(), instr_set);
+    sprintf(progress_text, "Start using %d threads and %s SIMD core", num_CPUs(), GetSIMDInstrName(GetSIMDInstrAuto()));
     PrintAndLogEx(NORMAL, "\n\n");
     PrintAndLogEx(NORMAL, " time    | #nonces | Activity                                                | expected to brute force");
     PrintAndLogEx(NORMAL, "         |         |                                                         | #states         | time ");
@@ -207,6 +183,255 @@ static inline uint32_t next_state(uint32_t *bitarray, uint32_t state) {
 
 static uint32_t *bitflip_bitarrays[2][0x400];
 static uint32_t count_bitflip_bitarrays[2][0x400];
+static uint32_t *part_sum_a0_bitarrays[2][NUM_PART_SUMS];
+static uint32_t *part_sum_a8_bitarrays[2][NUM_PART_SUMS];
+static uint32_t *sum_a0_bitarrays[2][NUM_SUMS];
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// on-disk cache of the bitflip and sum property bitarrays
+//
+// The first run stores the decompressed bitflip bitarrays and the calculated sum property bitarrays in one
+// page aligned file in the user directory. Later runs map that file instead. The bitflip and sum_a0 bitarrays
+// are mapped read-only and shared with other processes, the part_sum bitarrays are copy-on-write because
+// they are reduced during the attack.
+
+#define TABLES_CACHE_VERSION        1   // increment when the table files or the layout change
+#define TABLES_CACHE_FILE           "hardnested_tables_v%d.bin"
+#define TABLES_CACHE_MAGIC          "PM3HNTBL"
+#define TABLES_CACHE_PAGE           4096
+#define TABLES_CACHE_ALIGN          65536   // offset of the bitarrays, must be a multiple of the largest page size
+#define BITARRAY_BYTES              (sizeof(uint32_t) * (1 << 19))
+
+// slots of the fixed bitarrays in the cache file, the bitflip bitarrays follow
+#define TABLES_CACHE_SLOT_PART_A0   0
+#define TABLES_CACHE_SLOT_PART_A8   (TABLES_CACHE_SLOT_PART_A0 + 2 * NUM_PART_SUMS)
+#define TABLES_CACHE_SLOT_SUM_A0    (TABLES_CACHE_SLOT_PART_A8 + 2 * NUM_PART_SUMS)
+#define TABLES_CACHE_SLOT_BITFLIPS  (TABLES_CACHE_SLOT_SUM_A0 + 2 * NUM_SUMS)
+
+// table groups still using the mapping
+#define TABLES_CACHE_BITFLIPS       0x01
+#define TABLES_CACHE_PART_SUMS      0x02
+#define TABLES_CACHE_SUMS           0x04
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t bitarray_bytes;
+    uint32_t threshold;                 // IGNORE_BITFLIP_THRESHOLD in 1/1000
+    uint32_t num_slots;
+    uint32_t header_size;
+    uint32_t bitflip_count[2][0x400];
+    uint16_t bitflip_slot[2][0x400];    // 0 = bitflip not used
+} PACKED tables_cache_header_t;
+
+static uint8_t *tables_cache = NULL;
+static size_t tables_cache_size = 0;
+static uint8_t tables_cache_groups = 0;
+static int tables_cache_fd = -1;        // kept open to restore the part sum bitarrays
+
+static uint32_t tables_cache_header_size(void) {
+    return (sizeof(tables_cache_header_t) + TABLES_CACHE_ALIGN - 1) & ~(TABLES_CACHE_ALIGN - 1);
+}
+
+static char *tables_cache_path(bool create) {
+    char filename[40];
+    sprintf(filename, TABLES_CACHE_FILE, TABLES_CACHE_VERSION);
+    char *path = NULL;
+    if (searchHomeFilePath(&path, CACHE_SUBDIR, filename, create) != PM3_SUCCESS)
+        return NULL;
+    return path;
+}
+
+static uint32_t *tables_cache_slot(uint32_t slot) {
+    return (uint32_t *)(tables_cache + tables_cache_header_size() + (size_t)slot * BITARRAY_BYTES);
+}
+
+// returns true if the group was mapped, in which case its pointers are cleared instead of freed
+static bool release_tables_cache(uint8_t group, uint32_t **bitarrays, size_t count) {
+    if ((tables_cache_groups & group) == 0)
+        return false;
+
+    memset(bitarrays, 0, count * sizeof(uint32_t *));
+    tables_cache_groups &= ~group;
+#ifndef _WIN32
+    if (tables_cache_groups == 0) {
+        munmap(tables_cache, tables_cache_size);
+        close(tables_cache_fd);
+        tables_cache = NULL;
+        tables_cache_size = 0;
+        tables_cache_fd = -1;
+    }
+#endif
+    return true;
+}
+
+static bool map_tables_cache(void) {
+#ifdef _WIN32
+    return false;
+#else
+    char *path = tables_cache_path(false);
+    if (path == NULL)
+        return false;
+
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < tables_cache_header_size()) {
+        close(fd);
+        return false;
+    }
+
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    tables_cache_header_t *hdr = (tables_cache_header_t *)map;
+    if (memcmp(hdr->magic, TABLES_CACHE_MAGIC, sizeof(hdr->magic)) != 0
+            || hdr->version != TABLES_CACHE_VERSION
+            || hdr->bitarray_bytes != BITARRAY_BYTES
+            || hdr->threshold != (uint32_t)(IGNORE_BITFLIP_THRESHOLD * 1000)
+            || hdr->header_size != tables_cache_header_size()
+            || (size_t)st.st_size != hdr->header_size + (size_t)hdr->num_slots * BITARRAY_BYTES) {
+        PrintAndLogEx(DEBUG, "Ignoring outdated hardnested tables cache");
+        munmap(map, st.st_size);
+        close(fd);
+        return false;
+    }
+
+    // part sum bitarrays get reduced, let those pages be copied on write
+    size_t part_sums_len = (size_t)TABLES_CACHE_SLOT_SUM_A0 * BITARRAY_BYTES;
+    if (mprotect(map + hdr->header_size, part_sums_len, PROT_READ | PROT_WRITE) == -1) {
+        munmap(map, st.st_size);
+        close(fd);
+        return false;
+    }
+
+    tables_cache = map;
+    tables_cache_size = st.st_size;
+    tables_cache_fd = fd;
+    tables_cache_groups = TABLES_CACHE_BITFLIPS | TABLES_CACHE_PART_SUMS | TABLES_CACHE_SUMS;
+
+    for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE; odd_even++) {
+        for (uint16_t part_sum = 0; part_sum < NUM_PART_SUMS; part_sum++) {
+            part_sum_a0_bitarrays[odd_even][part_sum] = tables_cache_slot(TABLES_CACHE_SLOT_PART_A0 + odd_even * NUM_PART_SUMS + part_sum);
+            part_sum_a8_bitarrays[odd_even][part_sum] = tables_cache_slot(TABLES_CACHE_SLOT_PART_A8 + odd_even * NUM_PART_SUMS + part_sum);
+        }
+        for (uint16_t sum_a0 = 0; sum_a0 < NUM_SUMS; sum_a0++) {
+            sum_a0_bitarrays[odd_even][sum_a0] = tables_cache_slot(TABLES_CACHE_SLOT_SUM_A0 + odd_even * NUM_SUMS + sum_a0);
+        }
+
+        num_effective_bitflips[odd_even] = 0;
+        for (uint16_t bitflip = 0x001; bitflip < 0x400; bitflip++) {
+            count_bitflip_bitarrays[odd_even][bitflip] = hdr->bitflip_count[odd_even][bitflip];
+            bitflip_bitarrays[odd_even][bitflip] = NULL;
+            if (hdr->bitflip_slot[odd_even][bitflip] != 0) {
+                bitflip_bitarrays[odd_even][bitflip] = tables_cache_slot(hdr->bitflip_slot[odd_even][bitflip]);
+                effective_bitflip[odd_even][num_effective_bitflips[odd_even]++] = bitflip;
+            }
+        }
+        effective_bitflip[odd_even][num_effective_bitflips[odd_even]] = 0x400; // EndOfList marker
+    }
+    return true;
+#endif
+}
+
+// throws away the reduced copies of the part sum bitarrays and maps the original pages again
+static bool remap_part_sum_tables_cache(void) {
+#ifdef _WIN32
+    return false;
+#else
+    if ((tables_cache_groups & TABLES_CACHE_PART_SUMS) == 0)
+        return false;
+
+    size_t part_sums_len = (size_t)TABLES_CACHE_SLOT_SUM_A0 * BITARRAY_BYTES;
+    uint32_t header_size = tables_cache_header_size();
+    void *map = mmap(tables_cache + header_size, part_sums_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, tables_cache_fd, header_size);
+    return map != MAP_FAILED;
+#endif
+}
+
+#ifndef _WIN32
+// writes a bitarray, leaving holes for all-zero pages
+static bool write_tables_cache_slot(int fd, uint32_t slot, const uint32_t *bitarray) {
+    static const uint8_t zero_page[TABLES_CACHE_PAGE] = {0};
+    const uint8_t *p = (const uint8_t *)bitarray;
+    off_t offset = tables_cache_header_size() + (off_t)slot * BITARRAY_BYTES;
+    for (size_t i = 0; i < BITARRAY_BYTES; i += TABLES_CACHE_PAGE) {
+        if (memcmp(p + i, zero_page, TABLES_CACHE_PAGE) == 0)
+            continue;
+        if (pwrite(fd, p + i, TABLES_CACHE_PAGE, offset + i) != TABLES_CACHE_PAGE)
+            return false;
+    }
+    return true;
+}
+#endif
+
+static void save_tables_cache(void) {
+#ifndef _WIN32
+    char *path = tables_cache_path(true);
+    if (path == NULL)
+        return;
+
+    // write to a temporary file and rename it, concurrent runs only ever see a complete cache
+    char tmppath[strlen(path) + 16];
+    sprintf(tmppath, "%s.%d", path, (int)getpid());
+
+    int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        PrintAndLogEx(DEBUG, "Could not create hardnested tables cache %s", tmppath);
+        free(path);
+        return;
+    }
+
+    tables_cache_header_t *hdr = calloc(1, tables_cache_header_size());
+    bool ok = (hdr != NULL);
+    if (ok) {
+        memcpy(hdr->magic, TABLES_CACHE_MAGIC, sizeof(hdr->magic));
+        hdr->version = TABLES_CACHE_VERSION;
+        hdr->bitarray_bytes = BITARRAY_BYTES;
+        hdr->threshold = (uint32_t)(IGNORE_BITFLIP_THRESHOLD * 1000);
+        hdr->header_size = tables_cache_header_size();
+
+        uint32_t slot = TABLES_CACHE_SLOT_BITFLIPS;
+        for (odd_even_t odd_even = EVEN_STATE; odd_even <= ODD_STATE && ok; odd_even++) {
+            for (uint16_t part_sum = 0; part_sum < NUM_PART_SUMS && ok; part_sum++) {
+                ok = write_tables_cache_slot(fd, TABLES_CACHE_SLOT_PART_A0 + odd_even * NUM_PART_SUMS + part_sum, part_sum_a0_bitarrays[odd_even][part_sum])
+                     && write_tables_cache_slot(fd, TABLES_CACHE_SLOT_PART_A8 + odd_even * NUM_PART_SUMS + part_sum, part_sum_a8_bitarrays[odd_even][part_sum]);
+            }
+            for (uint16_t sum_a0 = 0; sum_a0 < NUM_SUMS && ok; sum_a0++) {
+                ok = write_tables_cache_slot(fd, TABLES_CACHE_SLOT_SUM_A0 + odd_even * NUM_SUMS + sum_a0, sum_a0_bitarrays[odd_even][sum_a0]);
+            }
+            for (uint16_t bitflip = 0x001; bitflip < 0x400 && ok; bitflip++) {
+                hdr->bitflip_count[odd_even][bitflip] = count_bitflip_bitarrays[odd_even][bitflip];
+                if (bitflip_bitarrays[odd_even][bitflip] != NULL) {
+                    hdr->bitflip_slot[odd_even][bitflip] = slot;
+                    ok = write_tables_cache_slot(fd, slot++, bitflip_bitarrays[odd_even][bitflip]);
+                }
+            }
+        }
+        hdr->num_slots = slot;
+
+        ok = ok && ftruncate(fd, hdr->header_size + (off_t)hdr->num_slots * BITARRAY_BYTES) == 0
+             && pwrite(fd, hdr, hdr->header_size, 0) == (ssize_t)hdr->header_size;
+    }
+    free(hdr);
+    close(fd);
+
+    if (ok && rename(tmppath, path) == 0) {
+        PrintAndLogEx(DEBUG, "Saved hardnested tables cache %s", path);
+    } else {
+        PrintAndLogEx(DEBUG, "Could not write hardnested tables cache %s", path);
+        unlink(tmppath);
+    }
+    free(path);
+#endif
+}
 
 static int compare_count_bitflip_bitarrays(const void *b1, const void *b2) {
     uint64_t count1 = (uint64_t)count_bitflip_bitarrays[ODD_STATE][*(uint16_t *)b1] * count_bitflip_bitarrays[EVEN_STATE][*(uint16_t *)b1];
@@ -324,7 +549,10 @@ static void init_bitflip_bitarrays(void) {
         }
         effective_bitflip[odd_even][num_effective_bitflips[odd_even]] = 0x400; // EndOfList marker
     }
+}
 
+
+static void sort_effective_bitflips(void) {
     uint16_t i = 0;
     uint16_t j = 0;
     num_all_effective_bitflips = 0;
@@ -366,22 +594,22 @@ static void init_bitflip_bitarrays(void) {
 
 
 static void free_bitflip_bitarrays(void) {
+    if (release_tables_cache(TABLES_CACHE_BITFLIPS, bitflip_bitarrays[0], sizeof(bitflip_bitarrays) / sizeof(uint32_t *)))
+        return;
+
     for (int16_t bitflip = 0x3ff; bitflip > 0x000; bitflip--) {
         free_bitarray(bitflip_bitarrays[ODD_STATE][bitflip]);
     }
     for (int16_t bitflip = 0x3ff; bitflip > 0x000; bitflip--) {
         free_bitarray(bitflip_bitarrays[EVEN_STATE][bitflip]);
     }
+    memset(bitflip_bitarrays, 0, sizeof(bitflip_bitarrays));
 }
 
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // sum property bitarrays
 
-static uint32_t *part_sum_a0_bitarrays[2][NUM_PART_SUMS];
-static uint32_t *part_sum_a8_bitarrays[2][NUM_PART_SUMS];
-static uint32_t *sum_a0_bitarrays[2][NUM_SUMS];
-
 static uint16_t PartialSumProperty(uint32_t state, odd_even_t odd_even) {
     uint16_t sum = 0;
     for (uint16_t j = 0; j < 16; j++) {
@@ -450,6 +678,11 @@ static void init_part_sum_bitarrays(void) {
 
 
 static void free_part_sum_bitarrays(void) {
+    if (release_tables_cache(TABLES_CACHE_PART_SUMS, part_sum_a0_bitarrays[0], sizeof(part_sum_a0_bitarrays) / sizeof(uint32_t *))) {
+        memset(part_sum_a8_bitarrays, 0, sizeof(part_sum_a8_bitarrays));
+        return;
+    }
+
     for (int16_t part_sum_a8 = (NUM_PART_SUMS - 1); part_sum_a8 >= 0; part_sum_a8--) {
         free_bitarray(part_sum_a8_bitarrays[ODD_STATE][part_sum_a8]);
     }
@@ -490,6 +723,9 @@ static void init_sum_bitarrays(void) {
 
 
 static void free_sum_bitarrays(void) {
+    if (release_tables_cache(TABLES_CACHE_SUMS, sum_a0_bitarrays[0], sizeof(sum_a0_bitarrays) / sizeof(uint32_t *)))
+        return;
+
     for (int8_t sum_a0 = NUM_SUMS - 1; sum_a0 >= 0; sum_a0--) {
         free_bitarray(sum_a0_bitarrays[ODD_STATE][sum_a0]);
         free_bitarray(sum_a0_bitarrays[EVEN_STATE][sum_a0]);
@@ -497,6 +733,51 @@ static void free_sum_bitarrays(void) {
 }
 
 
+// A session keeps the tables and the brute force benchmark between attacks on several sectors of the same card.
+// Only the part sum bitarrays are modified by an attack, they are restored before the next one.
+static bool session_active = false;
+static bool session_tables = false;
+static float session_brute_force_per_second = 0;
+
+static void init_bitarrays(void) {
+    if (session_tables) {
+        if (remap_part_sum_tables_cache() == false) {
+            free_part_sum_bitarrays();
+            init_part_sum_bitarrays();
+        }
+    } else if (map_tables_cache() == false) {
+        init_bitflip_bitarrays();
+        init_part_sum_bitarrays();
+        init_sum_bitarrays();
+        save_tables_cache();
+    }
+    session_tables = session_active;
+    sort_effective_bitflips();
+}
+
+static void free_bitarrays(void) {
+    if (session_tables)
+        return;
+
+    free_bitflip_bitarrays();
+    free_sum_bitarrays();
+    free_part_sum_bitarrays();
+}
+
+void hardnested_session_start(void) {
+    session_active = true;
+}
+
+void hardnested_session_end(void) {
+    session_active = false;
+    if (session_tables) {
+        session_tables = false;
+        free_bitarrays();
+    }
+    session_brute_force_per_second = 0;
+}
+
+
 #ifdef DEBUG_KEY_ELIMINATION
 static char failstr[250] = "";
 #endif
@@ -2172,21 +2453,155 @@ static void set_test_state(uint8_t byte) {
     crypto1_destroy(pcs);
 }
 
-int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename) {
-    char progress_text[80];
-    char instr_set[12] = {0};
+static void free_target_memory(void) {
+    free_nonces_memory();
+    free_bitarray(all_bitflips_bitarray[ODD_STATE]);
+    free_bitarray(all_bitflips_bitarray[EVEN_STATE]);
+    free_bitarrays();
+}
 
-    get_SIMD_instruction_set(instr_set);
-    PrintAndLogEx(SUCCESS, "Using %s SIMD core.", instr_set);
+static void hardnested_benchmark(void) {
+    if (session_active && session_brute_force_per_second > 0) {
+        brute_force_per_second = session_brute_force_per_second;
+        return;
+    }
+    brute_force_per_second = brute_force_benchmark();
+    if (session_active)
+        session_brute_force_per_second = brute_force_per_second;
+}
+
+// sets up the tables and acquires (or reads) the nonces of one target
+static int hardnested_prepare(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, bool nonce_file_read, bool nonce_file_write, bool slow, char *filename) {
+    char progress_text[80];
 
     memset(part_sum_count, 0, sizeof(part_sum_count));
     real_sum_a8 = 0;
+    start_time = msclock();
+    print_progress_header();
+    sprintf(progress_text, "Brute force benchmark: %1.0f million (2^%1.1f) keys/s", brute_force_per_second / 1000000, log(brute_force_per_second) / log(2.0));
+    hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
+    init_bitarrays();
+    init_allbitflips_array();
+    init_nonce_memory();
+    update_reduction_rate(0.0, true);
+
+    if (nonce_file_read) {  // use pre-acquired data from file nonces.bin
+        if (read_nonce_file(filename) != 0) {
+            free_target_memory();
+            return 3;
+        }
+        hardnested_stage = CHECK_1ST_BYTES | CHECK_2ND_BYTES;
+        update_nonce_data(false);
+        float brute_force_depth;
+        shrink_key_space(&brute_force_depth);
+    } else { // acquire nonces.
+        uint16_t is_OK = acquire_nonces(blockNo, keyType, key, trgBlockNo, trgKeyType, nonce_file_write, slow, filename);
+        if (is_OK != 0) {
+            free_target_memory();
+            return is_OK;
+        }
+    }
+    return 0;
+}
+
+// expected number of keys to test for the nonces acquired so far
+static float hardnested_expected_brute_force(void) {
+    uint32_t num_odd = nonces[best_first_byte_smallest_bitarray].num_states_bitarray[ODD_STATE];
+    uint32_t num_even = nonces[best_first_byte_smallest_bitarray].num_states_bitarray[EVEN_STATE];
+    return MIN((float)num_odd * num_even / 2.0, nonces[best_first_bytes[0]].expected_num_brute_force);
+}
+
+static int hardnested_target(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, uint64_t *foundkey, bool *key_found, char *filename) {
+    char progress_text[80];
+
+    int res = hardnested_prepare(blockNo, keyType, key, trgBlockNo, trgKeyType, nonce_file_read, nonce_file_write, slow, filename);
+    if (res != 0)
+        return res;
+
+    if (trgkey != NULL) {
+        known_target_key = bytes_to_num(trgkey, 6);
+        set_test_state(best_first_bytes[0]);
+    } else {
+        known_target_key = -1;
+    }
+
+    Tests();
+
+    // in a session the bitflip tables are needed for the next target
+    if (session_tables == false)
+        free_bitflip_bitarrays();
+    *key_found = false;
+    num_keys_tested = 0;
+    uint32_t num_odd = nonces[best_first_byte_smallest_bitarray].num_states_bitarray[ODD_STATE];
+    uint32_t num_even = nonces[best_first_byte_smallest_bitarray].num_states_bitarray[EVEN_STATE];
+    float expected_brute_force1 = (float)num_odd * num_even / 2.0;
+    float expected_brute_force2 = nonces[best_first_bytes[0]].expected_num_brute_force;
+
+    if (expected_brute_force1 < expected_brute_force2) {
+        hardnested_print_progress(num_acquired_nonces, "(Ignoring Sum(a8) properties)", expected_brute_force1, 0);
+        set_test_state(best_first_byte_smallest_bitarray);
+        add_bitflip_candidates(best_first_byte_smallest_bitarray);
+        Tests2();
+        maximum_states = 0;
+
+        for (statelist_t *sl = candidates; sl != NULL; sl = sl->next) {
+            maximum_states += (uint64_t)sl->len[ODD_STATE] * sl->len[EVEN_STATE];
+        }
+
+        best_first_bytes[0] = best_first_byte_smallest_bitarray;
+        pre_XOR_nonces();
+        prepare_bf_test_nonces(nonces, best_first_bytes[0]);
+
+        *key_found = brute_force(foundkey);
+        free(candidates->states[ODD_STATE]);
+        free(candidates->states[EVEN_STATE]);
+        free_candidates_memory(candidates);
+        candidates = NULL;
+    } else {
+
+        pre_XOR_nonces();
+        prepare_bf_test_nonces(nonces, best_first_bytes[0]);
+
+        for (uint8_t j = 0; j < NUM_SUMS && !*key_found; j++) {
+            float expected_brute_force = nonces[best_first_bytes[0]].expected_num_brute_force;
+            sprintf(progress_text, "(%d. guess: Sum(a8) = %" PRIu16 ")", j + 1, sums[nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx]);
+            hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
+
+            if (trgkey != NULL && sums[nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx] != real_sum_a8) {
+                sprintf(progress_text, "(Estimated Sum(a8) is WRONG! Correct Sum(a8) = %" PRIu16 ")", real_sum_a8);
+                hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
+            }
+
+            generate_candidates(first_byte_Sum, nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx);
+            *key_found = brute_force(foundkey);
+            free_statelist_cache();
+            free_candidates_memory(candidates);
+            candidates = NULL;
+            if (!*key_found) {
+                // update the statistics
+                nonces[best_first_bytes[0]].sum_a8_guess[j].prob = 0;
+                nonces[best_first_bytes[0]].sum_a8_guess[j].num_states = 0;
+                // and calculate new expected number of brute forces
+                update_expected_brute_force(best_first_bytes[0]);
+            }
+        }
+    }
+
+    free_target_memory();
+    return 0;
+
+}
+
+int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename) {
+    char progress_text[80];
+    PrintAndLogEx(SUCCESS, "Using %s SIMD core.", GetSIMDInstrName(GetSIMDInstrAuto()));
 
     srand((unsigned) time(NULL));
-    brute_force_per_second = brute_force_benchmark();
+    hardnested_benchmark();
     write_stats = false;
 
     if (tests) {
+
         // set the correct locale for the stats printing
         write_stats = true;
         setlocale(LC_NUMERIC, "");
@@ -2195,7 +2610,11 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             return 3;
         }
 
+        // all tests share the tables
+        hardnested_session_start();
         for (uint32_t i = 0; i < tests; i++) {
+            memset(part_sum_count, 0, sizeof(part_sum_count));
+            real_sum_a8 = 0;
             start_time = msclock();
             print_progress_header();
             sprintf(progress_text, "Brute force benchmark: %1.0f million (2^%1.1f) keys/s", brute_force_per_second / 1000000, log(brute_force_per_second) / log(2.0));
@@ -2209,9 +2628,7 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
                 known_target_key = -1;
             }
 
-            init_bitflip_bitarrays();
-            init_part_sum_bitarrays();
-            init_sum_bitarrays();
+            init_bitarrays();
             init_allbitflips_array();
             init_nonce_memory();
             update_reduction_rate(0.0, true);
@@ -2221,7 +2638,8 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
             set_test_state(best_first_bytes[0]);
 
             Tests();
-            free_bitflip_bitarrays();
+            if (session_tables == false)
+                free_bitflip_bitarrays();
 
             fprintf(fstats, "%" PRIu16 ";%1.1f;", sums[first_byte_Sum], log(p_K0[first_byte_Sum]) / log(2.0));
             fprintf(fstats, "%" PRIu16 ";%1.1f;", sums[nonces[best_first_bytes[0]].sum_a8_guess[0].sum_a8_idx], log(p_K[nonces[best_first_bytes[0]].sum_a8_guess[0].sum_a8_idx]) / log(2.0));
@@ -2298,124 +2716,99 @@ int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBloc
                    );
 #endif
 
-            free_nonces_memory();
-            free_bitarray(all_bitflips_bitarray[ODD_STATE]);
-            free_bitarray(all_bitflips_bitarray[EVEN_STATE]);
-            free_sum_bitarrays();
-            free_part_sum_bitarrays();
+            free_target_memory();
         }
+        hardnested_session_end();
         fclose(fstats);
     } else {
-        start_time = msclock();
-        print_progress_header();
-        sprintf(progress_text, "Brute force benchmark: %1.0f million (2^%1.1f) keys/s", brute_force_per_second / 1000000, log(brute_force_per_second) / log(2.0));
-        hardnested_print_progress(0, progress_text, (float)(1LL << 47), 0);
-        init_bitflip_bitarrays();
-        init_part_sum_bitarrays();
-        init_sum_bitarrays();
-        init_allbitflips_array();
-        init_nonce_memory();
-        update_reduction_rate(0.0, true);
-
-        if (nonce_file_read) {  // use pre-acquired data from file nonces.bin
-            if (read_nonce_file(filename) != 0) {
-                free_bitflip_bitarrays();
-                free_nonces_memory();
-                free_bitarray(all_bitflips_bitarray[ODD_STATE]);
-                free_bitarray(all_bitflips_bitarray[EVEN_STATE]);
-                free_sum_bitarrays();
-                free_part_sum_bitarrays();
-                return 3;
-            }
-            hardnested_stage = CHECK_1ST_BYTES | CHECK_2ND_BYTES;
-            update_nonce_data(false);
-            float brute_force_depth;
-            shrink_key_space(&brute_force_depth);
-        } else { // acquire nonces.
-            uint16_t is_OK = acquire_nonces(blockNo, keyType, key, trgBlockNo, trgKeyType, nonce_file_write, slow, filename);
-            if (is_OK != 0) {
-                free_bitflip_bitarrays();
-                free_nonces_memory();
-                free_bitarray(all_bitflips_bitarray[ODD_STATE]);
-                free_bitarray(all_bitflips_bitarray[EVEN_STATE]);
-                free_sum_bitarrays();
-                free_part_sum_bitarrays();
-                return is_OK;
-            }
-        }
-
-        if (trgkey != NULL) {
-            known_target_key = bytes_to_num(trgkey, 6);
-            set_test_state(best_first_bytes[0]);
-        } else {
-            known_target_key = -1;
-        }
-
-        Tests();
-
-        free_bitflip_bitarrays();
         bool key_found = false;
-        num_keys_tested = 0;
-        uint32_t num_odd = nonces[best_first_byte_smallest_bitarray].num_states_bitarray[ODD_STATE];
-        uint32_t num_even = nonces[best_first_byte_smallest_bitarray].num_states_bitarray[EVEN_STATE];
-        float expected_brute_force1 = (float)num_odd * num_even / 2.0;
-        float expected_brute_force2 = nonces[best_first_bytes[0]].expected_num_brute_force;
-
-        if (expected_brute_force1 < expected_brute_force2) {
-            hardnested_print_progress(num_acquired_nonces, "(Ignoring Sum(a8) properties)", expected_brute_force1, 0);
-            set_test_state(best_first_byte_smallest_bitarray);
-            add_bitflip_candidates(best_first_byte_smallest_bitarray);
-            Tests2();
-            maximum_states = 0;
-
-            for (statelist_t *sl = candidates; sl != NULL; sl = sl->next) {
-                maximum_states += (uint64_t)sl->len[ODD_STATE] * sl->len[EVEN_STATE];
-            }
+        return hardnested_target(blockNo, keyType, key, trgBlockNo, trgKeyType, trgkey, nonce_file_read, nonce_file_write, slow, foundkey, &key_found, filename);
+    }
+    return 0;
+}
 
-            best_first_bytes[0] = best_first_byte_smallest_bitarray;
-            pre_XOR_nonces();
-            prepare_bf_test_nonces(nonces, best_first_bytes[0]);
+// Attacks several sectors of the same card. The nonces of all targets are collected first, while the card is
+// in the field, then the targets are cracked cheapest first. The tables and the brute force benchmark are set
+// up once for the whole batch and every key found is tried on the targets still left.
+int mfnestedhard_batch(uint8_t blockNo, uint8_t keyType, uint8_t *key, hardnested_target_t *targets, uint8_t count, bool slow) {
+    uint8_t order[count];
+    int res = 0;
 
-            key_found = brute_force(foundkey);
-            free(candidates->states[ODD_STATE]);
-            free(candidates->states[EVEN_STATE]);
-            free_candidates_memory(candidates);
-            candidates = NULL;
-        } else {
+    PrintAndLogEx(SUCCESS, "Using %s SIMD core.", GetSIMDInstrName(GetSIMDInstrAuto()));
 
-            pre_XOR_nonces();
-            prepare_bf_test_nonces(nonces, best_first_bytes[0]);
+    hardnested_session_start();
+    srand((unsigned) time(NULL));
+    hardnested_benchmark();
+    write_stats = false;
+    known_target_key = -1;
+
+    for (uint8_t i = 0; i < count; i++) {
+        hardnested_target_t *t = &targets[i];
+        t->found = false;
+        t->key = 0;
+        t->expected_brute_force = 0;
+
+        PrintAndLogEx(INFO, "Acquiring nonces for target %u/%u, block %3u key %c", i + 1, count, t->blockno, t->keytype ? 'B' : 'A');
+        t->status = hardnested_prepare(blockNo, keyType, key, t->blockno, t->keytype, false, true, slow, t->filename);
+        if (t->status != 0) {
+            // no tag or aborted by the user, no point in going on with the other targets
+            res = t->status;
+            goto out;
+        }
+        t->expected_brute_force = hardnested_expected_brute_force();
+        free_target_memory();
+
+        // insert into the list of targets, sorted by expected brute force cost
+        uint8_t j = i;
+        for (; j > 0 && targets[order[j - 1]].expected_brute_force > t->expected_brute_force; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        hardnested_target_t *t = &targets[order[i]];
+        if (t->found)
+            continue;
+
+        PrintAndLogEx(INFO, "Cracking target %u/%u, block %3u key %c, expected brute force 2^%1.1f",
+                      i + 1, count, t->blockno, t->keytype ? 'B' : 'A', log(t->expected_brute_force) / log(2.0));
+        t->status = hardnested_target(blockNo, keyType, key, t->blockno, t->keytype, NULL, true, false, slow, &t->key, &t->found, t->filename);
+        if (t->found == false)
+            continue;
+
+        // sectors often share keys
+        uint8_t keyblock[6];
+        num_to_bytes(t->key, 6, keyblock);
+        for (uint8_t j = i + 1; j < count; j++) {
+            hardnested_target_t *other = &targets[order[j]];
+            if (other->found == false && mfCheckKeys(other->blockno, other->keytype, true, 1, keyblock, &other->key) == PM3_SUCCESS) {
+                PrintAndLogEx(SUCCESS, "Key for block %3u key %c is the same: %012" PRIx64, other->blockno, other->keytype ? 'B' : 'A', other->key);
+                other->found = true;
+                other->status = 0;
+            }
+        }
+    }
 
-            for (uint8_t j = 0; j < NUM_SUMS && !key_found; j++) {
-                float expected_brute_force = nonces[best_first_bytes[0]].expected_num_brute_force;
-                sprintf(progress_text, "(%d. guess: Sum(a8) = %" PRIu16 ")", j + 1, sums[nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx]);
-                hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
+out:
+    hardnested_session_end();
+    return res;
+}
 
-                if (trgkey != NULL && sums[nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx] != real_sum_a8) {
-                    sprintf(progress_text, "(Estimated Sum(a8) is WRONG! Correct Sum(a8) = %" PRIu16 ")", real_sum_a8);
-                    hardnested_print_progress(num_acquired_nonces, progress_text, expected_brute_force, 0);
-                }
+int mfnestedhard_benchmark(void) {
+    // restored afterwards, a forced instruction set stays forced
+    SIMDExecInstr setting = GetSIMDInstrSetting();
+    SIMDExecInstr selected = GetSIMDInstrAuto();
 
-                generate_candidates(first_byte_Sum, nonces[best_first_bytes[0]].sum_a8_guess[j].sum_a8_idx);
-                key_found = brute_force(foundkey);
-                free_statelist_cache();
-                free_candidates_memory(candidates);
-                candidates = NULL;
-                if (!key_found) {
-                    // update the statistics
-                    nonces[best_first_bytes[0]].sum_a8_guess[j].prob = 0;
-                    nonces[best_first_bytes[0]].sum_a8_guess[j].num_states = 0;
-                    // and calculate new expected number of brute forces
-                    update_expected_brute_force(best_first_bytes[0]);
-                }
-            }
-        }
+    PrintAndLogEx(INFO, "Brute force benchmark, %d threads", num_CPUs());
+    for (SIMDExecInstr instr = SIMD_AUTO + 1; instr <= SIMD_NONE; instr++) {
+        if (SIMDInstrSupported(instr) == false)
+            continue;
 
-        free_nonces_memory();
-        free_bitarray(all_bitflips_bitarray[ODD_STATE]);
-        free_bitarray(all_bitflips_bitarray[EVEN_STATE]);
-        free_sum_bitarrays();
-        free_part_sum_bitarrays();
+        SetSIMDInstr(instr);
+        float rate = brute_force_benchmark();
+        PrintAndLogEx(SUCCESS, "  %-8s %6.0f million (2^%1.1f) keys/s%s", GetSIMDInstrName(instr), rate / 1000000, log(rate) / log(2.0),
+                      instr == selected ? "  <- selected" : "");
     }
-    return 0;
+    SetSIMDInstr(setting);
+    return PM3_SUCCESS;
 }
@@ -12,8 +12,25 @@
 #define CMDHFMFHARD_H__
 
 #include "common.h"
+#include "util.h"       // FILE_PATH_SIZE
+
+#define HARDNESTED_MAX_TARGETS  80      // both keys of all sectors of a 4K card
+
+typedef struct {
+    uint8_t blockno;
+    uint8_t keytype;
+    char filename[FILE_PATH_SIZE];  // nonces of this target
+    float expected_brute_force;
+    int status;                     // mfnestedhard() return value
+    bool found;
+    uint64_t key;
+} hardnested_target_t;
 
 int mfnestedhard(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *trgkey, bool nonce_file_read, bool nonce_file_write, bool slow, int tests, uint64_t *foundkey, char *filename);
+int mfnestedhard_batch(uint8_t blockNo, uint8_t keyType, uint8_t *key, hardnested_target_t *targets, uint8_t count, bool slow);
+int mfnestedhard_benchmark(void);
+void hardnested_session_start(void);
+void hardnested_session_end(void);
 void hardnested_print_progress(uint32_t nonces, const char *activity, float brute_force, uint64_t min_diff_print_time);
 
 #endif
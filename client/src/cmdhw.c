@@ -651,6 +651,8 @@ static int CmdStatus(const char *Cmd) {
         PrintAndLogEx(WARNING, "Status command timeout. Communication speed test timed out");
         return PM3_ETIMEOUT;
     }
+    PrintCommandLatency();
+    PrintReplyQueueStats();
     return PM3_SUCCESS;
 }
 
@@ -17,6 +17,7 @@
 #include <string.h>
 #include <limits.h>
 #include <ctype.h>
+#include <pthread.h>
 #include "cmdparser.h"      // command_t
 #include "comms.h"
 #include "commonutil.h"     // ARRAYLEN
@@ -26,6 +27,11 @@
 #include "cliparser.h"      // args parsing
 #include "graph.h"          // for graph data
 #include "cmddata.h"        // for `lf search`
+#include "util.h"           // num_CPUs
+#include "util_posix.h"     // msclock
+#include "fileutils.h"      // FILE_PATH_SIZE
+#include "scandir.h"
+#include "jansson.h"
 #include "cmdlfawid.h"      // for awid menu
 #include "cmdlfem.h"        // for em menu
 #include "cmdlfem410x.h"      // for em4x menu
@@ -1403,6 +1409,496 @@ out:
     return retval;
 }
 
+// known tags for `lf search`, in priority order.  The first that decodes wins
+static const struct {
+    int (*demod)(bool verbose);
+    const char *name;
+} lf_search_demods[] = {
+    {demodVisa2k,    "Visa2000 ID"},
+    {demodDestron,   "FDX-A FECAVA Destron ID"}, // to do before HID
+    {demodHID,       "HID Prox ID"},
+    {demodAWID,      "AWID ID"},
+    {demodIOProx,    "IO Prox ID"},
+    {demodParadox,   "Paradox ID"},
+    {demodNexWatch,  "NexWatch ID"},
+    {demodIndala,    "Indala ID"},
+    {demodEM410x,    "EM410x ID"},
+    {demodFDXB,      "FDX-B ID"},
+    {demodGuard,     "Guardall G-Prox II ID"},
+    {demodIdteck,    "Idteck ID"},
+    {demodJablotron, "Jablotron ID"},
+    {demodNedap,     "NEDAP ID"},
+    {demodNoralsy,   "Noralsy ID"},
+    {demodKeri,      "KERI ID"},
+    {demodPac,       "PAC/Stanley ID"},
+    {demodPresco,    "Presco ID"},
+    {demodPyramid,   "Pyramid ID"},
+    {demodSecurakey, "Securakey ID"},
+    {demodViking,    "Viking ID"},
+    {demodGallagher, "GALLAGHER ID"},
+//    {demodTI,        "Texas Instrument ID"},
+//    {demodFermax,    "Fermax ID"},
+};
+
+// stack of the lf search workers
+#define LF_SEARCH_STACK_SIZE (8 * 1024 * 1024)
+
+typedef struct {
+    const demod_ctx_t *src;   // the plot window's samples, read only meanwhile
+    uint32_t next;            // next demod to try
+    uint32_t found;           // lowest demod that decoded so far
+    printCapture_t out[ARRAYLEN(lf_search_demods)];
+} lf_search_t;
+
+typedef struct {
+    lf_search_t *s;
+    demod_ctx_t *ctx;
+} lf_search_thread_t;
+
+static void *lf_search_thread(void *arg) {
+    lf_search_thread_t *t = (lf_search_thread_t *)arg;
+    lf_search_t *s = t->s;
+    demod_ctx_t *prev = demod_ctx_set(t->ctx);
+
+    for (;;) {
+        uint32_t i = __atomic_fetch_add(&s->next, 1, __ATOMIC_SEQ_CST);
+        if (i >= ARRAYLEN(lf_search_demods))
+            break;
+
+        // one with higher priority decoded already
+        if (i > __atomic_load_n(&s->found, __ATOMIC_SEQ_CST))
+            break;
+
+        demod_ctx_copy(t->ctx, s->src);
+
+        PrintAndLogCapture(&s->out[i]);
+        int res = lf_search_demods[i].demod(true);
+        PrintAndLogCapture(NULL);
+
+        if (res == PM3_SUCCESS) {
+            uint32_t found = __atomic_load_n(&s->found, __ATOMIC_SEQ_CST);
+            while (i < found && __atomic_compare_exchange_n(&s->found, &found, i, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) == false) {};
+        }
+    }
+
+    demod_ctx_set(prev);
+    return NULL;
+}
+
+// detect clock and carrier once on the plot window's samples, the demods then find them in the graph cache
+static void lf_search_prepare(demod_ctx_t *ctx) {
+    demod_ctx_t *prev = demod_ctx_set(ctx);
+    demod_ctx_copy(ctx, prev);
+
+    printCapture_t quiet = {0};
+    PrintAndLogCapture(&quiet);
+    GetAskClock("", false);
+    GetPskCarrier(false);
+    GetPskClock("", false);
+    GetNrzClock("", false);
+    GetFskClock("", false);
+    PrintAndLogCapture(NULL);
+    free(quiet.buf);
+
+    demod_ctx_set(prev);
+}
+
+// runs the known tag demods, concurrently when there are several CPUs.
+// Prints in priority order as if they ran one after another, returns true if one decoded
+static bool lf_search_known(void) {
+
+    const uint32_t n = ARRAYLEN(lf_search_demods);
+
+    int threads = num_CPUs();
+    if (threads > (int)n)
+        threads = n;
+
+    // every demod starts from the plot window's samples and an empty demod buffer,
+    // whatever ran before it, so the result doesn't depend on the number of threads
+    lf_search_thread_t t[ARRAYLEN(lf_search_demods)];
+    int ctxs = 0;
+    while (ctxs < threads) {
+        t[ctxs].ctx = demod_ctx_new();
+        if (t[ctxs].ctx == NULL)
+            break;
+        ctxs++;
+    }
+
+    if (ctxs == 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (lf_search_demods[i].demod(true) == PM3_SUCCESS) {
+                PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("%s") " found!", lf_search_demods[i].name);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // with debug output the cache is bypassed anyway
+    if (g_debugMode == 0)
+        lf_search_prepare(t[0].ctx);
+
+    lf_search_t *s = calloc(1, sizeof(lf_search_t));
+    if (s == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        for (int i = 0; i < ctxs; i++)
+            demod_ctx_free(t[i].ctx);
+        return false;
+    }
+    s->src = g_demod;
+    s->found = n;
+
+    pthread_t thread_ids[ARRAYLEN(lf_search_demods)];
+    for (int i = 0; i < ctxs; i++)
+        t[i].s = s;
+
+    // the demods are deep, don't depend on the platform's default thread stack size
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, LF_SEARCH_STACK_SIZE);
+    for (int i = 1; i < ctxs; i++) {
+        if (pthread_create(&thread_ids[i], &attr, lf_search_thread, &t[i]))
+            t[i].s = NULL;
+    }
+    pthread_attr_destroy(&attr);
+
+    lf_search_thread(&t[0]);
+
+    for (int i = 1; i < ctxs; i++) {
+        if (t[i].s)
+            pthread_join(thread_ids[i], NULL);
+    }
+
+    PrintAndLogEx(DEBUG, "lf search used %d thread(s)", ctxs);
+
+    for (int i = 0; i < ctxs; i++)
+        demod_ctx_free(t[i].ctx);
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (i < s->found)
+            PrintAndLogReplay(&s->out[i]);
+        else
+            free(s->out[i].buf);
+    }
+
+    // the winner once more on the plot window's samples, for its output and demod buffer
+    bool found = false;
+    if (s->found < n) {
+        if (lf_search_demods[s->found].demod(true) == PM3_SUCCESS) {
+            PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("%s") " found!", lf_search_demods[s->found].name);
+            found = true;
+        }
+    }
+    free(s);
+    return found;
+}
+
+// `lf search` over a number of captures, each decoded on its own by a pool of threads
+typedef struct {
+    char **files;
+    uint32_t count;
+    uint32_t next;            // next file to decode
+    char **lines;             // JSON line per file, printed in order
+    uint32_t printed;
+    uint32_t decoded;
+    uint64_t samples;
+    FILE *out;
+    pthread_mutex_t lock;
+} lf_batch_t;
+
+// bits of the demod buffer kept in the JSON line
+#define LF_BATCH_RAW_BITS 512
+
+// plain hex of the first LF_BATCH_RAW_BITS bits of a demod buffer, the last nibble zero padded.
+// Returns the number of bits, 0 when the buffer holds anything but bits.
+static size_t lf_batch_raw_hex(char *hex, const uint8_t *demod, size_t len) {
+    if (len > LF_BATCH_RAW_BITS)
+        len = LF_BATCH_RAW_BITS;
+
+    for (size_t i = 0; i < len; i++) {
+        if (demod[i] > 1)
+            return 0;
+    }
+
+    for (size_t i = 0; i < len; i += 4) {
+        uint8_t nibble = 0;
+        for (size_t j = 0; j < 4; j++)
+            nibble = (nibble << 1) | ((i + j < len) ? demod[i + j] : 0);
+        hex[i / 4] = "0123456789ABCDEF"[nibble];
+    }
+    hex[(len + 3) / 4] = '\0';
+    return len;
+}
+
+// fills in the JSON object of a capture with the winner, its demod buffer and what it printed
+static void lf_batch_file(json_t *root, const char *fn, demod_ctx_t *src, demod_ctx_t *scratch, lf_batch_t *b) {
+
+    json_object_set_new(root, "file", json_string(fn));
+
+    // what the loader has to say goes into the JSON line, not between the lines
+    printCapture_t cap = {0};
+    PrintAndLogCapture(&cap);
+    demod_ctx_t *prev = demod_ctx_set(src);
+    int res = loadGraphFile(fn, false);
+    size_t samples = GraphTraceLen;
+    demod_ctx_set(prev);
+    PrintAndLogCapture(NULL);
+
+    if (res != PM3_SUCCESS) {
+        char clean[MAX_PRINT_BUFFER] = "couldn't load file";
+        size_t pos = 0;
+        logLevel_t level;
+        const char *msg;
+        while (PrintAndLogCaptured(&cap, &pos, &level, &msg)) {
+            if (level == WARNING || level == ERR || level == FAILED) {
+                memcpy_filter_ansi(clean, msg, strlen(msg) + 1, true);
+                break;
+            }
+        }
+        json_object_set_new(root, "error", json_string(clean));
+        free(cap.buf);
+        return;
+    }
+    free(cap.buf);
+
+    json_object_set_new(root, "samples", json_integer(samples));
+    __atomic_add_fetch(&b->samples, samples, __ATOMIC_SEQ_CST);
+
+    if (samples < 2000) {
+        json_object_set_new(root, "error", json_string("too few samples"));
+        return;
+    }
+
+    lf_search_t *s = calloc(1, sizeof(lf_search_t));
+    if (s == NULL) {
+        json_object_set_new(root, "error", json_string("out of memory"));
+        return;
+    }
+    s->src = src;
+    s->found = ARRAYLEN(lf_search_demods);
+
+    lf_search_thread_t t = { .s = s, .ctx = scratch };
+    lf_search_thread(&t);
+
+    if (s->found < ARRAYLEN(lf_search_demods)) {
+        json_object_set_new(root, "tag", json_string(lf_search_demods[s->found].name));
+        __atomic_add_fetch(&b->decoded, 1, __ATOMIC_SEQ_CST);
+
+        // the scratch context holds the winner's demod buffer
+        char hex[LF_BATCH_RAW_BITS / 4 + 1] = {0x00};
+        size_t bits = lf_batch_raw_hex(hex, scratch->demod, scratch->demod_len);
+        if (bits) {
+            json_object_set_new(root, "raw", json_string(hex));
+            json_object_set_new(root, "raw_bits", json_integer(bits));
+        }
+
+        json_t *lines = json_array();
+        size_t pos = 0;
+        logLevel_t level;
+        const char *msg;
+        while (PrintAndLogCaptured(&s->out[s->found], &pos, &level, &msg)) {
+            if (level != SUCCESS)
+                continue;
+
+            char clean[MAX_PRINT_BUFFER] = {0};
+            memcpy_filter_ansi(clean, msg, strlen(msg) + 1, true);
+            char *start = clean;
+            while (*start == '\n')
+                start++;
+            if (*start)
+                json_array_append_new(lines, json_string(start));
+        }
+        json_object_set_new(root, "lines", lines);
+    } else {
+        json_object_set_new(root, "tag", json_null());
+    }
+
+    for (uint32_t i = 0; i < ARRAYLEN(lf_search_demods); i++)
+        free(s->out[i].buf);
+    free(s);
+}
+
+static void lf_batch_print(lf_batch_t *b, const char *line) {
+    if (b->out)
+        fprintf(b->out, "%s\n", line);
+    else
+        PrintAndLogEx(NORMAL, "%s", line);
+}
+
+static void *lf_batch_thread(void *arg) {
+    lf_batch_t *b = (lf_batch_t *)arg;
+
+    demod_ctx_t *src = demod_ctx_new();
+    demod_ctx_t *scratch = demod_ctx_new();
+
+    while (src && scratch) {
+        uint32_t i = __atomic_fetch_add(&b->next, 1, __ATOMIC_SEQ_CST);
+        if (i >= b->count)
+            break;
+
+        char *line = NULL;
+        json_t *root = json_object();
+        if (root) {
+            lf_batch_file(root, b->files[i], src, scratch, b);
+            line = json_dumps(root, JSON_COMPACT | JSON_PRESERVE_ORDER);
+            json_decref(root);
+        }
+
+        pthread_mutex_lock(&b->lock);
+        b->lines[i] = (line) ? line : strdup("{}");
+        while (b->printed < b->count && b->lines[b->printed]) {
+            lf_batch_print(b, b->lines[b->printed]);
+            free(b->lines[b->printed]);
+            b->lines[b->printed] = NULL;
+            b->printed++;
+        }
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    demod_ctx_free(src);
+    demod_ctx_free(scratch);
+    return NULL;
+}
+
+static int lf_batch_add(lf_batch_t *b, const char *fn) {
+    char **tmp = realloc(b->files, (b->count + 1) * sizeof(char *));
+    if (tmp == NULL)
+        return PM3_EMALLOC;
+
+    b->files = tmp;
+    b->files[b->count] = strdup(fn);
+    if (b->files[b->count] == NULL)
+        return PM3_EMALLOC;
+
+    b->count++;
+    return PM3_SUCCESS;
+}
+
+// the .pm3 and .pm3b captures of a directory
+static int lf_batch_add_dir(lf_batch_t *b, const char *dir) {
+    struct dirent **namelist;
+    int n = scandir(dir, &namelist, NULL, alphasort);
+    if (n == -1) {
+        PrintAndLogEx(WARNING, "couldn't read directory " _YELLOW_("%s"), dir);
+        return PM3_EFILE;
+    }
+
+    int res = PM3_SUCCESS;
+    for (int i = 0; i < n; i++) {
+        if (res == PM3_SUCCESS && (str_endswith(namelist[i]->d_name, ".pm3") || str_endswith(namelist[i]->d_name, ".pm3b"))) {
+            char fn[FILE_PATH_SIZE] = {0};
+            snprintf(fn, sizeof(fn), "%s/%s", dir, namelist[i]->d_name);
+            res = lf_batch_add(b, fn);
+        }
+        free(namelist[i]);
+    }
+    free(namelist);
+    return res;
+}
+
+// the captures in a file, one per line
+static int lf_batch_add_list(lf_batch_t *b, const char *list) {
+    FILE *f = fopen(list, "r");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "couldn't open " _YELLOW_("%s"), list);
+        return PM3_EFILE;
+    }
+
+    int res = PM3_SUCCESS;
+    char line[FILE_PATH_SIZE];
+    while (res == PM3_SUCCESS && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        res = lf_batch_add(b, line);
+    }
+    fclose(f);
+    return res;
+}
+
+static int lf_search_batch(const char *dir, const char *list, const char *outfn) {
+    lf_batch_t *b = calloc(1, sizeof(lf_batch_t));
+    if (b == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    int res = PM3_SUCCESS;
+    if (strlen(dir))
+        res = lf_batch_add_dir(b, dir);
+    if (res == PM3_SUCCESS && strlen(list))
+        res = lf_batch_add_list(b, list);
+
+    if (res == PM3_SUCCESS && b->count == 0) {
+        PrintAndLogEx(FAILED, "No captures found");
+        res = PM3_EINVARG;
+    }
+
+    if (res == PM3_SUCCESS) {
+        b->lines = calloc(b->count, sizeof(char *));
+        if (b->lines == NULL)
+            res = PM3_EMALLOC;
+    }
+
+    if (res == PM3_SUCCESS && strlen(outfn)) {
+        b->out = fopen(outfn, "w");
+        if (b->out == NULL) {
+            PrintAndLogEx(WARNING, "couldn't create " _YELLOW_("%s"), outfn);
+            res = PM3_EFILE;
+        }
+    }
+
+    if (res == PM3_SUCCESS) {
+        int threads = num_CPUs();
+        if (threads > (int)b->count)
+            threads = b->count;
+
+        pthread_mutex_init(&b->lock, NULL);
+        pthread_t thread_ids[threads];
+        int started = 0;
+        // the same deep demods as lf search
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstacksize(&attr, LF_SEARCH_STACK_SIZE);
+        for (int i = 1; i < threads; i++) {
+            if (pthread_create(&thread_ids[started], &attr, lf_batch_thread, b) == 0)
+                started++;
+        }
+        pthread_attr_destroy(&attr);
+
+        uint64_t t1 = msclock();
+        lf_batch_thread(b);
+        for (int i = 0; i < started; i++)
+            pthread_join(thread_ids[i], NULL);
+        uint64_t elapsed = msclock() - t1;
+        pthread_mutex_destroy(&b->lock);
+
+        if (b->printed < b->count) {
+            PrintAndLogEx(FAILED, "Failed to allocate memory");
+            res = PM3_EMALLOC;
+        }
+
+        double secs = (elapsed) ? elapsed / 1000.0 : 0.001;
+        PrintAndLogEx(NORMAL, "");
+        PrintAndLogEx(SUCCESS, "decoded " _YELLOW_("%u") " of " _YELLOW_("%u") " captures in %" PRIu64 " ms, %d thread(s)", b->decoded, b->count, elapsed, started + 1);
+        PrintAndLogEx(SUCCESS, "%.1f files/s, %.0f samples/s", b->count / secs, b->samples / secs);
+        if (b->out)
+            PrintAndLogEx(SUCCESS, "saved to " _YELLOW_("%s"), outfn);
+    }
+
+    if (b->out)
+        fclose(b->out);
+    for (uint32_t i = 0; i < b->count; i++) {
+        free(b->files[i]);
+        if (b->lines)
+            free(b->lines[i]);
+    }
+    free(b->files);
+    free(b->lines);
+    free(b);
+    return res;
+}
+
 int CmdLFfind(const char *Cmd) {
 
     CLIParserContext *ctx;
@@ -1412,19 +1908,36 @@ int CmdLFfind(const char *Cmd) {
                   "lf search -1    -> use data from GraphBuffer & search for known tag\n"
                   "lf search -u    -> try reading data from tag & search for known and unknown tag\n"
                   "lf search -1u   -> use data from GraphBuffer & search for known and unknown tag\n"
+                  "lf search -d traces              -> search known tags in each capture of a directory, JSON line per file\n"
+                  "lf search -l list.txt -o out.json -> search known tags in each capture listed in a file, save JSON lines\n"
                  );
 
     void *argtable[] = {
         arg_param_begin,
         arg_lit0("1", NULL, "Use data from Graphbuffer to search"),
         arg_lit0("u", NULL, "Search for unknown tags, if not set, reads only known tags"),
+        arg_str0("d", "dir", "<dir>", "Search the .pm3/.pm3b captures of a directory"),
+        arg_str0("l", "list", "<fn>", "Search the captures listed in a file, one per line"),
+        arg_str0("o", "out", "<fn>", "Save the JSON lines of -d / -l to a file"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, true);
     bool use_gb = arg_get_lit(ctx, 1);
     bool search_unk = arg_get_lit(ctx, 2);
+
+    int dlen = 0, llen = 0, olen = 0;
+    char dir[FILE_PATH_SIZE] = {0};
+    char list[FILE_PATH_SIZE] = {0};
+    char outfn[FILE_PATH_SIZE] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 3), (uint8_t *)dir, FILE_PATH_SIZE, &dlen);
+    CLIParamStrToBuf(arg_get_str(ctx, 4), (uint8_t *)list, FILE_PATH_SIZE, &llen);
+    CLIParamStrToBuf(arg_get_str(ctx, 5), (uint8_t *)outfn, FILE_PATH_SIZE, &olen);
     CLIParserFree(ctx);
 
+    // offline, the graph stays as it is
+    if (dlen || llen)
+        return lf_search_batch(dir, list, outfn);
+
     bool is_online = (session.pm3_present && (use_gb == false));
     if (is_online)
         lf_read(false, 30000);
@@ -1486,31 +1999,8 @@ int CmdLFfind(const char *Cmd) {
 
     int retval = PM3_SUCCESS;
 
-    if (demodVisa2k(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Visa2000 ID") " found!"); goto out;}
-    if (demodDestron(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("FDX-A FECAVA Destron ID") " found!"); goto out;} // to do before HID
-    if (demodHID(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("HID Prox ID") " found!"); goto out;}
-    if (demodAWID(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("AWID ID") " found!"); goto out;}
-    if (demodIOProx(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("IO Prox ID") " found!"); goto out;}
-    if (demodParadox(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Paradox ID") " found!"); goto out;}
-    if (demodNexWatch(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NexWatch ID") " found!"); goto out;}
-    if (demodIndala(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Indala ID") " found!");  goto out;}
-    if (demodEM410x(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("EM410x ID") " found!"); goto out;}
-    if (demodFDXB(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("FDX-B ID") " found!"); goto out;}
-    if (demodGuard(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Guardall G-Prox II ID") " found!"); goto out; }
-    if (demodIdteck(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Idteck ID") " found!"); goto out;}
-    if (demodJablotron(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Jablotron ID") " found!"); goto out;}
-    if (demodNedap(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("NEDAP ID") " found!"); goto out;}
-    if (demodNoralsy(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Noralsy ID") " found!"); goto out;}
-    if (demodKeri(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("KERI ID") " found!"); goto out;}
-    if (demodPac(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("PAC/Stanley ID") " found!"); goto out;}
-    if (demodPresco(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Presco ID") " found!"); goto out;}
-    if (demodPyramid(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Pyramid ID") " found!"); goto out;}
-    if (demodSecurakey(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Securakey ID") " found!"); goto out;}
-    if (demodViking(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Viking ID") " found!"); goto out;}
-    if (demodGallagher(true) == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("GALLAGHER ID") " found!"); goto out;}
-
-//    if (demodTI() == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Texas Instrument ID") " found!"); goto out;}
-//    if (demodFermax() == PM3_SUCCESS) { PrintAndLogEx(SUCCESS, "\nValid " _GREEN_("Fermax ID") " found!"); goto out;}
+    if (lf_search_known())
+        goto out;
 
     PrintAndLogEx(FAILED, _RED_("No known 125/134 kHz tags found!"));
 
@@ -253,7 +253,9 @@ int AskEm410xDecode(bool verbose, uint32_t *hi, uint64_t *lo) {
     }
 
     printEM410x(*hi, *lo, verbose);
-    g_em410xid = *lo;
+    // remembered for the plot window's samples only, not for lf search workers
+    if (g_demod->plot)
+        g_em410xid = *lo;
     return PM3_SUCCESS;
 }
 
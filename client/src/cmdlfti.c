@@ -250,7 +250,6 @@ int demodTI(bool verbose) {
             (shift1 >> 16) & 0xFF,
             (shift1 >> 24) & 0xFF
         };
-        init_table(CRC_KERMIT);
         uint16_t calccrc = crc16_kermit(raw, sizeof(raw));
         const char *crc_str = (calccrc == (shift2 & 0xFFFF)) ? _GREEN_("ok") : _RED_("fail");
         PrintAndLogEx(INFO, "Tag data = %08X%08X  [%04X] (%s)", shift1, shift0, calccrc, crc_str);
@@ -318,10 +318,18 @@ static int CmdHelp(const char *Cmd) {
 // Entry point into our code: called whenever the user types a command and
 // then presses Enter, which the full command line that they typed.
 //-----------------------------------------------------------------------------
+// the command line being run, recorded with samples acquired by it
+static char current_command[128];
+
 int CommandReceived(char *Cmd) {
+    strncpy(current_command, Cmd, sizeof(current_command) - 1);
     return CmdsParse(CommandTable, Cmd);
 }
 
+const char *getCurrentCommand(void) {
+    return current_command;
+}
+
 command_t *getTopLevelCommandTable(void) {
     return CommandTable;
 }
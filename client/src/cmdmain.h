@@ -15,6 +15,7 @@
 #include "cmdparser.h"    // command_t
 
 int CommandReceived(char *Cmd);
+const char *getCurrentCommand(void);
 int CmdRem(const char *Cmd);
 command_t *getTopLevelCommandTable(void);
 
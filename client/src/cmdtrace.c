@@ -10,6 +10,11 @@
 #include "cmdtrace.h"
 
 #include <ctype.h>
+#include <stdarg.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #include "cmdparser.h"    // command_t
 #include "protocols.h"
@@ -22,6 +27,8 @@
 #include "cmdlfhitag.h"         // annotate hitag
 #include "pm3_cmd.h"            // tracelog_hdr_t
 #include "cliparser.h"          // args..
+#include "util.h"               // num_CPUs
+#include "util_posix.h"         // msclock
 
 static int CmdHelp(const char *Cmd);
 
@@ -29,16 +36,65 @@ static int CmdHelp(const char *Cmd);
 static uint8_t *g_trace;
 static long g_traceLen = 0;
 
-static bool is_last_record(uint16_t tracepos, uint16_t traceLen) {
+// Index of the records of the trace.  Built when a trace is downloaded or loaded, or
+// mapped from a trace container file (see `trace save --index`), so listing a time window
+// or the frames of one command byte only visits the records shown.
+//
+// container file:
+//   trace_container_hdr_t | trace_record_t[records] | uint32_t cmd_start[257] | uint32_t cmd_list[commands] | trace
+#define TRACE_CONTAINER_MAGIC       "PM3TRIDX"
+#define TRACE_CONTAINER_VERSION     1
+
+#define TRACE_NO_PROTOCOL           0xFF
+#define TRACE_CRC_UNKNOWN           0xFF
+
+#define TRACE_RECORD_RESPONSE       0x01
+#define TRACE_INDEX_SORTED          0x01    // timestamps never decrease
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t records;
+    uint32_t commands;
+    uint32_t trace_len;
+    uint8_t protocol;       // of the crc status of the records
+    uint8_t flags;
+    uint8_t reserved[2];
+} PACKED trace_container_hdr_t;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t timestamp;
+    uint16_t data_len;
+    uint8_t flags;
+    uint8_t crc;            // crc status of trace list, for the protocol of the index
+} PACKED trace_record_t;
+
+typedef struct {
+    trace_record_t *records;
+    uint32_t count;
+    // the reader records starting with byte c are cmd_list[cmd_start[c] .. cmd_start[c + 1] - 1]
+    uint32_t *cmd_start;
+    uint32_t *cmd_list;
+    uint8_t protocol;
+    uint8_t flags;
+    bool owned;             // arrays allocated, not in a mapped container
+} trace_index_t;
+
+static trace_index_t g_trace_index;
+static uint8_t *g_trace_map = NULL;     // mapped container holding g_trace
+static size_t g_trace_map_len = 0;
+
+static bool is_last_record(uint32_t tracepos, uint32_t traceLen) {
     return ((tracepos + TRACELOG_HDR_LEN) >= traceLen);
 }
 
-static bool next_record_is_response(uint16_t tracepos, uint8_t *trace) {
+static bool next_record_is_response(uint32_t tracepos, uint8_t *trace) {
     tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
     return (hdr->isResponse);
 }
 
-static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t *tracepos, uint16_t traceLen,
+static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint32_t *tracepos, uint32_t traceLen,
                                       uint8_t *trace, uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len) {
 
 #define MAX_TOPAZ_READER_CMD_LEN 16
@@ -72,7 +128,7 @@ static bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, ui
     return true;
 }
 
-static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol) {
+static uint32_t printHexLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol) {
     // sanity check
     if (is_last_record(tracepos, traceLen)) return traceLen;
 
@@ -90,7 +146,7 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
         return tracepos;
     }
 
-    uint16_t ret;
+    uint32_t ret;
 
     switch (protocol) {
         case ISO_14443A: {
@@ -133,57 +189,30 @@ static uint16_t printHexLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trac
     return ret;
 }
 
-static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes, uint32_t *prev_eot, bool use_us, 
-                               const uint64_t *mfDicKeys, uint32_t mfDicKeysCount) {
-    // sanity check
-    if (is_last_record(tracepos, traceLen)) {
-        PrintAndLogEx(DEBUG, "last record triggered.  t-pos: %u  t-len %u", tracepos, traceLen);
-        return traceLen;
-    }
-
-    uint32_t end_of_transmission_timestamp = 0;
-    uint32_t duration;
-    uint16_t data_len;
-    uint8_t topaz_reader_command[9];
-    char explanation[40] = {0};
-    uint8_t mfData[32] = {0};
-    size_t mfDataLen = 0;
-    tracelog_hdr_t *first_hdr = (tracelog_hdr_t *)(trace);
-    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
-
-    duration = hdr->duration;
-    data_len = hdr->data_len;
+// silent pass over a MIFARE trace, recovers the keys of all its authentications up front
+static void mfTraceRecoverKeys(uint32_t traceLen, uint8_t *trace, const uint64_t *mfDicKeys, uint32_t mfDicKeysCount) {
+    uint32_t tracepos = 0;
 
-    if (tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
-        PrintAndLogEx(DEBUG, "trace pos offset %"PRIu64 " larger than reported tracelen %u", tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr), traceLen);
-        return traceLen;
-    }
+    mfTraceAuthCollectStart();
+    while (is_last_record(tracepos, traceLen) == false) {
+        tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
+        uint16_t data_len = hdr->data_len;
+        if (tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > traceLen)
+            break;
 
-    // adjust for different time scales
-    if (protocol == ICLASS || protocol == ISO_15693) {
-        duration *= 32;
-    }
-
-    uint8_t *frame = hdr->frame;
-    uint8_t *parityBytes = hdr->frame + data_len;
-
-    tracepos += TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr);
-
-    if (protocol == TOPAZ && !hdr->isResponse) {
-        // topaz reader commands come in 1 or 9 separate frames with 7 or 8 Bits each.
-        // merge them:
-        if (merge_topaz_reader_frames(hdr->timestamp, &duration, &tracepos, traceLen, trace, frame, topaz_reader_command, &data_len)) {
-            frame = topaz_reader_command;
-        }
+        mfTraceAuthCollect(hdr->frame, data_len, hdr->frame + data_len, hdr->isResponse);
+        tracepos += TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr);
     }
+    mfTraceAuthCollectEnd(mfDicKeys, mfDicKeysCount);
+}
 
-    //Check the CRC status
+static uint8_t trace_crc_status(uint8_t protocol, bool isResponse, uint8_t *frame, uint16_t data_len) {
     uint8_t crcStatus = 2;
 
     if (data_len > 2) {
         switch (protocol) {
             case ICLASS:
-                crcStatus = iclass_CRC_check(hdr->isResponse, frame, data_len);
+                crcStatus = iclass_CRC_check(isResponse, frame, data_len);
                 break;
             case ISO_14443B:
             case TOPAZ:
@@ -193,15 +222,15 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
                 crcStatus = !felica_CRC_check(frame + 2, data_len - 4);
                 break;
             case PROTO_MIFARE:
-                crcStatus = mifare_CRC_check(hdr->isResponse, frame, data_len);
+                crcStatus = mifare_CRC_check(isResponse, frame, data_len);
                 break;
             case ISO_14443A:
             case MFDES:
             case LTO:
-                crcStatus = iso14443A_CRC_check(hdr->isResponse, frame, data_len);
+                crcStatus = iso14443A_CRC_check(isResponse, frame, data_len);
                 break;
             case ISO_7816_4:
-                crcStatus = iso14443A_CRC_check(hdr->isResponse, frame, data_len) == 1 ? 3 : 0;
+                crcStatus = iso14443A_CRC_check(isResponse, frame, data_len) == 1 ? 3 : 0;
                 crcStatus = iso14443B_CRC_check(frame, data_len) == 1 ? 4 : crcStatus;
                 break;
             case THINFILM:
@@ -224,6 +253,403 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
                 break;
         }
     }
+    return crcStatus;
+}
+
+static void trace_index_free(void) {
+    if (g_trace_index.owned) {
+        free(g_trace_index.records);
+        free(g_trace_index.cmd_start);
+        free(g_trace_index.cmd_list);
+    }
+    memset(&g_trace_index, 0, sizeof(g_trace_index));
+}
+
+// drops the trace, allocated or in a mapped container
+static void trace_free(void) {
+    trace_index_free();
+    // the MIFARE keys recovered from it
+    mfTraceAuthFree();
+    if (g_trace_map != NULL) {
+#ifdef _WIN32
+        free(g_trace_map);
+#else
+        munmap(g_trace_map, g_trace_map_len);
+#endif
+        g_trace_map = NULL;
+        g_trace_map_len = 0;
+    } else {
+        free(g_trace);
+    }
+    g_trace = NULL;
+    g_traceLen = 0;
+}
+
+// one walk over the records, the same as the listing does
+static int trace_index_build(void) {
+    trace_index_free();
+
+    uint32_t count = 0, commands = 0, tracepos = 0;
+    while (is_last_record(tracepos, g_traceLen) == false) {
+        tracelog_hdr_t *hdr = (tracelog_hdr_t *)(g_trace + tracepos);
+        if (tracepos + TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr) > g_traceLen)
+            break;
+
+        count++;
+        if (hdr->isResponse == false && hdr->data_len > 0)
+            commands++;
+        tracepos += TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+    }
+
+    trace_index_t *idx = &g_trace_index;
+    idx->records = calloc(count + 1, sizeof(trace_record_t));
+    idx->cmd_start = calloc(257, sizeof(uint32_t));
+    idx->cmd_list = calloc(commands + 1, sizeof(uint32_t));
+    idx->owned = true;
+    if (idx->records == NULL || idx->cmd_start == NULL || idx->cmd_list == NULL) {
+        PrintAndLogEx(FAILED, "Cannot allocate memory for trace index");
+        trace_index_free();
+        return PM3_EMALLOC;
+    }
+
+    idx->count = count;
+    idx->protocol = TRACE_NO_PROTOCOL;
+    idx->flags = TRACE_INDEX_SORTED;
+
+    tracepos = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        tracelog_hdr_t *hdr = (tracelog_hdr_t *)(g_trace + tracepos);
+        trace_record_t *rec = &idx->records[i];
+
+        rec->offset = tracepos;
+        rec->timestamp = hdr->timestamp;
+        rec->data_len = hdr->data_len;
+        rec->flags = (hdr->isResponse) ? TRACE_RECORD_RESPONSE : 0;
+        rec->crc = TRACE_CRC_UNKNOWN;
+
+        if (i && rec->timestamp < idx->records[i - 1].timestamp)
+            idx->flags &= ~TRACE_INDEX_SORTED;
+
+        if (hdr->isResponse == false && hdr->data_len > 0)
+            idx->cmd_start[hdr->frame[0] + 1]++;
+
+        tracepos += TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+    }
+
+    for (int c = 0; c < 256; c++)
+        idx->cmd_start[c + 1] += idx->cmd_start[c];
+
+    uint32_t fill[256];
+    memcpy(fill, idx->cmd_start, sizeof(fill));
+    for (uint32_t i = 0; i < count; i++) {
+        trace_record_t *rec = &idx->records[i];
+        if ((rec->flags & TRACE_RECORD_RESPONSE) == 0 && rec->data_len > 0) {
+            uint8_t c = g_trace[rec->offset + TRACELOG_HDR_LEN];
+            idx->cmd_list[fill[c]++] = i;
+        }
+    }
+    return PM3_SUCCESS;
+}
+
+// crc status of all records for a protocol, kept for the following listings.
+// MIFARE depends on the auth state of the listing, left to printTraceLine
+static void trace_index_set_protocol(uint8_t protocol) {
+    if (g_trace_index.owned == false || g_trace_index.protocol == protocol)
+        return;
+
+    for (uint32_t i = 0; i < g_trace_index.count; i++) {
+        trace_record_t *rec = &g_trace_index.records[i];
+        tracelog_hdr_t *hdr = (tracelog_hdr_t *)(g_trace + rec->offset);
+        if (protocol == PROTO_MIFARE)
+            rec->crc = TRACE_CRC_UNKNOWN;
+        else
+            rec->crc = trace_crc_status(protocol, hdr->isResponse, hdr->frame, hdr->data_len);
+    }
+    g_trace_index.protocol = protocol;
+}
+
+// the records of a window of start times relative to the first record, [first, last)
+static void trace_index_window(uint32_t start, uint32_t end, uint32_t *first, uint32_t *last) {
+    const trace_record_t *records = g_trace_index.records;
+    uint32_t count = g_trace_index.count;
+
+    *first = 0;
+    *last = count;
+    if (count == 0 || (g_trace_index.flags & TRACE_INDEX_SORTED) == 0)
+        return;
+
+    uint32_t t0 = records[0].timestamp;
+    uint32_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (records[mid].timestamp - t0 < start)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *first = lo;
+
+    hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (records[mid].timestamp - t0 <= end)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *last = lo;
+}
+
+// the listing walks the mapped index without bounds checks, so it must match the trace.
+// Returns what is wrong, or NULL.
+static const char *trace_container_check(uint32_t commands) {
+    const trace_index_t *idx = &g_trace_index;
+    uint64_t end = 0;
+
+    for (uint32_t i = 0; i < idx->count; i++) {
+        const trace_record_t *rec = &idx->records[i];
+        if (rec->offset < end || (uint64_t)rec->offset + TRACELOG_HDR_LEN > (uint64_t)g_traceLen)
+            return "record offsets out of order or beyond the trace";
+
+        tracelog_hdr_t *hdr = (tracelog_hdr_t *)(g_trace + rec->offset);
+        end = (uint64_t)rec->offset + TRACELOG_HDR_LEN + hdr->data_len + TRACELOG_PARITY_LEN(hdr);
+        if (end > (uint64_t)g_traceLen)
+            return "record beyond the trace";
+        if (rec->data_len != hdr->data_len)
+            return "record length mismatch";
+        if ((rec->flags & TRACE_RECORD_RESPONSE) != (hdr->isResponse ? TRACE_RECORD_RESPONSE : 0))
+            return "record direction mismatch";
+
+        if (i && (idx->flags & TRACE_INDEX_SORTED) && rec->timestamp < idx->records[i - 1].timestamp)
+            return "timestamps not sorted";
+    }
+
+    if (idx->cmd_start[0] != 0 || idx->cmd_start[256] != commands)
+        return "command index size mismatch";
+
+    for (int c = 0; c < 256; c++) {
+        if (idx->cmd_start[c + 1] < idx->cmd_start[c])
+            return "command index out of order";
+
+        // records of each command byte in trace order, a record listed once
+        for (uint32_t k = idx->cmd_start[c]; k < idx->cmd_start[c + 1]; k++) {
+            uint32_t r = idx->cmd_list[k];
+            if (r >= idx->count || (k > idx->cmd_start[c] && r <= idx->cmd_list[k - 1]))
+                return "command list out of order or beyond the records";
+
+            const trace_record_t *rec = &idx->records[r];
+            if ((rec->flags & TRACE_RECORD_RESPONSE) || rec->data_len == 0 || g_trace[rec->offset + TRACELOG_HDR_LEN] != c)
+                return "command list entry is no such command";
+        }
+    }
+    return NULL;
+}
+
+// Takes over a container file.  The records and the trace are used in place, mapped on
+// systems which have mmap.  Returns PM3_ENODATA if the file isn't a container.
+static int trace_container_load(const char *path) {
+    trace_container_hdr_t hdr;
+
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", path);
+        return PM3_EFILE;
+    }
+    size_t bytes_read = fread(&hdr, 1, sizeof(hdr), f);
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    if (bytes_read != sizeof(hdr) || memcmp(hdr.magic, TRACE_CONTAINER_MAGIC, sizeof(hdr.magic)) != 0) {
+        fclose(f);
+        return PM3_ENODATA;
+    }
+
+    uint64_t expected = sizeof(hdr) + (uint64_t)hdr.records * sizeof(trace_record_t)
+                        + 257 * sizeof(uint32_t) + (uint64_t)hdr.commands * sizeof(uint32_t) + hdr.trace_len;
+    if (hdr.version != TRACE_CONTAINER_VERSION || (uint64_t)fsize != expected) {
+        PrintAndLogEx(FAILED, "trace container " _YELLOW_("%s") " has a wrong version or size", path);
+        fclose(f);
+        return PM3_EFILE;
+    }
+
+#ifdef _WIN32
+    uint8_t *map = calloc(fsize, sizeof(uint8_t));
+    if (map == NULL) {
+        PrintAndLogEx(FAILED, "error, cannot allocate memory");
+        fclose(f);
+        return PM3_EMALLOC;
+    }
+    fseek(f, 0, SEEK_SET);
+    bytes_read = fread(map, 1, fsize, f);
+    fclose(f);
+    if (bytes_read != (size_t)fsize) {
+        PrintAndLogEx(FAILED, "error, bytes read mismatch file size");
+        free(map);
+        return PM3_EFILE;
+    }
+#else
+    // private and writable, the listing swaps bytes of some frames in place
+    uint8_t *map = mmap(NULL, fsize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(f), 0);
+    fclose(f);
+    if (map == MAP_FAILED) {
+        PrintAndLogEx(FAILED, "Cannot map trace container " _YELLOW_("%s"), path);
+        return PM3_EFILE;
+    }
+#endif
+
+    g_trace_map = map;
+    g_trace_map_len = fsize;
+
+    uint8_t *p = map + sizeof(hdr);
+    g_trace_index.records = (trace_record_t *)p;
+    p += hdr.records * sizeof(trace_record_t);
+    g_trace_index.cmd_start = (uint32_t *)p;
+    p += 257 * sizeof(uint32_t);
+    g_trace_index.cmd_list = (uint32_t *)p;
+    p += hdr.commands * sizeof(uint32_t);
+    g_trace_index.count = hdr.records;
+    g_trace_index.protocol = hdr.protocol;
+    g_trace_index.flags = hdr.flags;
+    g_trace_index.owned = false;
+
+    g_trace = p;
+    g_traceLen = hdr.trace_len;
+
+    const char *damage = trace_container_check(hdr.commands);
+    if (damage != NULL) {
+        PrintAndLogEx(FAILED, "trace container " _YELLOW_("%s") " is damaged, %s", path, damage);
+        trace_free();
+        return PM3_EFILE;
+    }
+    return PM3_SUCCESS;
+}
+
+static int trace_container_save(const char *filename, uint8_t protocol) {
+    // a mapped index may hold the crc status of another protocol
+    if (g_trace_index.owned == false || g_trace_index.records == NULL) {
+        int res = trace_index_build();
+        if (res != PM3_SUCCESS)
+            return res;
+    }
+    trace_index_set_protocol(protocol);
+
+    trace_container_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_CONTAINER_MAGIC, sizeof(hdr.magic));
+    hdr.version = TRACE_CONTAINER_VERSION;
+    hdr.records = g_trace_index.count;
+    hdr.commands = g_trace_index.cmd_start[256];
+    hdr.trace_len = g_traceLen;
+    hdr.protocol = g_trace_index.protocol;
+    hdr.flags = g_trace_index.flags;
+
+    size_t records_len = hdr.records * sizeof(trace_record_t);
+    size_t cmd_len = (257 + hdr.commands) * sizeof(uint32_t);
+    size_t len = sizeof(hdr) + records_len + cmd_len + hdr.trace_len;
+
+    uint8_t *data = calloc(len, sizeof(uint8_t));
+    if (data == NULL) {
+        PrintAndLogEx(FAILED, "error, cannot allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    uint8_t *p = data;
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    memcpy(p, g_trace_index.records, records_len);
+    p += records_len;
+    memcpy(p, g_trace_index.cmd_start, 257 * sizeof(uint32_t));
+    memcpy(p + 257 * sizeof(uint32_t), g_trace_index.cmd_list, hdr.commands * sizeof(uint32_t));
+    p += cmd_len;
+    memcpy(p, g_trace, hdr.trace_len);
+
+    int res = saveFile(filename, ".trace", data, len);
+    free(data);
+    return res;
+}
+
+// Text of listed lines, '\0' terminated one after the other.  Without a text
+// printTraceLine prints right away.
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+} trace_text_t;
+
+static void trace_line(trace_text_t *out, const char *fmt, ...) {
+    char buffer[MAX_PRINT_BUFFER];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, args);
+    va_end(args);
+
+    if (out == NULL) {
+        PrintAndLogEx(NORMAL, "%s", buffer);
+        return;
+    }
+
+    size_t n = strlen(buffer) + 1;
+    if (out->len + n > out->size) {
+        size_t size = MAX(out->size * 2, out->len + n + 4096);
+        char *buf = realloc(out->buf, size);
+        if (buf == NULL)
+            return;
+        out->buf = buf;
+        out->size = size;
+    }
+    memcpy(out->buf + out->len, buffer, n);
+    out->len += n;
+}
+
+static uint32_t printTraceLine(uint32_t tracepos, uint32_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes, uint32_t *prev_eot, bool use_us,
+                               const uint64_t *mfDicKeys, uint32_t mfDicKeysCount, uint8_t knownCrcStatus, trace_text_t *out) {
+    // sanity check
+    if (is_last_record(tracepos, traceLen)) {
+        PrintAndLogEx(DEBUG, "last record triggered.  t-pos: %u  t-len %u", tracepos, traceLen);
+        return traceLen;
+    }
+
+    uint32_t end_of_transmission_timestamp = 0;
+    uint32_t duration;
+    uint16_t data_len;
+    uint8_t topaz_reader_command[MAX_TOPAZ_READER_CMD_LEN];
+    char explanation[40] = {0};
+    uint8_t mfData[32] = {0};
+    size_t mfDataLen = 0;
+    tracelog_hdr_t *first_hdr = (tracelog_hdr_t *)(trace);
+    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(trace + tracepos);
+
+    duration = hdr->duration;
+    data_len = hdr->data_len;
+
+    if (tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr) > traceLen) {
+        PrintAndLogEx(DEBUG, "trace pos offset %"PRIu64 " larger than reported tracelen %u", tracepos + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr), traceLen);
+        return traceLen;
+    }
+
+    // adjust for different time scales
+    if (protocol == ICLASS || protocol == ISO_15693) {
+        duration *= 32;
+    }
+
+    uint8_t *frame = hdr->frame;
+    uint8_t *parityBytes = hdr->frame + data_len;
+
+    tracepos += TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr);
+
+    if (protocol == TOPAZ && !hdr->isResponse) {
+        // topaz reader commands come in 1 or 9 separate frames with 7 or 8 Bits each.
+        // merge them:
+        if (merge_topaz_reader_frames(hdr->timestamp, &duration, &tracepos, traceLen, trace, frame, topaz_reader_command, &data_len)) {
+            frame = topaz_reader_command;
+        }
+    }
+
+    //Check the CRC status, the index has it unless frames were merged
+    uint8_t crcStatus = knownCrcStatus;
+    if (crcStatus == TRACE_CRC_UNKNOWN || frame != hdr->frame) {
+        crcStatus = trace_crc_status(protocol, hdr->isResponse, frame, data_len);
+    }
+
     //0 CRC-command, CRC not ok
     //1 CRC-command, CRC ok
     //2 Not crc-command
@@ -402,31 +828,31 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
             }
 
             if (use_us) {
-                PrintAndLogEx(NORMAL, " %10.1f | %10.1f | %s |%-72s | %s| %s",
-                              (float)time1 / 13.56,
-                              (float)time2 / 13.56,
-                              (hdr->isResponse ? "Tag" : _YELLOW_("Rdr")),
-                              line[j],
-                              (j == num_lines - 1) ? crc : "    ",
-                              (j == num_lines - 1) ? explanation : ""
-                             );
+                trace_line(out, " %10.1f | %10.1f | %s |%-72s | %s| %s",
+                           (float)time1 / 13.56,
+                           (float)time2 / 13.56,
+                           (hdr->isResponse ? "Tag" : _YELLOW_("Rdr")),
+                           line[j],
+                           (j == num_lines - 1) ? crc : "    ",
+                           (j == num_lines - 1) ? explanation : ""
+                          );
             } else {
-                PrintAndLogEx(NORMAL, " %10u | %10u | %s |%-72s | %s| %s",
-                              (hdr->timestamp - first_hdr->timestamp),
-                              (end_of_transmission_timestamp - first_hdr->timestamp),
-                              (hdr->isResponse ? "Tag" : _YELLOW_("Rdr")),
-                              line[j],
-                              (j == num_lines - 1) ? crc : "    ",
-                              (j == num_lines - 1) ? explanation : ""
-                             );
+                trace_line(out, " %10u | %10u | %s |%-72s | %s| %s",
+                           (hdr->timestamp - first_hdr->timestamp),
+                           (end_of_transmission_timestamp - first_hdr->timestamp),
+                           (hdr->isResponse ? "Tag" : _YELLOW_("Rdr")),
+                           line[j],
+                           (j == num_lines - 1) ? crc : "    ",
+                           (j == num_lines - 1) ? explanation : ""
+                          );
             }
 
         } else {
-            PrintAndLogEx(NORMAL, "            |            |     |%-72s | %s| %s",
-                          line[j],
-                          (j == num_lines - 1) ? crc : "    ",
-                          (j == num_lines - 1) ? explanation : ""
-                         );
+            trace_line(out, "            |            |     |%-72s | %s| %s",
+                       line[j],
+                       (j == num_lines - 1) ? crc : "    ",
+                       (j == num_lines - 1) ? explanation : ""
+                      );
         }
     }
 
@@ -434,13 +860,13 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
         if (DecodeMifareData(frame, data_len, parityBytes, hdr->isResponse, mfData, &mfDataLen, mfDicKeys, mfDicKeysCount)) {
             memset(explanation, 0x00, sizeof(explanation));
             if (hdr->isResponse == false) {
-                annotateIso14443a(explanation, sizeof(explanation), mfData, mfDataLen);
+                annotateMifarePlain(explanation, sizeof(explanation), mfData, mfDataLen);
             }
             uint8_t crcc = iso14443A_CRC_check(hdr->isResponse, mfData, mfDataLen);
-            PrintAndLogEx(NORMAL, "            |            |  *  |%-72s | %-4s| %s",
-                          sprint_hex_inrow_spaces(mfData, mfDataLen, 2),
-                          (crcc == 0 ? "!crc" : (crcc == 1 ? " ok " : "    ")),
-                          explanation);
+            trace_line(out, "            |            |  *  |%-72s | %-4s| %s",
+                       sprint_hex_inrow_spaces(mfData, mfDataLen, 2),
+                       (crcc == 0 ? "!crc" : (crcc == 1 ? " ok " : "    ")),
+                       explanation);
         }
     }
 
@@ -452,16 +878,207 @@ static uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *tr
 
         tracelog_hdr_t *next_hdr = (tracelog_hdr_t *)(trace + tracepos);
 
-        PrintAndLogEx(NORMAL, " %10u | %10u | %s |fdt (Frame Delay Time): " _YELLOW_("%d"),
-                      (end_of_transmission_timestamp - first_hdr->timestamp),
-                      (next_hdr->timestamp - first_hdr->timestamp),
-                      "   ",
-                      (next_hdr->timestamp - end_of_transmission_timestamp));
+        trace_line(out, " %10u | %10u | %s |fdt (Frame Delay Time): " _YELLOW_("%d"),
+                   (end_of_transmission_timestamp - first_hdr->timestamp),
+                   (next_hdr->timestamp - first_hdr->timestamp),
+                   "   ",
+                   (next_hdr->timestamp - end_of_transmission_timestamp));
     }
 
     return tracepos;
 }
 
+// Listing in three steps.  The lines are taken from the index first, with the
+// relative times which depend on the line before.  Then chunks of lines are
+// annotated by a few threads while the caller prints the finished chunks in order.
+// MIFARE and iCLASS annotation keeps state from one frame to the next, the auth and
+// crypto1 state and the keys found, those are listed by the caller alone.
+#define TRACE_CHUNK_LINES           256
+#define TRACE_CHUNKS_AHEAD          4       // per thread, bounds the text waiting
+
+typedef struct {
+    uint32_t record;        // first record of the line
+    uint32_t prev_eot;      // end of the line before, for relative times
+} trace_line_t;
+
+typedef struct {
+    trace_text_t text;
+    bool done;
+} trace_chunk_t;
+
+typedef struct {
+    const trace_line_t *lines;
+    uint32_t count;
+    uint8_t protocol;
+    bool show_wait_cycles;
+    bool mark_crc;
+    bool use_relative;
+    bool use_us;
+    const uint64_t *dicKeys;
+    uint32_t dicKeysCount;
+
+    trace_chunk_t *chunks;
+    uint32_t nchunks;
+    uint32_t window;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t next;          // next chunk to annotate
+    uint32_t emitted;       // chunks printed
+    bool abort;
+} trace_pipeline_t;
+
+static bool trace_protocol_has_state(uint8_t protocol) {
+    return (protocol == PROTO_MIFARE || protocol == ICLASS);
+}
+
+// the record after the line starting at record r, and the end of transmission of the line
+static uint32_t trace_line_span(uint32_t r, uint8_t protocol, uint32_t *eot) {
+    const trace_record_t *rec = &g_trace_index.records[r];
+    tracelog_hdr_t *hdr = (tracelog_hdr_t *)(g_trace + rec->offset);
+    uint32_t duration = hdr->duration;
+    uint16_t data_len = hdr->data_len;
+    uint32_t tracepos = rec->offset + TRACELOG_HDR_LEN + data_len + TRACELOG_PARITY_LEN(hdr);
+
+    if (protocol == ICLASS || protocol == ISO_15693) {
+        duration *= 32;
+    }
+
+    if (protocol == TOPAZ && !hdr->isResponse) {
+        uint8_t topaz_reader_command[MAX_TOPAZ_READER_CMD_LEN];
+        merge_topaz_reader_frames(hdr->timestamp, &duration, &tracepos, g_traceLen, g_trace, hdr->frame, topaz_reader_command, &data_len);
+    }
+
+    *eot = hdr->timestamp + duration;
+
+    for (r++; r < g_trace_index.count && g_trace_index.records[r].offset < tracepos; r++) {};
+    return r;
+}
+
+static void trace_list_chunk(trace_pipeline_t *p, uint32_t c, trace_text_t *out) {
+    uint32_t last = MIN((c + 1) * TRACE_CHUNK_LINES, p->count);
+    for (uint32_t i = c * TRACE_CHUNK_LINES; i < last; i++) {
+        const trace_record_t *rec = &g_trace_index.records[p->lines[i].record];
+        uint8_t crc = (g_trace_index.protocol == p->protocol) ? rec->crc : TRACE_CRC_UNKNOWN;
+        uint32_t prev_eot = p->lines[i].prev_eot;
+
+        printTraceLine(rec->offset, g_traceLen, g_trace, p->protocol, p->show_wait_cycles, p->mark_crc,
+                       (p->use_relative) ? &prev_eot : NULL, p->use_us, p->dicKeys, p->dicKeysCount, crc, out);
+    }
+}
+
+static void *trace_list_thread(void *arg) {
+    trace_pipeline_t *p = (trace_pipeline_t *)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        while (p->abort == false && p->next < p->nchunks && p->next >= p->emitted + p->window)
+            pthread_cond_wait(&p->cond, &p->lock);
+
+        if (p->abort || p->next >= p->nchunks) {
+            pthread_mutex_unlock(&p->lock);
+            return NULL;
+        }
+        uint32_t c = p->next++;
+        pthread_mutex_unlock(&p->lock);
+
+        trace_text_t text = {0};
+        trace_list_chunk(p, c, &text);
+
+        pthread_mutex_lock(&p->lock);
+        p->chunks[c].text = text;
+        p->chunks[c].done = true;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+// prints the lines, returns the number of threads used
+static int trace_list_lines(trace_pipeline_t *p) {
+    p->nchunks = (p->count + TRACE_CHUNK_LINES - 1) / TRACE_CHUNK_LINES;
+
+    int n = num_CPUs();
+    if (trace_protocol_has_state(p->protocol) || n < 2 || p->nchunks < 2)
+        n = 0;
+
+    pthread_t *threads = NULL;
+    if (n) {
+        p->chunks = calloc(p->nchunks, sizeof(trace_chunk_t));
+        threads = calloc(n, sizeof(pthread_t));
+        if (p->chunks == NULL || threads == NULL) {
+            free(p->chunks);
+            p->chunks = NULL;
+            n = 0;
+        }
+    }
+
+    if (n == 0) {
+        free(threads);
+        for (uint32_t c = 0; c < p->nchunks; c++) {
+            trace_list_chunk(p, c, NULL);
+            if (kbd_enter_pressed())
+                break;
+        }
+        return 1;
+    }
+
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    p->window = n * TRACE_CHUNKS_AHEAD;
+
+    int started = 0;
+    for (; started < n; started++) {
+        if (pthread_create(&threads[started], NULL, trace_list_thread, p) != 0)
+            break;
+    }
+
+    for (uint32_t c = 0; c < p->nchunks; c++) {
+        trace_chunk_t *chunk = &p->chunks[c];
+
+        pthread_mutex_lock(&p->lock);
+        // annotate it here when no thread could be started
+        if (started == 0 && chunk->done == false) {
+            p->next = c + 1;
+            pthread_mutex_unlock(&p->lock);
+            trace_list_chunk(p, c, &chunk->text);
+            pthread_mutex_lock(&p->lock);
+            chunk->done = true;
+        }
+        while (chunk->done == false)
+            pthread_cond_wait(&p->cond, &p->lock);
+        pthread_mutex_unlock(&p->lock);
+
+        for (size_t pos = 0; pos < chunk->text.len; pos += strlen(chunk->text.buf + pos) + 1)
+            PrintAndLogEx(NORMAL, "%s", chunk->text.buf + pos);
+
+        free(chunk->text.buf);
+        chunk->text.buf = NULL;
+
+        bool abort = kbd_enter_pressed();
+
+        pthread_mutex_lock(&p->lock);
+        p->emitted++;
+        p->abort = abort;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+
+        if (abort)
+            break;
+    }
+
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    for (uint32_t c = 0; c < p->nchunks; c++)
+        free(p->chunks[c].text.buf);
+
+    free(p->chunks);
+    p->chunks = NULL;
+    free(threads);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->cond);
+    return MAX(started, 1);
+}
+
 static int download_trace(void) {
 
     if (IfPm3Present() == false) {
@@ -470,10 +1087,7 @@ static int download_trace(void) {
     }
 
     // reserve some space.
-    if (g_trace)
-        free(g_trace);
-
-    g_traceLen = 0;
+    trace_free();
 
     g_trace = calloc(PM3_CMD_DATA_SIZE, sizeof(uint8_t));
     if (g_trace == NULL) {
@@ -487,7 +1101,7 @@ static int download_trace(void) {
     PacketResponseNG response;
     if (!GetFromDevice(BIG_BUF, g_trace, PM3_CMD_DATA_SIZE, 0, NULL, 0, &response, 4000, true)) {
         PrintAndLogEx(WARNING, "timeout while waiting for reply.");
-        free(g_trace);
+        trace_free();
         return PM3_ETIMEOUT;
     }
 
@@ -500,16 +1114,17 @@ static int download_trace(void) {
         g_trace = calloc(g_traceLen, sizeof(uint8_t));
         if (g_trace == NULL) {
             PrintAndLogEx(FAILED, "Cannot allocate memory for trace");
+            g_traceLen = 0;
             return PM3_EMALLOC;
         }
 
         if (!GetFromDevice(BIG_BUF, g_trace, g_traceLen, 0, NULL, 0, NULL, 2500, false)) {
             PrintAndLogEx(WARNING, "command execution time out");
-            free(g_trace);
+            trace_free();
             return PM3_ETIMEOUT;
         }
     }
-    return PM3_SUCCESS;
+    return trace_index_build();
 }
 
 // sanity check. Don't use proxmark if it is offline and you didn't specify useTraceBuffer
@@ -523,12 +1138,38 @@ static int SanityOfflineCheck( bool useTraceBuffer ){
 }
 */
 
+static uint8_t trace_protocol_from_type(const char *type) {
+    // no crc, no annotations
+    uint8_t protocol = -1;
+
+    // validate type of output
+    if (strcmp(type,      "iclass") == 0)   protocol = ICLASS;
+    else if (strcmp(type, "14a") == 0)      protocol = ISO_14443A;
+    else if (strcmp(type, "14b") == 0)      protocol = ISO_14443B;
+    else if (strcmp(type, "topaz") == 0)    protocol = TOPAZ;
+    else if (strcmp(type, "7816") == 0)     protocol = ISO_7816_4;
+    else if (strcmp(type, "des") == 0)      protocol = MFDES;
+    else if (strcmp(type, "legic") == 0)    protocol = LEGIC;
+    else if (strcmp(type, "15") == 0)       protocol = ISO_15693;
+    else if (strcmp(type, "felica") == 0)   protocol = FELICA;
+    else if (strcmp(type, "mf") == 0)       protocol = PROTO_MIFARE;
+    else if (strcmp(type, "hitag1") == 0)   protocol = PROTO_HITAG1;
+    else if (strcmp(type, "hitag2") == 0)   protocol = PROTO_HITAG2;
+    else if (strcmp(type, "hitags") == 0)   protocol = PROTO_HITAGS;
+    else if (strcmp(type, "thinfilm") == 0) protocol = THINFILM;
+    else if (strcmp(type, "lto") == 0)      protocol = LTO;
+    else if (strcmp(type, "cryptorf") == 0) protocol = PROTO_CRYPTORF;
+    else if (strcmp(type, "raw") == 0)      protocol = -1;
+
+    return protocol;
+}
+
 static int CmdTraceLoad(const char *Cmd) {
 
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "trace load",
                   "Load protocol data from binary file to trace buffer\n"
-                  "File extension is <.trace>",
+                  "File extension is <.trace>, trace containers saved with `trace save --index` are mapped",
                   "trace load -f mytracefile    -> w/o file extension"
                  );
 
@@ -544,16 +1185,31 @@ static int CmdTraceLoad(const char *Cmd) {
     CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
     CLIParserFree(ctx);
 
-    if (g_trace)
-        free(g_trace);
+    trace_free();
 
-    size_t len = 0;
-    if (loadFile_safe(filename, ".trace", (void **)&g_trace, &len) != PM3_SUCCESS) {
+    char *path = NULL;
+    if (searchFile(&path, RESOURCES_SUBDIR, filename, ".trace", false) != PM3_SUCCESS) {
         PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filename);
         return PM3_EIO;
     }
+    int res = trace_container_load(path);
+    free(path);
+
+    if (res == PM3_SUCCESS) {
+        PrintAndLogEx(SUCCESS, "Mapped trace container, " _YELLOW_("%u") " records", g_trace_index.count);
+    } else if (res == PM3_ENODATA) {
+        size_t len = 0;
+        if (loadFile_safe(filename, ".trace", (void **)&g_trace, &len) != PM3_SUCCESS) {
+            PrintAndLogEx(FAILED, "Could not open file " _YELLOW_("%s"), filename);
+            return PM3_EIO;
+        }
 
-    g_traceLen = (long)len;
+        g_traceLen = (long)len;
+        if (trace_index_build() != PM3_SUCCESS)
+            return PM3_EMALLOC;
+    } else {
+        return PM3_EIO;
+    }
 
     PrintAndLogEx(SUCCESS, "Recorded Activity (TraceLen = " _YELLOW_("%lu") " bytes)", g_traceLen);
     return PM3_SUCCESS;
@@ -564,13 +1220,18 @@ static int CmdTraceSave(const char *Cmd) {
     CLIParserContext *ctx;
     CLIParserInit(&ctx, "trace save",
                   "Save protocol data from trace buffer to binary file\n"
-                  "File extension is <.trace>",
-                  "trace save -f mytracefile    -> w/o file extension"
+                  "File extension is <.trace>\n"
+                  "With --index the file is a trace container holding the record index and the\n"
+                  "CRC status of the records for the protocol given, which `trace load` maps",
+                  "trace save -f mytracefile                  -> w/o file extension\n"
+                  "trace save -f mytracefile --index -t 14a   -> save as indexed trace container"
                  );
 
     void *argtable[] = {
         arg_param_begin,
         arg_strx0("f", "file", "<filename>", "trace file to save"),
+        arg_lit0(NULL, "index", "save as indexed trace container"),
+        arg_strx0("t", "type", NULL, "protocol of the CRC status in the index (see `trace list -h`)"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -578,6 +1239,12 @@ static int CmdTraceSave(const char *Cmd) {
     int fnlen = 0;
     char filename[FILE_PATH_SIZE] = {0};
     CLIParamStrToBuf(arg_get_str(ctx, 1), (uint8_t *)filename, FILE_PATH_SIZE, &fnlen);
+    bool use_index = arg_get_lit(ctx, 2);
+
+    int tlen = 0;
+    char type[10] = {0};
+    CLIParamStrToBuf(arg_get_str(ctx, 3), (uint8_t *)type, sizeof(type), &tlen);
+    str_lower(type);
     CLIParserFree(ctx);
 
     if (g_traceLen == 0) {
@@ -589,6 +1256,10 @@ static int CmdTraceSave(const char *Cmd) {
         return PM3_SUCCESS;
     }
 
+    if (use_index) {
+        return trace_container_save(filename, trace_protocol_from_type(type));
+    }
+
     saveFile(filename, ".trace", g_trace, g_traceLen);
     return PM3_SUCCESS;
 }
@@ -617,7 +1288,9 @@ int CmdTraceList(const char *Cmd) {
                   "trace list -t cryptorf -> interpret as " _YELLOW_("CryptoRF") " communitcations\n"
                   "trace list -t mf --dict <mfc_default_keys>    -> use dictionary keys file\n"
                   "trace list -t 14a -f                          -> show frame delay times\n"
-                  "trace list -t 14a -1                          -> use trace buffer "
+                  "trace list -t 14a -1                          -> use trace buffer\n"
+                  "trace list -t 14a -1 --start 100000 --end 200000  -> frames starting in this time window\n"
+                  "trace list -t 14a -1 --cmd 30                 -> reader frames starting with 0x30 and their responses"
                  );
 
     void *argtable[] = {
@@ -631,6 +1304,9 @@ int CmdTraceList(const char *Cmd) {
                  "                                   or to import into Wireshark using encapsulation type \"ISO 14443\""),
         arg_strx0("t", "type", NULL, "protocol to annotate the trace"),
         arg_strx0(NULL, "dict", "<file>", "use dictionary keys file"),
+        arg_u64_0(NULL, "start", "<dec>", "list frames starting at this time or later, in the unit of the start column"),
+        arg_u64_0(NULL, "end", "<dec>", "list frames starting at this time or earlier"),
+        arg_str0(NULL, "cmd", "<hex>", "list reader frames with this first byte and their responses"),
         arg_param_end
     };
     CLIExecWithReturn(ctx, Cmd, argtable, false);
@@ -654,31 +1330,28 @@ int CmdTraceList(const char *Cmd) {
         diclen = 0;
     }
 
+    uint64_t start = arg_get_u64_def(ctx, 9, 0);
+    uint64_t end = arg_get_u64_def(ctx, 10, UINT32_MAX);
+    bool use_window = arg_get_u64_count(ctx, 9) || arg_get_u64_count(ctx, 10);
+
+    int cmdlen = 0;
+    uint8_t cmd[1] = {0};
+    CLIGetHexWithReturn(ctx, 11, cmd, &cmdlen);
+
     CLIParserFree(ctx);
 
-    clearCommandBuffer();
+    if (use_us) {
+        start = start * 1356 / 100;
+        end = (end >= UINT32_MAX) ? UINT32_MAX : end * 1356 / 100;
+    }
+    if (start > UINT32_MAX || end > UINT32_MAX) {
+        PrintAndLogEx(FAILED, "time window exceeds the trace timestamps");
+        return PM3_EINVARG;
+    }
 
-    // no crc, no annotations
-    uint8_t protocol = -1;
+    clearCommandBuffer();
 
-    // validate type of output
-    if (strcmp(type,      "iclass") == 0)   protocol = ICLASS;
-    else if (strcmp(type, "14a") == 0)      protocol = ISO_14443A;
-    else if (strcmp(type, "14b") == 0)      protocol = ISO_14443B;
-    else if (strcmp(type, "topaz") == 0)    protocol = TOPAZ;
-    else if (strcmp(type, "7816") == 0)     protocol = ISO_7816_4;
-    else if (strcmp(type, "des") == 0)      protocol = MFDES;
-    else if (strcmp(type, "legic") == 0)    protocol = LEGIC;
-    else if (strcmp(type, "15") == 0)       protocol = ISO_15693;
-    else if (strcmp(type, "felica") == 0)   protocol = FELICA;
-    else if (strcmp(type, "mf") == 0)       protocol = PROTO_MIFARE;
-    else if (strcmp(type, "hitag1") == 0)   protocol = PROTO_HITAG1;
-    else if (strcmp(type, "hitag2") == 0)   protocol = PROTO_HITAG2;
-    else if (strcmp(type, "hitags") == 0)   protocol = PROTO_HITAGS;
-    else if (strcmp(type, "thinfilm") == 0) protocol = THINFILM;
-    else if (strcmp(type, "lto") == 0)      protocol = LTO;
-    else if (strcmp(type, "cryptorf") == 0) protocol = PROTO_CRYPTORF;
-    else if (strcmp(type, "raw") == 0)      protocol = -1;
+    uint8_t protocol = trace_protocol_from_type(type);
 
     if (use_buffer == false || (g_traceLen == 0)) {
         download_trace();
@@ -689,7 +1362,7 @@ int CmdTraceList(const char *Cmd) {
         return PM3_SUCCESS;
     }
 
-    uint16_t tracepos = 0;
+    uint32_t tracepos = 0;
 
     /*
     if (protocol == FELICA) {
@@ -794,19 +1467,80 @@ int CmdTraceList(const char *Cmd) {
         if (protocol == ISO_14443A || protocol == PROTO_MIFARE)
             ClearAuthData();
 
-        uint32_t previous_EOT = 0;
-        uint32_t *prev_EOT = NULL;
-        if (use_relative) {
-            prev_EOT = &previous_EOT;
+        if (protocol == PROTO_MIFARE) {
+            mfTraceRecoverKeys(g_traceLen, g_trace, dicKeys, dicKeysCount);
         }
 
-        while (tracepos < g_traceLen) {
-            tracepos = printTraceLine(tracepos, g_traceLen, g_trace, protocol, show_wait_cycles, mark_crc, prev_EOT, use_us, dicKeys, dicKeysCount);
+        // the records of the time window, with the crc status of the protocol
+        trace_index_set_protocol(protocol);
 
-            if (kbd_enter_pressed())
-                break;
+        uint32_t first = 0, last = 0;
+        trace_index_window(start, end, &first, &last);
+
+        const trace_record_t *records = g_trace_index.records;
+        const uint32_t t0 = (g_trace_index.count) ? records[0].timestamp : 0;
+
+        trace_line_t *lines = calloc(last - first + 1, sizeof(trace_line_t));
+        if (lines == NULL) {
+            PrintAndLogEx(FAILED, "Cannot allocate memory for trace lines");
+            if (dictionaryLoad)
+                free((void *) dicKeys);
+            return PM3_EMALLOC;
         }
 
+        uint64_t t1 = msclock();
+        uint32_t nlines = 0, nrecords = 0, eot = 0;
+
+        if (cmdlen) {
+            const uint32_t *list = g_trace_index.cmd_list + g_trace_index.cmd_start[cmd[0]];
+            uint32_t n = g_trace_index.cmd_start[cmd[0] + 1] - g_trace_index.cmd_start[cmd[0]];
+
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t r = list[i];
+                if (r < first || r >= last || records[r].timestamp - t0 < start || records[r].timestamp - t0 > end)
+                    continue;
+
+                do {
+                    lines[nlines].record = r;
+                    lines[nlines++].prev_eot = eot;
+                    uint32_t next = trace_line_span(r, protocol, &eot);
+                    nrecords += next - r;
+                    r = next;
+                } while (r < last && (records[r].flags & TRACE_RECORD_RESPONSE));
+            }
+        } else {
+            for (uint32_t r = first; r < last;) {
+                if (use_window && (records[r].timestamp - t0 < start || records[r].timestamp - t0 > end)) {
+                    r++;
+                    continue;
+                }
+
+                lines[nlines].record = r;
+                lines[nlines++].prev_eot = eot;
+                uint32_t next = trace_line_span(r, protocol, &eot);
+                nrecords += next - r;
+                r = next;
+            }
+        }
+
+        trace_pipeline_t pipeline = {
+            .lines = lines,
+            .count = nlines,
+            .protocol = protocol,
+            .show_wait_cycles = show_wait_cycles,
+            .mark_crc = mark_crc,
+            .use_relative = use_relative,
+            .use_us = use_us,
+            .dicKeys = dicKeys,
+            .dicKeysCount = dicKeysCount,
+        };
+        int threads = trace_list_lines(&pipeline);
+
+        t1 = msclock() - t1;
+        PrintAndLogEx(DEBUG, "listed %u records in %" PRIu64 " ms, %.0f records/s, %d thread%s",
+                      nrecords, t1, (float)nrecords * 1000 / MAX(t1, 1), threads, (threads == 1) ? "" : "s");
+        free(lines);
+
         if (dictionaryLoad)
             free((void *) dicKeys);
     }
@@ -15,10 +15,13 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
+#include <sys/time.h>
 
 #include "uart/uart.h"
 #include "ui.h"
 #include "crc16.h"
+#include "lz4/lz4.h"
 #include "util.h" // g_pendingPrompt
 #include "util_posix.h" // msclock
 #include "util_darwin.h" // en/dis-ableNapp();
@@ -43,18 +46,90 @@ static bool txBuffer_pending = false;
 static pthread_mutex_t txBufferMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t txBufferSig = PTHREAD_COND_INITIALIZER;
 
-// Used by PacketResponseReceived as a ring buffer for messages that are yet to be
-// processed by a command handler (WaitForResponse{,Timeout})
-static PacketResponseNG rxBuffer[CMD_BUFFER_SIZE];
-
-// Points to the next empty position to write to
-static int cmd_head = 0;
-
-// Points to the position of the last unread command
-static int cmd_tail = 0;
-
-// to lock rxBuffer operations from different threads
+// Used by PacketResponseReceived as a queue for messages that are yet to be
+// processed by a command handler (WaitForResponse{,Timeout}).
+//
+// Single producer (communication thread) / single consumer (main thread) lock-free queue.
+// Replies are stored as variable length records in a chain of power-of-two byte rings:
+// a record only takes its header and the used part of the payload.
+// When a ring is full the producer links a new ring twice as large and continues there,
+// the consumer drains the old one, then frees it.  Once RX_QUEUE_MAX_SIZE is reached
+// the producer waits for the consumer (backpressure) instead of overwriting replies.
+#define RX_QUEUE_INIT_SIZE  (64 * 1024)
+#define RX_QUEUE_MAX_SIZE   (16 * 1024 * 1024)
+#define RX_RECORD_ALIGN     8
+
+// A padding record can be as short as RX_RECORD_ALIGN, only its first 8 bytes are used.
+// Padding is marked apart from cmd, every command value is a reply the device may send.
+typedef struct {
+    uint32_t size;       // bytes taken in the ring, header and alignment included
+    bool padding;        // no reply, skip till end of ring
+    bool ng;
+    uint16_t cmd;
+    uint16_t length;
+    int16_t  status;
+    uint32_t magic;
+    uint16_t crc;
+    uint64_t oldarg[3];
+} rx_record_t;
+
+typedef struct rx_segment_s {
+    uint8_t *buf;
+    uint64_t size;                  // power of two
+    uint64_t head;                  // only written by the producer
+    uint8_t pad[64];                // keep head and tail on different cache lines
+    uint64_t tail;                  // only written by the consumer
+    struct rx_segment_s *next;      // set by the producer once it stopped writing to this ring
+} rx_segment_t;
+
+static uint8_t rx_first_buf[RX_QUEUE_INIT_SIZE] __attribute__((aligned(RX_RECORD_ALIGN)));
+static rx_segment_t rx_first_seg = { rx_first_buf, RX_QUEUE_INIT_SIZE, 0, {0}, 0, NULL };
+static rx_segment_t *rx_wseg = &rx_first_seg;   // producer side
+static rx_segment_t *rx_rseg = &rx_first_seg;   // consumer side
+
+typedef struct {
+    uint64_t records;       // replies stored
+    uint64_t bytes_in;      // bytes stored, padding included
+    uint64_t bytes_out;     // bytes consumed or cleared
+    uint64_t bytes_hwm;     // high-water mark of queued bytes
+    uint64_t capacity;      // size of the largest ring allocated
+    uint32_t grows;         // number of ring reallocations
+    uint32_t stalls;        // number of times the producer had to wait for the consumer
+} rx_queue_stats_t;
+
+// written by the receiver thread, read by others, all through atomics
+static rx_queue_stats_t rx_stats = { 0, 0, 0, 0, RX_QUEUE_INIT_SIZE, 0, 0 };
+
+// to sleep on the queue from different threads, the queue itself is lock-free
 static pthread_mutex_t rxBufferMutex = PTHREAD_MUTEX_INITIALIZER;
+// signaled by the communication thread whenever a reply is stored
+static pthread_cond_t rxBufferSig = PTHREAD_COND_INITIALIZER;
+// signaled by the consumer whenever it freed space while the producer is waiting
+static pthread_cond_t rxSpaceSig = PTHREAD_COND_INITIALIZER;
+// set under rxBufferMutex before sleeping, so the other side only takes the mutex when needed
+static bool rx_consumer_waiting = false;
+static bool rx_producer_waiting = false;
+
+// Upper bound for a single sleep on rxBufferSig.  We are woken up as soon as a reply
+// is stored, this only limits how late we notice timeouts and a dead communication thread
+#define RX_WAIT_SLICE_MS 100
+
+// Round-trip latency statistics, per command, measured from SendCommand* to the
+// moment the waiting WaitForResponse* / GetFromDevice call got its reply
+#define CMD_LATENCY_SLOTS 64
+typedef struct {
+    uint16_t cmd;
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t min_us;
+    uint32_t max_us;
+} cmd_latency_t;
+
+static cmd_latency_t cmd_latency[CMD_LATENCY_SLOTS];
+static pthread_mutex_t cmd_latency_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint16_t latency_cmd;
+static uint64_t latency_start;
+static bool latency_pending = false;
 
 // Global start time for WaitForResponseTimeout & dl_it, so we can reset timeout when we get packets
 // as sending lot of these packets can slow down things wuite a lot on slow links (e.g. hw status or lf read at 9600)
@@ -63,6 +138,46 @@ static uint64_t timeout_start_time;
 static uint64_t last_packet_time;
 
 static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd);
+static int dl_windowed(uint8_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout);
+
+// Does the firmware know CMD_DOWNLOAD_WINDOWED?  -1 = not probed yet for this device
+static int8_t windowed_dl_support = -1;
+
+static void latency_begin(uint16_t cmd) {
+    pthread_mutex_lock(&cmd_latency_mutex);
+    latency_cmd = cmd;
+    latency_start = usclock();
+    latency_pending = true;
+    pthread_mutex_unlock(&cmd_latency_mutex);
+}
+
+static void latency_end(void) {
+    pthread_mutex_lock(&cmd_latency_mutex);
+    if (latency_pending == false) {
+        pthread_mutex_unlock(&cmd_latency_mutex);
+        return;
+    }
+    latency_pending = false;
+
+    uint32_t us = (uint32_t)MIN(usclock() - latency_start, UINT32_MAX);
+
+    // open addressing on the command id,  when the table is full the command is not tracked.
+    for (uint8_t i = 0; i < CMD_LATENCY_SLOTS; i++) {
+        cmd_latency_t *e = &cmd_latency[(latency_cmd + i) % CMD_LATENCY_SLOTS];
+        if (e->count == 0) {
+            e->cmd = latency_cmd;
+            e->min_us = us;
+        }
+        if (e->cmd == latency_cmd) {
+            e->count++;
+            e->total_us += us;
+            e->min_us = MIN(e->min_us, us);
+            e->max_us = MAX(e->max_us, us);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cmd_latency_mutex);
+}
 
 // Simple alias to track usages linked to the Bootloader, these commands must not be migrated.
 // - commands sent to enter bootloader mode as we might have to talk to old firmwares
@@ -106,6 +221,7 @@ void SendCommandOLD(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
 
     txBuffer = c;
     txBuffer_pending = true;
+    latency_begin(cmd);
 
     // tell communication thread that a new command can be send
     pthread_cond_signal(&txBufferSig);
@@ -169,6 +285,7 @@ static void SendCommandNG_internal(uint16_t cmd, uint8_t *data, size_t len, bool
     print_hex_break((uint8_t *)tx_post, sizeof(PacketCommandNGPostamble), 32);
 #endif
     txBuffer_pending = true;
+    latency_begin(cmd);
 
     // tell communication thread that a new command can be send
     pthread_cond_signal(&txBufferSig);
@@ -196,6 +313,22 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
 }
 
 
+static void rx_deadline(struct timespec *deadline, uint32_t ms) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t ns = (uint64_t)now.tv_usec * 1000 + (uint64_t)ms * 1000000;
+    deadline->tv_sec = now.tv_sec + (ns / 1000000000);
+    deadline->tv_nsec = ns % 1000000000;
+}
+
+static void rx_wakeup(pthread_cond_t *sig, bool *waiting) {
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&rxBufferMutex);
+        pthread_cond_signal(sig);
+        pthread_mutex_unlock(&rxBufferMutex);
+    }
+}
+
 /**
  * @brief This method should be called when sending a new command to the pm3. In case any old
  *  responses from previous commands are stored in the buffer, a call to this method should clear them.
@@ -203,51 +336,204 @@ void SendCommandMIX(uint64_t cmd, uint64_t arg0, uint64_t arg1, uint64_t arg2, v
  *  operation. Right now we'll just have to live with this.
  */
 void clearCommandBuffer(void) {
-    //This is a very simple operation
-    pthread_mutex_lock(&rxBufferMutex);
-    cmd_tail = cmd_head;
-    pthread_mutex_unlock(&rxBufferMutex);
+    // consumer side: drop everything queued so far, ring by ring
+    while (true) {
+        rx_segment_t *next = __atomic_load_n(&rx_rseg->next, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&rx_rseg->head, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&rx_stats.bytes_out, head - rx_rseg->tail, __ATOMIC_RELAXED);
+        __atomic_store_n(&rx_rseg->tail, head, __ATOMIC_SEQ_CST);
+
+        if (next == NULL)
+            break;
+
+        rx_segment_t *old = rx_rseg;
+        rx_rseg = next;
+        if (old != &rx_first_seg) {
+            free(old->buf);
+            free(old);
+        }
+    }
+
+    rx_wakeup(&rxSpaceSig, &rx_producer_waiting);
 }
+
+static bool rx_segment_fits(rx_segment_t *seg, uint32_t size, uint32_t *padding) {
+    uint64_t tail = __atomic_load_n(&seg->tail, __ATOMIC_SEQ_CST);
+    uint64_t free_bytes = seg->size - (seg->head - tail);
+    uint64_t to_end = seg->size - (seg->head & (seg->size - 1));
+    *padding = (to_end < size) ? to_end : 0;
+    return (free_bytes >= (uint64_t)size + *padding);
+}
+
 /**
- * @brief storeCommand stores a USB command in a circular buffer
- * @param UC
+ * @brief storeReply stores a USB reply in the lock-free reply queue.
+ *  Only the communication thread calls it.
+ * @param packet
  */
 static void storeReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
-    if ((cmd_head + 1) % CMD_BUFFER_SIZE == cmd_tail) {
-        //If these two are equal, we're about to overwrite in the
-        // circular buffer.
-        PrintAndLogEx(FAILED, "WARNING: Command buffer about to overwrite command! This needs to be fixed!");
-        fflush(stdout);
+
+    uint32_t length = MIN(packet->length, PM3_CMD_DATA_SIZE);
+    uint32_t size = (sizeof(rx_record_t) + length + RX_RECORD_ALIGN - 1) & ~(RX_RECORD_ALIGN - 1);
+    uint32_t padding = 0;
+
+    while (rx_segment_fits(rx_wseg, size, &padding) == false) {
+
+        if (rx_wseg->size < RX_QUEUE_MAX_SIZE) {
+            // grow: continue in a new ring, the consumer frees the old one once drained
+            rx_segment_t *seg = calloc(1, sizeof(rx_segment_t));
+            uint8_t *buf = (seg) ? malloc(rx_wseg->size * 2) : NULL;
+            if (buf) {
+                seg->buf = buf;
+                seg->size = rx_wseg->size * 2;
+                __atomic_store_n(&rx_wseg->next, seg, __ATOMIC_RELEASE);
+                rx_wseg = seg;
+                __atomic_store_n(&rx_stats.capacity, MAX(__atomic_load_n(&rx_stats.capacity, __ATOMIC_RELAXED), seg->size), __ATOMIC_RELAXED);
+                __atomic_fetch_add(&rx_stats.grows, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            free(seg);
+        }
+
+        // backpressure: nobody reads the replies we get, wait for the consumer
+        // instead of overwriting.  The device stalls on its side meanwhile.
+        if (__atomic_fetch_add(&rx_stats.stalls, 1, __ATOMIC_RELAXED) == 0) {
+            PrintAndLogEx(WARNING, "Reply queue full (%" PRIu64 " bytes), waiting for the client to catch up", rx_wseg->size);
+        }
+        pthread_mutex_lock(&rxBufferMutex);
+        __atomic_store_n(&rx_producer_waiting, true, __ATOMIC_SEQ_CST);
+        if (rx_segment_fits(rx_wseg, size, &padding) == false && conn.run) {
+            struct timespec deadline;
+            rx_deadline(&deadline, RX_WAIT_SLICE_MS);
+            pthread_cond_timedwait(&rxSpaceSig, &rxBufferMutex, &deadline);
+        }
+        __atomic_store_n(&rx_producer_waiting, false, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&rxBufferMutex);
+
+        if (conn.run == false)
+            return;
+    }
+
+    uint64_t head = rx_wseg->head;
+    if (padding) {
+        rx_record_t *pad = (rx_record_t *)(rx_wseg->buf + (head & (rx_wseg->size - 1)));
+        pad->size = padding;
+        pad->padding = true;
+        head += padding;
+    }
+
+    rx_record_t *rec = (rx_record_t *)(rx_wseg->buf + (head & (rx_wseg->size - 1)));
+    rec->size = size;
+    rec->padding = false;
+    rec->cmd = packet->cmd;
+    rec->length = length;
+    rec->magic = packet->magic;
+    rec->status = packet->status;
+    rec->crc = packet->crc;
+    rec->oldarg[0] = packet->oldarg[0];
+    rec->oldarg[1] = packet->oldarg[1];
+    rec->oldarg[2] = packet->oldarg[2];
+    rec->ng = packet->ng;
+    memcpy((uint8_t *)rec + sizeof(rx_record_t), packet->data.asBytes, length);
+
+    // publish
+    __atomic_store_n(&rx_wseg->head, head + size, __ATOMIC_SEQ_CST);
+
+    __atomic_fetch_add(&rx_stats.records, 1, __ATOMIC_RELAXED);
+    uint64_t in = __atomic_add_fetch(&rx_stats.bytes_in, size + padding, __ATOMIC_RELAXED);
+    uint64_t queued = in - __atomic_load_n(&rx_stats.bytes_out, __ATOMIC_RELAXED);
+    if (queued > __atomic_load_n(&rx_stats.bytes_hwm, __ATOMIC_RELAXED))
+        __atomic_store_n(&rx_stats.bytes_hwm, queued, __ATOMIC_RELAXED);
+
+    // wake up WaitForResponseTimeoutW / dl_it
+    rx_wakeup(&rxBufferSig, &rx_consumer_waiting);
+}
+
+// consumer side, lock-free
+static bool popReply(PacketResponseNG *packet) {
+    while (true) {
+        // read next before head: once next is set, head is final for this ring
+        rx_segment_t *next = __atomic_load_n(&rx_rseg->next, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&rx_rseg->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = rx_rseg->tail;
+
+        if (tail == head) {
+            if (next == NULL)
+                return false;
+
+            rx_segment_t *old = rx_rseg;
+            rx_rseg = next;
+            if (old != &rx_first_seg) {
+                free(old->buf);
+                free(old);
+            }
+            continue;
+        }
+
+        rx_record_t *rec = (rx_record_t *)(rx_rseg->buf + (tail & (rx_rseg->size - 1)));
+        uint32_t size = rec->size;
+        bool is_padding = rec->padding;
+        if (is_padding == false) {
+            packet->cmd = rec->cmd;
+            packet->length = rec->length;
+            packet->magic = rec->magic;
+            packet->status = rec->status;
+            packet->crc = rec->crc;
+            packet->oldarg[0] = rec->oldarg[0];
+            packet->oldarg[1] = rec->oldarg[1];
+            packet->oldarg[2] = rec->oldarg[2];
+            packet->ng = rec->ng;
+            memcpy(packet->data.asBytes, (uint8_t *)rec + sizeof(rx_record_t), rec->length);
+            memset(packet->data.asBytes + rec->length, 0, PM3_CMD_DATA_SIZE - rec->length);
+        }
+
+        __atomic_store_n(&rx_rseg->tail, tail + size, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&rx_stats.bytes_out, size, __ATOMIC_RELAXED);
+
+        if (is_padding == false)
+            return true;
     }
-    //Store the command at the 'head' location
-    PacketResponseNG *destination = &rxBuffer[cmd_head];
-    memcpy(destination, packet, sizeof(PacketResponseNG));
+}
 
-    //increment head and wrap
-    cmd_head = (cmd_head + 1) % CMD_BUFFER_SIZE;
-    pthread_mutex_unlock(&rxBufferMutex);
+static bool rx_queue_empty(void) {
+    rx_segment_t *next = __atomic_load_n(&rx_rseg->next, __ATOMIC_ACQUIRE);
+    return (next == NULL) && (__atomic_load_n(&rx_rseg->head, __ATOMIC_SEQ_CST) == rx_rseg->tail);
 }
+
 /**
- * @brief getCommand gets a command from an internal circular buffer.
+ * @brief getReply gets a reply from the reply queue.
+ *  If the queue is empty, it sleeps until the communication thread stores a reply
+ *  or ms_wait milliseconds have passed.
  * @param response location to write command
+ * @param ms_wait max time to wait for a reply, 0 to return immediately
  * @return 1 if response was returned, 0 if nothing has been received
  */
-static int getReply(PacketResponseNG *packet) {
-    pthread_mutex_lock(&rxBufferMutex);
-    //If head == tail, there's nothing to read, or if we just got initialized
-    if (cmd_head == cmd_tail)  {
-        pthread_mutex_unlock(&rxBufferMutex);
-        return 0;
-    }
+static int getReply(PacketResponseNG *packet, uint32_t ms_wait) {
 
-    //Pick out the next unread command
-    memcpy(packet, &rxBuffer[cmd_tail], sizeof(PacketResponseNG));
+    if (popReply(packet) == false) {
 
-    //Increment tail - this is a circular buffer, so modulo buffer size
-    cmd_tail = (cmd_tail + 1) % CMD_BUFFER_SIZE;
+        if (ms_wait == 0)
+            return 0;
 
-    pthread_mutex_unlock(&rxBufferMutex);
+        struct timespec deadline;
+        rx_deadline(&deadline, ms_wait);
+
+        // flag is raised before checking the queue, the producer signals under rxBufferMutex:
+        // a reply stored meanwhile can't be missed
+        pthread_mutex_lock(&rxBufferMutex);
+        __atomic_store_n(&rx_consumer_waiting, true, __ATOMIC_SEQ_CST);
+        while (rx_queue_empty()) {
+            if (pthread_cond_timedwait(&rxBufferSig, &rxBufferMutex, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        __atomic_store_n(&rx_consumer_waiting, false, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&rxBufferMutex);
+
+        if (popReply(packet) == false)
+            return 0;
+    }
+
+    rx_wakeup(&rxSpaceSig, &rx_producer_waiting);
     return 1;
 }
 
@@ -643,6 +929,7 @@ int TestProxmark(pm3_device *dev) {
     }
 
     memcpy(&pm3_capabilities, resp.data.asBytes, MIN(sizeof(capabilities_t), resp.length));
+    windowed_dl_support = -1;
     conn.send_via_fpc_usart = pm3_capabilities.via_fpc;
     conn.uart_speed = pm3_capabilities.baudrate;
 
@@ -731,30 +1018,36 @@ bool WaitForResponseTimeoutW(uint32_t cmd, PacketResponseNG *response, size_t ms
     // Wait until the command is received
     while (true) {
 
-        while (getReply(response)) {
-            if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
-                return true;
-            }
-            if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
-                uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
-                PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
-                if (ms_timeout != (size_t) - 1)
-                    ms_timeout += wtx;
-            }
-        }
-
         uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
-        if ((ms_timeout != (size_t) - 1) && (msclock() - tmp_clk > ms_timeout))
+        uint64_t elapsed = msclock() - tmp_clk;
+        if ((ms_timeout != (size_t) - 1) && (elapsed > ms_timeout))
             break;
 
-        if (msclock() - tmp_clk > 3000 && show_warning) {
+        if (elapsed > 3000 && show_warning) {
             // 3 seconds elapsed (but this doesn't mean the timeout was exceeded)
 //            PrintAndLogEx(INFO, "Waiting for a response from the Proxmark3...");
             PrintAndLogEx(INFO, "You can cancel this operation by pressing the pm3 button");
             show_warning = false;
         }
-        // just to avoid CPU busy loop:
-        msleep(10);
+
+        // sleeps until the communication thread stores a reply, no CPU busy loop
+        uint32_t ms_wait = RX_WAIT_SLICE_MS;
+        if (ms_timeout != (size_t) - 1)
+            ms_wait = MIN(ms_wait, ms_timeout - elapsed + 1);
+
+        if (getReply(response, ms_wait) == 0)
+            continue;
+
+        if (cmd == CMD_UNKNOWN || response->cmd == cmd) {
+            latency_end();
+            return true;
+        }
+        if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
+            uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
+            PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
+            if (ms_timeout != (size_t) - 1)
+                ms_timeout += wtx;
+        }
     }
     return false;
 }
@@ -791,6 +1084,31 @@ bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint3
     if (response == NULL)
         response = &resp;
 
+    // Windowed download, old firmwares don't know it and fall back to the legacy commands
+    uint8_t dl_memtype = 0xFF;
+    switch (memtype) {
+        case BIG_BUF:
+            dl_memtype = DL_WINDOWED_MEM_BIGBUF;
+            break;
+        case BIG_BUF_EML:
+            dl_memtype = DL_WINDOWED_MEM_EML;
+            break;
+        case FLASH_MEM:
+            dl_memtype = DL_WINDOWED_MEM_FLASH;
+            break;
+        case SPIFFS:
+            dl_memtype = DL_WINDOWED_MEM_SPIFFS;
+            break;
+        case SIM_MEM:
+        case FPGA_MEM:
+            break;
+    }
+    if (dl_memtype != 0xFF && windowed_dl_support != 0) {
+        int res = dl_windowed(dl_memtype, dest, bytes, start_index, data, datalen, response, ms_timeout);
+        if (res != PM3_ENOTIMPL)
+            return (res == PM3_SUCCESS);
+    }
+
     // clear
     clearCommandBuffer();
 
@@ -824,6 +1142,173 @@ bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint3
     return false;
 }
 
+static void dl_windowed_ack(uint8_t *have, uint32_t total, uint32_t *next) {
+    while (*next < total && have[*next])
+        (*next)++;
+
+    download_windowed_ack_t ack = { .next = *next, .bitmap = 0 };
+    for (uint8_t i = 0; i < 32 && *next + i < total; i++) {
+        if (have[*next + i])
+            ack.bitmap |= (1u << i);
+    }
+    SendCommandNG(CMD_DOWNLOAD_WINDOWED_ACK, (uint8_t *)&ack, sizeof(ack));
+}
+
+/**
+* Windowed download. The device sends numbered, CRC protected, optionally LZ4 compressed chunks.
+* After each window we acknowledge what we got and the device resends only the missing chunks.
+* If the device goes silent, the acknowledge is resent and eventually the download is resumed
+* from the first missing chunk instead of restarting from zero.
+* @return PM3_ENOTIMPL if the firmware doesn't support it
+*/
+static int dl_windowed(uint8_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout) {
+
+    download_windowed_t req;
+    memset(&req, 0, sizeof(req));
+    req.memtype = memtype;
+    // compression pays off on slow links only, on USB the device CPU is the bottleneck
+    req.flags = (conn.send_via_fpc_usart) ? DL_WINDOWED_FLAG_LZ4 : 0;
+    req.window = DL_WINDOWED_MAX_WINDOW;
+    req.start_index = start_index;
+    req.bytes = bytes;
+    if (data && datalen)
+        memcpy(req.filename, data, MIN(datalen, sizeof(req.filename) - 1));
+
+    uint32_t total = (bytes + DL_WINDOWED_CHUNK_SIZE - 1) / DL_WINDOWED_CHUNK_SIZE;
+    uint8_t *have = calloc(total, sizeof(uint8_t));
+    if (have == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    // Add delay depending on the communication channel & speed
+    if (ms_timeout != (size_t) - 1)
+        ms_timeout += communication_delay();
+
+    uint32_t next = 0, received = 0, resent = 0, crc_errors = 0;
+    uint64_t wire_bytes = 0;
+    uint8_t stalls = 0;
+    bool started = false;
+    int res = PM3_ETIMEOUT;
+    uint64_t t_start = msclock();
+
+    while (true) {
+
+        if (started == false) {
+            req.first_chunk = next;
+            clearCommandBuffer();
+            SendCommandNG(CMD_DOWNLOAD_WINDOWED, (uint8_t *)&req, sizeof(req));
+
+            // while probing the firmware, don't wait long for an answer it won't send
+            size_t probe_timeout = (windowed_dl_support == -1) ? 1000 + communication_delay() : ms_timeout;
+            if (WaitForResponseTimeoutW(CMD_DOWNLOAD_WINDOWED, response, probe_timeout, false) == false) {
+                if (windowed_dl_support == -1) {
+                    PrintAndLogEx(DEBUG, "Firmware doesn't support windowed download, using legacy download");
+                    windowed_dl_support = 0;
+                    res = PM3_ENOTIMPL;
+                }
+                break;
+            }
+            windowed_dl_support = 1;
+
+            if (response->status != PM3_SUCCESS) {
+                res = response->status;
+                break;
+            }
+            started = true;
+            __atomic_store_n(&timeout_start_time, msclock(), __ATOMIC_SEQ_CST);
+        }
+
+        if (getReply(response, RX_WAIT_SLICE_MS)) {
+
+            if (response->cmd == CMD_DOWNLOADED_WINDOWED && response->length >= sizeof(download_windowed_chunk_t)) {
+
+                download_windowed_chunk_t *chunk = (download_windowed_chunk_t *)response->data.asBytes;
+                uint32_t offset = chunk->seq * DL_WINDOWED_CHUNK_SIZE;
+
+                if (chunk->seq >= total
+                        || chunk->raw_len != MIN(bytes - offset, DL_WINDOWED_CHUNK_SIZE)
+                        || response->length != sizeof(download_windowed_chunk_t) + chunk->len) {
+                    PrintAndLogEx(DEBUG, "Dropping malformed chunk %u", chunk->seq);
+                    continue;
+                }
+
+                wire_bytes += response->length;
+                if (have[chunk->seq]) {
+                    resent++;
+                    continue;
+                }
+
+                if (chunk->flags & DL_WINDOWED_FLAG_LZ4) {
+                    int n = LZ4_decompress_safe((const char *)chunk->data, (char *)dest + offset, chunk->len, chunk->raw_len);
+                    if (n != chunk->raw_len) {
+                        crc_errors++;
+                        continue;
+                    }
+                } else {
+                    memcpy(dest + offset, chunk->data, chunk->raw_len);
+                }
+
+                uint8_t first = 0, second = 0;
+                compute_crc(CRC_14443_A, dest + offset, chunk->raw_len, &first, &second);
+                if (((first << 8) | second) != chunk->crc) {
+                    crc_errors++;
+                    continue;
+                }
+
+                have[chunk->seq] = 1;
+                received++;
+                stalls = 0;
+
+            } else if (response->cmd == CMD_DOWNLOAD_WINDOWED_ACK) {
+                // end of window
+                dl_windowed_ack(have, total, &next);
+
+            } else if (response->cmd == CMD_ACK) {
+                if (received == total) {
+                    res = PM3_SUCCESS;
+                    break;
+                }
+            } else if (response->cmd == CMD_WTX && response->length == sizeof(uint16_t)) {
+                uint16_t wtx = response->data.asDwords[0] & 0xFFFF;
+                PrintAndLogEx(DEBUG, "Got Waiting Time eXtension request %i ms", wtx);
+                if (ms_timeout != (size_t) - 1)
+                    ms_timeout += wtx;
+            }
+            continue;
+        }
+
+        uint64_t tmp_clk = __atomic_load_n(&timeout_start_time, __ATOMIC_SEQ_CST);
+        if (msclock() - tmp_clk > ms_timeout) {
+            // device silent: acknowledge again, then resume from the first missing chunk
+            stalls++;
+            if (stalls > 3) {
+                PrintAndLogEx(FAILED, "Timed out while trying to download data from device");
+                break;
+            }
+            if (stalls == 3) {
+                PrintAndLogEx(DEBUG, "Resuming download at chunk %u / %u", next, total);
+                started = false;
+            } else {
+                dl_windowed_ack(have, total, &next);
+            }
+            __atomic_store_n(&timeout_start_time, msclock(), __ATOMIC_SEQ_CST);
+        }
+    }
+
+    if (res == PM3_SUCCESS) {
+        uint64_t ms = MAX(msclock() - t_start, 1);
+        // only worth showing on big transfers (flash, spiffs),  trace / sample downloads would get noisy
+        PrintAndLogEx((bytes >= 0x10000) ? INFO : DEBUG,
+                      "Downloaded " _YELLOW_("%u") " bytes in " _YELLOW_("%" PRIu64) " ms, " _YELLOW_("%.1f") " kB/s ( %" PRIu64 " bytes on the wire, %u chunks resent, %u crc errors )",
+                      bytes, ms, (float)bytes / ms, wire_bytes, resent, crc_errors
+                     );
+    }
+
+    free(have);
+    return res;
+}
+
 static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, size_t ms_timeout, bool show_warning, uint32_t rec_cmd) {
 
     uint32_t bytes_completed = 0;
@@ -835,10 +1320,13 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
 
     while (true) {
 
-        if (getReply(response)) {
+        // sleeps until the communication thread stores a reply
+        if (getReply(response, RX_WAIT_SLICE_MS)) {
 
-            if (response->cmd == CMD_ACK)
+            if (response->cmd == CMD_ACK) {
+                latency_end();
                 return true;
+            }
 
             // sample_buf is a array pointer, located in data.c
             // arg0 = offset in transfer. Startindex of this chunk
@@ -885,3 +1373,48 @@ static bool dl_it(uint8_t *dest, uint32_t bytes, PacketResponseNG *response, siz
     }
     return false;
 }
+
+void PrintCommandLatency(void) {
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "--- " _CYAN_("Client round-trip latency") " ---------------------------");
+
+    pthread_mutex_lock(&cmd_latency_mutex);
+    bool found = false;
+    for (uint8_t i = 0; i < CMD_LATENCY_SLOTS; i++) {
+        cmd_latency_t *e = &cmd_latency[i];
+        if (e->count == 0)
+            continue;
+
+        if (found == false) {
+            PrintAndLogEx(INFO, "  cmd  |   count |    min us |    avg us |    max us");
+            PrintAndLogEx(INFO, "-------+---------+-----------+-----------+----------");
+            found = true;
+        }
+        PrintAndLogEx(INFO, " 0x%04x| %7u | %9u | %9" PRIu64 " | %9u",
+                      e->cmd,
+                      e->count,
+                      e->min_us,
+                      e->total_us / e->count,
+                      e->max_us
+                     );
+    }
+    pthread_mutex_unlock(&cmd_latency_mutex);
+
+    if (found == false) {
+        PrintAndLogEx(INFO, "  no round-trips measured yet");
+    }
+}
+
+void PrintReplyQueueStats(void) {
+    uint64_t bytes_in = __atomic_load_n(&rx_stats.bytes_in, __ATOMIC_RELAXED);
+    uint64_t bytes_out = __atomic_load_n(&rx_stats.bytes_out, __ATOMIC_RELAXED);
+
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "--- " _CYAN_("Client reply queue") " ---------------------------------");
+    PrintAndLogEx(INFO, "  Replies stored.............. %" PRIu64, __atomic_load_n(&rx_stats.records, __ATOMIC_RELAXED));
+    PrintAndLogEx(INFO, "  Bytes queued now............ %" PRIu64, bytes_in - bytes_out);
+    PrintAndLogEx(INFO, "  High-water mark............. %" PRIu64 " bytes", __atomic_load_n(&rx_stats.bytes_hwm, __ATOMIC_RELAXED));
+    PrintAndLogEx(INFO, "  Capacity.................... %" PRIu64 " bytes", __atomic_load_n(&rx_stats.capacity, __ATOMIC_RELAXED));
+    PrintAndLogEx(INFO, "  Grows....................... %u", __atomic_load_n(&rx_stats.grows, __ATOMIC_RELAXED));
+    PrintAndLogEx(INFO, "  Backpressure stalls......... %u", __atomic_load_n(&rx_stats.stalls, __ATOMIC_RELAXED));
+}
@@ -32,11 +32,6 @@ extern "C" {
     }
 #endif
 
-//For storing command that are received from the device
-#ifndef CMD_BUFFER_SIZE
-#define CMD_BUFFER_SIZE 100
-#endif
-
 typedef enum {
     BIG_BUF,
     BIG_BUF_EML,
@@ -89,6 +84,11 @@ bool WaitForResponse(uint32_t cmd, PacketResponseNG *response);
 //bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 bool GetFromDevice(DeviceMemType_t memtype, uint8_t *dest, uint32_t bytes, uint32_t start_index, uint8_t *data, uint32_t datalen, PacketResponseNG *response, size_t ms_timeout, bool show_warning);
 
+// print per-command round-trip latency statistics collected by WaitForResponse* / GetFromDevice
+void PrintCommandLatency(void);
+// print reply queue statistics (high-water mark, grows, backpressure stalls)
+void PrintReplyQueueStats(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -49,6 +49,11 @@
 #include "util.h"
 #include "cmdhficlass.h"  // pagemap
 #include "protocols.h"    // iclass defines
+#include "lz4/lz4.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #ifdef _WIN32
 #include "scandir.h"
@@ -77,6 +82,27 @@ struct wave_info_t {
     } PACKED audio_data;
 } PACKED;
 
+// binary graph file:
+//   graph_file_hdr_t | samples, int8_t or int32_t each, raw or as one LZ4 block
+#define GRAPH_FILE_MAGIC        "PM3GRAPH"
+#define GRAPH_FILE_VERSION      1
+#define GRAPH_FILE_RAW          0
+#define GRAPH_FILE_LZ4          1
+
+typedef struct {
+    char magic[8];
+    uint16_t version;
+    uint8_t encoding;
+    uint8_t sample_size;        // bytes per stored sample, 1 or 4
+    uint32_t samples;
+    uint32_t data_len;          // bytes following the header
+    uint32_t sample_rate;
+    uint8_t decimation;
+    uint8_t bits_per_sample;
+    uint8_t reserved[2];
+    char source[48];
+} PACKED graph_file_hdr_t;
+
 /**
  * @brief checks if a file exists
  * @param filename
@@ -696,6 +722,198 @@ out:
     return retval;
 }
 
+int saveFileGraph(const char *preferredName, const int *data, size_t datalen, const graph_file_info_t *info, bool compress) {
+
+    if (data == NULL || datalen > UINT32_MAX / sizeof(int32_t)) return PM3_EINVARG;
+
+    graph_file_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, GRAPH_FILE_MAGIC, sizeof(hdr.magic));
+    hdr.version = GRAPH_FILE_VERSION;
+    hdr.encoding = compress ? GRAPH_FILE_LZ4 : GRAPH_FILE_RAW;
+    hdr.samples = datalen;
+    if (info) {
+        hdr.sample_rate = info->sample_rate;
+        hdr.decimation = info->decimation;
+        hdr.bits_per_sample = info->bits_per_sample;
+        memcpy(hdr.source, info->source, MIN(sizeof(hdr.source), sizeof(info->source)) - 1);
+    }
+
+    // samples of the device are bytes, processed graphs may not be
+    hdr.sample_size = sizeof(int8_t);
+    for (size_t i = 0; i < datalen; i++) {
+        if (data[i] < INT8_MIN || data[i] > INT8_MAX) {
+            hdr.sample_size = sizeof(int32_t);
+            break;
+        }
+    }
+
+    size_t raw_len = datalen * hdr.sample_size;
+    size_t bound = compress ? LZ4_compressBound(raw_len) : raw_len;
+    uint8_t *buf = calloc(sizeof(hdr) + raw_len + bound, sizeof(uint8_t));
+    if (buf == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    uint8_t *raw = buf + sizeof(hdr);
+    if (hdr.sample_size == sizeof(int8_t)) {
+        for (size_t i = 0; i < datalen; i++)
+            raw[i] = (int8_t)data[i];
+    } else {
+        memcpy(raw, data, raw_len);
+    }
+    hdr.data_len = raw_len;
+
+    // compressed after the raw samples, moved behind the header when smaller
+    if (compress) {
+        int n = LZ4_compress_default((const char *)raw, (char *)raw + raw_len, raw_len, bound);
+        if (n > 0 && (size_t)n < raw_len) {
+            memmove(raw, raw + raw_len, n);
+            hdr.data_len = n;
+        } else {
+            hdr.encoding = GRAPH_FILE_RAW;
+        }
+    }
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    char *fileName = newfilenamemcopy(preferredName, ".pm3b");
+    if (fileName == NULL) {
+        free(buf);
+        return PM3_EMALLOC;
+    }
+
+    int retval = PM3_SUCCESS;
+    FILE *f = fopen(fileName, "wb");
+    if (!f) {
+        PrintAndLogEx(WARNING, "file not found or locked. "_YELLOW_("'%s'"), fileName);
+        retval = PM3_EFILE;
+        goto out;
+    }
+    size_t len = sizeof(hdr) + hdr.data_len;
+    if (fwrite(buf, 1, len, f) != len) {
+        PrintAndLogEx(WARNING, "error writing to " _YELLOW_("'%s'"), fileName);
+        retval = PM3_EFILE;
+    }
+    fclose(f);
+
+    if (retval == PM3_SUCCESS) {
+        PrintAndLogEx(SUCCESS, "saved " _YELLOW_("%zu") " samples in " _YELLOW_("%zu") " bytes to binary graph file " _YELLOW_("'%s'"), datalen, len, fileName);
+    }
+
+out:
+    free(buf);
+    free(fileName);
+    return retval;
+}
+
+int loadFileGraph(const char *path, int *data, size_t maxdatalen, size_t *datalen, graph_file_info_t *info) {
+
+    if (data == NULL || datalen == NULL) return PM3_EINVARG;
+
+    graph_file_hdr_t hdr;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "file not found or locked. '" _YELLOW_("%s")"'", path);
+        return PM3_EFILE;
+    }
+    size_t bytes_read = fread(&hdr, 1, sizeof(hdr), f);
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    if (bytes_read != sizeof(hdr) || memcmp(hdr.magic, GRAPH_FILE_MAGIC, sizeof(hdr.magic)) != 0) {
+        fclose(f);
+        return PM3_ENODATA;
+    }
+
+    size_t raw_len = (size_t)hdr.samples * hdr.sample_size;
+    if (hdr.version != GRAPH_FILE_VERSION
+            || (hdr.sample_size != sizeof(int8_t) && hdr.sample_size != sizeof(int32_t))
+            || (hdr.encoding == GRAPH_FILE_RAW && hdr.data_len != raw_len)
+            || hdr.encoding > GRAPH_FILE_LZ4
+            || raw_len > INT32_MAX
+            || (uint64_t)fsize != sizeof(hdr) + (uint64_t)hdr.data_len) {
+        PrintAndLogEx(FAILED, "graph file " _YELLOW_("%s") " has a wrong version or size", path);
+        fclose(f);
+        return PM3_EFILE;
+    }
+
+    // the header is not trusted, check the sample count before allocating or decompressing anything
+    if (hdr.samples > maxdatalen) {
+        PrintAndLogEx(FAILED, "graph file " _YELLOW_("%s") " has %u samples, more than the %zu allowed", path, hdr.samples, maxdatalen);
+        fclose(f);
+        return PM3_EOVFLOW;
+    }
+
+#ifdef _WIN32
+    uint8_t *map = calloc(fsize, sizeof(uint8_t));
+    if (map == NULL) {
+        PrintAndLogEx(FAILED, "error, cannot allocate memory");
+        fclose(f);
+        return PM3_EMALLOC;
+    }
+    fseek(f, 0, SEEK_SET);
+    bytes_read = fread(map, 1, fsize, f);
+    fclose(f);
+    if (bytes_read != (size_t)fsize) {
+        PrintAndLogEx(FAILED, "error, bytes read mismatch file size");
+        free(map);
+        return PM3_EFILE;
+    }
+#else
+    uint8_t *map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    fclose(f);
+    if (map == MAP_FAILED) {
+        PrintAndLogEx(FAILED, "Cannot map graph file " _YELLOW_("%s"), path);
+        return PM3_EFILE;
+    }
+#endif
+
+    int retval = PM3_SUCCESS;
+    const uint8_t *raw = map + sizeof(hdr);
+    uint8_t *unpacked = NULL;
+    if (hdr.encoding == GRAPH_FILE_LZ4) {
+        unpacked = calloc(raw_len + 1, sizeof(uint8_t));
+        if (unpacked == NULL) {
+            PrintAndLogEx(FAILED, "error, cannot allocate memory");
+            retval = PM3_EMALLOC;
+            goto out;
+        }
+        int n = LZ4_decompress_safe((const char *)raw, (char *)unpacked, hdr.data_len, raw_len);
+        if (n < 0 || (size_t)n != raw_len) {
+            PrintAndLogEx(FAILED, "graph file " _YELLOW_("%s") " is damaged", path);
+            retval = PM3_EFILE;
+            goto out;
+        }
+        raw = unpacked;
+    }
+
+    size_t n = hdr.samples;
+    if (hdr.sample_size == sizeof(int8_t)) {
+        for (size_t i = 0; i < n; i++)
+            data[i] = (int8_t)raw[i];
+    } else {
+        memcpy(data, raw, n * sizeof(int32_t));
+    }
+    *datalen = n;
+
+    if (info) {
+        memset(info, 0, sizeof(graph_file_info_t));
+        info->sample_rate = hdr.sample_rate;
+        info->decimation = hdr.decimation;
+        info->bits_per_sample = hdr.bits_per_sample;
+        memcpy(info->source, hdr.source, MIN(sizeof(info->source), sizeof(hdr.source)) - 1);
+    }
+
+out:
+    free(unpacked);
+#ifdef _WIN32
+    free(map);
+#else
+    munmap(map, fsize);
+#endif
+    return retval;
+}
+
 int createMfcKeyDump(const char *preferredName, uint8_t sectorsCnt, sector_t *e_sector) {
 
     if (e_sector == NULL) return PM3_EINVARG;
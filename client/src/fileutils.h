@@ -146,6 +146,42 @@ int saveFileWAVE(const char *preferredName, int *data, size_t datalen);
  */
 int saveFilePM3(const char *preferredName, int *data, size_t datalen);
 
+// acquisition details kept in a binary graph file
+typedef struct {
+    uint32_t sample_rate;       // Hz, 0 if unknown
+    uint8_t decimation;         // 0 if unknown
+    uint8_t bits_per_sample;    // 0 if unknown
+    char source[48];            // command which acquired the samples
+} graph_file_info_t;
+
+/**
+ * @brief Utility function to save graph samples to a binary file (.pm3b). The header holds the
+ * acquisition details, samples are stored as bytes when they fit, else as 32 bit ints,
+ * optionally LZ4 compressed. This method takes a preferred name, but if that
+ * file already exists, it tries with another name until it finds something suitable.
+ *
+ * @param preferredName
+ * @param data The samples to write to the file
+ * @param datalen the number of samples
+ * @param info acquisition details, may be NULL
+ * @param compress LZ4 compress the samples
+ * @return PM3_SUCCESS for ok, PM3_E* for failz
+ */
+int saveFileGraph(const char *preferredName, const int *data, size_t datalen, const graph_file_info_t *info, bool compress);
+
+/**
+ * @brief Utility function to load graph samples from a binary file (.pm3b). The file is memory mapped
+ * where the system allows it.
+ *
+ * @param path
+ * @param data The array to store the samples in
+ * @param maxdatalen the number of samples your data array has, longer files fail with PM3_EOVFLOW
+ * @param datalen the number of samples loaded from file
+ * @param info acquisition details from the header, may be NULL
+ * @return PM3_SUCCESS for ok, PM3_ENODATA if the file isn't a binary graph file, PM3_E* for failz
+ */
+int loadFileGraph(const char *path, int *data, size_t maxdatalen, size_t *datalen, graph_file_info_t *info);
+
 /**
  * @brief Utility function to save a keydump into a binary file.
  *
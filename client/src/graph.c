@@ -10,6 +10,8 @@
 #include "graph.h"
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include "ui.h"
 #include "proxgui.h"
 #include "util.h"    //param_get32ex
@@ -17,8 +19,184 @@
 #include "cmddata.h" //for g_debugmode
 
 
-int GraphBuffer[MAX_GRAPH_TRACE_LEN];
-size_t GraphTraceLen;
+static int plot_graph[MAX_GRAPH_TRACE_LEN];
+static uint8_t plot_demod[MAX_DEMOD_BUF_LEN];
+static demod_ctx_t plot_ctx = {
+    .graph = plot_graph,
+    .demod = plot_demod,
+    .signal = { 255, -255, 0, 0, true },
+    .plot = true
+};
+
+__thread demod_ctx_t *g_demod = &plot_ctx;
+
+// lfdemod.c works on the signal properties of the current context
+signal_t *getSignalProperties(void) {
+    return &g_demod->signal;
+}
+
+demod_ctx_t *demod_ctx_new(void) {
+    demod_ctx_t *ctx = calloc(1, sizeof(demod_ctx_t));
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->graph = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+    ctx->demod = calloc(MAX_DEMOD_BUF_LEN, sizeof(uint8_t));
+    if (ctx->graph == NULL || ctx->demod == NULL) {
+        demod_ctx_free(ctx);
+        return NULL;
+    }
+    ctx->signal = (signal_t) { 255, -255, 0, 0, true };
+    return ctx;
+}
+
+void demod_ctx_free(demod_ctx_t *ctx) {
+    if (ctx == NULL || ctx == &plot_ctx)
+        return;
+
+    free(ctx->graph);
+    free(ctx->demod);
+    free(ctx->saved_graph);
+    free(ctx->saved_demod);
+    free(ctx->autocorr.correl);
+    free(ctx->autocorr.sums);
+    free(ctx->autocorr.fft_re);
+    free(ctx->autocorr.fft_im);
+    free(ctx->autocorr.fft_cos);
+    free(ctx->autocorr.fft_sin);
+    free(ctx);
+}
+
+demod_ctx_t *demod_ctx_set(demod_ctx_t *ctx) {
+    demod_ctx_t *prev = g_demod;
+    g_demod = (ctx) ? ctx : &plot_ctx;
+    return prev;
+}
+
+void demod_ctx_copy(demod_ctx_t *dst, const demod_ctx_t *src) {
+    memcpy(dst->graph, src->graph, src->graph_len * sizeof(int));
+    dst->graph_len = src->graph_len;
+    // all of it, some demods leave bits past their length untouched
+    memcpy(dst->demod, src->demod, MAX_DEMOD_BUF_LEN);
+    dst->demod_len = src->demod_len;
+    dst->demod_start_idx = src->demod_start_idx;
+    dst->demod_clock = src->demod_clock;
+    dst->signal = src->signal;
+}
+
+// Clock and carrier detection remembered for the samples they ran on, so the
+// demodulators of lf search share them.  Not with debug output, which would be lost.
+#define GRAPH_DETECT_SLOTS  8
+#define GRAPH_DETECT_ASK    0x01
+#define GRAPH_DETECT_FC     0x02
+#define GRAPH_DETECT_PSK    0x04
+#define GRAPH_DETECT_NRZ    0x08
+#define GRAPH_DETECT_FSK    0x10
+
+typedef struct {
+    uint64_t hash;
+    size_t size;
+    uint8_t have;
+    int ask_in;
+    int ask_clock;
+    int ask_idx;
+    uint16_t fc;
+    int psk_clock;
+    size_t psk_start;
+    int nrz_clock;
+    size_t nrz_start;
+    uint16_t fsk_fc;
+    uint8_t fsk_rf;
+    int fsk_edge;
+} graph_detect_t;
+
+static graph_detect_t graph_detect[GRAPH_DETECT_SLOTS];
+static uint32_t graph_detect_next = 0;
+static pthread_mutex_t graph_detect_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// the samples and the signal properties the detection depends on
+static uint64_t graph_detect_hash(const uint8_t *bits, size_t size) {
+    const signal_t *sp = getSignalProperties();
+    int props[] = { sp->low, sp->high, sp->mean, sp->amplitude, sp->isnoise };
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < sizeof(props); i++) {
+        h ^= ((const uint8_t *)props)[i];
+        h *= 0x100000001b3ULL;
+    }
+    for (size_t i = 0; i < size; i++) {
+        h ^= bits[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// copies the slot of the samples to e, returns false if there's none or it lacks what
+static bool graph_detect_get(const uint8_t *bits, size_t size, uint8_t what, graph_detect_t *e) {
+    if (g_debugMode)
+        return false;
+
+    memset(e, 0, sizeof(graph_detect_t));
+    e->hash = graph_detect_hash(bits, size);
+    e->size = size;
+
+    bool found = false;
+    pthread_mutex_lock(&graph_detect_lock);
+    for (int i = 0; i < GRAPH_DETECT_SLOTS; i++) {
+        if (graph_detect[i].have && graph_detect[i].hash == e->hash && graph_detect[i].size == size) {
+            *e = graph_detect[i];
+            found = (e->have & what) == what;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&graph_detect_lock);
+    return found;
+}
+
+static void graph_detect_put(const graph_detect_t *e) {
+    if (g_debugMode)
+        return;
+
+    pthread_mutex_lock(&graph_detect_lock);
+    int slot = -1;
+    for (int i = 0; i < GRAPH_DETECT_SLOTS; i++) {
+        if (graph_detect[i].have && graph_detect[i].hash == e->hash && graph_detect[i].size == e->size) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        slot = graph_detect_next++ % GRAPH_DETECT_SLOTS;
+        memset(&graph_detect[slot], 0, sizeof(graph_detect_t));
+    }
+
+    // merge, another thread may have filled in other results meanwhile
+    graph_detect_t *d = &graph_detect[slot];
+    d->hash = e->hash;
+    d->size = e->size;
+    if (e->have & GRAPH_DETECT_ASK) {
+        d->ask_in = e->ask_in;
+        d->ask_clock = e->ask_clock;
+        d->ask_idx = e->ask_idx;
+    }
+    if (e->have & GRAPH_DETECT_FC)
+        d->fc = e->fc;
+    if (e->have & GRAPH_DETECT_PSK) {
+        d->psk_clock = e->psk_clock;
+        d->psk_start = e->psk_start;
+    }
+    if (e->have & GRAPH_DETECT_NRZ) {
+        d->nrz_clock = e->nrz_clock;
+        d->nrz_start = e->nrz_start;
+    }
+    if (e->have & GRAPH_DETECT_FSK) {
+        d->fsk_fc = e->fsk_fc;
+        d->fsk_rf = e->fsk_rf;
+        d->fsk_edge = e->fsk_edge;
+    }
+    d->have |= e->have;
+    pthread_mutex_unlock(&graph_detect_lock);
+}
 
 /* write a manchester bit to the graph
 TODO,  verfy that this doesn't overflow buffer  (iceman)
@@ -49,21 +227,25 @@ size_t ClearGraph(bool redraw) {
 }
 // option '1' to save GraphBuffer any other to restore
 void save_restoreGB(uint8_t saveOpt) {
-    static int SavedGB[MAX_GRAPH_TRACE_LEN];
-    static size_t SavedGBlen = 0;
-    static bool GB_Saved = false;
-    static int SavedGridOffsetAdj = 0;
+    demod_ctx_t *ctx = g_demod;
 
     if (saveOpt == GRAPH_SAVE) { //save
-        memcpy(SavedGB, GraphBuffer, sizeof(GraphBuffer));
-        SavedGBlen = GraphTraceLen;
-        GB_Saved = true;
-        SavedGridOffsetAdj = GridOffset;
-    } else if (GB_Saved) { //restore
-        memcpy(GraphBuffer, SavedGB, sizeof(GraphBuffer));
-        GraphTraceLen = SavedGBlen;
-        GridOffset = SavedGridOffsetAdj;
-        RepaintGraphWindow();
+        if (ctx->saved_graph == NULL)
+            ctx->saved_graph = calloc(MAX_GRAPH_TRACE_LEN, sizeof(int));
+        if (ctx->saved_graph == NULL)
+            return;
+
+        memcpy(ctx->saved_graph, GraphBuffer, GraphTraceLen * sizeof(int));
+        ctx->saved_graph_len = GraphTraceLen;
+        if (ctx->plot)
+            ctx->saved_grid_offset = GridOffset;
+    } else if (ctx->saved_graph) { //restore
+        memcpy(GraphBuffer, ctx->saved_graph, ctx->saved_graph_len * sizeof(int));
+        GraphTraceLen = ctx->saved_graph_len;
+        if (ctx->plot) {
+            GridOffset = ctx->saved_grid_offset;
+            RepaintGraphWindow();
+        }
     }
 }
 
@@ -96,6 +278,23 @@ size_t getFromGraphBuf(uint8_t *buff) {
     return i;
 }
 
+// set signal properties low/high/mean/amplitude and is_noise detection from the graph samples
+void computeGraphSignalProperties(void) {
+    if (GraphTraceLen == 0) {
+        computeSignalProperties(NULL, 0);
+        return;
+    }
+
+    uint8_t *bits = calloc(GraphTraceLen, sizeof(uint8_t));
+    if (bits == NULL) {
+        PrintAndLogEx(WARNING, "Failed to allocate memory");
+        return;
+    }
+    size_t size = getFromGraphBuf(bits);
+    computeSignalProperties(bits, size);
+    free(bits);
+}
+
 // A simple test to see if there is any data inside Graphbuffer.
 bool HasGraphData(void) {
     if (GraphTraceLen == 0) {
@@ -172,11 +371,25 @@ int GetAskClock(const char *str, bool printAns) {
         return -1;
     }
 
-    size_t ststart = 0, stend = 0;
-    bool st = DetectST(bits, &size, &clock1, &ststart, &stend);
-    int idx = stend;
-    if (st == false) {
-        idx = DetectASKClock(bits, size, &clock1, 20);
+    graph_detect_t e;
+    int idx = 0;
+    if (graph_detect_get(bits, size, GRAPH_DETECT_ASK, &e) && e.ask_in == clock1) {
+        clock1 = e.ask_clock;
+        idx = e.ask_idx;
+    } else {
+        e.ask_in = clock1;
+
+        size_t ststart = 0, stend = 0;
+        bool st = DetectST(bits, &size, &clock1, &ststart, &stend);
+        idx = stend;
+        if (st == false) {
+            idx = DetectASKClock(bits, size, &clock1, 20);
+        }
+
+        e.ask_clock = clock1;
+        e.ask_idx = idx;
+        e.have = GRAPH_DETECT_ASK;
+        graph_detect_put(&e);
     }
 
     if (clock1 > 0) {
@@ -207,7 +420,13 @@ int GetPskCarrier(bool verbose) {
         return -1;
     }
 
-    uint16_t fc = countFC(bits, size, false);
+    graph_detect_t e;
+    if (graph_detect_get(bits, size, GRAPH_DETECT_FC, &e) == false) {
+        e.fc = countFC(bits, size, false);
+        e.have = GRAPH_DETECT_FC;
+        graph_detect_put(&e);
+    }
+    uint16_t fc = e.fc;
     free(bits);
 
     uint8_t carrier = fc & 0xFF;
@@ -244,8 +463,18 @@ int GetPskClock(const char *str, bool verbose) {
     }
 
     size_t firstPhaseShiftLoc = 0;
-    uint8_t curPhase = 0, fc = 0;
-    clock1 = DetectPSKClock(bits, size, 0, &firstPhaseShiftLoc, &curPhase, &fc);
+    graph_detect_t e;
+    if (graph_detect_get(bits, size, GRAPH_DETECT_PSK, &e)) {
+        clock1 = e.psk_clock;
+        firstPhaseShiftLoc = e.psk_start;
+    } else {
+        uint8_t curPhase = 0, fc = 0;
+        clock1 = DetectPSKClock(bits, size, 0, &firstPhaseShiftLoc, &curPhase, &fc);
+        e.psk_clock = clock1;
+        e.psk_start = firstPhaseShiftLoc;
+        e.have = GRAPH_DETECT_PSK;
+        graph_detect_put(&e);
+    }
 
     if (clock1 >= 0)
         setClockGrid(clock1, firstPhaseShiftLoc);
@@ -282,7 +511,17 @@ int GetNrzClock(const char *str, bool verbose) {
     }
 
     size_t clkStartIdx = 0;
-    clock1 = DetectNRZClock(bits, size, 0, &clkStartIdx);
+    graph_detect_t e;
+    if (graph_detect_get(bits, size, GRAPH_DETECT_NRZ, &e)) {
+        clock1 = e.nrz_clock;
+        clkStartIdx = e.nrz_start;
+    } else {
+        clock1 = DetectNRZClock(bits, size, 0, &clkStartIdx);
+        e.nrz_clock = clock1;
+        e.nrz_start = clkStartIdx;
+        e.have = GRAPH_DETECT_NRZ;
+        graph_detect_put(&e);
+    }
     setClockGrid(clock1, clkStartIdx);
     // Only print this message if we're not looping something
     if (verbose)
@@ -337,7 +576,19 @@ bool fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, int *firstClockEdge) {
         return false;
     }
 
-    uint16_t ans = countFC(bits, size, true);
+    graph_detect_t e;
+    if (graph_detect_get(bits, size, GRAPH_DETECT_FSK, &e) == false) {
+        e.fsk_fc = countFC(bits, size, true);
+        e.fsk_rf = 0;
+        // left alone unless an edge is found
+        e.fsk_edge = INT_MIN;
+        if (e.fsk_fc)
+            e.fsk_rf = detectFSKClk(bits, size, (e.fsk_fc >> 8) & 0xFF, e.fsk_fc & 0xFF, &e.fsk_edge);
+        e.have = GRAPH_DETECT_FSK;
+        graph_detect_put(&e);
+    }
+
+    uint16_t ans = e.fsk_fc;
     if (ans == 0) {
         PrintAndLogEx(DEBUG, "DEBUG: No data found");
         free(bits);
@@ -346,7 +597,9 @@ bool fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, int *firstClockEdge) {
 
     *fc1 = (ans >> 8) & 0xFF;
     *fc2 = ans & 0xFF;
-    *rf1 = detectFSKClk(bits, size, *fc1, *fc2, firstClockEdge);
+    *rf1 = e.fsk_rf;
+    if (e.fsk_edge != INT_MIN)
+        *firstClockEdge = e.fsk_edge;
 
     free(bits);
 
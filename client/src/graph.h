@@ -12,6 +12,7 @@
 #define GRAPH_H__
 
 #include "common.h"
+#include "lfdemod.h"  // signal_t
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,6 +24,7 @@ bool HasGraphData(void);
 void setGraphBuf(uint8_t *buff, size_t size);
 void save_restoreGB(uint8_t saveOpt);
 size_t getFromGraphBuf(uint8_t *buff);
+void computeGraphSignalProperties(void);
 void convertGraphFromBitstream(void);
 void convertGraphFromBitstreamEx(int hi, int low);
 bool isGraphBitstream(void);
@@ -35,11 +37,60 @@ int GetFskClock(const char *str, bool verbose);
 bool fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, int *firstClockEdge);
 
 #define MAX_GRAPH_TRACE_LEN (40000 * 8)
+#define MAX_DEMOD_BUF_LEN (1024*128)
 #define GRAPH_SAVE 1
 #define GRAPH_RESTORE 0
 
-extern int GraphBuffer[MAX_GRAPH_TRACE_LEN];
-extern size_t GraphTraceLen;
+// AutoCorrelate's buffers, kept from one call to the next
+typedef struct {
+    int *correl;
+    size_t correl_size;
+    double *sums;
+    size_t sums_size;
+    double *fft_re, *fft_im, *fft_cos, *fft_sin;
+    size_t fft_size;
+} autocorr_buf_t;
+
+// The graph and demod buffers.  Commands work on the context of the calling thread,
+// which is the one shown in the plot window unless the thread has set its own, so a
+// few demodulations can run side by side on private copies of the graph.
+typedef struct {
+    int *graph;
+    size_t graph_len;
+    uint8_t *demod;
+    size_t demod_len;
+    int32_t demod_start_idx;
+    int demod_clock;
+    signal_t signal;        // getSignalProperties
+    bool plot;              // the plot window's, keeps the grid settings
+
+    // save_restoreGB / save_restoreDB
+    int *saved_graph;
+    size_t saved_graph_len;
+    int saved_grid_offset;
+    uint8_t *saved_demod;
+    size_t saved_demod_len;
+    int32_t saved_demod_start_idx;
+    int saved_demod_clock;
+
+    autocorr_buf_t autocorr;
+} demod_ctx_t;
+
+extern __thread demod_ctx_t *g_demod;
+
+demod_ctx_t *demod_ctx_new(void);
+void demod_ctx_free(demod_ctx_t *ctx);
+// sets the context of the calling thread, NULL for the plot window's, returns the one before
+demod_ctx_t *demod_ctx_set(demod_ctx_t *ctx);
+// copies the graph, the demod buffer and the signal properties of src
+void demod_ctx_copy(demod_ctx_t *dst, const demod_ctx_t *src);
+
+#define GraphBuffer         (g_demod->graph)
+#define GraphTraceLen       (g_demod->graph_len)
+#define DemodBuffer         (g_demod->demod)
+#define DemodBufferLen      (g_demod->demod_len)
+#define g_DemodStartIdx     (g_demod->demod_start_idx)
+#define g_DemodClock        (g_demod->demod_clock)
 
 #ifdef __cplusplus
 }
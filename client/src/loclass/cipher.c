@@ -280,6 +280,232 @@ void doMAC_N(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_ke
     free(address_data);
 }
 
+/**
+* Bitsliced MAC. The cipher above on MAC_BS_LANES keys at once, one key per bit of a
+* vector: every register bit is a vector, select() is a multiplexer tree over the key
+* bytes and the additions are ripple carry adders. The input bits are the same for all
+* keys. The core is compiled for several instruction sets with the target attribute and
+* picked at runtime.
+**/
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5)))
+#define MAC_BS_X86
+#endif
+
+#define MAC_BS_MAX_BITS (12 * 8)
+
+typedef uint64_t mac_bs_t __attribute__((vector_size(MAC_BS_LANES / 8)));
+typedef union {
+    mac_bs_t v;
+    uint64_t w[MAC_BS_LANES / 64];
+} mac_bs_u;
+
+// x0 when s is clear, x1 when set
+#define MAC_BS_MUX(s, x1, x0) ((x0) ^ ((s) & ((x0) ^ (x1))))
+
+// sum = a + b mod 256
+#define MAC_BS_ADD8(sum, a, b) { \
+        mac_bs_t _c = zero; \
+        for (int _i = 0; _i < 8; _i++) { \
+            mac_bs_t _x = (a)[_i] ^ (b)[_i]; \
+            (sum)[_i] = _x ^ _c; \
+            _c = ((a)[_i] & (b)[_i]) | (_c & _x); \
+        } \
+    }
+
+typedef void mac_bs_block_t(const uint8_t *data, uint8_t data_size, const uint8_t *div_keys, uint32_t n, uint8_t *macs);
+
+static inline __attribute__((always_inline))
+void mac_bs_block(const uint8_t *data, uint8_t data_size, const uint8_t *div_keys, uint32_t n, uint8_t *macs) {
+    const uint32_t steps = data_size * 8 + 32;
+    mac_bs_t zero, ones;
+    memset(&zero, 0, sizeof(zero));
+    ones = ~zero;
+
+    // k[j][i] is bit i of key byte j
+    mac_bs_u k[8][8];
+    memset(k, 0, sizeof(k));
+    for (uint32_t lane = 0; lane < n; lane++) {
+        uint64_t m = 1ULL << (lane & 0x3f);
+        for (int j = 0; j < 8; j++) {
+            uint8_t kb = div_keys[lane * 8 + j];
+            for (int i = 0; i < 8; i++)
+                k[j][i].w[lane >> 6] |= m & -(uint64_t)((kb >> i) & 1);
+        }
+    }
+
+    // t and b shift right, a new bit goes in at the top.  tp[i] is bit i of t, each step
+    // moves the window up by one.
+    mac_bs_t t_buf[16 + MAC_BS_MAX_BITS + 32];
+    mac_bs_t b_buf[8 + MAC_BS_MAX_BITS + 32];
+    mac_bs_t *tp = t_buf, *bp = b_buf;
+    mac_bs_t l[8], r[8], tmp[8];
+
+    // init(k)
+    for (int i = 0; i < 16; i++)
+        tp[i] = ((0xE012 >> i) & 1) ? ones : zero;
+    for (int i = 0; i < 8; i++) {
+        bp[i] = ((0x4c >> i) & 1) ? ones : zero;
+        tmp[i] = k[0][i].v ^ bp[i];
+    }
+    mac_bs_t c_ec[8], c_21[8];
+    for (int i = 0; i < 8; i++) {
+        c_ec[i] = ((0xEC >> i) & 1) ? ones : zero;
+        c_21[i] = ((0x21 >> i) & 1) ? ones : zero;
+    }
+    MAC_BS_ADD8(l, tmp, c_ec);
+    MAC_BS_ADD8(r, tmp, c_21);
+
+    mac_bs_u out[32];
+
+    for (uint32_t step = 0; step < steps; step++) {
+        bool y = false;
+        if (step < data_size * 8u)
+            y = (data[step >> 3] >> (step & 7)) & 1;
+        else
+            out[step - data_size * 8].v = r[2];
+
+        // T(t), B(b), in the paper's numbering x0 is the top bit
+        mac_bs_t Tt = tp[15] ^ tp[14] ^ tp[10] ^ tp[8] ^ tp[5] ^ tp[4] ^ tp[1] ^ tp[0];
+        mac_bs_t Bb = bp[6] ^ bp[5] ^ bp[4] ^ bp[0];
+
+        // select(T(t), y, r), r0 is the top bit of r
+        mac_bs_t z0 = (r[7] & r[5]) ^ (r[6] & ~r[4]) ^ (r[5] | r[3]);
+        mac_bs_t z1 = (r[7] | r[5]) ^ (r[2] | r[0]) ^ r[6] ^ r[1] ^ Tt;
+        mac_bs_t z2 = (r[4] & ~r[2]) ^ (r[3] & r[1]) ^ r[0] ^ Tt;
+        if (y)
+            z1 = ~z1;
+
+        tp[16] = Tt ^ r[7] ^ r[3];
+        bp[8] = Bb ^ r[0];
+        tp++;
+        bp++;
+
+        // (k[select] ^ b')
+        for (int i = 0; i < 8; i++) {
+            mac_bs_t a0 = MAC_BS_MUX(z2, k[1][i].v, k[0][i].v);
+            mac_bs_t a1 = MAC_BS_MUX(z2, k[3][i].v, k[2][i].v);
+            mac_bs_t a2 = MAC_BS_MUX(z2, k[5][i].v, k[4][i].v);
+            mac_bs_t a3 = MAC_BS_MUX(z2, k[7][i].v, k[6][i].v);
+            mac_bs_t c0 = MAC_BS_MUX(z1, a1, a0);
+            mac_bs_t c1 = MAC_BS_MUX(z1, a3, a2);
+            tmp[i] = MAC_BS_MUX(z0, c1, c0) ^ bp[i];
+        }
+
+        // r' = tmp + l, l' = tmp + l + r
+        mac_bs_t rn[8];
+        MAC_BS_ADD8(rn, tmp, l);
+        MAC_BS_ADD8(l, rn, r);
+        memcpy(r, rn, sizeof(r));
+    }
+
+    // output bit o is bit o & 7 of mac byte o >> 3
+    memset(macs, 0, n * 4);
+    for (uint32_t lane = 0; lane < n; lane++) {
+        for (int o = 0; o < 32; o++)
+            macs[lane * 4 + (o >> 3)] |= ((out[o].w[lane >> 6] >> (lane & 0x3f)) & 1) << (o & 7);
+    }
+}
+
+static void mac_bs_block_NOSIMD(const uint8_t *data, uint8_t data_size, const uint8_t *div_keys, uint32_t n, uint8_t *macs) {
+    mac_bs_block(data, data_size, div_keys, n, macs);
+}
+
+#if defined(MAC_BS_X86)
+__attribute__((target("avx2")))
+static void mac_bs_block_AVX2(const uint8_t *data, uint8_t data_size, const uint8_t *div_keys, uint32_t n, uint8_t *macs) {
+    mac_bs_block(data, data_size, div_keys, n, macs);
+}
+
+__attribute__((target("avx512f")))
+static void mac_bs_block_AVX512(const uint8_t *data, uint8_t data_size, const uint8_t *div_keys, uint32_t n, uint8_t *macs) {
+    mac_bs_block(data, data_size, div_keys, n, macs);
+}
+#endif
+
+static mac_bs_simd_t intMacSIMD = MAC_BS_AUTO;
+
+void SetMacSIMDInstr(mac_bs_simd_t instr) {
+    intMacSIMD = instr;
+}
+
+bool MacSIMDInstrSupported(mac_bs_simd_t instr) {
+#if defined(MAC_BS_X86)
+    __builtin_cpu_init();
+#endif
+    switch (instr) {
+#if defined(MAC_BS_X86)
+        case MAC_BS_AVX512:
+            return __builtin_cpu_supports("avx512f");
+        case MAC_BS_AVX2:
+            return __builtin_cpu_supports("avx2");
+#else
+        case MAC_BS_AVX512:
+        case MAC_BS_AVX2:
+            return false;
+#endif
+        case MAC_BS_AUTO:
+        case MAC_BS_NOSIMD:
+            return true;
+    }
+    return false;
+}
+
+mac_bs_simd_t GetMacSIMDInstr(void) {
+    if (intMacSIMD != MAC_BS_AUTO)
+        return intMacSIMD;
+    if (MacSIMDInstrSupported(MAC_BS_AVX512))
+        return MAC_BS_AVX512;
+    if (MacSIMDInstrSupported(MAC_BS_AVX2))
+        return MAC_BS_AVX2;
+    return MAC_BS_NOSIMD;
+}
+
+const char *GetMacSIMDInstrName(mac_bs_simd_t instr) {
+    switch (instr) {
+        case MAC_BS_AVX512:
+            return "AVX512F";
+        case MAC_BS_AVX2:
+            return "AVX2";
+        case MAC_BS_AUTO:
+        case MAC_BS_NOSIMD:
+            break;
+    }
+    return "no";
+}
+
+static mac_bs_block_t *mac_bs_function(void) {
+    switch (GetMacSIMDInstr()) {
+#if defined(MAC_BS_X86)
+        case MAC_BS_AVX512:
+            return mac_bs_block_AVX512;
+        case MAC_BS_AVX2:
+            return mac_bs_block_AVX2;
+#else
+        case MAC_BS_AVX512:
+        case MAC_BS_AVX2:
+#endif
+        case MAC_BS_AUTO:
+        case MAC_BS_NOSIMD:
+            break;
+    }
+    return mac_bs_block_NOSIMD;
+}
+
+void doMAC_N_batch(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_keys, uint32_t count, uint8_t *macs) {
+    if (address_data_size > MAC_BS_MAX_BITS / 8)
+        address_data_size = MAC_BS_MAX_BITS / 8;
+
+    mac_bs_block_t *block = mac_bs_function();
+    for (uint32_t i = 0; i < count; i += MAC_BS_LANES) {
+        uint32_t n = (count - i < MAC_BS_LANES) ? count - i : MAC_BS_LANES;
+        block(address_data_p, address_data_size, div_keys + i * 8, n, macs + i * 4);
+    }
+}
+
+void doMAC_batch(uint8_t *cc_nr_p, uint8_t *div_keys, uint32_t count, uint8_t *macs) {
+    doMAC_N_batch(cc_nr_p, 12, div_keys, count, macs);
+}
+
 #ifndef ON_DEVICE
 int testMAC(void) {
     PrintAndLogEx(SUCCESS, "Testing MAC calculation...");
@@ -301,6 +527,47 @@ int testMAC(void) {
         printarr("    Correct_MAC   ", correct_MAC, 4);
         return PM3_ESOFT;
     }
-    return PM3_SUCCESS;
+
+    // the bitsliced MAC on every instruction set of this CPU, a partial last block included
+    uint32_t count = MAC_BS_LANES + 77;
+    uint8_t *keys = calloc(count, 8);
+    uint8_t *macs = calloc(count, 4);
+    if (keys == NULL || macs == NULL) {
+        free(keys);
+        free(macs);
+        return PM3_EMALLOC;
+    }
+    uint32_t seed = 0x1d49c9da;
+    for (uint32_t i = 0; i < count * 8; i++) {
+        seed = seed * 1103515245 + 12345;
+        keys[i] = seed >> 16;
+    }
+    memcpy(keys, div_key, 8);
+
+    int res = PM3_SUCCESS;
+    for (mac_bs_simd_t instr = MAC_BS_NOSIMD; instr <= MAC_BS_AVX512; instr++) {
+        if (MacSIMDInstrSupported(instr) == false)
+            continue;
+
+        SetMacSIMDInstr(instr);
+        doMAC_batch(cc_nr, keys, count, macs);
+
+        uint32_t bad = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            doMAC(cc_nr, keys + i * 8, calculated_mac);
+            if (memcmp(calculated_mac, macs + i * 4, 4) != 0)
+                bad++;
+        }
+        if (bad == 0) {
+            PrintAndLogEx(SUCCESS, "    MAC batch %s SIMD (%s)", GetMacSIMDInstrName(instr), _GREEN_("ok"));
+        } else {
+            PrintAndLogEx(FAILED, "    MAC batch %s SIMD (%s) %u of %u", GetMacSIMDInstrName(instr), _RED_("failed"), bad, count);
+            res = PM3_ESOFT;
+        }
+    }
+    SetMacSIMDInstr(MAC_BS_AUTO);
+    free(keys);
+    free(macs);
+    return res;
 }
 #endif
@@ -39,11 +39,31 @@
 #ifndef CIPHER_H
 #define CIPHER_H
 #include <stdint.h>
+#include <stdbool.h>
 #include "pm3_cmd.h"
 
 void doMAC(uint8_t *cc_nr_p, uint8_t *div_key_p, uint8_t mac[4]);
 void doMAC_N(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_key_p, uint8_t mac[4]);
 
+// MACs of count diversified keys (8 bytes each) over the same data, 4 bytes each into macs.
+// Bitsliced, MAC_BS_LANES keys at a time.  Data is at most 12 bytes.
+#define MAC_BS_LANES 512
+
+typedef enum {
+    MAC_BS_AUTO,
+    MAC_BS_NOSIMD,
+    MAC_BS_AVX2,
+    MAC_BS_AVX512
+} mac_bs_simd_t;
+
+void doMAC_batch(uint8_t *cc_nr_p, uint8_t *div_keys, uint32_t count, uint8_t *macs);
+void doMAC_N_batch(uint8_t *address_data_p, uint8_t address_data_size, uint8_t *div_keys, uint32_t count, uint8_t *macs);
+
+void SetMacSIMDInstr(mac_bs_simd_t instr);
+mac_bs_simd_t GetMacSIMDInstr(void);
+bool MacSIMDInstrSupported(mac_bs_simd_t instr);
+const char *GetMacSIMDInstrName(mac_bs_simd_t instr);
+
 #ifndef ON_DEVICE
 int testMAC(void);
 #endif
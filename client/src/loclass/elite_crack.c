@@ -48,6 +48,8 @@
 #include "fileutils.h"
 #include "mbedtls/des.h"
 #include "util_posix.h"
+#include "util.h"
+#include "crc32.h"
 
 /**
  * @brief Permutes a key from standard NIST format to Iclass specific format
@@ -291,120 +293,268 @@ static int _readFromDump(uint8_t dump[], dumpdata *item, uint8_t i) {
 }
 */
 
+/*
+ * The search of an item is cut in work units of up to LOCLASS_UNIT_SIZE brute values,
+ * which the threads take in turn.  Checked units are kept in a progress file, so an
+ * interrupted run resumes where it stopped.  Several processes can share the search of a
+ * dump, part k of n runs the units k, k + n, k + 2n ... of each item.  Every part writes
+ * its own progress file <name>.<k> and reads the files of the others to pick up the bytes
+ * they recovered.
+ */
+#define LOCLASS_UNIT_BITS           12
+#define LOCLASS_UNIT_SIZE           (1 << LOCLASS_UNIT_BITS)
+#define LOCLASS_MAX_UNITS           (1 << (24 - LOCLASS_UNIT_BITS))
+
+#define LOCLASS_PROGRESS_MAGIC      "LCPR"
+#define LOCLASS_PROGRESS_VERSION    1
+#define LOCLASS_SAVE_INTERVAL       10000   // ms between writes of the progress file
+#define LOCLASS_POLL_INTERVAL       1000    // ms between reads of the other parts' files
+#define LOCLASS_PRINT_INTERVAL      500
+
 typedef struct {
-    int thread_idx;
-    uint32_t endmask;
-    uint8_t numbytes_to_recover;
-    uint8_t bytes_to_recover[3];
-    uint8_t key_index[8];
-    uint16_t keytable[128];
-    loclass_dumpdata_t item;
-} loclass_thread_arg_t;
+    char magic[4];
+    uint16_t version;
+    uint16_t part;
+    uint16_t parts;
+    uint16_t item;                          // the items before this one are recovered
+    uint32_t dump_size;
+    uint8_t dump_crc[4];
+    uint8_t item_done;                      // all units of the item in this part are checked
+    uint16_t keytable[128];                 // as of the start of the item
+    uint8_t units[LOCLASS_MAX_UNITS / 8];   // units of the item checked
+} PACKED loclass_progress_t;
 
 typedef struct {
-    uint8_t values[3];
-} loclass_thread_ret_t;
+    const char *filename;                   // NULL, no progress file
+    uint16_t items;
+    loclass_progress_t p;
+} loclass_session_t;
+
+typedef struct {
+    loclass_dumpdata_t item;
+    uint32_t units;
+    uint32_t unit_size;
+    uint16_t part;
+    uint16_t parts;
+    uint8_t *done;
+    // DES subkeys of the key selection with the bytes to recover cleared, and of value v
+    // of byte i to recover on its own.  The key permutation and the DES key schedule only
+    // move bits around, the subkeys of a candidate are the xor of these.
+    uint32_t sk_base[32];
+    uint32_t sk_byte[3][256][32];
+    // shared by the threads
+    uint32_t next;
+    uint32_t checked;
+    uint32_t running;
+    uint32_t value;
+    bool found;
+    bool abort;
+} loclass_search_t;
 
 static size_t loclass_tc = 1;
-static int loclass_found = 0;
+
+static void loclass_key_schedule(uint8_t key_sel[8], uint32_t sk[32]) {
+    uint8_t key_sel_p[8] = {0};
+    permutekey_rev(key_sel, key_sel_p);
+    mbedtls_des_setkey(sk, key_sel_p);
+}
 
 static void *bf_thread(void *thread_arg) {
 
-    loclass_thread_arg_t *targ = (loclass_thread_arg_t *)thread_arg;
-    const uint32_t endmask = targ->endmask;
-    const uint8_t numbytes_to_recover = targ->numbytes_to_recover;
-    uint32_t brute = targ->thread_idx;
+    loclass_search_t *s = (loclass_search_t *)thread_arg;
 
-    uint8_t csn[8];
-    uint8_t cc_nr[12];
-    uint8_t mac[4];
-    uint8_t key_index[8];
-    uint8_t bytes_to_recover[3];
-    uint16_t keytable[128];
+    // diversified keys of a block of brute values and their MACs, computed bitsliced
+    uint8_t div_keys[MAC_BS_LANES * 8];
+    uint8_t macs[MAC_BS_LANES * 4];
+    uint8_t crypted_csn[8];
+    mbedtls_des_context ctx;
+    mbedtls_des_init(&ctx);
 
-    memcpy(csn, targ->item.csn, sizeof(csn));
-    memcpy(cc_nr, targ->item.cc_nr, sizeof(cc_nr));
-    memcpy(mac, targ->item.mac, sizeof(mac));
-    memcpy(key_index, targ->key_index, sizeof(key_index));
-    memcpy(bytes_to_recover, targ->bytes_to_recover, sizeof(bytes_to_recover));
-    memcpy(keytable, targ->keytable, sizeof(keytable));
+    while (__atomic_load_n(&s->found, __ATOMIC_SEQ_CST) == false && __atomic_load_n(&s->abort, __ATOMIC_SEQ_CST) == false) {
 
-    int found;
-    while (!(brute & endmask)) {
+        uint32_t unit = s->part + __atomic_fetch_add(&s->next, 1, __ATOMIC_SEQ_CST) * s->parts;
+        if (unit >= s->units)
+            break;
 
-        found = __atomic_load_n(&loclass_found, __ATOMIC_SEQ_CST);
+        // checked before an interruption
+        if (__atomic_load_n(&s->done[unit >> 3], __ATOMIC_SEQ_CST) & (1 << (unit & 7)))
+            continue;
 
-        if (found != 0xFF) return NULL;
+        bool complete = true;
+        const uint32_t end = (unit + 1) * s->unit_size;
+        for (uint32_t brute = unit * s->unit_size; brute < end; brute += MAC_BS_LANES) {
 
-        //Update the keytable with the brute-values
-        for (uint8_t i = 0; i < numbytes_to_recover; i++) {
-            keytable[bytes_to_recover[i]] &= 0xFF00;
-            keytable[bytes_to_recover[i]] |= (brute >> (i * 8) & 0xFF);
+            if (__atomic_load_n(&s->found, __ATOMIC_SEQ_CST) || __atomic_load_n(&s->abort, __ATOMIC_SEQ_CST)) {
+                complete = false;
+                break;
+            }
+
+            uint32_t n = (end - brute < MAC_BS_LANES) ? end - brute : MAC_BS_LANES;
+            for (uint32_t j = 0; j < n; j++) {
+                uint32_t v = brute + j;
+                const uint32_t *sk0 = s->sk_byte[0][v & 0xFF];
+                const uint32_t *sk1 = s->sk_byte[1][(v >> 8) & 0xFF];
+                const uint32_t *sk2 = s->sk_byte[2][(v >> 16) & 0xFF];
+                for (uint8_t k = 0; k < 32; k++) {
+                    ctx.sk[k] = s->sk_base[k] ^ sk0[k] ^ sk1[k] ^ sk2[k];
+                }
+
+                // Diversify, as diversifyKey() does
+                mbedtls_des_crypt_ecb(&ctx, s->item.csn, crypted_csn);
+                hash0(x_bytes_to_num(crypted_csn, sizeof(crypted_csn)), div_keys + 8 * j);
+            }
+
+            // Calc mac
+            doMAC_batch(s->item.cc_nr, div_keys, n, macs);
+
+            // success
+            for (uint32_t j = 0; j < n; j++) {
+                if (memcmp(macs + 4 * j, s->item.mac, 4) == 0) {
+                    __atomic_store_n(&s->value, brute + j, __ATOMIC_SEQ_CST);
+                    __atomic_store_n(&s->found, true, __ATOMIC_SEQ_CST);
+                    break;
+                }
+            }
         }
 
-        uint8_t key_sel[8] = {0};
+        if (complete) {
+            __atomic_fetch_or(&s->done[unit >> 3], 1 << (unit & 7), __ATOMIC_SEQ_CST);
+            __atomic_fetch_add(&s->checked, 1, __ATOMIC_SEQ_CST);
+        }
+    }
 
-        // Piece together the key
-        key_sel[0] = keytable[key_index[0]] & 0xFF;
-        key_sel[1] = keytable[key_index[1]] & 0xFF;
-        key_sel[2] = keytable[key_index[2]] & 0xFF;
-        key_sel[3] = keytable[key_index[3]] & 0xFF;
-        key_sel[4] = keytable[key_index[4]] & 0xFF;
-        key_sel[5] = keytable[key_index[5]] & 0xFF;
-        key_sel[6] = keytable[key_index[6]] & 0xFF;
-        key_sel[7] = keytable[key_index[7]] & 0xFF;
+    mbedtls_des_free(&ctx);
+    __atomic_fetch_sub(&s->running, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
 
-        // Permute from iclass format to standard format
+static void loclass_progress_name(const loclass_session_t *lsession, uint16_t part, char *fn, size_t fnlen) {
+    if (lsession->p.parts > 1)
+        snprintf(fn, fnlen, "%s.%u", lsession->filename, part + 1);
+    else
+        snprintf(fn, fnlen, "%s", lsession->filename);
+}
 
-        uint8_t key_sel_p[8] = {0};
-        permutekey_rev(key_sel, key_sel_p);
+static int loclass_progress_read(const char *fn, loclass_progress_t *p) {
+    FILE *f = fopen(fn, "rb");
+    if (f == NULL)
+        return PM3_EFILE;
 
-        // Diversify
-        uint8_t div_key[8] = {0};
-        diversifyKey(csn, key_sel_p, div_key);
+    size_t bytes_read = fread(p, 1, sizeof(loclass_progress_t), f);
+    fclose(f);
+
+    if (bytes_read != sizeof(loclass_progress_t) ||
+            memcmp(p->magic, LOCLASS_PROGRESS_MAGIC, sizeof(p->magic)) != 0 ||
+            p->version != LOCLASS_PROGRESS_VERSION) {
+        return PM3_ESOFT;
+    }
+    return PM3_SUCCESS;
+}
 
-        // Calc mac
-        uint8_t calculated_MAC[4] = {0};
-        doMAC(cc_nr, div_key, calculated_MAC);
+// written to a temporary file first, a part reading it never sees half of it
+static int loclass_progress_save(loclass_session_t *lsession) {
+    if (lsession->filename == NULL)
+        return PM3_SUCCESS;
 
-        // success
-        if (memcmp(calculated_MAC, mac, 4) == 0) {
+    char fn[FILE_PATH_SIZE + 16] = {0};
+    char tmp[FILE_PATH_SIZE + 24] = {0};
+    loclass_progress_name(lsession, lsession->p.part, fn, sizeof(fn));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", fn);
 
-            loclass_thread_ret_t *r = (loclass_thread_ret_t *)malloc(sizeof(loclass_thread_ret_t));
+    loclass_progress_t p = lsession->p;
+    for (size_t i = 0; i < sizeof(p.units); i++) {
+        p.units[i] = __atomic_load_n(&lsession->p.units[i], __ATOMIC_SEQ_CST);
+    }
 
-            for (uint8_t i = 0 ; i < numbytes_to_recover; i++) {
-                r->values[i] = keytable[bytes_to_recover[i]] & 0xFF;
-            }
-            __atomic_store_n(&loclass_found, targ->thread_idx, __ATOMIC_SEQ_CST);
-            pthread_exit((void *)r);
-        }
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL) {
+        PrintAndLogEx(WARNING, "failed to write progress file " _YELLOW_("%s"), tmp);
+        return PM3_EFILE;
+    }
+    size_t bytes_written = fwrite(&p, 1, sizeof(p), f);
+    fclose(f);
+
+#ifdef _WIN32
+    remove(fn);
+#endif
+    if (bytes_written != sizeof(p) || rename(tmp, fn) != 0) {
+        PrintAndLogEx(WARNING, "failed to write progress file " _YELLOW_("%s"), fn);
+        return PM3_EFILE;
+    }
+    return PM3_SUCCESS;
+}
 
-        brute += loclass_tc;
+static void loclass_next_item(loclass_session_t *lsession, uint16_t item, const uint16_t keytable[]) {
+    lsession->p.item = item;
+    lsession->p.item_done = 0;
+    memcpy(lsession->p.keytable, keytable, sizeof(lsession->p.keytable));
+    memset(lsession->p.units, 0, sizeof(lsession->p.units));
+    loclass_progress_save(lsession);
+}
 
-#define _CLR_ "\x1b[0K"
+// Reads the progress of the other parts.  When one of them is past the current item, true is
+// returned with its item and keytable, the session is left alone.  all_done tells if every other
+// part has checked all its units of the current item.
+static bool loclass_peek_parts(const loclass_session_t *lsession, uint16_t *ahead_item, uint16_t keytable[], bool *all_done) {
+    loclass_progress_t p;
+    char fn[FILE_PATH_SIZE + 16] = {0};
+    int ahead = -1;
+
+    *all_done = true;
+    for (uint16_t part = 0; part < lsession->p.parts; part++) {
+        if (part == lsession->p.part)
+            continue;
+
+        loclass_progress_name(lsession, part, fn, sizeof(fn));
+        if (loclass_progress_read(fn, &p) != PM3_SUCCESS ||
+                p.parts != lsession->p.parts ||
+                p.dump_size != lsession->p.dump_size ||
+                memcmp(p.dump_crc, lsession->p.dump_crc, sizeof(p.dump_crc)) != 0) {
+            *all_done = false;
+            continue;
+        }
 
-        if (numbytes_to_recover == 3) {
-            if ((brute > 0) && ((brute & 0xFFFF) == 0)) {
-                PrintAndLogEx(INPLACE, "[ %02x %02x %02x ] %8u / %u", bytes_to_recover[0], bytes_to_recover[1], bytes_to_recover[2], brute, 0xFFFFFF);
-            }
-        } else if (numbytes_to_recover == 2) {
-            if ((brute > 0) && ((brute & 0x3F) == 0))
-                PrintAndLogEx(INPLACE, "[ %02x %02x ] %5u / %u" _CLR_, bytes_to_recover[0], bytes_to_recover[1], brute, 0xFFFF);
-        } else {
-            if ((brute > 0) && ((brute & 0x1F) == 0))
-                PrintAndLogEx(INPLACE, "[ %02x ] %3u / %u" _CLR_, bytes_to_recover[0], brute, 0xFF);
+        if (p.item > lsession->p.item && (ahead == -1 || p.item > ahead)) {
+            ahead = p.item;
+            memcpy(keytable, p.keytable, sizeof(p.keytable));
         }
+
+        // a part behind hasn't seen this item yet
+        if (p.item < lsession->p.item || (p.item == lsession->p.item && p.item_done == 0))
+            *all_done = false;
     }
-    pthread_exit(NULL);
 
-    void *dummyptr = NULL;
-    return dummyptr;
+    if (ahead == -1)
+        return false;
+
+    *ahead_item = ahead;
+    return true;
 }
 
-int bruteforceItem(loclass_dumpdata_t item, uint16_t keytable[]) {
+// as loclass_peek_parts, and takes over the item and keytable of a part ahead.
+// Not while bf_thread workers run, they mark their units in the session.
+static bool loclass_poll_parts(loclass_session_t *lsession, uint16_t keytable[], bool *all_done) {
+    uint16_t ahead = 0;
+    if (loclass_peek_parts(lsession, &ahead, keytable, all_done) == false)
+        return false;
+
+    loclass_next_item(lsession, ahead, keytable);
+    return true;
+}
+
+#define _CLR_ "\x1b[0K"
+
+static void loclass_print_progress(const loclass_session_t *lsession, const loclass_search_t *s, const uint8_t *bytes_to_recover, uint8_t numbytes_to_recover, uint32_t total, uint32_t done, uint64_t elapsed) {
+    uint32_t checked = __atomic_load_n(&s->checked, __ATOMIC_SEQ_CST);
+    double rate = (elapsed) ? (double)checked * s->unit_size * 1000 / elapsed : 0;
+    uint32_t eta = (checked) ? (uint64_t)(total - done - checked) * elapsed / checked / 1000 : 0;
 
-    // reset thread signals
-    loclass_found = 0xFF;
+    PrintAndLogEx(INPLACE, "item %u / %u [ %s] %4u / %u units  %.0f keys/s  ETA " _YELLOW_("%02u:%02u:%02u") _CLR_,
+                  lsession->p.item + 1, lsession->items, sprint_hex(bytes_to_recover, numbytes_to_recover),
+                  done + checked, total, rate, eta / 3600, (eta / 60) % 60, eta % 60);
+}
+
+static int bruteforceItemEx(loclass_dumpdata_t item, uint16_t keytable[], loclass_session_t *lsession) {
 
     //Get the key index (hash1)
     uint8_t key_index[8] = {0};
@@ -448,37 +598,145 @@ int bruteforceItem(loclass_dumpdata_t item, uint16_t keytable[]) {
         return PM3_ESOFT;
     }
 
-    loclass_thread_arg_t args[loclass_tc];
-    // init thread arguments
-    for (int i = 0; i < loclass_tc; i++) {
-        args[i].thread_idx = i;
-        args[i].numbytes_to_recover = numbytes_to_recover;
-        args[i].endmask = 1 << 8 * numbytes_to_recover;
+    loclass_search_t *s = (loclass_search_t *)calloc(1, sizeof(loclass_search_t));
+    if (s == NULL) {
+        PrintAndLogEx(WARNING, "failed to allocate memory");
+        return PM3_EMALLOC;
+    }
+
+    const uint32_t space = 1 << 8 * numbytes_to_recover;
+    memcpy(&s->item, &item, sizeof(loclass_dumpdata_t));
+    s->units = (space > LOCLASS_UNIT_SIZE) ? space >> LOCLASS_UNIT_BITS : 1;
+    s->unit_size = space / s->units;
+    s->part = lsession->p.part;
+    s->parts = lsession->p.parts;
+    s->done = lsession->p.units;
+
+    // Piece together the key, the bytes to recover left out
+    uint8_t key_sel[8] = {0};
+    for (uint8_t i = 0; i < 8; i++) {
+        if ((keytable[key_index[i]] & LOCLASS_BEING_CRACKED) == 0)
+            key_sel[i] = keytable[key_index[i]] & 0xFF;
+    }
+    loclass_key_schedule(key_sel, s->sk_base);
+
+    for (uint8_t b = 0; b < numbytes_to_recover; b++) {
+        for (uint16_t v = 0; v < 256; v++) {
+            for (uint8_t i = 0; i < 8; i++) {
+                key_sel[i] = (key_index[i] == bytes_to_recover[b]) ? v : 0;
+            }
+            loclass_key_schedule(key_sel, s->sk_byte[b][v]);
+        }
+    }
 
-        memcpy((void *)&args[i].item, (void *)&item, sizeof(loclass_dumpdata_t));
-        memcpy(args[i].bytes_to_recover, bytes_to_recover, sizeof(args[i].bytes_to_recover));
-        memcpy(args[i].key_index, key_index, sizeof(args[i].key_index));
-        memcpy(args[i].keytable, keytable, sizeof(args[i].keytable));
+    // units of this part, and how many of them an earlier run checked
+    uint32_t total = 0, done = 0;
+    for (uint32_t unit = s->part; unit < s->units; unit += s->parts) {
+        total++;
+        if (s->done[unit >> 3] & (1 << (unit & 7)))
+            done++;
     }
 
+    s->running = loclass_tc;
     pthread_t threads[loclass_tc];
+    size_t started = 0;
     // create threads
-    for (int i = 0; i < loclass_tc; i++) {
-        int res = pthread_create(&threads[i], NULL, bf_thread, (void *)&args[i]);
-        if (res) {
+    for (; started < loclass_tc; started++) {
+        if (pthread_create(&threads[started], NULL, bf_thread, (void *)s)) {
             PrintAndLogEx(NORMAL, "");
             PrintAndLogEx(WARNING, "Failed to create pthreads. Quitting");
-            return PM3_ESOFT;
+            __atomic_store_n(&s->abort, true, __ATOMIC_SEQ_CST);
+            __atomic_fetch_sub(&s->running, loclass_tc - started, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+
+    // report progress, save it and look at the other parts while the threads run
+    bool aborted = (started != loclass_tc);
+    bool taken_over = false;
+    bool all_done = false;
+    uint16_t ahead_item = 0;
+    uint16_t ahead_keytable[sizeof(lsession->p.keytable) / sizeof(uint16_t)];
+    uint64_t t_start = msclock(), t_save = t_start, t_poll = t_start, t_print = t_start;
+    while (__atomic_load_n(&s->running, __ATOMIC_SEQ_CST) > 0) {
+        // most items take a few ms, look closer at the start
+        msleep((msclock() - t_start < 100) ? 1 : 20);
+        uint64_t now = msclock();
+
+        if (kbd_enter_pressed()) {
+            PrintAndLogEx(WARNING, "\naborted via keyboard!");
+            __atomic_store_n(&s->abort, true, __ATOMIC_SEQ_CST);
+            aborted = true;
+        }
+
+        if (now - t_print >= LOCLASS_PRINT_INTERVAL) {
+            loclass_print_progress(lsession, s, bytes_to_recover, numbytes_to_recover, total, done, now - t_start);
+            t_print = now;
+        }
+
+        if (now - t_save >= LOCLASS_SAVE_INTERVAL) {
+            loclass_progress_save(lsession);
+            t_save = now;
+        }
+
+        if (lsession->p.parts > 1 && now - t_poll >= LOCLASS_POLL_INTERVAL && taken_over == false) {
+            // switched to only once the threads are gone
+            taken_over = loclass_peek_parts(lsession, &ahead_item, ahead_keytable, &all_done);
+            if (taken_over)
+                __atomic_store_n(&s->abort, true, __ATOMIC_SEQ_CST);
+            t_poll = now;
         }
     }
+
     // wait for threads to terminate:
-    void *ptrs[loclass_tc];
-    for (int i = 0; i < loclass_tc; i++)
-        pthread_join(threads[i], &ptrs[i]);
+    for (size_t i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    if (t_print != t_start)
+        loclass_print_progress(lsession, s, bytes_to_recover, numbytes_to_recover, total, done, msclock() - t_start);
 
-    // was it a success?
     int res = PM3_SUCCESS;
-    if (loclass_found == 0xFF) {
+    if (taken_over) {
+        // continue with the other part's progress
+        memcpy(keytable, ahead_keytable, sizeof(ahead_keytable));
+        loclass_next_item(lsession, ahead_item, keytable);
+
+    } else if (s->found) {
+        for (uint8_t i = 0; i < numbytes_to_recover; i++) {
+            keytable[bytes_to_recover[i]] = (s->value >> (i * 8)) & 0xFF;
+            keytable[bytes_to_recover[i]] |= LOCLASS_CRACKED;
+        }
+        loclass_next_item(lsession, lsession->p.item + 1, keytable);
+
+    } else if (aborted) {
+        res = PM3_EOPABORTED;
+        for (uint8_t i = 0; i < numbytes_to_recover; i++) {
+            keytable[bytes_to_recover[i]] &= ~LOCLASS_BEING_CRACKED;
+        }
+        loclass_progress_save(lsession);
+
+    } else {
+        // this part is done, the key may be in one of the others
+        lsession->p.item_done = 1;
+        loclass_progress_save(lsession);
+
+        if (lsession->p.parts > 1) {
+            PrintAndLogEx(NORMAL, "");
+            PrintAndLogEx(INFO, "waiting for the other parts... press " _GREEN_("<Enter>") " to abort");
+            while ((taken_over = loclass_poll_parts(lsession, keytable, &all_done)) == false && all_done == false) {
+                if (kbd_enter_pressed()) {
+                    PrintAndLogEx(WARNING, "\naborted via keyboard!");
+                    res = PM3_EOPABORTED;
+                    break;
+                }
+                msleep(LOCLASS_POLL_INTERVAL);
+            }
+            if (taken_over || res == PM3_EOPABORTED) {
+                free(s);
+                return res;
+            }
+        }
+
         res = PM3_ESOFT;
         PrintAndLogEx(NORMAL, "");
         PrintAndLogEx(WARNING, "Failed to recover %d bytes using the following CSN", numbytes_to_recover);
@@ -489,25 +747,20 @@ int bruteforceItem(loclass_dumpdata_t item, uint16_t keytable[]) {
             keytable[bytes_to_recover[i]] &= 0xFF;
             keytable[bytes_to_recover[i]] |= LOCLASS_CRACK_FAILED;
         }
-
-    } else {
-        loclass_thread_ret_t ice = *((loclass_thread_ret_t *)ptrs[loclass_found]);
-
-        for (uint8_t i = 0; i < numbytes_to_recover; i++) {
-            keytable[bytes_to_recover[i]] = ice.values[i];
-            keytable[bytes_to_recover[i]] &= 0xFF;
-            keytable[bytes_to_recover[i]] |= LOCLASS_CRACKED;
-        }
-        for (uint8_t i = 0; i < loclass_tc; i++) {
-            free(ptrs[i]);
-        }
     }
 
-    memset(args, 0x00, sizeof(args));
-    memset(threads, 0x00, sizeof(threads));
+    free(s);
     return res;
 }
 
+int bruteforceItem(loclass_dumpdata_t item, uint16_t keytable[]) {
+    loclass_session_t lsession;
+    memset(&lsession, 0, sizeof(lsession));
+    lsession.items = 1;
+    lsession.p.parts = 1;
+    return bruteforceItemEx(item, keytable, &lsession);
+}
+
 /**
  * @brief Performs brute force attack against a dump-data item, containing csn, cc_nr and mac.
  *This method calculates the hash1 for the CSN, and determines what bytes need to be bruteforced
@@ -721,9 +974,12 @@ int calculateMasterKey(uint8_t first16bytes[], uint8_t kcus[]) {
  * @param dump
  * @param dumpsize
  * @param keytable
+ * @param progress progress file to resume from and update, or NULL
+ * @param part the part of the search to run, 0 .. parts - 1
+ * @param parts number of processes sharing the search
  * @return
  */
-int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]) {
+int bruteforceDumpEx(uint8_t dump[], size_t dumpsize, uint16_t keytable[], const char *progress, uint16_t part, uint16_t parts) {
     uint8_t i;
     size_t itemsize = sizeof(loclass_dumpdata_t);
     loclass_dumpdata_t *attack = (loclass_dumpdata_t *) calloc(itemsize, sizeof(uint8_t));
@@ -732,23 +988,96 @@ int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]) {
         return PM3_EMALLOC;
     }
 
+    loclass_session_t *lsession = (loclass_session_t *) calloc(1, sizeof(loclass_session_t));
+    if (lsession == NULL) {
+        PrintAndLogEx(WARNING, "failed to allocate memory");
+        free(attack);
+        return PM3_EMALLOC;
+    }
+    lsession->filename = progress;
+    lsession->items = dumpsize / itemsize;
+    memcpy(lsession->p.magic, LOCLASS_PROGRESS_MAGIC, sizeof(lsession->p.magic));
+    lsession->p.version = LOCLASS_PROGRESS_VERSION;
+    lsession->p.part = part;
+    lsession->p.parts = parts;
+    lsession->p.dump_size = dumpsize;
+    crc32_ex(dump, dumpsize, lsession->p.dump_crc);
+    memcpy(lsession->p.keytable, keytable, sizeof(lsession->p.keytable));
+
+    // resume
+    if (progress != NULL) {
+        char fn[FILE_PATH_SIZE + 16] = {0};
+        loclass_progress_name(lsession, part, fn, sizeof(fn));
+
+        loclass_progress_t *p = (loclass_progress_t *) calloc(1, sizeof(loclass_progress_t));
+        if (p == NULL) {
+            PrintAndLogEx(WARNING, "failed to allocate memory");
+            free(lsession);
+            free(attack);
+            return PM3_EMALLOC;
+        }
+
+        int res = loclass_progress_read(fn, p);
+        if (res == PM3_SUCCESS) {
+            if (p->part != part || p->parts != parts || p->dump_size != dumpsize ||
+                    memcmp(p->dump_crc, lsession->p.dump_crc, sizeof(p->dump_crc)) != 0) {
+                PrintAndLogEx(ERR, "progress file " _YELLOW_("%s") " belongs to another dump or part", fn);
+                res = PM3_EINVARG;
+            } else {
+                memcpy(&lsession->p, p, sizeof(loclass_progress_t));
+                memcpy(keytable, p->keytable, sizeof(p->keytable));
+                PrintAndLogEx(INFO, "resuming from " _YELLOW_("%s") ", item %u / %u", fn, p->item + 1, lsession->items);
+            }
+        } else if (res == PM3_ESOFT) {
+            PrintAndLogEx(ERR, "progress file " _YELLOW_("%s") " is damaged", fn);
+            res = PM3_EINVARG;
+        } else {
+            res = loclass_progress_save(lsession);
+        }
+        free(p);
+
+        if (res != PM3_SUCCESS) {
+            free(lsession);
+            free(attack);
+            return res;
+        }
+    }
+
     loclass_tc = num_CPUs();
     PrintAndLogEx(INFO, "bruteforce using " _YELLOW_("%zu") " threads", loclass_tc);
+    if (parts > 1)
+        PrintAndLogEx(INFO, "running part " _YELLOW_("%u") " of %u", part + 1, parts);
+    PrintAndLogEx(INFO, "press " _GREEN_("<Enter>") " to abort");
 
-    int res = 0;
+    int res = PM3_SUCCESS;
 
     uint64_t t1 = msclock();
-    for (i = 0 ; i * itemsize < dumpsize ; i++) {
-        memcpy(attack, dump + i * itemsize, itemsize);
-        res = bruteforceItem(*attack, keytable);
-        if (res != PM3_SUCCESS)
-            break;
+    while (lsession->p.item < lsession->items) {
+        bool taken_over = false, all_done;
+        if (parts > 1)
+            taken_over = loclass_poll_parts(lsession, keytable, &all_done);
+
+        if (taken_over == false) {
+            memcpy(attack, dump + lsession->p.item * itemsize, itemsize);
+            res = bruteforceItemEx(*attack, keytable, lsession);
+            if (res != PM3_SUCCESS)
+                break;
+        }
     }
     free(attack);
     t1 = msclock() - t1;
     PrintAndLogEx(NORMAL, "");
     PrintAndLogEx(SUCCESS, "time " _YELLOW_("%" PRIu64) " seconds", t1 / 1000);
 
+    if (res == PM3_EOPABORTED && progress != NULL) {
+        PrintAndLogEx(INFO, "progress saved, run the same command again to resume");
+    }
+    free(lsession);
+
+    if (res == PM3_EOPABORTED) {
+        return res;
+    }
+
     if (res != PM3_SUCCESS) {
         PrintAndLogEx(ERR, "loclass exiting. Try run " _YELLOW_("`hf iclass sim -t 2`") " again and collect new data");
         return PM3_ESOFT;
@@ -769,6 +1098,11 @@ int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]) {
     }
     return calculateMasterKey(first16bytes, NULL);
 }
+
+int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]) {
+    return bruteforceDumpEx(dump, dumpsize, keytable, NULL, 0, 1);
+}
+
 /**
  * Perform a bruteforce against a file which has been saved by pm3
  *
@@ -776,7 +1110,7 @@ int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]) {
  * @param filename
  * @return
  */
-int bruteforceFile(const char *filename, uint16_t keytable[]) {
+int bruteforceFileEx(const char *filename, uint16_t keytable[], const char *progress, uint16_t part, uint16_t parts) {
 
     size_t dumplen = 0;
     uint8_t *dump = NULL;
@@ -784,10 +1118,14 @@ int bruteforceFile(const char *filename, uint16_t keytable[]) {
         return PM3_EFILE;
     }
 
-    uint8_t res = bruteforceDump(dump, dumplen, keytable);
+    int res = bruteforceDumpEx(dump, dumplen, keytable, progress, part, parts);
     free(dump);
     return res;
 }
+
+int bruteforceFile(const char *filename, uint16_t keytable[]) {
+    return bruteforceFileEx(filename, keytable, NULL, 0, 1);
+}
 /**
  *
  * @brief Same as above, if you don't care about the returned keytable (results only printed on screen)
@@ -873,6 +1211,31 @@ static int _testHash1(void) {
     return PM3_SUCCESS;
 }
 
+// the search xors the DES subkeys of the parts of the key selection
+static int _test_key_schedule(void) {
+    uint8_t a[8], b[8], ab[8];
+    uint32_t sk_a[32], sk_b[32], sk_ab[32];
+
+    for (int n = 0; n < 64; n++) {
+        for (uint8_t i = 0; i < 8; i++) {
+            a[i] = rand() & 0xFF;
+            b[i] = (n == 0) ? 0 : rand() & 0xFF;
+            ab[i] = a[i] ^ b[i];
+        }
+        loclass_key_schedule(a, sk_a);
+        loclass_key_schedule(b, sk_b);
+        loclass_key_schedule(ab, sk_ab);
+
+        for (uint8_t k = 0; k < 32; k++) {
+            if ((sk_a[k] ^ sk_b[k]) != sk_ab[k]) {
+                PrintAndLogEx(ERR, "Error with the key schedule of %s", sprint_hex(ab, 8));
+                return PM3_ESOFT;
+            }
+        }
+    }
+    return PM3_SUCCESS;
+}
+
 int testElite(bool slowtests) {
     PrintAndLogEx(INFO, "Testing iClass Elite functionality");
     PrintAndLogEx(INFO, "Testing hash2...");
@@ -909,6 +1272,10 @@ int testElite(bool slowtests) {
     res += _test_iclass_key_permutation();
     PrintAndLogEx((res == PM3_SUCCESS) ? SUCCESS : WARNING, "    key diversification (%s)", (res == PM3_SUCCESS) ? _GREEN_("ok") : _RED_("fail"));
 
+    PrintAndLogEx(INFO, "Testing key schedule...");
+    res += _test_key_schedule();
+    PrintAndLogEx((res == PM3_SUCCESS) ? SUCCESS : WARNING, "    key schedule (%s)", (res == PM3_SUCCESS) ? _GREEN_("ok") : _RED_("fail"));
+
     if (slowtests)
         res += _testBruteforce();
 
@@ -73,6 +73,17 @@ void permutekey_rev(uint8_t key[8], uint8_t dest[8]);
  * @return
  */
 int bruteforceFile(const char *filename, uint16_t keytable[]);
+/**
+ * @brief Same as bruteforceFile, resumable and shareable by several processes
+ * @param filename
+ * @param keytable
+ * @param progress progress file to resume from and update, or NULL.  With parts > 1
+ * each part uses <progress>.<part + 1>
+ * @param part the part of the search to run, 0 .. parts - 1
+ * @param parts number of processes sharing the search
+ * @return
+ */
+int bruteforceFileEx(const char *filename, uint16_t keytable[], const char *progress, uint16_t part, uint16_t parts);
 /**
  *
  * @brief Same as above, if you don't care about the returned keytable (results only printed on screen)
@@ -88,6 +99,7 @@ int bruteforceFileNoKeys(const char *filename);
  * @return
  */
 int bruteforceDump(uint8_t dump[], size_t dumpsize, uint16_t keytable[]);
+int bruteforceDumpEx(uint8_t dump[], size_t dumpsize, uint16_t keytable[], const char *progress, uint16_t part, uint16_t parts);
 
 /**
  * @brief Performs brute force attack against a dump-data item, containing csn, cc_nr and mac.
@@ -11,7 +11,13 @@
 //-----------------------------------------------------------------------------
 #include "mfkey.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "crapto1/crapto1.h"
+#include "crapto1/crypto1_bs.h"
+#include "util.h"              // num_CPUs
+#include "commonutil.h"        // ARRAYLEN
 
 // MIFARE
 int inline compare_uint64(const void *a, const void *b) {
@@ -42,6 +48,69 @@ uint32_t intersection(uint64_t *listA, uint64_t *listB) {
     return p3 - listA;
 }
 
+// open addressing hash set of keys, -1 marks an empty slot.
+// Used to intersect candidate lists in linear time, neither list needs to be sorted.
+static inline uint32_t keyset_slot(const keyset_t *set, uint64_t key) {
+    return (uint32_t)((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32) & set->mask;
+}
+
+bool keyset_init(keyset_t *set, const uint64_t *list, uint32_t count) {
+    uint64_t size = 16;
+    while (size < (uint64_t)count * 2)
+        size <<= 1;
+
+    set->slots = malloc(size * sizeof(uint64_t));
+    if (set->slots == NULL) {
+        set->mask = 0;
+        return false;
+    }
+    memset(set->slots, 0xFF, size * sizeof(uint64_t));
+    set->mask = size - 1;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (list[i] == UINT64_C(-1))
+            continue;
+        uint32_t slot = keyset_slot(set, list[i]);
+        while (set->slots[slot] != UINT64_C(-1) && set->slots[slot] != list[i])
+            slot = (slot + 1) & set->mask;
+        set->slots[slot] = list[i];
+    }
+    return true;
+}
+
+void keyset_free(keyset_t *set) {
+    free(set->slots);
+    set->slots = NULL;
+    set->mask = 0;
+}
+
+bool keyset_contains(const keyset_t *set, uint64_t key) {
+    if (set->slots == NULL || key == UINT64_C(-1))
+        return false;
+
+    uint32_t slot = keyset_slot(set, key);
+    while (set->slots[slot] != UINT64_C(-1)) {
+        if (set->slots[slot] == key)
+            return true;
+        slot = (slot + 1) & set->mask;
+    }
+    return false;
+}
+
+// keeps the members of list (terminated by -1) which are in the set. Number of elements is returned.
+uint32_t intersection_keyset(uint64_t *list, const keyset_t *set) {
+    if (list == NULL || set == NULL)
+        return 0;
+
+    uint64_t *p3 = list;
+    for (uint64_t *p1 = list; *p1 != UINT64_C(-1); p1++) {
+        if (keyset_contains(set, *p1))
+            *p3++ = *p1;
+    }
+    *p3 = UINT64_C(-1);
+    return p3 - list;
+}
+
 // Darkside attack (hf mf mifare)
 // if successful it will return a list of keys, not just one.
 uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t par_info, uint64_t ks_info, uint64_t **keys) {
@@ -89,32 +158,42 @@ uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t
     return i;
 }
 
+// rolls the states recovered from the first reader response back to the key and runs
+// them bitsliced through the second authentication.  Returns the number of matching
+// keys, the first one in key.
+static size_t mfkey32_check_states(struct Crypto1State *s, uint32_t nr_enc, uint32_t uid_nt, const crypto1_bs_word_t *words, size_t nwords, uint64_t *key) {
+    struct Crypto1State *t;
+    size_t first = 0;
+
+    for (t = s; t->odd | t->even; ++t) {
+        lfsr_rollback_word(t, 0, 0);
+        lfsr_rollback_word(t, nr_enc, 1);
+        lfsr_rollback_word(t, uid_nt, 0);
+    }
+
+    size_t found = crypto1_bs_test_states(s, t - s, words, nwords, &first, 1);
+    if (found)
+        crypto1_get_lfsr(&s[first], key);
+    return found;
+}
+
 // recover key from 2 different reader responses on same tag challenge
 bool mfkey32(nonces_t *data, uint64_t *outputkey) {
-    struct Crypto1State *s, *t;
+    struct Crypto1State *s;
     uint64_t outkey = 0;
-    uint64_t key = 0;     // recovered key
     bool isSuccess = false;
-    uint8_t counter = 0;
 
     uint32_t p640 = prng_successor(data->nonce, 64);
 
-    s = lfsr_recovery32(data->ar ^ p640, 0);
+    s = lfsr_recovery32_mt(data->ar ^ p640, 0, num_CPUs());
 
-    for (t = s; t->odd | t->even; ++t) {
-        lfsr_rollback_word(t, 0, 0);
-        lfsr_rollback_word(t, data->nr, 1);
-        lfsr_rollback_word(t, data->cuid ^ data->nonce, 0);
-        crypto1_get_lfsr(t, &key);
-        crypto1_word(t, data->cuid ^ data->nonce, 0);
-        crypto1_word(t, data->nr2, 1);
-        if (data->ar2 == (crypto1_word(t, 0, 0) ^ p640)) {
-            outkey = key;
-            counter++;
-            if (counter == 20) break;
-        }
-    }
-    isSuccess = (counter == 1);
+    const crypto1_bs_word_t words[] = {
+        { .in = data->cuid ^ data->nonce },
+        { .in = data->nr2, .is_encrypted = 1 },
+        { .in = 0, .ks = data->ar2 ^ p640, .ks_mask = 0xFFFFFFFF },
+    };
+    size_t found = mfkey32_check_states(s, data->nr, data->cuid ^ data->nonce, words, ARRAYLEN(words), &outkey);
+    isSuccess = (found == 1);
     *outputkey = (isSuccess) ? outkey : 0;
     crypto1_destroy(s);
     return isSuccess;
@@ -123,31 +202,21 @@ bool mfkey32(nonces_t *data, uint64_t *outputkey) {
 // recover key from 2 reader responses on 2 different tag challenges
 // skip "several found keys".  Only return true if ONE key is found
 bool mfkey32_moebius(nonces_t *data, uint64_t *outputkey) {
-    struct Crypto1State *s, *t;
+    struct Crypto1State *s;
     uint64_t outkey  = 0;
-    uint64_t key     = 0; // recovered key
     bool isSuccess = false;
-    int counter = 0;
     uint32_t p640 = prng_successor(data->nonce, 64);
     uint32_t p641 = prng_successor(data->nonce2, 64);
 
-    s = lfsr_recovery32(data->ar ^ p640, 0);
+    s = lfsr_recovery32_mt(data->ar ^ p640, 0, num_CPUs());
 
-    for (t = s; t->odd | t->even; ++t) {
-        lfsr_rollback_word(t, 0, 0);
-        lfsr_rollback_word(t, data->nr, 1);
-        lfsr_rollback_word(t, data->cuid ^ data->nonce, 0);
-        crypto1_get_lfsr(t, &key);
-
-        crypto1_word(t, data->cuid ^ data->nonce2, 0);
-        crypto1_word(t, data->nr2, 1);
-        if (data->ar2 == (crypto1_word(t, 0, 0) ^ p641)) {
-            outkey = key;
-            ++counter;
-            if (counter == 20) break;
-        }
-    }
-    isSuccess  = (counter == 1);
+    const crypto1_bs_word_t words[] = {
+        { .in = data->cuid ^ data->nonce2 },
+        { .in = data->nr2, .is_encrypted = 1 },
+        { .in = 0, .ks = data->ar2 ^ p641, .ks_mask = 0xFFFFFFFF },
+    };
+    size_t found = mfkey32_check_states(s, data->nr, data->cuid ^ data->nonce, words, ARRAYLEN(words), &outkey);
+    isSuccess  = (found == 1);
     *outputkey = (isSuccess) ? outkey : 0;
     crypto1_destroy(s);
     return isSuccess;
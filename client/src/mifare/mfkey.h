@@ -16,6 +16,11 @@
 #include "common.h"
 #include "mifare.h"
 
+typedef struct {
+    uint64_t *slots;
+    uint32_t mask;
+} keyset_t;
+
 uint32_t nonce2key(uint32_t uid, uint32_t nt, uint32_t nr, uint32_t ar, uint64_t par_info, uint64_t ks_info, uint64_t **keys);
 bool mfkey32(nonces_t *data, uint64_t *outputkey);
 bool mfkey32_moebius(nonces_t *data, uint64_t *outputkey);
@@ -24,4 +29,9 @@ int mfkey64(nonces_t *data, uint64_t *outputkey);
 int compare_uint64(const void *a, const void *b);
 uint32_t intersection(uint64_t *listA, uint64_t *listB);
 
+bool keyset_init(keyset_t *set, const uint64_t *list, uint32_t count);
+void keyset_free(keyset_t *set);
+bool keyset_contains(const keyset_t *set, uint64_t key);
+uint32_t intersection_keyset(uint64_t *list, const keyset_t *set);
+
 #endif
@@ -26,12 +26,126 @@
 #include "cmdparser.h"          // detection of flash capabilities
 #include "cmdflashmemspiffs.h"  // upload to flash mem
 
+// Darkside pipeline:  the device keeps collecting parity / keystream samples while worker
+// threads run nonce2key on the earlier ones.  Samples are handled in the order they came in.
+#define DARKSIDE_MAX_JOBS   4
+#define DARKSIDE_POLL_MS    100
+
+typedef struct {
+    uint32_t uid;
+    uint32_t nt;
+    uint32_t nr;
+    uint32_t ar;
+    uint64_t par_list;
+    uint64_t ks_list;
+    uint64_t *keylist;          // terminated by -1
+    uint32_t keycount;
+    keyset_t keyset;            // parity zero attack only
+    pthread_t thread;
+    bool threaded;
+    bool done;
+} darkside_job_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+darkside_worker_thread(void *arg) {
+    darkside_job_t *job = arg;
+
+    job->keycount = nonce2key(job->uid, job->nt, job->nr, job->ar, job->par_list, job->ks_list, &job->keylist);
+
+    // the hash set lets the main thread intersect with the earlier rounds without sorting
+    if (job->keycount && job->par_list == 0) {
+        if (keyset_init(&job->keyset, job->keylist, job->keycount) == false) {
+            free(job->keylist);
+            job->keylist = NULL;
+            job->keycount = 0;
+        }
+    }
+
+    __atomic_store_n(&job->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void darkside_send(uint8_t blockno, uint8_t key_type, bool first_run) {
+    struct {
+        uint8_t first_run;
+        uint8_t blockno;
+        uint8_t key_type;
+    } PACKED payload;
+    payload.first_run = first_run;
+    payload.blockno = blockno;
+    payload.key_type = key_type;
+    clearCommandBuffer();
+    SendCommandNG(CMD_HF_MIFARE_READER, (uint8_t *)&payload, sizeof(payload));
+}
+
+// stops the collecting round in progress.  The device answers with an abort, or with the sample it just finished.
+static bool darkside_stop(PacketResponseNG *resp) {
+    SendCommandNG(CMD_BREAK_LOOP, NULL, 0);
+    for (uint8_t i = 0; i < 3; i++) {
+        if (WaitForResponseTimeout(CMD_HF_MIFARE_READER, resp, 2000))
+            return true;
+    }
+    return false;
+}
+
+// fills the job from the device answer, returns the device status.  Only >= 0 comes with a sample
+static int32_t darkside_sample(PacketResponseNG *resp, darkside_job_t *job) {
+    struct p {
+        int32_t isOK;
+        uint8_t cuid[4];
+        uint8_t nt[4];
+        uint8_t par_list[8];
+        uint8_t ks_list[8];
+        uint8_t nr[4];
+        uint8_t ar[4];
+    } PACKED;
+    struct p *package = (struct p *) resp->data.asBytes;
+
+    if (resp->status == PM3_EOPABORTED)
+        return -1;
+
+    if (package->isOK < 0)
+        return package->isOK;
+
+    memset(job, 0, sizeof(*job));
+    job->uid = (uint32_t)bytes_to_num(package->cuid, sizeof(package->cuid));
+    job->nt = (uint32_t)bytes_to_num(package->nt, sizeof(package->nt));
+    job->par_list = bytes_to_num(package->par_list, sizeof(package->par_list));
+    job->ks_list = bytes_to_num(package->ks_list, sizeof(package->ks_list));
+    job->nr = (uint32_t)bytes_to_num(package->nr, 4);
+    job->ar = (uint32_t)bytes_to_num(package->ar, 4);
+    return package->isOK;
+}
+
+static void darkside_start(darkside_job_t *job) {
+    job->threaded = (pthread_create(&job->thread, NULL, darkside_worker_thread, job) == 0);
+    if (job->threaded == false)
+        darkside_worker_thread(job);
+}
+
+static void darkside_finish(darkside_job_t *job) {
+    if (job->threaded)
+        pthread_join(job->thread, NULL);
+    free(job->keylist);
+    keyset_free(&job->keyset);
+    job->keylist = NULL;
+}
+
 int mfDarkside(uint8_t blockno, uint8_t key_type, uint64_t *key) {
-    uint32_t uid = 0;
-    uint32_t nt = 0, nr = 0, ar = 0;
-    uint64_t par_list = 0, ks_list = 0;
-    uint64_t *keylist = NULL, *last_keylist = NULL;
+
+    darkside_job_t jobs[DARKSIDE_MAX_JOBS];
+    uint8_t jobs_head = 0, jobs_count = 0;
+    uint64_t *last_keylist = NULL;
     bool first_run = true;
+    bool device_busy = false;
+    bool parity_zero_reported = false;
+    uint16_t polls = 0;
+    int res = PM3_SUCCESS;
 
     // message
     PrintAndLogEx(INFO, "--------------------------------------------------------------------------------");
@@ -39,128 +153,151 @@ int mfDarkside(uint8_t blockno, uint8_t key_type, uint64_t *key) {
     PrintAndLogEx(INFO, "press pm3-button on the Proxmark3 device to abort both Proxmark3 and client");
     PrintAndLogEx(INFO, "--------------------------------------------------------------------------------");
 
-    while (true) {
-        clearCommandBuffer();
-        struct {
-            uint8_t first_run;
-            uint8_t blockno;
-            uint8_t key_type;
-        } PACKED payload;
-        payload.first_run = first_run;
-        payload.blockno = blockno;
-        payload.key_type = key_type;
-        SendCommandNG(CMD_HF_MIFARE_READER, (uint8_t *)&payload, sizeof(payload));
-
-        //flush queue
-        while (kbd_enter_pressed()) {
-            return PM3_EOPABORTED;
-        }
-
-        // wait cycle
-        while (true) {
-            PrintAndLogEx(NORMAL, "." NOLF);
+    //flush queue
+    while (kbd_enter_pressed()) {
+        return PM3_EOPABORTED;
+    }
 
-            if (kbd_enter_pressed()) {
-                return PM3_EOPABORTED;
-            }
+    *key = UINT64_C(-1);
 
-            PacketResponseNG resp;
-            if (WaitForResponseTimeout(CMD_HF_MIFARE_READER, &resp, 2000)) {
-                if (resp.status == PM3_EOPABORTED) {
-                    return -1;
-                }
+    while (res == PM3_SUCCESS && *key == UINT64_C(-1)) {
 
-                struct p {
-                    int32_t isOK;
-                    uint8_t cuid[4];
-                    uint8_t nt[4];
-                    uint8_t par_list[8];
-                    uint8_t ks_list[8];
-                    uint8_t nr[4];
-                    uint8_t ar[4];
-                } PACKED;
-
-                struct p *package = (struct p *) resp.data.asBytes;
-
-                if (package->isOK == -6) {
-                    *key = 0101;
-                    return 1;
-                }
+        // keep the device collecting while the host works on the earlier samples.
+        // Only start a round when there is room for its sample
+        if (device_busy == false && jobs_count < DARKSIDE_MAX_JOBS) {
+            darkside_send(blockno, key_type, first_run);
+            device_busy = true;
+            first_run = false;
+        }
 
-                if (package->isOK < 0)
-                    return package->isOK;
+        if (kbd_enter_pressed()) {
+            res = PM3_EOPABORTED;
+            break;
+        }
 
+        PacketResponseNG resp;
+        if (device_busy && WaitForResponseTimeout(CMD_HF_MIFARE_READER, &resp, DARKSIDE_POLL_MS)) {
+            device_busy = false;
 
-                uid = (uint32_t)bytes_to_num(package->cuid, sizeof(package->cuid));
-                nt = (uint32_t)bytes_to_num(package->nt, sizeof(package->nr));
-                par_list = bytes_to_num(package->par_list, sizeof(package->par_list));
-                ks_list = bytes_to_num(package->ks_list, sizeof(package->ks_list));
-                nr = (uint32_t)bytes_to_num(package->nr, 4);
-                ar = (uint32_t)bytes_to_num(package->ar, 4);
+            darkside_job_t *job = &jobs[(jobs_head + jobs_count) % DARKSIDE_MAX_JOBS];
+            int32_t isOK = darkside_sample(&resp, job);
+            if (isOK == -6) {
+                *key = 0101;
+                res = 1;
+                break;
+            }
+            if (isOK < 0) {
+                res = isOK;
                 break;
             }
-        }
-        PrintAndLogEx(NORMAL, "\n");
 
-        if (par_list == 0 && first_run == true) {
-            PrintAndLogEx(SUCCESS, "Parity is all zero. Most likely this card sends NACK on every authentication.");
+            PrintAndLogEx(NORMAL, "");
+            if (job->par_list == 0 && parity_zero_reported == false) {
+                PrintAndLogEx(SUCCESS, "Parity is all zero. Most likely this card sends NACK on every authentication.");
+                parity_zero_reported = true;
+            }
+            darkside_start(job);
+            jobs_count++;
+
+        } else if (++polls % (2000 / DARKSIDE_POLL_MS) == 0) {
+            PrintAndLogEx(NORMAL, "." NOLF);
         }
-        first_run = false;
 
-        uint32_t keycount = nonce2key(uid, nt, nr, ar, par_list, ks_list, &keylist);
+        if (device_busy == false && jobs_count)
+            msleep(DARKSIDE_POLL_MS / 10);
 
-        if (keycount == 0) {
-            PrintAndLogEx(FAILED, "key not found (lfsr_common_prefix list is null). Nt=%08x", nt);
-            PrintAndLogEx(FAILED, "this is expected to happen in 25%% of all cases. Trying again with a different reader nonce...");
-            continue;
-        }
+        // handle the finished samples, in order
+        while (jobs_count && __atomic_load_n(&jobs[jobs_head].done, __ATOMIC_ACQUIRE)) {
+            darkside_job_t *job = &jobs[jobs_head];
+            if (job->threaded) {
+                pthread_join(job->thread, NULL);
+                job->threaded = false;
+            }
+
+            uint64_t *candidates = job->keylist;
+            uint32_t keycount = job->keycount;
 
-        // only parity zero attack
-        if (par_list == 0) {
-            qsort(keylist, keycount, sizeof(*keylist), compare_uint64);
-            keycount = intersection(last_keylist, keylist);
             if (keycount == 0) {
-                free(last_keylist);
-                last_keylist = keylist;
-                PrintAndLogEx(FAILED, "no candidates found, trying again");
-                continue;
+                PrintAndLogEx(FAILED, "key not found (lfsr_common_prefix list is null). Nt=%08x", job->nt);
+                PrintAndLogEx(FAILED, "this is expected to happen in 25%% of all cases. Trying again with a different reader nonce...");
+                candidates = NULL;
+            } else if (job->par_list == 0) {
+                // only parity zero attack
+                candidates = last_keylist;
+                keycount = intersection_keyset(last_keylist, &job->keyset);
+                if (keycount == 0) {
+                    free(last_keylist);
+                    last_keylist = job->keylist;
+                    job->keylist = NULL;
+                    PrintAndLogEx(FAILED, "no candidates found, trying again");
+                    candidates = NULL;
+                }
             }
-        }
 
-        PrintAndLogEx(SUCCESS, "found " _YELLOW_("%u") " candidate key%s", keycount, (keycount > 1) ? "s." : ".");
+            if (candidates != NULL) {
+                // the device is needed for checking, stop the round in progress but keep its sample if it completed
+                if (device_busy) {
+                    if (darkside_stop(&resp) == false) {
+                        res = PM3_ETIMEOUT;
+                        break;
+                    }
+                    device_busy = false;
+
+                    darkside_job_t *next = &jobs[(jobs_head + jobs_count) % DARKSIDE_MAX_JOBS];
+                    if (darkside_sample(&resp, next) >= 0) {
+                        darkside_start(next);
+                        jobs_count++;
+                    }
+                }
+
+                PrintAndLogEx(SUCCESS, "found " _YELLOW_("%u") " candidate key%s", keycount, (keycount > 1) ? "s." : ".");
 
-        *key = UINT64_C(-1);
-        uint8_t keyBlock[PM3_CMD_DATA_SIZE];
-        uint32_t max_keys = KEYS_IN_BLOCK;
-        for (uint32_t i = 0; i < keycount; i += max_keys) {
+                uint8_t keyBlock[PM3_CMD_DATA_SIZE];
+                uint32_t max_keys = KEYS_IN_BLOCK;
+                for (uint32_t i = 0; i < keycount; i += max_keys) {
 
-            uint8_t size = keycount - i > max_keys ? max_keys : keycount - i;
-            register uint8_t j;
-            for (j = 0; j < size; j++) {
-                if (par_list == 0) {
-                    num_to_bytes(last_keylist[i * max_keys + j], 6, keyBlock + (j * 6));
-                } else {
-                    num_to_bytes(keylist[i * max_keys + j], 6, keyBlock + (j * 6));
+                    uint8_t size = keycount - i > max_keys ? max_keys : keycount - i;
+                    for (uint8_t j = 0; j < size; j++) {
+                        num_to_bytes(candidates[i + j], 6, keyBlock + (j * 6));
+                    }
+
+                    if (mfCheckKeys(blockno, key_type - 0x60, false, size, keyBlock, key) == PM3_SUCCESS) {
+                        break;
+                    }
+                }
+
+                if (*key == UINT64_C(-1)) {
+                    PrintAndLogEx(FAILED, "all key candidates failed. Restarting darkside attack");
+                    free(last_keylist);
+                    last_keylist = job->keylist;
+                    job->keylist = NULL;
+                    first_run = true;
                 }
             }
 
-            if (mfCheckKeys(blockno, key_type - 0x60, false, size, keyBlock, key) == PM3_SUCCESS) {
+            darkside_finish(job);
+            jobs_head = (jobs_head + 1) % DARKSIDE_MAX_JOBS;
+            jobs_count--;
+
+            if (*key != UINT64_C(-1))
                 break;
-            }
         }
+    }
 
-        if (*key != UINT64_C(-1)) {
-            break;
-        } else {
-            PrintAndLogEx(FAILED, "all key candidates failed. Restarting darkside attack");
-            free(last_keylist);
-            last_keylist = keylist;
-            first_run = true;
-        }
+    if (device_busy) {
+        PacketResponseNG resp;
+        darkside_stop(&resp);
+    }
+
+    // nonce2key can't be cancelled, it is short anyway
+    while (jobs_count) {
+        darkside_finish(&jobs[jobs_head]);
+        jobs_head = (jobs_head + 1) % DARKSIDE_MAX_JOBS;
+        jobs_count--;
     }
+
     free(last_keylist);
-    free(keylist);
-    return PM3_SUCCESS;
+    return res;
 }
 
 int mfCheckKeys(uint8_t blockNo, uint8_t keyType, bool clear_trace, uint8_t keycnt, uint8_t *keyBlock, uint64_t *key) {
@@ -376,7 +513,8 @@ __attribute__((force_align_arg_pointer))
 *nested_worker_thread(void *arg) {
     struct Crypto1State *p1;
     StateList_t *statelist = arg;
-    statelist->head.slhead = lfsr_recovery32(statelist->ks1, statelist->nt_enc ^ statelist->uid);
+    // two of these run at the same time, share the cores between them
+    statelist->head.slhead = lfsr_recovery32_mt(statelist->ks1, statelist->nt_enc ^ statelist->uid, MAX(1, num_CPUs() / 2));
 
     for (p1 = statelist->head.slhead; p1->odd | p1->even; p1++) {};
 
@@ -388,6 +526,104 @@ __attribute__((force_align_arg_pointer))
     return statelist->head.slhead;
 }
 
+// Key candidate pipeline for mfnested:  worker threads turn the candidate states into
+// deduplicated key batches while the main thread has the device check the previous batch.
+#define NESTED_QUEUE_DEPTH  8
+
+typedef struct {
+    uint8_t keys[KEYBLOCK_SIZE];
+    uint8_t count;
+} nested_batch_t;
+
+typedef struct {
+    struct Crypto1State *states;    // sorted, terminated by odd = even = -1
+    uint32_t len;
+    uint32_t nbatches;              // batches of KEYS_IN_BLOCK states
+    uint32_t next_batch;            // next batch to expand, shared by the workers
+    uint32_t done_batches;          // expanded batches, empty ones included
+    nested_batch_t queue[NESTED_QUEUE_DEPTH];
+    uint8_t q_head;
+    uint8_t q_count;
+    bool stop;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} nested_pipeline_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+nested_candidate_thread(void *arg) {
+    nested_pipeline_t *pl = arg;
+
+    while (true) {
+        pthread_mutex_lock(&pl->lock);
+        if (pl->stop || pl->next_batch >= pl->nbatches) {
+            pthread_mutex_unlock(&pl->lock);
+            break;
+        }
+        uint32_t b = pl->next_batch++;
+        pthread_mutex_unlock(&pl->lock);
+
+        // expand and deduplicate, identical states are adjacent in the sorted list
+        nested_batch_t batch = { .count = 0 };
+        uint32_t first = b * KEYS_IN_BLOCK;
+        uint32_t last = MIN(first + KEYS_IN_BLOCK, pl->len);
+        for (uint32_t i = first; i < last; i++) {
+            if (i > 0 && pl->states[i].odd == pl->states[i - 1].odd && pl->states[i].even == pl->states[i - 1].even)
+                continue;
+
+            uint64_t key64 = 0;
+            crypto1_get_lfsr(pl->states + i, &key64);
+            num_to_bytes(key64, 6, batch.keys + batch.count * 6);
+            batch.count++;
+        }
+
+        pthread_mutex_lock(&pl->lock);
+        while (pl->q_count == NESTED_QUEUE_DEPTH && pl->stop == false)
+            pthread_cond_wait(&pl->not_full, &pl->lock);
+
+        if (pl->stop == false && batch.count) {
+            pl->queue[(pl->q_head + pl->q_count) % NESTED_QUEUE_DEPTH] = batch;
+            pl->q_count++;
+        }
+        pl->done_batches++;
+        pthread_cond_signal(&pl->not_empty);
+        pthread_mutex_unlock(&pl->lock);
+    }
+    return NULL;
+}
+
+// returns false once all batches are consumed
+static bool nested_next_batch(nested_pipeline_t *pl, nested_batch_t *batch) {
+    pthread_mutex_lock(&pl->lock);
+    while (pl->q_count == 0 && pl->done_batches < pl->nbatches)
+        pthread_cond_wait(&pl->not_empty, &pl->lock);
+
+    if (pl->q_count == 0) {
+        pthread_mutex_unlock(&pl->lock);
+        return false;
+    }
+
+    *batch = pl->queue[pl->q_head];
+    pl->q_head = (pl->q_head + 1) % NESTED_QUEUE_DEPTH;
+    pl->q_count--;
+    pthread_cond_signal(&pl->not_full);
+    pthread_mutex_unlock(&pl->lock);
+    return true;
+}
+
+static void nested_pipeline_stop(nested_pipeline_t *pl) {
+    pthread_mutex_lock(&pl->lock);
+    pl->stop = true;
+    pthread_cond_broadcast(&pl->not_full);
+    pthread_cond_broadcast(&pl->not_empty);
+    pthread_mutex_unlock(&pl->lock);
+}
+
 int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo, uint8_t trgKeyType, uint8_t *resultKey, bool calibrate) {
 
     uint32_t uid;
@@ -514,37 +750,73 @@ int mfnested(uint8_t blockNo, uint8_t keyType, uint8_t *key, uint8_t trgBlockNo,
     memset(resultKey, 0, 6);
     uint64_t key64 = -1;
 
-    // The list may still contain several key candidates. Test each of them with mfCheckKeys
-    uint32_t max_keys = keycnt > KEYS_IN_BLOCK ? KEYS_IN_BLOCK : keycnt;
-    uint8_t keyBlock[PM3_CMD_DATA_SIZE] = {0x00};
+    // The list may still contain several key candidates. Test each of them with mfCheckKeys,
+    // full payload batches are prepared by worker threads while the device checks the previous one.
+    nested_pipeline_t pl;
+    memset(&pl, 0, sizeof(pl));
+    pl.states = statelists[0].head.slhead;
+    pl.len = keycnt;
+    pl.nbatches = (keycnt + KEYS_IN_BLOCK - 1) / KEYS_IN_BLOCK;
+    pthread_mutex_init(&pl.lock, NULL);
+    pthread_cond_init(&pl.not_empty, NULL);
+    pthread_cond_init(&pl.not_full, NULL);
+
+    uint8_t nthreads = MAX(1, MIN(num_CPUs(), 8));
+    pthread_t candidate_threads[8];
+    for (uint8_t i = 0; i < nthreads; i++)
+        pthread_create(&candidate_threads[i], NULL, nested_candidate_thread, &pl);
+
+    int res = PM3_ESOFT;
+    uint32_t tested = 0;
+    uint64_t start_time = msclock();
+    nested_batch_t batch;
+
+    while (nested_next_batch(&pl, &batch)) {
+
+        if (kbd_enter_pressed()) {
+            SendCommandNG(CMD_BREAK_LOOP, NULL, 0);
+            res = PM3_EOPABORTED;
+            break;
+        }
 
-    for (uint32_t i = 0; i < keycnt; i += max_keys) {
+        res = mfCheckKeys(statelists[0].blockNo, statelists[0].keyType, false, batch.count, batch.keys, &key64);
+        tested += batch.count;
+        if (res == PM3_SUCCESS || res == PM3_ETIMEOUT)
+            break;
 
-        uint64_t start_time = msclock();
+        float bruteforce_per_second = (float)tested / (MAX(msclock() - start_time, 1) / 1000.0);
+        PrintAndLogEx(INPLACE, "%6u/%u keys | %5.1f keys/sec | worst case %6.1f seconds remaining", tested, keycnt, bruteforce_per_second, (keycnt - tested) / bruteforce_per_second);
+    }
 
-        uint8_t size = keycnt - i > max_keys ? max_keys : keycnt - i;
+    nested_pipeline_stop(&pl);
+    for (uint8_t i = 0; i < nthreads; i++)
+        pthread_join(candidate_threads[i], NULL);
 
-        register uint8_t j;
-        for (j = 0; j < size; j++) {
-            crypto1_get_lfsr(statelists[0].head.slhead + i, &key64);
-            num_to_bytes(key64, 6, keyBlock + j * 6);
-        }
+    pthread_cond_destroy(&pl.not_full);
+    pthread_cond_destroy(&pl.not_empty);
+    pthread_mutex_destroy(&pl.lock);
 
-        if (mfCheckKeys(statelists[0].blockNo, statelists[0].keyType, false, size, keyBlock, &key64) == PM3_SUCCESS) {
-            free(statelists[0].head.slhead);
-            free(statelists[1].head.slhead);
-            num_to_bytes(key64, 6, resultKey);
+    uint64_t elapsed = MAX(msclock() - start_time, 1);
+    PrintAndLogEx(NORMAL, "");
+    PrintAndLogEx(INFO, "Tested " _YELLOW_("%u") " keys in %.1f seconds ( " _YELLOW_("%.1f") " keys/sec )", tested, elapsed / 1000.0, (float)tested * 1000 / elapsed);
 
-            PrintAndLogEx(SUCCESS, "\ntarget block:%3u key type: %c  -- found valid key [ " _GREEN_("%s") "]",
-                          package->block,
-                          package->keytype ? 'B' : 'A',
-                          sprint_hex(resultKey, 6)
-                         );
-            return PM3_SUCCESS;
-        }
+    if (res == PM3_SUCCESS) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        num_to_bytes(key64, 6, resultKey);
+
+        PrintAndLogEx(SUCCESS, "target block:%3u key type: %c  -- found valid key [ " _GREEN_("%s") "]",
+                      package->block,
+                      package->keytype ? 'B' : 'A',
+                      sprint_hex(resultKey, 6)
+                     );
+        return PM3_SUCCESS;
+    }
 
-        float bruteforce_per_second = (float)(i + max_keys) / ((msclock() - start_time) / 1000.0);
-        PrintAndLogEx(INPLACE, "%6d/%u keys | %5.1f keys/sec | worst case %6.1f seconds remaining", i, keycnt, bruteforce_per_second, (keycnt - i) / bruteforce_per_second);
+    if (res == PM3_EOPABORTED) {
+        free(statelists[0].head.slhead);
+        free(statelists[1].head.slhead);
+        return res;
     }
 
 out:
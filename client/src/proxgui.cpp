@@ -14,6 +14,7 @@
 #include "proxguiqt.h"
 #include "proxmark3.h"
 #include "ui.h"  // for prints
+#include "graph.h"  // g_demod
 
 static ProxGuiQT *gui = NULL;
 static WorkerThread *main_loop_thread = NULL;
@@ -50,7 +51,8 @@ extern "C" void HideGraphWindow(void) {
 }
 
 extern "C" void RepaintGraphWindow(void) {
-    if (!gui)
+    // private demod contexts, i.e. lf search workers, are not plotted
+    if (!gui || g_demod->plot == false)
         return;
 
     gui->RepaintGraphWindow();
@@ -28,6 +28,7 @@
 #include "cmdmain.h"
 #include "ui.h"
 #include "cmdhw.h"
+#include "cmdhflist.h"
 #include "whereami.h"
 #include "comms.h"
 #include "fileutils.h"
@@ -1081,6 +1082,9 @@ int main(int argc, char *argv[]) {
         CloseProxmark(session.current_device);
     }
 
+    // the MIFARE keys recovered from the last listed trace
+    mfTraceAuthFree();
+
     if (session.window_changed) // Plot/Overlay moved or resized
         preferences_save();
     exit(EXIT_SUCCESS);
@@ -180,6 +180,52 @@ void PrintAndLogOptions(const char *str[][2], size_t size, size_t space) {
 
 static uint8_t PrintAndLogEx_spinidx = 0;
 
+// set per thread by PrintAndLogCapture
+static __thread printCapture_t *print_capture = NULL;
+
+void PrintAndLogCapture(printCapture_t *cap) {
+    print_capture = cap;
+}
+
+static void capture_append(printCapture_t *cap, logLevel_t level, const char *msg) {
+    size_t n = strlen(msg) + 2;
+    if (cap->len + n > cap->size) {
+        size_t size = (cap->size) ? cap->size * 2 : 1024;
+        while (size < cap->len + n)
+            size *= 2;
+        char *tmp = realloc(cap->buf, size);
+        if (tmp == NULL)
+            return;
+        cap->buf = tmp;
+        cap->size = size;
+    }
+    // level byte, then the message with its terminator
+    cap->buf[cap->len] = (char)level;
+    memcpy(cap->buf + cap->len + 1, msg, n - 1);
+    cap->len += n;
+}
+
+bool PrintAndLogCaptured(const printCapture_t *cap, size_t *pos, logLevel_t *level, const char **msg) {
+    if (*pos >= cap->len)
+        return false;
+
+    *level = (logLevel_t)cap->buf[*pos];
+    *msg = cap->buf + *pos + 1;
+    *pos += strlen(*msg) + 2;
+    return true;
+}
+
+void PrintAndLogReplay(printCapture_t *cap) {
+    size_t pos = 0;
+    logLevel_t level;
+    const char *msg;
+    while (PrintAndLogCaptured(cap, &pos, &level, &msg))
+        PrintAndLogEx(level, "%s", msg);
+
+    free(cap->buf);
+    memset(cap, 0, sizeof(printCapture_t));
+}
+
 void PrintAndLogEx(logLevel_t level, const char *fmt, ...) {
 
     // skip debug messages if client debugging is turned off i.e. 'DATA SETDEBUG 0'
@@ -190,6 +236,16 @@ void PrintAndLogEx(logLevel_t level, const char *fmt, ...) {
     if (session.show_hints == false && level == HINT)
         return;
 
+    if (print_capture) {
+        char msg[MAX_PRINT_BUFFER] = {0};
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(msg, sizeof(msg), fmt, args);
+        va_end(args);
+        capture_append(print_capture, level, msg);
+        return;
+    }
+
     char prefix[40] = {0};
     char buffer[MAX_PRINT_BUFFER] = {0};
     char buffer2[MAX_PRINT_BUFFER + sizeof(prefix)] = {0};
@@ -62,6 +62,17 @@ extern bool showDemod;
 #define PROMPT_CLEARLINE PrintAndLogEx(INPLACE, "                                          \r")
 void PrintAndLogOptions(const char *str[][2], size_t size, size_t space);
 void PrintAndLogEx(logLevel_t level, const char *fmt, ...);
+
+// collects this thread's PrintAndLogEx output instead of printing it
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t size;
+} printCapture_t;
+void PrintAndLogCapture(printCapture_t *cap); // NULL stops capturing
+void PrintAndLogReplay(printCapture_t *cap);  // prints and frees the captured lines
+// iterates the captured lines, start with *pos = 0
+bool PrintAndLogCaptured(const printCapture_t *cap, size_t *pos, logLevel_t *level, const char **msg);
 void SetFlushAfterWrite(bool value);
 void memcpy_filter_ansi(void *dest, const void *src, size_t n, bool filter);
 void memcpy_filter_rlmarkers(void *dest, const void *src, size_t n);
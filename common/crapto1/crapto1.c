@@ -24,6 +24,19 @@
 #include <stdlib.h>
 #include "parity.h"
 
+#if !defined(__arm__) || defined(__linux__) || defined(_WIN32) || defined(__APPLE__) // bare metal ARM Proxmark lacks threads
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RECOVERY_HAS_AVX2
+#elif defined(__ARM_NEON) && (defined(__aarch64__) || defined(__linux__) || defined(__APPLE__))
+#include <arm_neon.h>
+#define RECOVERY_HAS_NEON
+#endif
+#endif
+
 #if !defined LOWMEM && defined __GNUC__
 static uint8_t filterlut[1 << 20];
 static void __attribute__((constructor)) fill_lut(void) {
@@ -220,31 +233,19 @@ static const uint32_t T2[] = {  0x3C88B810, 0x5E445C08, 0x2982A580, 0x14C152C0,
                              };
 static const uint32_t C1[] = { 0x846B5, 0x4235A, 0x211AD};
 static const uint32_t C2[] = { 0x1A822E0, 0x21A822E0, 0x21A822E0};
-/** Reverse 64 bits of keystream into possible cipher states
- * Variation mentioned in the paper. Somewhat optimized version
+/** recovery64_range
+ * lfsr_recovery64 worker, tries the initial odd states from last down to first
+ * and appends the matching cipher states to statelist, which is grown as needed.
  */
-struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3) {
-    struct Crypto1State *statelist, *sl;
-    uint8_t oks[32], eks[32], hi[32];
+static struct Crypto1State *recovery64_range(const uint8_t *oks, const uint8_t *eks, int first, int last,
+                                             struct Crypto1State *statelist, size_t *size) {
+    uint8_t hi[32];
     uint32_t low = 0,  win = 0;
     uint32_t *tail, table[1 << 16];
+    size_t n = 0;
     int i, j;
 
-    sl = statelist = malloc(sizeof(struct Crypto1State) << 4);
-    if (!sl)
-        return 0;
-    sl->odd = sl->even = 0;
-
-    for (i = 30; i >= 0; i -= 2) {
-        oks[i >> 1] = BEBIT(ks2, i);
-        oks[16 + (i >> 1)] = BEBIT(ks3, i);
-    }
-    for (i = 31; i >= 0; i -= 2) {
-        eks[i >> 1] = BEBIT(ks2, i);
-        eks[16 + (i >> 1)] = BEBIT(ks3, i);
-    }
-
-    for (i = 0xfffff; i >= 0; --i) {
+    for (i = last; i >= first; --i) {
         if (filter(i) != oks[0])
             continue;
 
@@ -278,17 +279,513 @@ struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3) {
                     goto continue2;
             }
 
+            if (n + 2 > *size) {
+                struct Crypto1State *tmp = realloc(statelist, sizeof(struct Crypto1State) * *size * 2);
+                if (!tmp) {
+                    free(statelist);
+                    return 0;
+                }
+                statelist = tmp;
+                *size *= 2;
+            }
+
             *tail = *tail << 1 | (evenparity32(LF_POLY_EVEN & *tail));
-            sl->odd = *tail ^ (evenparity32(LF_POLY_ODD & win));
-            sl->even = win;
-            ++sl;
-            sl->odd = sl->even = 0;
+            statelist[n].odd = *tail ^ (evenparity32(LF_POLY_ODD & win));
+            statelist[n].even = win;
+            ++n;
+            statelist[n].odd = statelist[n].even = 0;
 continue2:
             ;
         }
     }
     return statelist;
 }
+
+static void split_keystream64(uint32_t ks2, uint32_t ks3, uint8_t oks[32], uint8_t eks[32]) {
+    for (int i = 30; i >= 0; i -= 2) {
+        oks[i >> 1] = BEBIT(ks2, i);
+        oks[16 + (i >> 1)] = BEBIT(ks3, i);
+    }
+    for (int i = 31; i >= 0; i -= 2) {
+        eks[i >> 1] = BEBIT(ks2, i);
+        eks[16 + (i >> 1)] = BEBIT(ks3, i);
+    }
+}
+
+/** Reverse 64 bits of keystream into possible cipher states
+ * Variation mentioned in the paper. Somewhat optimized version
+ */
+struct Crypto1State *lfsr_recovery64(uint32_t ks2, uint32_t ks3) {
+    uint8_t oks[32], eks[32];
+    size_t size = 1 << 4;
+
+    struct Crypto1State *statelist = malloc(sizeof(struct Crypto1State) * size);
+    if (!statelist)
+        return 0;
+    statelist->odd = statelist->even = 0;
+
+    split_keystream64(ks2, ks3, oks, eks);
+    return recovery64_range(oks, eks, 0, 0xfffff, statelist, &size);
+}
+
+/** lfsr_recovery64_buf
+ * as lfsr_recovery64, but fills the caller's state list of *size entries, growing it
+ * when needed.  Callers doing many recoveries in a row keep one list around instead of
+ * allocating one per call.  Returns NULL, with the list freed, when out of memory.
+ */
+struct Crypto1State *lfsr_recovery64_buf(uint32_t ks2, uint32_t ks3, struct Crypto1State **statelist, size_t *size) {
+    uint8_t oks[32], eks[32];
+
+    if (*statelist == NULL || *size < 2) {
+        free(*statelist);
+        *size = 1 << 4;
+        *statelist = malloc(sizeof(struct Crypto1State) * *size);
+        if (*statelist == NULL)
+            return 0;
+    }
+    (*statelist)->odd = (*statelist)->even = 0;
+
+    split_keystream64(ks2, ks3, oks, eks);
+    *statelist = recovery64_range(oks, eks, 0, 0xfffff, *statelist, size);
+    return *statelist;
+}
+
+/*
+ * Parallel recovery
+ *
+ * lfsr_recovery32_mt splits the work in two parallel phases:
+ *  - the 2^20 initial states are divided into slices, every thread builds and extends
+ *    the odd and even tables of its slice up to the first bucket sort of recover()
+ *  - the merged tables are bucket sorted once, after which every intersecting bucket
+ *    is an independent recover() job, handed out to the threads one bucket at a time.
+ * lfsr_recovery64_mt splits the initial odd states over the threads.
+ *
+ * The initial table fill is dispatched to an AVX2 or NEON version when available.
+ * Both functions return the same states as their serial versions, lfsr_recovery32_mt
+ * may return them in a different order.
+ */
+
+#define RECOVERY_MAX_THREADS 16
+
+typedef void fill_table_t(uint32_t **tail, uint32_t first, uint32_t last, int bit);
+
+/** fill_table
+ * append all initial states in [first, last] matching the first keystream bit, from last down to first
+ */
+static void fill_table_NOSIMD(uint32_t **tail, uint32_t first, uint32_t last, int bit) {
+    for (uint32_t i = last + 1; i-- > first;)
+        if (filter(i) == bit)
+            *++*tail = i;
+}
+
+#if defined(RECOVERY_HAS_AVX2)
+__attribute__((target("avx2")))
+static void fill_table_AVX2(uint32_t **tail, uint32_t first, uint32_t last, int bit) {
+    const __m256i nibble = _mm256_set1_epi32(0xf);
+    const __m256i lanes = _mm256_setr_epi32(0, -1, -2, -3, -4, -5, -6, -7);
+    const __m256i want = _mm256_set1_epi32(bit);
+#define FILTER_AVX2(x, shift, fa, m) \
+    _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(fa), _mm256_and_si256(_mm256_srli_epi32(x, shift), nibble)), _mm256_set1_epi32(m))
+
+    uint32_t i = last + 1;
+    while (i - first >= 8) {
+        i -= 8;
+        // lane k holds state i + 7 - k, keeping the serial order
+        __m256i x = _mm256_add_epi32(_mm256_set1_epi32(i + 7), lanes);
+        __m256i f = FILTER_AVX2(x,  0, 0xf22c0, 16);
+        f = _mm256_or_si256(f, FILTER_AVX2(x,  4, 0x6c9c0, 8));
+        f = _mm256_or_si256(f, FILTER_AVX2(x,  8, 0x3c8b0, 4));
+        f = _mm256_or_si256(f, FILTER_AVX2(x, 12, 0x1e458, 2));
+        f = _mm256_or_si256(f, FILTER_AVX2(x, 16, 0x0d938, 1));
+        f = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32(0xEC57E80A), f), _mm256_set1_epi32(1));
+
+        uint32_t mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(f, want)));
+        while (mask) {
+            *++*tail = i + 7 - __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#undef FILTER_AVX2
+    while (i-- > first)
+        if (filter(i) == bit)
+            *++*tail = i;
+}
+#endif
+
+#if defined(RECOVERY_HAS_NEON)
+static void fill_table_NEON(uint32_t **tail, uint32_t first, uint32_t last, int bit) {
+    const uint32x4_t nibble = vdupq_n_u32(0xf);
+    const int32_t lane_init[4] = {0, -1, -2, -3};
+    const int32x4_t lanes = vld1q_s32(lane_init);
+#define FILTER_NEON(xs, fa, m) \
+    vandq_u32(vshlq_u32(vdupq_n_u32(fa), vnegq_s32(vreinterpretq_s32_u32(vandq_u32(xs, nibble)))), vdupq_n_u32(m))
+
+    uint32_t i = last + 1;
+    while (i - first >= 4) {
+        i -= 4;
+        uint32x4_t x = vreinterpretq_u32_s32(vaddq_s32(vdupq_n_s32(i + 3), lanes));
+        uint32x4_t f = FILTER_NEON(x, 0xf22c0, 16);
+        f = vorrq_u32(f, FILTER_NEON(vshrq_n_u32(x,  4), 0x6c9c0, 8));
+        f = vorrq_u32(f, FILTER_NEON(vshrq_n_u32(x,  8), 0x3c8b0, 4));
+        f = vorrq_u32(f, FILTER_NEON(vshrq_n_u32(x, 12), 0x1e458, 2));
+        f = vorrq_u32(f, FILTER_NEON(vshrq_n_u32(x, 16), 0x0d938, 1));
+        f = vandq_u32(vshlq_u32(vdupq_n_u32(0xEC57E80A), vnegq_s32(vreinterpretq_s32_u32(f))), vdupq_n_u32(1));
+
+        uint32_t res[4];
+        vst1q_u32(res, f);
+        for (int k = 0; k < 4; k++)
+            if (res[k] == (uint32_t)bit)
+                *++*tail = i + 3 - k;
+    }
+#undef FILTER_NEON
+    while (i-- > first)
+        if (filter(i) == bit)
+            *++*tail = i;
+}
+#endif
+
+static fill_table_t *fill_table_dispatch(void) {
+#if defined(RECOVERY_HAS_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+        return &fill_table_AVX2;
+#endif
+#if defined(RECOVERY_HAS_NEON)
+    return &fill_table_NEON;
+#endif
+    return &fill_table_NOSIMD;
+}
+
+typedef struct {
+    fill_table_t *fill_table;
+    uint32_t first, last;       // initial states of this slice
+    uint32_t oks, eks, in;
+    uint32_t *odd_head, *odd_tail;
+    uint32_t *even_head, *even_tail;
+} recovery32_slice_t;
+
+typedef struct {
+    bucket_info_t bucket_info;
+    uint32_t next;              // next bucket to hand out, shared by the threads
+    uint32_t oks, eks, in;
+    struct {
+        uint32_t thread, offset, count;
+    } out[0x100];
+} recovery32_job_t;
+
+typedef struct {
+    recovery32_job_t *job;
+    uint32_t id;
+    uint32_t *odd, *even;
+    bucket_array_t bucket;
+    struct Crypto1State *statelist;
+    uint32_t used;
+} recovery32_worker_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+recovery32_slice_thread(void *arg) {
+    recovery32_slice_t *s = arg;
+    uint32_t oks = s->oks, eks = s->eks, in = s->in;
+
+    s->fill_table(&s->odd_tail, s->first, s->last, oks & 1);
+    s->fill_table(&s->even_tail, s->first, s->last, eks & 1);
+
+    for (int i = 0; i < 4; i++) {
+        extend_table_simple(s->odd_head,  &s->odd_tail, (oks >>= 1) & 1);
+        extend_table_simple(s->even_head, &s->even_tail, (eks >>= 1) & 1);
+    }
+
+    // first round of recover(), up to its bucket sort
+    for (int i = 0; i < 4; i++) {
+        oks >>= 1;
+        eks >>= 1;
+        in >>= 2;
+        extend_table(s->odd_head, &s->odd_tail, oks & 1, LF_POLY_EVEN << 1 | 1, LF_POLY_ODD << 1, 0);
+        extend_table(s->even_head, &s->even_tail, eks & 1, LF_POLY_ODD, LF_POLY_EVEN << 1 | 1, in & 3);
+    }
+    return NULL;
+}
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+recovery32_bucket_thread(void *arg) {
+    recovery32_worker_t *w = arg;
+    recovery32_job_t *job = w->job;
+    uint32_t b;
+
+    while ((b = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->bucket_info.numbuckets) {
+        // same order as the serial recover()
+        uint32_t idx = job->bucket_info.numbuckets - 1 - b;
+        uint32_t olen = job->bucket_info.bucket_info[1][idx].tail - job->bucket_info.bucket_info[1][idx].head + 1;
+        uint32_t elen = job->bucket_info.bucket_info[0][idx].tail - job->bucket_info.bucket_info[0][idx].head + 1;
+
+        // private copies, recover() extends the tables in place
+        memcpy(w->odd, job->bucket_info.bucket_info[1][idx].head, olen * sizeof(uint32_t));
+        memcpy(w->even, job->bucket_info.bucket_info[0][idx].head, elen * sizeof(uint32_t));
+
+        struct Crypto1State *sl = w->statelist + w->used;
+        struct Crypto1State *end = recover(w->odd, w->odd + olen - 1, job->oks,
+                                           w->even, w->even + elen - 1, job->eks,
+                                           7, sl, job->in, w->bucket);
+
+        job->out[idx].thread = w->id;
+        job->out[idx].offset = w->used;
+        job->out[idx].count = end - sl;
+        w->used += end - sl;
+    }
+    return NULL;
+}
+
+/** lfsr_recovery32_mt
+ * lfsr_recovery32 using up to threads threads
+ */
+struct Crypto1State *lfsr_recovery32_mt(uint32_t ks2, uint32_t in, uint8_t threads) {
+    if (threads <= 1)
+        return lfsr_recovery32(ks2, in);
+
+    if (threads > RECOVERY_MAX_THREADS)
+        threads = RECOVERY_MAX_THREADS;
+
+    struct Crypto1State *statelist = 0;
+    uint32_t *odd_head = 0, *even_head = 0;
+    uint32_t oks = 0, eks = 0;
+    recovery32_slice_t slices[RECOVERY_MAX_THREADS];
+    recovery32_worker_t *workers[RECOVERY_MAX_THREADS];
+    recovery32_job_t *job = 0;
+    pthread_t tids[RECOVERY_MAX_THREADS];
+    int i, t;
+
+    memset(slices, 0, sizeof(slices));
+    memset(workers, 0, sizeof(workers));
+
+    // split the keystream into an odd and even part
+    for (i = 31; i >= 0; i -= 2)
+        oks = oks << 1 | BEBIT(ks2, i);
+    for (i = 30; i >= 0; i -= 2)
+        eks = eks << 1 | BEBIT(ks2, i);
+
+    in = (in >> 16 & 0xff) | (in << 16) | (in & 0xff00); // Byte swapping
+    in <<= 1;
+
+    // phase 1, slices of the initial states, highest first as in lfsr_recovery32
+    fill_table_t *fill_table = fill_table_dispatch();
+    uint32_t per_slice = ((1 << 20) + threads) / threads;
+    for (t = 0; t < threads; t++) {
+        recovery32_slice_t *s = &slices[t];
+        s->fill_table = fill_table;
+        s->last = (1 << 20) - t * per_slice;
+        s->first = (t == threads - 1) ? 0 : s->last - per_slice + 1;
+        s->oks = oks;
+        s->eks = eks;
+        s->in = in;
+        s->odd_head = s->odd_tail = malloc(sizeof(uint32_t) << 21);
+        s->even_head = s->even_tail = malloc(sizeof(uint32_t) << 21);
+        if (!s->odd_tail-- || !s->even_tail--)
+            goto out;
+    }
+
+    for (t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, recovery32_slice_thread, &slices[t]);
+    for (t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+
+    // merge the slices
+    uint32_t olen = 0, elen = 0;
+    for (t = 0; t < threads; t++) {
+        olen += slices[t].odd_tail + 1 - slices[t].odd_head;
+        elen += slices[t].even_tail + 1 - slices[t].even_head;
+    }
+
+    if (olen == 0 || elen == 0 || olen >= (1 << 21) || elen >= (1 << 21)) {
+        statelist = malloc(sizeof(struct Crypto1State));
+        if (statelist)
+            statelist->odd = statelist->even = 0;
+        goto out;
+    }
+
+    odd_head = malloc(sizeof(uint32_t) * olen);
+    even_head = malloc(sizeof(uint32_t) * elen);
+    job = calloc(1, sizeof(recovery32_job_t));
+    if (!odd_head || !even_head || !job)
+        goto out;
+
+    uint32_t *o = odd_head, *e = even_head;
+    for (t = 0; t < threads; t++) {
+        uint32_t n = slices[t].odd_tail + 1 - slices[t].odd_head;
+        memcpy(o, slices[t].odd_head, n * sizeof(uint32_t));
+        o += n;
+        n = slices[t].even_tail + 1 - slices[t].even_head;
+        memcpy(e, slices[t].even_head, n * sizeof(uint32_t));
+        e += n;
+    }
+
+    // phase 2, one recover() per intersecting bucket. The slice tables are reused as thread private tables
+    for (t = 0; t < threads; t++) {
+        recovery32_worker_t *w = calloc(1, sizeof(recovery32_worker_t));
+        if (!w)
+            goto out;
+        workers[t] = w;
+        w->job = job;
+        w->id = t;
+        w->odd = slices[t].odd_head;
+        w->even = slices[t].even_head;
+        w->statelist = malloc(sizeof(struct Crypto1State) << 18);
+        if (!w->statelist)
+            goto out;
+        w->statelist->odd = w->statelist->even = 0;
+        for (i = 0; i < 2; i++) {
+            for (uint32_t j = 0; j <= 0xff; j++) {
+                w->bucket[i][j].head = malloc(sizeof(uint32_t) << 14);
+                if (!w->bucket[i][j].head)
+                    goto out;
+            }
+        }
+    }
+
+    bucket_sort_intersect(even_head, even_head + elen - 1, odd_head, odd_head + olen - 1, &job->bucket_info, workers[0]->bucket);
+    job->oks = oks >> 8;
+    job->eks = eks >> 8;
+    job->in = in >> 8;
+
+    for (t = 0; t < threads; t++)
+        pthread_create(&tids[t], NULL, recovery32_bucket_thread, workers[t]);
+    for (t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+
+    // collect in bucket order
+    uint32_t total = 0;
+    for (uint32_t b = 0; b < job->bucket_info.numbuckets; b++)
+        total += job->out[b].count;
+
+    statelist = malloc(sizeof(struct Crypto1State) * (total + 1));
+    if (!statelist)
+        goto out;
+
+    struct Crypto1State *sl = statelist;
+    for (i = job->bucket_info.numbuckets - 1; i >= 0; i--) {
+        memcpy(sl, workers[job->out[i].thread]->statelist + job->out[i].offset, sizeof(struct Crypto1State) * job->out[i].count);
+        sl += job->out[i].count;
+    }
+    sl->odd = sl->even = 0;
+
+out:
+    for (t = 0; t < threads; t++) {
+        if (workers[t]) {
+            for (i = 0; i < 2; i++)
+                for (uint32_t j = 0; j <= 0xff; j++)
+                    free(workers[t]->bucket[i][j].head);
+            free(workers[t]->statelist);
+            free(workers[t]);
+        }
+        free(slices[t].odd_head);
+        free(slices[t].even_head);
+    }
+    free(job);
+    free(odd_head);
+    free(even_head);
+    return statelist;
+}
+
+typedef struct {
+    const uint8_t *oks, *eks;
+    int first, last;
+    struct Crypto1State *statelist;
+    size_t size;
+} recovery64_slice_t;
+
+static void *
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
+#endif
+#endif
+recovery64_slice_thread(void *arg) {
+    recovery64_slice_t *s = arg;
+    s->statelist = recovery64_range(s->oks, s->eks, s->first, s->last, s->statelist, &s->size);
+    return NULL;
+}
+
+/** lfsr_recovery64_mt
+ * lfsr_recovery64 using up to threads threads
+ */
+struct Crypto1State *lfsr_recovery64_mt(uint32_t ks2, uint32_t ks3, uint8_t threads) {
+    if (threads <= 1)
+        return lfsr_recovery64(ks2, ks3);
+
+    if (threads > RECOVERY_MAX_THREADS)
+        threads = RECOVERY_MAX_THREADS;
+
+    uint8_t oks[32], eks[32];
+    recovery64_slice_t slices[RECOVERY_MAX_THREADS];
+    pthread_t tids[RECOVERY_MAX_THREADS];
+    struct Crypto1State *statelist = 0;
+    int t;
+
+    split_keystream64(ks2, ks3, oks, eks);
+
+    int per_slice = (0x100000 + threads - 1) / threads;
+    for (t = 0; t < threads; t++) {
+        recovery64_slice_t *s = &slices[t];
+        s->oks = oks;
+        s->eks = eks;
+        s->last = 0xfffff - t * per_slice;
+        s->first = (t == threads - 1) ? 0 : s->last - per_slice + 1;
+        s->size = 1 << 4;
+        s->statelist = malloc(sizeof(struct Crypto1State) * s->size);
+        if (s->statelist)
+            s->statelist->odd = s->statelist->even = 0;
+    }
+
+    for (t = 0; t < threads; t++) {
+        if (slices[t].statelist)
+            pthread_create(&tids[t], NULL, recovery64_slice_thread, &slices[t]);
+    }
+
+    size_t total = 0;
+    bool failed = false;
+    for (t = 0; t < threads; t++) {
+        if (slices[t].statelist == 0) {
+            failed = true;
+            continue;
+        }
+        pthread_join(tids[t], NULL);
+        if (slices[t].statelist == 0) {
+            failed = true;
+            continue;
+        }
+        struct Crypto1State *p = slices[t].statelist;
+        while (p->odd | p->even)
+            p++;
+        slices[t].size = p - slices[t].statelist;
+        total += slices[t].size;
+    }
+
+    if (failed == false)
+        statelist = malloc(sizeof(struct Crypto1State) * (total + 1));
+
+    if (statelist) {
+        // slices were cut from the highest state down, so this is the serial order
+        struct Crypto1State *sl = statelist;
+        for (t = 0; t < threads; t++) {
+            memcpy(sl, slices[t].statelist, sizeof(struct Crypto1State) * slices[t].size);
+            sl += slices[t].size;
+        }
+        sl->odd = sl->even = 0;
+    }
+
+    for (t = 0; t < threads; t++)
+        free(slices[t].statelist);
+
+    return statelist;
+}
 #endif
 
 /** lfsr_rollback_bit
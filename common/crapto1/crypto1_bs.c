@@ -0,0 +1,270 @@
+/*  crypto1_bs.c
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    Bitsliced Crypto1, after the brute forcer of the hardnested attack.
+*/
+#include "crypto1_bs.h"
+
+#include <string.h>
+
+// The core is written once on 512 bit vectors and compiled for several instruction sets
+// with the target attribute, the compiler splits the vectors into what the unit can do.
+// Unlike hardnested's core this keeps common/ a plain source file for every build.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5)))
+#define CRYPTO1_BS_X86
+#endif
+
+#define STATE_SIZE 48
+#define WORD_SIZE 32
+
+typedef uint64_t bitslice_value_t __attribute__((vector_size(CRYPTO1_BS_LANES / 8)));
+typedef union {
+    bitslice_value_t value;
+    uint64_t bytes64[CRYPTO1_BS_LANES / 64];
+} bitslice_t;
+
+// p[2m] is bit m of the odd half of the state, p[2m + 1] bit m of the even half, so
+// clocking the LFSR is p--; p[0] = feedback.  Same layout as hardnested uses.
+#define BS_FILTER(p) F20C(F20A(p[38].value, p[36].value, p[34].value, p[32].value), \
+                          F20B(p[30].value, p[28].value, p[26].value, p[24].value), \
+                          F20B(p[22].value, p[20].value, p[18].value, p[16].value), \
+                          F20A(p[14].value, p[12].value, p[10].value, p[8].value),  \
+                          F20B(p[6].value, p[4].value, p[2].value, p[0].value))
+
+// taps of LF_POLY_ODD and LF_POLY_EVEN
+#define BS_FEEDBACK(p) (p[4].value ^ p[5].value ^ p[6].value ^ p[8].value ^ p[12].value ^ p[18].value ^ \
+                        p[20].value ^ p[22].value ^ p[23].value ^ p[28].value ^ p[30].value ^ p[32].value ^ \
+                        p[33].value ^ p[35].value ^ p[37].value ^ p[38].value ^ p[42].value ^ p[47].value)
+
+typedef void bs_block_t(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, uint32_t *ks, uint64_t *pass);
+
+// runs up to CRYPTO1_BS_LANES states through the words.  Writes the keystream when ks
+// isn't NULL and the lanes which pass all checks to pass[].
+static inline __attribute__((always_inline))
+void bs_block(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, uint32_t *ks, uint64_t *pass) {
+    bitslice_t buf[STATE_SIZE + WORD_SIZE];
+    bitslice_t *p = &buf[WORD_SIZE];
+    bitslice_t result;
+
+    memset(p, 0, STATE_SIZE * sizeof(bitslice_t));
+    for (size_t i = 0; i < n; i++) {
+        uint32_t o = states[i].odd, e = states[i].even;
+        uint64_t lane = 1ULL << (i & 0x3f);
+        for (uint32_t m = 0; m < STATE_SIZE / 2; m++, o >>= 1, e >>= 1) {
+            p[2 * m].bytes64[i >> 6] |= lane & -(uint64_t)(o & 1);
+            p[2 * m + 1].bytes64[i >> 6] |= lane & -(uint64_t)(e & 1);
+        }
+    }
+
+    for (uint32_t i = 0; i < CRYPTO1_BS_LANES / 64; i++) {
+        if (64 * i + 64 <= n)
+            result.bytes64[i] = UINT64_C(-1);
+        else if (64 * i < n)
+            result.bytes64[i] = (UINT64_C(1) << (n & 0x3f)) - 1;
+        else
+            result.bytes64[i] = 0;
+    }
+
+    for (size_t w = 0; w < nwords; w++) {
+        const crypto1_bs_word_t *word = &words[w];
+        bitslice_value_t parity = result.value ^ result.value;
+
+        for (uint32_t i = 0; i < WORD_SIZE; i++) {
+            uint32_t bit = i ^ 24;
+            bitslice_value_t k = BS_FILTER(p);
+
+            // the keystream bit after each byte encrypts its parity
+            if (i && (i & 7) == 0) {
+                if (BIT(word->par_mask, 4 - (i >> 3))) {
+                    bitslice_value_t check = parity ^ k;
+                    result.value &= BIT(word->par, 4 - (i >> 3)) ? ~check : check;
+                }
+                parity ^= parity;
+            }
+
+            if (BIT(word->ks_mask, bit))
+                result.value &= BIT(word->ks, bit) ? k : ~k;
+
+            // parity of the plain byte, even here, odd on the air
+            parity ^= BIT(word->enc, bit) ? ~k : k;
+
+            if (ks != NULL) {
+                bitslice_t kb = { .value = k };
+                for (size_t l = 0; l < n; l++)
+                    ks[l * nwords + w] |= (uint32_t)((kb.bytes64[l >> 6] >> (l & 0x3f)) & 1) << bit;
+            }
+
+            bitslice_value_t fb = BS_FEEDBACK(p);
+            if (word->is_encrypted)
+                fb ^= k;
+            if (BIT(word->in, bit))
+                fb = ~fb;
+            p--;
+            p[0].value = fb;
+        }
+
+        if (BIT(word->par_mask, 0)) {
+            bitslice_value_t check = parity ^ BS_FILTER(p);
+            result.value &= BIT(word->par, 0) ? ~check : check;
+        }
+
+        // keep the state at the top of the buffer for the next word
+        memmove(&buf[WORD_SIZE], &buf[0], STATE_SIZE * sizeof(bitslice_t));
+        p = &buf[WORD_SIZE];
+
+        // no need to go on when every lane failed, unless the keystream is wanted
+        if (ks == NULL) {
+            uint64_t any = 0;
+            for (uint32_t i = 0; i < CRYPTO1_BS_LANES / 64; i++)
+                any |= result.bytes64[i];
+            if (any == 0)
+                break;
+        }
+    }
+
+    memcpy(pass, result.bytes64, sizeof(result.bytes64));
+}
+
+static void bs_block_NOSIMD(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, uint32_t *ks, uint64_t *pass) {
+    bs_block(states, n, words, nwords, ks, pass);
+}
+
+#if defined(CRYPTO1_BS_X86)
+__attribute__((target("avx2")))
+static void bs_block_AVX2(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, uint32_t *ks, uint64_t *pass) {
+    bs_block(states, n, words, nwords, ks, pass);
+}
+
+__attribute__((target("avx512f")))
+static void bs_block_AVX512(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, uint32_t *ks, uint64_t *pass) {
+    bs_block(states, n, words, nwords, ks, pass);
+}
+#endif
+
+static crypto1_bs_simd_t intSIMD = CRYPTO1_BS_AUTO;
+
+void crypto1_bs_set_simd(crypto1_bs_simd_t simd) {
+    intSIMD = simd;
+}
+
+bool crypto1_bs_simd_supported(crypto1_bs_simd_t simd) {
+#if defined(CRYPTO1_BS_X86)
+    __builtin_cpu_init();
+#endif
+    switch (simd) {
+#if defined(CRYPTO1_BS_X86)
+        case CRYPTO1_BS_AVX512:
+            return __builtin_cpu_supports("avx512f");
+        case CRYPTO1_BS_AVX2:
+            return __builtin_cpu_supports("avx2");
+#else
+        case CRYPTO1_BS_AVX512:
+        case CRYPTO1_BS_AVX2:
+            return false;
+#endif
+        case CRYPTO1_BS_AUTO:
+        case CRYPTO1_BS_NOSIMD:
+            return true;
+    }
+    return false;
+}
+
+crypto1_bs_simd_t crypto1_bs_get_simd(void) {
+    if (intSIMD != CRYPTO1_BS_AUTO)
+        return intSIMD;
+
+    if (crypto1_bs_simd_supported(CRYPTO1_BS_AVX512))
+        return CRYPTO1_BS_AVX512;
+    if (crypto1_bs_simd_supported(CRYPTO1_BS_AVX2))
+        return CRYPTO1_BS_AVX2;
+    return CRYPTO1_BS_NOSIMD;
+}
+
+const char *crypto1_bs_simd_name(crypto1_bs_simd_t simd) {
+    switch (simd) {
+        case CRYPTO1_BS_AVX512:
+            return "AVX512F";
+        case CRYPTO1_BS_AVX2:
+            return "AVX2";
+        case CRYPTO1_BS_AUTO:
+        case CRYPTO1_BS_NOSIMD:
+            break;
+    }
+    return "no";
+}
+
+static bs_block_t *bs_block_function(void) {
+    switch (crypto1_bs_get_simd()) {
+#if defined(CRYPTO1_BS_X86)
+        case CRYPTO1_BS_AVX512:
+            return bs_block_AVX512;
+        case CRYPTO1_BS_AVX2:
+            return bs_block_AVX2;
+#else
+        case CRYPTO1_BS_AVX512:
+        case CRYPTO1_BS_AVX2:
+#endif
+        case CRYPTO1_BS_AUTO:
+        case CRYPTO1_BS_NOSIMD:
+            break;
+    }
+    return bs_block_NOSIMD;
+}
+
+void crypto1_bs_keystream(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, uint32_t *ks) {
+    bs_block_t *block = bs_block_function();
+    uint64_t pass[CRYPTO1_BS_LANES / 64];
+
+    memset(ks, 0, n * nwords * sizeof(uint32_t));
+    for (size_t i = 0; i < n; i += CRYPTO1_BS_LANES) {
+        size_t lanes = (n - i < CRYPTO1_BS_LANES) ? n - i : CRYPTO1_BS_LANES;
+        block(states + i, lanes, words, nwords, ks + i * nwords, pass);
+    }
+}
+
+size_t crypto1_bs_test_states(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, size_t *found, size_t max) {
+    bs_block_t *block = bs_block_function();
+    uint64_t pass[CRYPTO1_BS_LANES / 64];
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; i += CRYPTO1_BS_LANES) {
+        size_t lanes = (n - i < CRYPTO1_BS_LANES) ? n - i : CRYPTO1_BS_LANES;
+        block(states + i, lanes, words, nwords, NULL, pass);
+
+        for (uint32_t j = 0; j < CRYPTO1_BS_LANES / 64; j++) {
+            for (uint64_t bits = pass[j]; bits; bits &= bits - 1) {
+                if (count < max)
+                    found[count] = i + 64 * j + __builtin_ctzll(bits);
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+size_t crypto1_bs_test_keys(const uint64_t *keys, size_t n, const crypto1_bs_word_t *words, size_t nwords, size_t *found, size_t max) {
+    struct Crypto1State states[CRYPTO1_BS_LANES];
+    size_t count = 0;
+
+    for (size_t i = 0; i < n; i += CRYPTO1_BS_LANES) {
+        size_t lanes = (n - i < CRYPTO1_BS_LANES) ? n - i : CRYPTO1_BS_LANES;
+        for (size_t j = 0; j < lanes; j++)
+            crypto1_init(&states[j], keys[i + j]);
+
+        size_t room = (count < max) ? max - count : 0;
+        size_t got = crypto1_bs_test_states(states, lanes, words, nwords, found + (max - room), room);
+        for (size_t j = count; j < max && j < count + got; j++)
+            found[j] += i;
+        count += got;
+    }
+    return count;
+}
@@ -0,0 +1,71 @@
+/*  crypto1_bs.h
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    Bitsliced Crypto1.  Runs the cipher on CRYPTO1_BS_LANES states at once, one state per
+    bit of a vector, and picks the widest vector unit of the CPU at runtime.
+*/
+#ifndef CRYPTO1_BS_INCLUDED
+#define CRYPTO1_BS_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include "crapto1.h"
+
+#define CRYPTO1_BS_LANES 512
+
+// filter function (f20) on bitslices, the five parts of crapto1's filter()
+// sourced from ``Wirelessly Pickpocketing a Mifare Classic Card'' by Flavio Garcia, Peter van Rossum, Roel Verdult and Ronny Wichers Schreur
+#define F20A(a,b,c,d) (((a|b)^(a&d))^(c&((a^b)|d)))
+#define F20B(a,b,c,d) (((a&b)|c)^((a^b)&(c|d)))
+#define F20C(a,b,c,d,e) ((a|((b|e)&(d^e)))^((a^(b&d))&((c^d)|(b&e))))
+
+// One word clocked through the cipher, the same for all states.  The keystream of the
+// word is crypto1_word(s, in, is_encrypted).
+//
+// Checks, a state passes when all of them hold:
+//   ks_mask   keystream bits which must equal ks
+//   par_mask  parity bits to check, bit 3 is the first byte.  par are the parity bits
+//             received with the ciphertext enc, i.e. the odd parity of the plain byte
+//             encrypted with the keystream bit following the byte.
+typedef struct {
+    uint32_t in;
+    uint8_t is_encrypted;
+    uint32_t ks;
+    uint32_t ks_mask;
+    uint32_t enc;
+    uint8_t par;
+    uint8_t par_mask;
+} crypto1_bs_word_t;
+
+typedef enum {
+    CRYPTO1_BS_AUTO,
+    CRYPTO1_BS_NOSIMD,
+    CRYPTO1_BS_AVX2,
+    CRYPTO1_BS_AVX512
+} crypto1_bs_simd_t;
+
+void crypto1_bs_set_simd(crypto1_bs_simd_t simd);
+crypto1_bs_simd_t crypto1_bs_get_simd(void);
+bool crypto1_bs_simd_supported(crypto1_bs_simd_t simd);
+const char *crypto1_bs_simd_name(crypto1_bs_simd_t simd);
+
+// keystream of all words for each state, ks[i * nwords + w]
+void crypto1_bs_keystream(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, uint32_t *ks);
+
+// parity and keystream checks of the words.  Stores the indexes of up to max passing
+// states in found and returns the number of passing states, which may be larger than max.
+size_t crypto1_bs_test_states(const struct Crypto1State *states, size_t n, const crypto1_bs_word_t *words, size_t nwords, size_t *found, size_t max);
+
+// same on keys
+size_t crypto1_bs_test_keys(const uint64_t *keys, size_t n, const crypto1_bs_word_t *words, size_t nwords, size_t *found, size_t max);
+
+#endif
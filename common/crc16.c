@@ -7,57 +7,33 @@
 //-----------------------------------------------------------------------------
 #include "crc16.h"
 
-#include <string.h>
+#ifndef ON_DEVICE
+#include <pthread.h>
+#endif
 #include "commonutil.h"
 
-static uint16_t crc_table[256];
-static bool crc_table_init = false;
-static CrcType_t current_crc_type = CRC_NONE;
-
-void init_table(CrcType_t crctype) {
-
-    // same crc algo, and initialised already
-    if (crctype == current_crc_type && crc_table_init)
-        return;
-
-    // not the same crc algo. reset table.
-    if (crctype != current_crc_type)
-        reset_table();
-
-    current_crc_type = crctype;
-
-    switch (crctype) {
-        case CRC_14443_A:
-        case CRC_14443_B:
-        case CRC_15693:
-        case CRC_ICLASS:
-        case CRC_CRYPTORF:
-            generate_table(CRC16_POLY_CCITT, true);
-            break;
-        case CRC_FELICA:
-        case CRC_XMODEM:
-            generate_table(CRC16_POLY_CCITT, false);
-            break;
-        case CRC_LEGIC:
-            generate_table(CRC16_POLY_LEGIC, true);
-            break;
-        case CRC_CCITT:
-            generate_table(CRC16_POLY_CCITT, false);
-            break;
-        case CRC_KERMIT:
-            generate_table(CRC16_POLY_CCITT, true);
-            break;
-        case CRC_11784:
-            generate_table(CRC16_POLY_CCITT, false);
-            break;
-        case CRC_NONE:
-            crc_table_init = false;
-            current_crc_type = CRC_NONE;
-            break;
-    }
-}
-
-void generate_table(uint16_t polynomial, bool refin) {
+// Table driven engine.  The tables are kept per polynom and bit order, not per crc type, as the
+// crc types only differ in init value and output handling.  The client fills all of them once and only
+// reads them afterwards, so any thread can use any crc type, and processes eight bytes per step with
+// eight slices of each table (slice-by-8).  The device is short on RAM, it keeps one slice of the table
+// in use and regenerates it when a crc type with another table is asked for.
+typedef enum {
+    CRC16_TAB_CCITT,            // msb first
+    CRC16_TAB_CCITT_REF,        // reflected
+    CRC16_TAB_LEGIC_REF,        // reflected
+    CRC16_TAB_COUNT
+} crc16_tab_t;
+
+#ifdef ON_DEVICE
+# define CRC16_SLICES 1
+#else
+# define CRC16_SLICES 8
+#endif
+
+// slice k holds the crc of a byte followed by k zero bytes
+#define CRC16_SLICE(t, k, i) (t)[((k) << 8) | (i)]
+
+static void crc16_generate(uint16_t *t, uint16_t polynomial, bool refin) {
 
     for (uint16_t i = 0; i < 256; i++) {
         uint16_t c, crc = 0;
@@ -78,19 +54,95 @@ void generate_table(uint16_t polynomial, bool refin) {
         if (refin)
             crc = reflect16(crc);
 
-        crc_table[i] = crc;
+        t[i] = crc;
+    }
+
+    for (uint16_t k = 1; k < CRC16_SLICES; k++) {
+        for (uint16_t i = 0; i < 256; i++) {
+            uint16_t prev = CRC16_SLICE(t, k - 1, i);
+            if (refin)
+                CRC16_SLICE(t, k, i) = (prev >> 8) ^ t[prev & 0xFF];
+            else
+                CRC16_SLICE(t, k, i) = (prev << 8) ^ t[prev >> 8];
+        }
     }
-    crc_table_init = true;
 }
 
-void reset_table(void) {
-    memset(crc_table, 0, sizeof(crc_table));
-    crc_table_init = false;
-    current_crc_type = CRC_NONE;
+static void crc16_generate_tab(uint16_t *t, crc16_tab_t tab) {
+    switch (tab) {
+        case CRC16_TAB_CCITT:
+            crc16_generate(t, CRC16_POLY_CCITT, false);
+            break;
+        case CRC16_TAB_CCITT_REF:
+            crc16_generate(t, CRC16_POLY_CCITT, true);
+            break;
+        case CRC16_TAB_LEGIC_REF:
+        case CRC16_TAB_COUNT:
+            crc16_generate(t, CRC16_POLY_LEGIC, true);
+            break;
+    }
 }
 
-// table lookup LUT solution
-uint16_t crc16_fast(uint8_t const *d, size_t n, uint16_t initval, bool refin, bool refout) {
+#ifdef ON_DEVICE
+static uint16_t crc16_table[CRC16_SLICES * 256];
+static crc16_tab_t crc16_table_tab = CRC16_TAB_COUNT;
+
+static const uint16_t *crc16_get_table(crc16_tab_t tab) {
+    if (tab != crc16_table_tab) {
+        crc16_generate_tab(crc16_table, tab);
+        crc16_table_tab = tab;
+    }
+    return crc16_table;
+}
+#else
+static uint16_t crc16_tables[CRC16_TAB_COUNT][CRC16_SLICES * 256];
+static pthread_once_t crc16_tables_once = PTHREAD_ONCE_INIT;
+
+static void crc16_init_tables(void) {
+    for (int tab = 0; tab < CRC16_TAB_COUNT; tab++)
+        crc16_generate_tab(crc16_tables[tab], tab);
+}
+
+static const uint16_t *crc16_get_table(crc16_tab_t tab) {
+    pthread_once(&crc16_tables_once, crc16_init_tables);
+    return crc16_tables[tab];
+}
+#endif
+
+// the crc register runs reflected through reflected tables
+static uint16_t crc16_update_ref(const uint16_t *t, uint16_t crc, uint8_t const *d, size_t n) {
+#if CRC16_SLICES == 8
+    while (n >= 8) {
+        crc ^= d[0] | (d[1] << 8);
+        crc = CRC16_SLICE(t, 7, crc & 0xFF) ^ CRC16_SLICE(t, 6, crc >> 8)
+              ^ CRC16_SLICE(t, 5, d[2]) ^ CRC16_SLICE(t, 4, d[3])
+              ^ CRC16_SLICE(t, 3, d[4]) ^ CRC16_SLICE(t, 2, d[5])
+              ^ CRC16_SLICE(t, 1, d[6]) ^ CRC16_SLICE(t, 0, d[7]);
+        d += 8;
+        n -= 8;
+    }
+#endif
+    while (n--) crc = (crc >> 8) ^ t[(crc & 0xFF) ^ *d++];
+    return crc;
+}
+
+static uint16_t crc16_update(const uint16_t *t, uint16_t crc, uint8_t const *d, size_t n) {
+#if CRC16_SLICES == 8
+    while (n >= 8) {
+        crc ^= (d[0] << 8) | d[1];
+        crc = CRC16_SLICE(t, 7, crc >> 8) ^ CRC16_SLICE(t, 6, crc & 0xFF)
+              ^ CRC16_SLICE(t, 5, d[2]) ^ CRC16_SLICE(t, 4, d[3])
+              ^ CRC16_SLICE(t, 3, d[4]) ^ CRC16_SLICE(t, 2, d[5])
+              ^ CRC16_SLICE(t, 1, d[6]) ^ CRC16_SLICE(t, 0, d[7]);
+        d += 8;
+        n -= 8;
+    }
+#endif
+    while (n--) crc = (crc << 8) ^ t[((crc >> 8) ^ *d++) & 0xFF];
+    return crc;
+}
+
+static uint16_t crc16_tab(crc16_tab_t tab, uint8_t const *d, size_t n, uint16_t initval, bool refin, bool refout) {
 
     // fast lookup table algorithm without augmented zero bytes, e.g. used in pkzip.
     // only usable with polynom orders of 8, 16, 24 or 32.
@@ -102,10 +154,11 @@ uint16_t crc16_fast(uint8_t const *d, size_t n, uint16_t initval, bool refin, bo
     if (refin)
         crc = reflect16(crc);
 
-    if (!refin)
-        while (n--) crc = (crc << 8) ^ crc_table[((crc >> 8) ^ *d++) & 0xFF ];
+    const uint16_t *t = crc16_get_table(tab);
+    if (refin)
+        crc = crc16_update_ref(t, crc, d, n);
     else
-        while (n--) crc = (crc >> 8) ^ crc_table[(crc & 0xFF) ^ *d++];
+        crc = crc16_update(t, crc, d, n);
 
     if (refout ^ refin)
         crc = reflect16(crc);
@@ -113,6 +166,11 @@ uint16_t crc16_fast(uint8_t const *d, size_t n, uint16_t initval, bool refin, bo
     return crc;
 }
 
+// table lookup LUT solution, CCITT polynom
+uint16_t crc16_fast(uint8_t const *d, size_t n, uint16_t initval, bool refin, bool refout) {
+    return crc16_tab(refin ? CRC16_TAB_CCITT_REF : CRC16_TAB_CCITT, d, n, initval, refin, refout);
+}
+
 // bit looped solution  TODO REMOVED
 uint16_t update_crc16_ex(uint16_t crc, uint8_t c, uint16_t polynomial) {
     uint16_t tmp = 0;
@@ -165,8 +223,6 @@ void compute_crc(CrcType_t ct, const uint8_t *d, size_t n, uint8_t *first, uint8
     // can't calc a crc on less than 1 byte
     if (n == 0) return;
 
-    init_table(ct);
-
     uint16_t crc = 0;
     switch (ct) {
         case CRC_14443_A:
@@ -207,7 +263,6 @@ uint16_t Crc16ex(CrcType_t ct, const uint8_t *d, size_t n) {
     // can't calc a crc on less than 3 byte. (1byte + 2 crc bytes)
     if (n < 3) return 0;
 
-    init_table(ct);
     switch (ct) {
         case CRC_14443_A:
             return crc16_a(d, n);
@@ -250,8 +305,6 @@ bool check_crc(CrcType_t ct, const uint8_t *d, size_t n) {
     // can't calc a crc on less than 3 byte. (1byte + 2 crc bytes)
     if (n < 3) return false;
 
-    init_table(ct);
-
     switch (ct) {
         case CRC_14443_A:
             return (crc16_a(d, n) == 0);
@@ -331,6 +384,6 @@ uint16_t crc16_iclass(uint8_t const *d, size_t n) {
 // poly=0xB400,  init=depends  refin=true  refout=true  xorout=0x0000  check=  name="CRC-16/LEGIC"
 uint16_t crc16_legic(uint8_t const *d, size_t n, uint8_t uidcrc) {
     uint16_t initial = uidcrc << 8 | uidcrc;
-    return crc16_fast(d, n, initial, true, true);
+    return crc16_tab(CRC16_TAB_LEGIC_REF, d, n, initial, true, true);
 }
 
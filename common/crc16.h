@@ -66,10 +66,7 @@ uint16_t crc16_iclass(uint8_t const *d, size_t n);
 // ie:  uidcrc = 0x78  then initial_value == 0x7878
 uint16_t crc16_legic(uint8_t const *d, size_t n, uint8_t uidcrc);
 
-// table implementation
-void init_table(CrcType_t crctype);
-void reset_table(void);
-void generate_table(uint16_t polynomial, bool refin);
+// table implementation, CCITT polynom, no state, usable from any thread
 uint16_t crc16_fast(uint8_t const *d, size_t n, uint16_t initval, bool refin, bool refout);
 
 #endif
@@ -1,13 +1,22 @@
 #include "crc32.h"
 
+#ifndef ON_DEVICE
+#include <pthread.h>
+#endif
+
 #define htole32(x) (x)
 #define CRC32_PRESET 0xFFFFFFFF
 
+/* x32 + x26 + x23 + x22 + x16 + x12 + x11 + x10 + x8 + x7 + x5 + x4 + x2 + x + 1 */
+#define CRC32_POLY   0xEDB88320
+
+#ifdef ON_DEVICE
+
+// bit looped, the device has no RAM to spare for tables
 static void crc32_byte(uint32_t *crc, const uint8_t value);
 
 static void crc32_byte(uint32_t *crc, const uint8_t value) {
-    /* x32 + x26 + x23 + x22 + x16 + x12 + x11 + x10 + x8 + x7 + x5 + x4 + x2 + x + 1 */
-    const uint32_t poly = 0xEDB88320;
+    const uint32_t poly = CRC32_POLY;
 
     *crc ^= value;
     for (int current_bit = 7; current_bit >= 0; current_bit--) {
@@ -18,11 +27,58 @@ static void crc32_byte(uint32_t *crc, const uint8_t value) {
     }
 }
 
-void crc32_ex(const uint8_t *data, const size_t len, uint8_t *crc) {
-    uint32_t desfire_crc = CRC32_PRESET;
+uint32_t crc32_fast(const uint8_t *data, const size_t len, uint32_t crc) {
     for (size_t i = 0; i < len; i++) {
-        crc32_byte(&desfire_crc, data[i]);
+        crc32_byte(&crc, data[i]);
+    }
+    return crc;
+}
+
+#else
+
+// slice k holds the crc of a byte followed by k zero bytes, filled once
+static uint32_t crc32_table[8][256];
+static pthread_once_t crc32_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; j++)
+            crc = (crc >> 1) ^ ((crc & 1) ? CRC32_POLY : 0);
+        crc32_table[0][i] = crc;
     }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t prev = crc32_table[k - 1][i];
+            crc32_table[k][i] = (prev >> 8) ^ crc32_table[0][prev & 0xFF];
+        }
+    }
+}
+
+// slice-by-8
+uint32_t crc32_fast(const uint8_t *data, const size_t len, uint32_t crc) {
+    pthread_once(&crc32_table_once, crc32_init_table);
+
+    const uint8_t *d = data;
+    size_t n = len;
+    while (n >= 8) {
+        crc ^= d[0] | (d[1] << 8) | (d[2] << 16) | ((uint32_t)d[3] << 24);
+        crc = crc32_table[7][crc & 0xFF] ^ crc32_table[6][(crc >> 8) & 0xFF]
+              ^ crc32_table[5][(crc >> 16) & 0xFF] ^ crc32_table[4][crc >> 24]
+              ^ crc32_table[3][d[4]] ^ crc32_table[2][d[5]]
+              ^ crc32_table[1][d[6]] ^ crc32_table[0][d[7]];
+        d += 8;
+        n -= 8;
+    }
+    while (n--)
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *d++) & 0xFF];
+    return crc;
+}
+
+#endif
+
+void crc32_ex(const uint8_t *data, const size_t len, uint8_t *crc) {
+    uint32_t desfire_crc = crc32_fast(data, len, CRC32_PRESET);
     uint32_t crctmp = htole32(desfire_crc);
     for (size_t i = 0; i < sizeof(uint32_t); i++) {
         crc[i] = ((uint8_t *) &crctmp)[i];
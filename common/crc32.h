@@ -11,6 +11,9 @@
 
 #include "common.h"
 
+// reflected crc32 register update, no preset or final xor, usable from any thread
+uint32_t crc32_fast(const uint8_t *data, const size_t len, uint32_t crc);
+
 void crc32_ex(const uint8_t *data, const size_t len, uint8_t *crc);
 void crc32_append(uint8_t *data, const size_t len);
 
@@ -1,5 +1,7 @@
 #include "crc64.h"
 
+#include <pthread.h>
+
 #define CRC64_ISO_PRESET 0xFFFFFFFFFFFFFFFF
 #define CRC64_ECMA_PRESET 0x0000000000000000
 
@@ -70,12 +72,45 @@ const uint64_t crc64_table[] = {
     0x5DEDC41A34BBEEB2, 0x1F1D25F19D51D821, 0xD80C07CD676F8394, 0x9AFCE626CE85B507
 };
 
+// slices 1..7 of crc64_table for slice-by-8, slice k holds the crc of a byte followed by k zero bytes
+static uint64_t crc64_slices[8][256];
+static pthread_once_t crc64_slices_once = PTHREAD_ONCE_INIT;
+
+static void crc64_init_slices(void) {
+    for (int i = 0; i < 256; i++)
+        crc64_slices[0][i] = crc64_table[i];
+
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint64_t prev = crc64_slices[k - 1][i];
+            crc64_slices[k][i] = (prev << 8) ^ crc64_table[prev >> 56];
+        }
+    }
+}
+
 void crc64(const uint8_t *data, const size_t len, uint64_t *crc) {
+    pthread_once(&crc64_slices_once, crc64_init_slices);
+
+    uint64_t c = *crc;
+    const uint8_t *d = data;
+    size_t n = len;
+    while (n >= 8) {
+        for (int i = 0; i < 8; i++)
+            c ^= (uint64_t)d[i] << (56 - 8 * i);
+
+        c = crc64_slices[7][c >> 56] ^ crc64_slices[6][(c >> 48) & 0xff]
+            ^ crc64_slices[5][(c >> 40) & 0xff] ^ crc64_slices[4][(c >> 32) & 0xff]
+            ^ crc64_slices[3][(c >> 24) & 0xff] ^ crc64_slices[2][(c >> 16) & 0xff]
+            ^ crc64_slices[1][(c >> 8) & 0xff] ^ crc64_slices[0][c & 0xff];
+        d += 8;
+        n -= 8;
+    }
 
-    for (size_t i = 0; i < len; i++) {
-        uint8_t tableIndex = (((uint8_t)(*crc >> 56)) ^ data[i]) & 0xff;
-        *crc = crc64_table[tableIndex] ^ (*crc << 8);
+    while (n--) {
+        uint8_t tableIndex = (((uint8_t)(c >> 56)) ^ *d++) & 0xff;
+        c = crc64_table[tableIndex] ^ (c << 8);
     }
+    *crc = c;
 }
 
 //suint8_t x = (c & 0xFF00000000000000 ) >> 56;
@@ -60,10 +60,15 @@ uint8_t g_debugMode = 0;
 # define prnt Dbprintf
 #endif
 
-signal_t signalprop = { 255, -255, 0, 0, true };
+#ifdef ON_DEVICE
+static signal_t signalprop = { 255, -255, 0, 0, true };
 signal_t *getSignalProperties(void) {
     return &signalprop;
 }
+#else
+// the client keeps them in the demod context of the samples, see graph.c
+# define signalprop (*getSignalProperties())
+#endif
 
 static void resetSignal(void) {
     signalprop.low = 255;
@@ -84,11 +89,15 @@ static void printSignal(void) {
 }
 
 #ifndef ON_DEVICE
-static int cmp_uint8(const void *a, const void *b) {
-    if (*(const uint8_t *)a < * (const uint8_t *)b)
-        return -1;
-    else
-        return *(const uint8_t *)a > *(const uint8_t *)b;
+// the n:th smallest sample, given a histogram of them
+static uint8_t nth_sample(const uint32_t hist[256], uint32_t n) {
+    uint32_t seen = 0;
+    for (int v = 0; v < 256; v++) {
+        seen += hist[v];
+        if (seen > n)
+            return v;
+    }
+    return 255;
 }
 #endif
 
@@ -101,24 +110,31 @@ void computeSignalProperties(uint8_t *samples, uint32_t size) {
     uint32_t offset_size = size - SIGNAL_IGNORE_FIRST_SAMPLES;
 
 #ifndef ON_DEVICE
-    uint8_t tmp[offset_size];
-    memcpy(tmp, samples + SIGNAL_IGNORE_FIRST_SAMPLES, sizeof(tmp));
-    qsort(tmp, sizeof(tmp), sizeof(uint8_t), cmp_uint8);
+    // 10th and 90th percentile from a histogram, samples are 8 bit
+    uint32_t hist[256] = {0};
+    for (uint32_t i = SIGNAL_IGNORE_FIRST_SAMPLES; i < size; i++)
+        hist[samples[i]]++;
+
+    uint8_t low10 = 0.5 * (nth_sample(hist, (int)(offset_size * 0.1)) + nth_sample(hist, (int)((offset_size - 1) * 0.1)));
+    uint8_t hi90 =  0.5 * (nth_sample(hist, (int)(offset_size * 0.9)) + nth_sample(hist, (int)((offset_size - 1) * 0.9)));
 
-    uint8_t low10 = 0.5 * (tmp[(int)(offset_size * 0.1)] + tmp[(int)((offset_size - 1) * 0.1)]);
-    uint8_t hi90 =  0.5 * (tmp[(int)(offset_size * 0.9)] + tmp[(int)((offset_size - 1) * 0.9)]);
+    int low = 255, high = -255;
     uint32_t cnt = 0;
-    for (uint32_t i = SIGNAL_IGNORE_FIRST_SAMPLES; i < size; i++) {
+    for (int v = 0; v < 256; v++) {
+        if (hist[v] == 0)
+            continue;
 
-        if (samples[i] < signalprop.low) signalprop.low = samples[i];
-        if (samples[i] > signalprop.high) signalprop.high = samples[i];
+        if (v < low) low = v;
+        if (v > high) high = v;
 
-        if (samples[i] < low10 || samples[i] > hi90)
+        if (v < low10 || v > hi90)
             continue;
 
-        sum += samples[i];
-        cnt++;
+        sum += v * hist[v];
+        cnt += hist[v];
     }
+    signalprop.low = low;
+    signalprop.high = high;
     if (cnt > 0)
         signalprop.mean = sum / cnt;
     else
@@ -150,20 +166,16 @@ void removeSignalOffset(uint8_t *samples, uint32_t size) {
 
 #ifndef ON_DEVICE
 
-    uint8_t tmp[offset_size];
-    memcpy(tmp, samples + SIGNAL_IGNORE_FIRST_SAMPLES, sizeof(tmp));
-    qsort(tmp, sizeof(tmp), sizeof(uint8_t), cmp_uint8);
+    uint32_t hist[256] = {0};
+    for (uint32_t i = SIGNAL_IGNORE_FIRST_SAMPLES; i < size; i++)
+        hist[samples[i]]++;
 
-    uint8_t low10 = 0.5 * (tmp[(int)(offset_size * 0.05)] + tmp[(int)((offset_size - 1) * 0.05)]);
-    uint8_t hi90 =  0.5 * (tmp[(int)(offset_size * 0.95)] + tmp[(int)((offset_size - 1) * 0.95)]);
+    uint8_t low10 = 0.5 * (nth_sample(hist, (int)(offset_size * 0.05)) + nth_sample(hist, (int)((offset_size - 1) * 0.05)));
+    uint8_t hi90 =  0.5 * (nth_sample(hist, (int)(offset_size * 0.95)) + nth_sample(hist, (int)((offset_size - 1) * 0.95)));
     int32_t cnt = 0;
-    for (uint32_t i = SIGNAL_IGNORE_FIRST_SAMPLES; i < size; i++) {
-
-        if (samples[i] < low10 || samples[i] > hi90)
-            continue;
-
-        acc_off += samples[i] - 128;
-        cnt++;
+    for (int v = low10; v <= hi90; v++) {
+        acc_off += (v - 128) * (int32_t)hist[v];
+        cnt += hist[v];
     }
     if (cnt > 0)
         acc_off /= cnt;
@@ -351,14 +363,15 @@ static size_t findModStart(uint8_t *src, size_t size, uint8_t expWaveSize) {
     size_t i = 0;
     size_t waveSizeCnt = 0;
     uint8_t thresholdCnt = 0;
-    bool isAboveThreshold = src[i++] >= signalprop.mean; //FSK_PSK_THRESHOLD;
+    int mean = signalprop.mean;
+    bool isAboveThreshold = src[i++] >= mean; //FSK_PSK_THRESHOLD;
     for (; i < size - 20; i++) {
-        if (src[i] < signalprop.mean && isAboveThreshold) {
+        if (src[i] < mean && isAboveThreshold) {
             thresholdCnt++;
             if (thresholdCnt > 2 && waveSizeCnt < expWaveSize + 1) break;
             isAboveThreshold = false;
             waveSizeCnt = 0;
-        } else if (src[i] >= signalprop.mean && !isAboveThreshold) {
+        } else if (src[i] >= mean && !isAboveThreshold) {
             thresholdCnt++;
             if (thresholdCnt > 2 && waveSizeCnt < expWaveSize + 1) break;
             isAboveThreshold = true;
@@ -1780,7 +1793,8 @@ static size_t fsk_wave_demod(uint8_t *dest, size_t size, uint8_t fchigh, uint8_t
     //find start of modulating data in trace
     idx = findModStart(dest, size, fchigh);
     // Need to threshold first sample
-    dest[idx] = (dest[idx] < signalprop.mean) ? 0 : 1;
+    int mean = signalprop.mean;
+    dest[idx] = (dest[idx] < mean) ? 0 : 1;
 
     last_transition = idx;
     idx++;
@@ -1818,7 +1832,7 @@ static size_t fsk_wave_demod(uint8_t *dest, size_t size, uint8_t fchigh, uint8_t
     for (; idx < size - 20; idx++) {
 
         // threshold current value
-        dest[idx] = (dest[idx] < signalprop.mean) ? 0 : 1;
+        dest[idx] = (dest[idx] < mean) ? 0 : 1;
 
         // Check for 0->1 transition
         if (dest[idx - 1] < dest[idx]) {
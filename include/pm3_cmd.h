@@ -384,6 +384,54 @@ typedef struct {
     bool off;
 } PACKED tearoff_params_t;
 
+// For CMD_DOWNLOAD_WINDOWED, windowed & resumable bulk download
+// client -> device  CMD_DOWNLOAD_WINDOWED        download_windowed_t
+// device -> client  CMD_DOWNLOAD_WINDOWED        download_windowed_start_t  (status != PM3_SUCCESS on error)
+// device -> client  CMD_DOWNLOADED_WINDOWED      download_windowed_chunk_t  x window
+// device -> client  CMD_DOWNLOAD_WINDOWED_ACK    download_windowed_ack_t    end of window (next = window base, bitmap = chunks sent)
+// client -> device  CMD_DOWNLOAD_WINDOWED_ACK    download_windowed_ack_t    received chunks, device resends missing ones
+// client -> device  CMD_DOWNLOAD_WINDOWED        download_windowed_t        again when the device went silent, resumes at first_chunk
+// device -> client  CMD_ACK                      same final frame as the legacy download commands
+#define DL_WINDOWED_MEM_BIGBUF      0
+#define DL_WINDOWED_MEM_EML         1
+#define DL_WINDOWED_MEM_FLASH       2
+#define DL_WINDOWED_MEM_SPIFFS      3
+
+#define DL_WINDOWED_FLAG_LZ4        0x01
+
+#define DL_WINDOWED_CHUNK_SIZE      496
+#define DL_WINDOWED_MAX_WINDOW      32
+
+typedef struct {
+    uint8_t memtype;
+    uint8_t flags;
+    uint16_t window;        // chunks sent before the device waits for an ack
+    uint32_t start_index;
+    uint32_t bytes;
+    uint32_t first_chunk;   // to resume an interrupted download
+    uint8_t filename[32];   // SPIFFS only
+} PACKED download_windowed_t;
+
+typedef struct {
+    uint32_t total_chunks;
+    uint16_t chunk_size;
+    uint16_t window;
+} PACKED download_windowed_start_t;
+
+typedef struct {
+    uint32_t seq;
+    uint16_t raw_len;       // bytes once decompressed
+    uint16_t len;           // bytes in data
+    uint16_t crc;           // CRC_14443_A over the raw bytes
+    uint8_t flags;          // DL_WINDOWED_FLAG_LZ4 if data is compressed
+    uint8_t data[];
+} PACKED download_windowed_chunk_t;
+
+typedef struct {
+    uint32_t next;          // all chunks before this one are received
+    uint32_t bitmap;        // bit n: chunk next + n received
+} PACKED download_windowed_ack_t;
+
 // For the bootloader
 #define CMD_DEVICE_INFO                                                   0x0000
 //#define CMD_SETUP_WRITE                                                   0x0001
@@ -416,6 +464,9 @@ typedef struct {
 #define CMD_TIA                                                           0x0117
 #define CMD_BREAK_LOOP                                                    0x0118
 #define CMD_SET_TEAROFF                                                   0x0119
+#define CMD_DOWNLOAD_WINDOWED                                             0x011A
+#define CMD_DOWNLOADED_WINDOWED                                           0x011B
+#define CMD_DOWNLOAD_WINDOWED_ACK                                         0x011C
 
 // RDV40, Flash memory operations
 #define CMD_FLASHMEM_WRITE                                                0x0121
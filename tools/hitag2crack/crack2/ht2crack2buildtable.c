@@ -1,315 +1,285 @@
 /*
  * ht2crack2buildtable.c
- * This builds the 1.2TB table and sorts it.
+ * This builds the table and sorts it.
+ *
+ * The table is built as an external sort.  The PRNG states are generated in chunks that fit
+ * in the memory budget, each chunk is sorted in memory and written to disk as a sorted run,
+ * and while that happens the next chunk is already being generated.  Finally all runs are
+ * merged into the bucket files of the sorted table, see ht2crack2table.h for their format.
+ * When there are more runs than open files, the oldest ones are merged into bigger runs first.
  */
 
-#include "ht2crackutils.h"
-#include <stdlib.h>
-
-// DATAMAX is the size of each bucket (bytes).  There are 65536 buckets so choose a value such that
-// DATAMAX * 65536 < RAM available.  For ex, if you want to use 12GB of RAM (for a 16GB machine
-// leaving some RAM free for OS and other stuff), DATAMAX = 12GB / 65536 = 196608.  Round this down
-// to a power of 10; DATAMAX = 196600.
-#define DATAMAX 196600 // around 192K rounded down to a power of 10
-
-// NUM_BUILD_THREADS and NUM_SORT_THREADS are the number of threads to run concurrently.  These should
-// ideally be equal to the number of virtual cores you have available.  A quad-core machine will
-// likely have 8 virtual cores, so set them to 8.
-//
-// If sorting fails with a 'bus error' then that is likely because your disk I/O can't keep up with
-// the read/write demands of the multi-threaded sorting.  In this case, reduce the number of sorting
-// threads.  This will most likely only be a problem with network disks; SATA should be okay;
-// USB2/3 should keep up.
-//
-// These MUST be a power of 2 for the maths to work - you have been warned!
-// Also, sort threads MUST be <= build threads or a horrible buffer overflow will happen!
-#define NUM_BUILD_THREADS 8
-#define NUM_SORT_THREADS 8
-
-// DATASIZE is the number of bytes in an entry.  This is 10; 4 bytes of keystream (2 are in the filepath) +
-// 6 bytes of PRNG state.
-#define DATASIZE 10
+#include "ht2crack2table.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <sys/resource.h>
 
 int debug = 0;
 
-// table entry for a bucket
-struct table {
-    char path[32];
-    pthread_mutex_t mutex;
-    unsigned char *data;
-    unsigned char *ptr;
-};
-
-
-// actual table
-struct table *t;
-
-// jump table 1
-uint64_t d[48];
-int nsteps;
-
-// jump table 2
-uint64_t d2[48];
-int nsteps2;
-
-// create table entry
-static void create_table(struct table *tt, int d_1, int d_2) {
-    if (!tt) {
-        printf("create_table: t is NULL\n");
-        exit(1);
-    }
-
-    // create some space
-    tt->data = (unsigned char *)malloc(DATAMAX);
-    if (!(tt->data)) {
-        printf("create_table: cannot malloc data\n");
-        exit(1);
-    }
-
-    // set data ptr to start of data table
-    tt->ptr = tt->data;
-
-    // init the mutex
-    if (pthread_mutex_init(&(tt->mutex), NULL)) {
-        printf("create_table: cannot init mutex\n");
-        exit(1);
-    }
-
-    // create the path
-//    sprintf(tt->path, "/Volumes/2tb/%02X/%02X.bin", d_1 & 0xff, d_2 & 0xff);
-    sprintf(tt->path, "table/%02x/%02x.bin", d_1 & 0xff, d_2 & 0xff);
+// options
+static uint64_t memory_budget = 4096ULL << 20;
+static int num_build_threads = 0;
+static int num_sort_threads = 0;
+static int index_bits = HT2TABLE_INDEX_BITS;
+static const char *tmpdir = "table";
+static const char *outdir = "sorted";
+
+// an entry while building: 48 bits of keystream and the table entry number
+typedef struct {
+    uint64_t ks;
+    uint64_t n;
+} entry_t;
+
+// jump tables
+static ht2table_jumps_t jumps;
+
+// runs written so far, the ones below first_run are merged into later runs already
+static uint32_t num_runs = 0;
+static uint32_t first_run = 0;
+
+static time_t start_time;
+
+static int num_CPUs(void) {
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        count = 1;
+    return count;
 }
 
+static void runpath(char *path, uint32_t run) {
+    sprintf(path, "%s/run%05u.bin", tmpdir, run);
+}
 
-// create all table entries
-static void create_tables(struct table *tt) {
-    int i, j;
+static int entrycmp(const void *p1, const void *p2) {
+    const entry_t *e1 = (const entry_t *)p1;
+    const entry_t *e2 = (const entry_t *)p2;
 
-    if (!tt) {
-        printf("create_tables: t is NULL\n");
-        exit(1);
-    }
+    if (e1->ks != e2->ks)
+        return (e1->ks < e2->ks) ? -1 : 1;
+    return (e1->n > e2->n) - (e1->n < e2->n);
+}
 
-    for (i = 0; i < 0x100; i++) {
-        for (j = 0; j < 0x100; j++) {
-            create_table(tt + ((i * 0x100) + j), i, j);
-        }
+//----------------------------------------------------------------------------
+// k-way merge
+//
+// A min-heap of sources, each one yielding entries in sorted order.  Used to merge the
+// sorted slices of a chunk into a run, and to merge the runs into the final table.
+
+typedef struct mergesrc {
+    entry_t cur;
+    int (*next)(struct mergesrc *src);
+    void *ctx;
+} mergesrc_t;
+
+typedef struct {
+    mergesrc_t **src;
+    int size;
+} mergeheap_t;
+
+static void heap_down(mergeheap_t *h, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < h->size && entrycmp(&h->src[l]->cur, &h->src[m]->cur) < 0)
+            m = l;
+        if (r < h->size && entrycmp(&h->src[r]->cur, &h->src[m]->cur) < 0)
+            m = r;
+        if (m == i)
+            return;
+        mergesrc_t *tmp = h->src[i];
+        h->src[i] = h->src[m];
+        h->src[m] = tmp;
+        i = m;
     }
 }
 
-
-// free the table memory
-static void free_tables(struct table *tt) {
+// takes the sources that have an entry, the array must hold all of them
+static void heap_init(mergeheap_t *h, mergesrc_t *src, int count, mergesrc_t **slots) {
     int i;
-    struct table *ttmp;
-
-    if (!tt) {
-        printf("free_tables: t is NULL\n");
-        exit(1);
-    }
 
-    for (i = 0; i < 0x10000; i++) {
-        ttmp = tt + i;
-        free(ttmp->data);
+    h->src = slots;
+    h->size = 0;
+    for (i = 0; i < count; i++) {
+        if (src[i].next(&src[i]))
+            h->src[h->size++] = &src[i];
     }
+    for (i = h->size / 2 - 1; i >= 0; i--)
+        heap_down(h, i);
 }
 
+// pops the smallest entry, returns 0 once all sources are drained
+static int heap_pop(mergeheap_t *h, entry_t *e) {
+    if (h->size == 0)
+        return 0;
 
+    *e = h->src[0]->cur;
+    if (h->src[0]->next(h->src[0]) == 0)
+        h->src[0] = h->src[--h->size];
+    heap_down(h, 0);
+    return 1;
+}
 
-// write (partial) table to file
-static void writetable(struct table *t1) {
-    int fd;
+//----------------------------------------------------------------------------
+// sorted runs
+//
+// A run holds the entries of one chunk in the table entry coding, with 48 bit keystream
+// deltas.  The deltas restart at each first keystream byte, whose offsets are in the
+// header, so the final merge can be split by first byte.
+
+#define RUN_MAGIC "HT2R"
+
+typedef struct {
+    char magic[4];
+    uint32_t reserved;
+    uint64_t entries;
+    uint64_t offsets[0x101];
+} run_header_t;
+
+typedef struct {
+    entry_t *data;
+    uint64_t count;
+} slice_t;
+
+static int slice_next(mergesrc_t *src) {
+    slice_t *s = (slice_t *)src->ctx;
+    if (s->count == 0)
+        return 0;
+    src->cur = *s->data++;
+    s->count--;
+    return 1;
+}
 
-    if (debug) printf("writetable %s\n", t1->path);
+static void *sortslice(void *dd) {
+    slice_t *s = (slice_t *)dd;
+    qsort(s->data, s->count, sizeof(entry_t), entrycmp);
+    return NULL;
+}
 
-    fd = open(t1->path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd <= 0) {
-        printf("writetable cannot open file %s for appending\n", t1->path);
+typedef struct {
+    FILE *fp;
+    char path[256];
+    run_header_t header;
+    unsigned char buf[65536];
+    size_t len;
+    uint64_t pos;
+    uint64_t prev;
+    int section;
+} runwriter_t;
+
+static void runwriter_open(runwriter_t *w, uint32_t run) {
+    runpath(w->path, run);
+    w->fp = fopen(w->path, "wb");
+    if (!w->fp) {
+        printf("cannot create run file %s\n", w->path);
         exit(1);
     }
 
-    if (debug) printf("writetable %s opened\n", t1->path);
-
-    if (write(fd, t1->data, t1->ptr - t1->data) < (t1->ptr - t1->data)) {
-        printf("writetable cannot write all of the data\n");
+    memset(&w->header, 0, sizeof(w->header));
+    memcpy(w->header.magic, RUN_MAGIC, 4);
+    if (fwrite(&w->header, sizeof(w->header), 1, w->fp) != 1) {
+        printf("cannot write run file %s\n", w->path);
         exit(1);
     }
-
-    if (debug) printf("writetable %s written\n", t1->path);
-
-    close(fd);
+    w->len = 0;
+    w->pos = sizeof(w->header);
+    w->prev = 0;
+    w->section = -1;
 }
 
-
-// store value in table
-static void store(unsigned char *data) {
-    unsigned char d_1, d_2;
-    int offset;
-    struct table *t1;
-
-    // use the first two bytes as an index
-    d_1 = data[0];
-    d_2 = data[1];
-    offset = (d_1 * 0x100) + d_2;
-
-    if (debug) printf("store, d1=%02X, d2=%02X, offset = %d\n", d_1, d_2, offset);
-
-    // get pointer to table entry
-    t1 = t + offset;
-
-    // wait for a lock on this entry
-    if (pthread_mutex_lock(&(t1->mutex))) {
-        printf("store: cannot lock mutex at offset %d\n", offset);
-        exit(1);
-    }
-
-    if (debug) printf("store, offset = %d, got lock\n", offset);
-
-    // store the entry
-    memcpy(t1->ptr, data + 2, 10);
-
-    if (debug) printf("store, offset = %d, copied data\n", offset);
-
-    // update the ptr
-    t1->ptr += 10;
-
-    // check if table is full
-    if ((t1->ptr - t1->data) >= DATAMAX) {
-        // write the table to disk
-        writetable(t1);
-        // reset ptr
-        t1->ptr = t1->data;
+// entries must come in sorted order
+static void runwriter_add(runwriter_t *w, const entry_t *e) {
+    int s = e->ks >> 40;
+    while (w->section < s) {
+        w->header.offsets[++w->section] = w->pos + w->len;
+        w->prev = (uint64_t)w->section << 40;
     }
+    w->len += ht2table_put_entry(w->buf + w->len, e->ks - w->prev, e->n);
+    w->prev = e->ks;
+    w->header.entries++;
 
-    if (debug) printf("store, offset = %d, after possible write\n", offset);
-
-    // release the lock
-    if (pthread_mutex_unlock(&(t1->mutex))) {
-        printf("store: cannot unlock mutex at offset %d\n", offset);
-        exit(1);
+    if (w->len > sizeof(w->buf) - HT2TABLE_MAX_ENTRY) {
+        if (fwrite(w->buf, 1, w->len, w->fp) != w->len) {
+            printf("cannot write run file %s\n", w->path);
+            exit(1);
+        }
+        w->pos += w->len;
+        w->len = 0;
     }
-
-    if (debug) printf("store, offset = %d, unlocked\n", offset);
-
-}
-
-// writes the ks (keystream) and s (state)
-static void write_ks_s(uint32_t ks1, uint32_t ks2, uint64_t shiftreg) {
-    unsigned char buf[16];
-
-    // create buffer
-    writebuf(buf, ks1, 3);
-    writebuf(buf + 3, ks2, 3);
-    writebuf(buf + 6, shiftreg, 6);
-
-    // store buffer
-    store(buf);
 }
 
-
-// builds the di table for jumping
-static void builddi(int steps, int table) {
-    uint64_t statemask;
-    int i;
-    Hitag_State mystate;
-    uint64_t *thisd = NULL;
-
-    statemask = 1;
-
-    // select jump table
-    if (table == 1) {
-        nsteps = steps;
-        thisd = d;
-    } else if (table == 2) {
-        nsteps2 = steps;
-        thisd = d2;
-    } else {
-        printf("builddi: invalid table num\n");
+static void runwriter_close(runwriter_t *w) {
+    if (w->len && fwrite(w->buf, 1, w->len, w->fp) != w->len) {
+        printf("cannot write run file %s\n", w->path);
         exit(1);
     }
-
-    // build di states
-    for (i = 0; i < 48; i++) {
-        mystate.shiftreg = statemask;
-        buildlfsr(&mystate);
-        hitag2_nstep(&mystate, steps);
-        thisd[i] = mystate.shiftreg;
-
-        statemask = statemask << 1;
+    w->pos += w->len;
+    while (w->section < 0x100) {
+        w->header.offsets[++w->section] = w->pos;
     }
-}
-
-// jump function - quickly jumps a load of steps
-static void jumpnsteps(Hitag_State *hstate, int table) {
-    uint64_t output = 0;
-    uint64_t bitmask;
-    int i;
-    uint64_t *thisd = NULL;
-
 
-    // select jump table
-    if (table == 1) {
-        thisd = d;
-    } else if (table == 2) {
-        thisd = d2;
-    } else {
-        printf("jumpnsteps: invalid table num\n");
+    if (fseek(w->fp, 0, SEEK_SET) || fwrite(&w->header, sizeof(w->header), 1, w->fp) != 1) {
+        printf("cannot write run file header %s\n", w->path);
         exit(1);
     }
+    fclose(w->fp);
+}
 
-    // xor all di.si where di is a d state and si is a bit
-    // we do this by multiplying di by si:
-    // if si is 1, di.si = di; if si is 0, di.si = 0
+// sorts a chunk with all sort threads and writes it as run number 'run'
+static void writerun(entry_t *data, uint64_t count, uint32_t run) {
+    pthread_t threads[num_sort_threads];
+    slice_t slices[num_sort_threads];
+    mergesrc_t src[num_sort_threads];
+    mergesrc_t *slots[num_sort_threads];
+    mergeheap_t heap;
+    runwriter_t w;
+    entry_t e;
+    int i;
 
-    bitmask = 1;
-    for (i = 0; i < 48; i++) {
-        if (hstate->shiftreg & bitmask) {
-            output = output ^ thisd[i];
+    for (i = 0; i < num_sort_threads; i++) {
+        slices[i].data = data + (count * i) / num_sort_threads;
+        slices[i].count = (count * (i + 1)) / num_sort_threads - (count * i) / num_sort_threads;
+        if (pthread_create(&threads[i], NULL, sortslice, &slices[i])) {
+            printf("cannot start sortslice thread %d\n", i);
+            exit(1);
         }
-
-        bitmask = bitmask << 1;
+    }
+    for (i = 0; i < num_sort_threads; i++) {
+        pthread_join(threads[i], NULL);
+        src[i].next = slice_next;
+        src[i].ctx = &slices[i];
     }
 
-    hstate->shiftreg = output;
-    buildlfsr(hstate);
+    runwriter_open(&w, run);
+    heap_init(&heap, src, num_sort_threads, slots);
+    while (heap_pop(&heap, &e)) {
+        runwriter_add(&w, &e);
+    }
+    runwriter_close(&w);
 }
 
+//----------------------------------------------------------------------------
+// generation
+
+typedef struct {
+    entry_t *data;
+    uint64_t first;
+    uint64_t count;
+} buildjob_t;
 
-// thread to build a part of the table
+// fills a part of a chunk with consecutive table entries
 static void *buildtable(void *dd) {
+    buildjob_t *job = (buildjob_t *)dd;
     Hitag_State hstate;
     Hitag_State hstate2;
-    unsigned long i;
-    unsigned long maxentries = 1;
+    uint64_t i;
     uint32_t ks1;
     uint32_t ks2;
-    int index = (int)(long)dd;
-    int tnum = NUM_BUILD_THREADS;
 
-    /* set random state */
-    hstate.shiftreg = 0x123456789abc;
+    // jump straight to the first entry
+    hstate.shiftreg = ht2table_state(jumps, job->first);
     buildlfsr(&hstate);
 
-    /* jump to offset using jump table 2 (2048) */
-    for (i = 0; i < index; i++) {
-        jumpnsteps(&hstate, 2);
-    }
-
-    /* set max entries - this is a fraction of 2^37 depending on how many threads we are running.
-       1 thread  = 2^37
-       2 threads = 2^36
-       4 threads = 2^35
-       8 threads = 2^34
-       etc
-    */
-    maxentries = maxentries << 37;
-    while (!(tnum & 0x1)) {
-        maxentries = maxentries >> 1;
-        tnum = tnum >> 1;
-    }
-
-    /* make the entries */
-    for (i = 0; i < maxentries; i++) {
+    for (i = 0; i < job->count; i++) {
 
         // copy the current state
         hstate2.shiftreg = hstate.shiftreg;
@@ -317,234 +287,579 @@ static void *buildtable(void *dd) {
 
         // get 48 bits of keystream from hstate2
         // this is split into 2 x 24 bit
-        ks1 = hitag2_nstep(&hstate2, 24);
-        ks2 = hitag2_nstep(&hstate2, 24);
+        ks1 = hitag2_nstep(&hstate2, 24) & 0xffffff;
+        ks2 = hitag2_nstep(&hstate2, 24) & 0xffffff;
 
-        write_ks_s(ks1, ks2, hstate.shiftreg);
+        job->data[i].ks = ((uint64_t)ks1 << 24) | ks2;
+        job->data[i].n = job->first + i;
 
-        // jump hstate forward 2048 * NUM_BUILD_THREADS states using di table
-        // this is because we're running NUM_BUILD_THREADS threads at once, from NUM_BUILD_THREADS
-        // different offsets that are 2048 states apart.
-        jumpnsteps(&hstate, 1);
+        // jump hstate forward to the next entry
+        hstate.shiftreg = ht2table_jump(jumps[0], hstate.shiftreg);
+        buildlfsr(&hstate);
     }
 
     return NULL;
 }
 
-
-// make 'table/' (unsorted) and 'sorted/' dir structures
-static void makedirs(void) {
-    char path[32];
+static void buildchunk(entry_t *data, uint64_t first, uint64_t count) {
+    pthread_t threads[num_build_threads];
+    buildjob_t jobs[num_build_threads];
     int i;
 
-    if (mkdir("table", 0755)) {
-        printf("cannot make dir table\n");
-        exit(1);
+    for (i = 0; i < num_build_threads; i++) {
+        jobs[i].first = first + (count * i) / num_build_threads;
+        jobs[i].count = first + (count * (i + 1)) / num_build_threads - jobs[i].first;
+        jobs[i].data = data + (jobs[i].first - first);
+        if (pthread_create(&threads[i], NULL, buildtable, &jobs[i])) {
+            printf("cannot start buildtable thread %d\n", i);
+            exit(1);
+        }
     }
-    if (mkdir("sorted", 0755)) {
-        printf("cannot make dir sorted\n");
-        exit(1);
+    for (i = 0; i < num_build_threads; i++) {
+        pthread_join(threads[i], NULL);
     }
+}
 
-    for (i = 0; i < 0x100; i++) {
-        sprintf(path, "table/%02x", i);
-        if (mkdir(path, 0755)) {
-            printf("cannot make dir %s\n", path);
-            exit(1);
-        }
-        sprintf(path, "sorted/%02x", i);
-        if (mkdir(path, 0755)) {
-            printf("cannot make dir %s\n", path);
+typedef struct {
+    entry_t *data;
+    uint64_t count;
+    uint32_t run;
+} sortjob_t;
+
+static void *sortchunk(void *dd) {
+    sortjob_t *job = (sortjob_t *)dd;
+    writerun(job->data, job->count, job->run);
+    printf("[%6lds] run %u sorted and written\n", (long)(time(NULL) - start_time), job->run);
+    return NULL;
+}
+
+//----------------------------------------------------------------------------
+// final merge
+
+typedef struct {
+    int fd;
+    unsigned char *buf;
+    size_t bufsize;
+    size_t pos;
+    size_t len;
+    uint64_t off;       // next file offset to read
+    uint64_t end;       // end of the current section
+    uint64_t prev;
+} runreader_t;
+
+static int run_next(mergesrc_t *src) {
+    runreader_t *r = (runreader_t *)src->ctx;
+    uint64_t delta;
+
+    if ((r->len - r->pos < HT2TABLE_MAX_ENTRY) && (r->off < r->end)) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+
+        size_t want = r->bufsize - r->len;
+        if (want > r->end - r->off)
+            want = r->end - r->off;
+        ssize_t got = pread(r->fd, r->buf + r->len, want, r->off);
+        if (got <= 0) {
+            printf("cannot read run file\n");
             exit(1);
         }
+        r->len += got;
+        r->off += got;
     }
-}
 
-static int datacmp(const void *p1, const void *p2, void *dummy) {
-    unsigned char *d_1 = (unsigned char *)p1;
-    unsigned char *d_2 = (unsigned char *)p2;
+    if (r->pos >= r->len)
+        return 0;
 
-    return memcmp(d_1, d_2, DATASIZE);
+    r->pos += ht2table_get_entry(r->buf + r->pos, &delta, &src->cur.n);
+    r->prev += delta;
+    src->cur.ks = r->prev;
+    return 1;
 }
 
-static void *sorttable(void *dd) {
-    int i, j;
-    int fdin;
-    int fdout;
-    char infile[64];
-    char outfile[64];
-    unsigned char *data = NULL;
-    struct stat filestat;
-    uint64_t numentries = 0;
-    int index = (int)(long)dd;
-    int space = 0x100 / NUM_SORT_THREADS;
-
-    // create table - 50MB should be enough
-    unsigned char *table = (unsigned char *)malloc(50UL * 1024UL * 1024UL);
-    if (!table) {
-        printf("sorttable: cannot malloc table\n");
+// opens a run and reads its header
+static int run_open(uint32_t run, run_header_t *header) {
+    char path[256];
+
+    runpath(path, run);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("cannot open run file %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    if ((pread(fd, header, sizeof(run_header_t), 0) != sizeof(run_header_t)) ||
+            memcmp(header->magic, RUN_MAGIC, 4)) {
+        printf("invalid run file %s\n", path);
         exit(1);
     }
+    return fd;
+}
 
-    // loop over our first byte values
-    for (i = (index * space); i < ((index + 1) * space); i++) {
-        // loop over all second byte values
-        for (j = 0; j < 0x100; j++) {
+static void run_section(runreader_t *r, const run_header_t *header, int section) {
+    r->off = header->offsets[section];
+    r->end = header->offsets[section + 1];
+    r->pos = r->len = 0;
+    r->prev = (uint64_t)section << 40;
+}
 
-            printf("sorttable: processing bytes 0x%02x/0x%02x\n", i, j);
+// gives back the disk space of sections that are merged, they are never read again
+static void run_release(int fd, const run_header_t *header, int from, int to) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    uint64_t start = header->offsets[from];
+    uint64_t end = header->offsets[to];
+    if (end > start) {
+        // not every file system can, then the space is only freed when the run is removed
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start);
+    }
+#else
+    (void)fd;
+    (void)header;
+    (void)from;
+    (void)to;
+#endif
+}
 
-            // open file, stat it and mmap it
-            sprintf(infile, "table/%02x/%02x.bin", i, j);
+static void run_remove(uint32_t run) {
+    char path[256];
 
-            fdin = open(infile, O_RDONLY);
-            if (fdin <= 0) {
-                printf("cannot open file %s\n", infile);
-                exit(1);
-            }
+    runpath(path, run);
+    if (unlink(path)) {
+        printf("cannot remove file %s\n", path);
+    }
+}
 
-            if (fstat(fdin, &filestat)) {
-                printf("cannot stat file %s\n", infile);
-                exit(1);
-            }
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t size;
+    ht2table_block_t *blocks;
+    uint32_t entries;
+    uint32_t prev;
+} bucket_t;
+
+static void bucket_add(bucket_t *b, uint32_t key, uint64_t n) {
+
+    if (b->len + HT2TABLE_MAX_ENTRY > b->size) {
+        b->size = b->size ? b->size * 2 : 1 << 20;
+        b->data = realloc(b->data, b->size);
+        if (!b->data) {
+            printf("cannot malloc bucket\n");
+            exit(1);
+        }
+    }
 
-            data = mmap((caddr_t)0, filestat.st_size, PROT_READ, MAP_PRIVATE, fdin, 0);
-            if (data == MAP_FAILED) {
-                printf("cannot mmap file %s\n", infile);
+    if ((b->entries % HT2TABLE_BLOCK) == 0) {
+        uint32_t block = b->entries / HT2TABLE_BLOCK;
+        if ((block & (block - 1)) == 0) {
+            b->blocks = realloc(b->blocks, sizeof(ht2table_block_t) * (block ? block * 2 : 1));
+            if (!b->blocks) {
+                printf("cannot malloc bucket index\n");
                 exit(1);
             }
+        }
+        b->blocks[block].first_key = key;
+        b->blocks[block].offset = b->len;
+        b->prev = key;
+    }
+
+    b->len += ht2table_put_entry(b->data + b->len, key - b->prev, n);
+    b->prev = key;
+    b->entries++;
+}
 
-            // copy data into table
-            memcpy(table, data, filestat.st_size);
+static void bucket_write(bucket_t *b, int bucket) {
+    ht2table_header_t header;
+    char path[256];
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HT2TABLE_MAGIC, 4);
+    header.version = HT2TABLE_VERSION;
+    header.block_entries = HT2TABLE_BLOCK;
+    header.entries = b->entries;
+    header.blocks = (b->entries + HT2TABLE_BLOCK - 1) / HT2TABLE_BLOCK;
+    header.start = HT2TABLE_START;
+    header.step = HT2TABLE_STEP;
+    header.index_bits = index_bits;
+
+    sprintf(path, "%s/%02x/%02x.bin", outdir, bucket >> 8, bucket & 0xff);
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        printf("cannot create table file %s\n", path);
+        exit(1);
+    }
+    if ((fwrite(&header, sizeof(header), 1, fp) != 1) ||
+            (fwrite(b->blocks, sizeof(ht2table_block_t), header.blocks, fp) != header.blocks) ||
+            (fwrite(b->data, 1, b->len, fp) != b->len)) {
+        printf("cannot write table file %s\n", path);
+        exit(1);
+    }
+    fclose(fp);
 
-            numentries = filestat.st_size / DATASIZE;
+    b->len = 0;
+    b->entries = 0;
+}
 
-            // unmap file and close it
-            if (munmap(data, filestat.st_size)) {
-                printf("cannot munmap %s\n", infile);
-                exit(1);
-            }
+typedef struct {
+    uint32_t count;
+    int *fds;
+    run_header_t *headers;
+    size_t bufsize;
+    int next_section;
+    pthread_mutex_t lock;
+    uint8_t merged[0x100];
+    int released;           // sections below are merged and released
+} mergejob_t;
+
+// merges all runs, one first keystream byte at a time
+static void *mergeruns(void *dd) {
+    mergejob_t *job = (mergejob_t *)dd;
+    runreader_t *readers = calloc(job->count, sizeof(runreader_t));
+    mergesrc_t *src = calloc(job->count, sizeof(mergesrc_t));
+    mergesrc_t **slots = calloc(job->count, sizeof(mergesrc_t *));
+    bucket_t bucket;
+    mergeheap_t heap;
+    entry_t e;
+    uint32_t i;
+    int section;
+
+    if (!readers || !src || !slots) {
+        printf("cannot malloc merge\n");
+        exit(1);
+    }
+    memset(&bucket, 0, sizeof(bucket));
+
+    for (i = 0; i < job->count; i++) {
+        readers[i].fd = job->fds[i];
+        readers[i].bufsize = job->bufsize;
+        readers[i].buf = malloc(job->bufsize);
+        if (!readers[i].buf) {
+            printf("cannot malloc merge buffer\n");
+            exit(1);
+        }
+        src[i].next = run_next;
+        src[i].ctx = &readers[i];
+    }
 
-            close(fdin);
+    while ((section = __atomic_fetch_add(&job->next_section, 1, __ATOMIC_RELAXED)) < 0x100) {
 
-            // sort it
-            void *dummy = NULL; // clang
-            qsort_r(table, numentries, DATASIZE, datacmp, dummy);
+        for (i = 0; i < job->count; i++) {
+            run_section(&readers[i], &job->headers[i], section);
+        }
 
-            // write to file
-            sprintf(outfile, "sorted/%02x/%02x.bin", i, j);
-            fdout = open(outfile, O_WRONLY | O_CREAT, 0644);
-            if (fdout <= 0) {
-                printf("cannot create outfile %s\n", outfile);
-                exit(1);
-            }
-            if (write(fdout, table, numentries * DATASIZE)) {
-                printf("writetable cannot write all of the data\n");
-                exit(1);
+        int current = section << 8;
+        heap_init(&heap, src, job->count, slots);
+        while (heap_pop(&heap, &e)) {
+            int b = e.ks >> 32;
+            while (current < b) {
+                bucket_write(&bucket, current++);
             }
-            close(fdout);
+            bucket_add(&bucket, e.ks & 0xffffffff, e.n);
+        }
+        // empty buckets get a file too
+        while (current < ((section + 1) << 8)) {
+            bucket_write(&bucket, current++);
+        }
 
-            // remove input file
-            if (unlink(infile)) {
-                printf("cannot remove file %s\n", infile);
-                exit(1);
-            }
+        // the sections are merged out of order, release the runs up to the first one still in work
+        pthread_mutex_lock(&job->lock);
+        job->merged[section] = 1;
+        int from = job->released;
+        while ((job->released < 0x100) && job->merged[job->released])
+            job->released++;
+        for (i = 0; (job->released > from) && (i < job->count); i++) {
+            run_release(job->fds[i], &job->headers[i], from, job->released);
         }
+        pthread_mutex_unlock(&job->lock);
+
+        printf("[%6lds] sorted/%02x merged\n", (long)(time(NULL) - start_time), section);
     }
 
+    for (i = 0; i < job->count; i++)
+        free(readers[i].buf);
+    free(readers);
+    free(src);
+    free(slots);
+    free(bucket.data);
+    free(bucket.blocks);
     return NULL;
 }
 
-int main(int argc, char *argv[]) {
-    pthread_t threads[NUM_BUILD_THREADS];
-    void *status;
-    long i;
-    int ret;
-    struct table *t1;
+// merges the oldest 'count' runs into a new run and removes them
+static void premerge(uint32_t count) {
+    runreader_t *readers = calloc(count, sizeof(runreader_t));
+    mergesrc_t *src = calloc(count, sizeof(mergesrc_t));
+    mergesrc_t **slots = calloc(count, sizeof(mergesrc_t *));
+    run_header_t *headers = calloc(count, sizeof(run_header_t));
+    runwriter_t *w = malloc(sizeof(runwriter_t));
+    mergeheap_t heap;
+    entry_t e;
+    uint32_t i;
+    int section;
+
+    if (!readers || !src || !slots || !headers || !w) {
+        printf("cannot malloc merge\n");
+        exit(1);
+    }
 
+    size_t bufsize = memory_budget / count;
+    if (bufsize > (1 << 20))
+        bufsize = 1 << 20;
+    if (bufsize < 4096)
+        bufsize = 4096;
+
+    for (i = 0; i < count; i++) {
+        readers[i].fd = run_open(first_run + i, &headers[i]);
+        readers[i].bufsize = bufsize;
+        readers[i].buf = malloc(bufsize);
+        if (!readers[i].buf) {
+            printf("cannot malloc merge buffer\n");
+            exit(1);
+        }
+        src[i].next = run_next;
+        src[i].ctx = &readers[i];
+    }
 
-    // make the table of tables
-    t = (struct table *)malloc(sizeof(struct table) * 65536);
-    if (!t) {
-        printf("malloc failed\n");
-        exit(1);
+    runwriter_open(w, num_runs);
+    for (section = 0; section < 0x100; section++) {
+        for (i = 0; i < count; i++) {
+            run_section(&readers[i], &headers[i], section);
+        }
+        heap_init(&heap, src, count, slots);
+        while (heap_pop(&heap, &e)) {
+            runwriter_add(w, &e);
+        }
+        for (i = 0; i < count; i++) {
+            run_release(readers[i].fd, &headers[i], section, section + 1);
+        }
     }
+    runwriter_close(w);
 
-    // init the table
-    create_tables(t);
+    printf("[%6lds] runs %u - %u merged into run %u\n", (long)(time(NULL) - start_time), first_run, first_run + count - 1, num_runs);
 
-    // create the directories
-    makedirs();
+    for (i = 0; i < count; i++) {
+        close(readers[i].fd);
+        free(readers[i].buf);
+        run_remove(first_run + i);
+    }
+    first_run += count;
+    num_runs++;
+
+    free(readers);
+    free(src);
+    free(slots);
+    free(headers);
+    free(w);
+}
 
-    // build the jump table for incremental steps
-    builddi(2048 * NUM_BUILD_THREADS, 1);
+// the number of runs the final merge can keep open, raises the open file limit if needed
+static uint32_t mergefan(void) {
+    // stdio, and every merge thread writes a table file
+    rlim_t spare = 16 + num_sort_threads;
+    rlim_t want = (num_runs - first_run) + spare;
+    struct rlimit rl;
 
-    // build the jump table for setting the offset
-    builddi(2048, 2);
+    if (getrlimit(RLIMIT_NOFILE, &rl))
+        return num_runs - first_run;
 
-    // start the threads
-    for (i = 0; i < NUM_BUILD_THREADS; i++) {
-        ret = pthread_create(&(threads[i]), NULL, buildtable, (void *)(i));
-        if (ret) {
-            printf("cannot start buildtable thread %ld\n", i);
-            exit(1);
+    if ((rl.rlim_cur != RLIM_INFINITY) && (rl.rlim_cur < want)) {
+        rl.rlim_cur = ((rl.rlim_max == RLIM_INFINITY) || (rl.rlim_max > want)) ? want : rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) || getrlimit(RLIMIT_NOFILE, &rl)) {
+            printf("cannot raise the open file limit\n");
         }
     }
 
-    if (debug) printf("main, started buildtable threads\n");
+    if ((rl.rlim_cur == RLIM_INFINITY) || (rl.rlim_cur >= want))
+        return num_runs - first_run;
+    if (rl.rlim_cur < spare + 2) {
+        printf("open file limit of %lu is too low, raise it with ulimit -n\n", (unsigned long)rl.rlim_cur);
+        exit(1);
+    }
+    return rl.rlim_cur - spare;
+}
+
+static void mergeall(void) {
+    pthread_t threads[num_sort_threads];
+    mergejob_t job;
+    uint32_t i;
+    int t;
+
+    // more runs than open files, merge the oldest ones into a single run until they fit
+    uint32_t fan = mergefan();
+    while (num_runs - first_run > fan) {
+        uint32_t count = num_runs - first_run - fan + 1;
+        if (count > fan)
+            count = fan;
+        premerge(count);
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.count = num_runs - first_run;
+    job.fds = calloc(job.count, sizeof(int));
+    job.headers = calloc(job.count, sizeof(run_header_t));
+    if (!job.fds || !job.headers) {
+        printf("cannot malloc run headers\n");
+        exit(1);
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    for (i = 0; i < job.count; i++) {
+        job.fds[i] = run_open(first_run + i, &job.headers[i]);
+    }
+
+    // every merge thread keeps a read buffer per run
+    job.bufsize = memory_budget / ((uint64_t)job.count * num_sort_threads);
+    if (job.bufsize > (1 << 20))
+        job.bufsize = 1 << 20;
+    if (job.bufsize < 4096)
+        job.bufsize = 4096;
 
-    // wait for threads to finish
-    for (i = 0; i < NUM_BUILD_THREADS; i++) {
-        ret = pthread_join(threads[i], &status);
-        if (ret) {
-            printf("cannot join buildtable thread %ld\n", i);
+    for (t = 0; t < num_sort_threads; t++) {
+        if (pthread_create(&threads[t], NULL, mergeruns, &job)) {
+            printf("cannot start merge thread %d\n", t);
             exit(1);
         }
-        printf("buildtable thread %ld finished\n", i);
+    }
+    for (t = 0; t < num_sort_threads; t++) {
+        pthread_join(threads[t], NULL);
     }
 
-    // write all remaining files
-    for (i = 0; i < 0x10000; i++) {
-        t1 = t + i;
-        if (t1->ptr > t1->data) {
-            writetable(t1);
-        }
+    for (i = 0; i < job.count; i++) {
+        close(job.fds[i]);
+        run_remove(first_run + i);
     }
+    pthread_mutex_destroy(&job.lock);
+    free(job.fds);
+    free(job.headers);
+}
+
+//----------------------------------------------------------------------------
 
-    // dump the memory
-    free_tables(t);
-    free(t);
+static void makedir(const char *path) {
+    if (mkdir(path, 0755) && (errno != EEXIST)) {
+        printf("cannot make dir %s\n", path);
+        exit(1);
+    }
+}
 
+// make the run directory and the 'sorted/' dir structure
+static void makedirs(void) {
+    char path[256];
+    int i;
 
+    makedir(tmpdir);
+    makedir(outdir);
 
-    // now for the sorting
+    for (i = 0; i < 0x100; i++) {
+        sprintf(path, "%s/%02x", outdir, i);
+        makedir(path);
+    }
+}
 
+static void usage(char *prog) {
+    printf("%s [-m MB] [-b build threads] [-s sort threads] [-n bits] [-T tmpdir] [-o outdir]\n", prog);
+    printf("  -m  memory budget in MB (default %" PRIu64 ")\n", memory_budget >> 20);
+    printf("  -b  number of threads generating PRNG states (default: number of cores)\n");
+    printf("  -s  number of threads sorting and merging (default: number of cores)\n");
+    printf("  -n  build a table of 2^n entries (default %d), smaller values only for testing\n", HT2TABLE_INDEX_BITS);
+    printf("  -T  directory for the temporary sorted runs (default '%s')\n", tmpdir);
+    printf("  -o  directory of the sorted table (default '%s')\n", outdir);
+    exit(1);
+}
 
-    // start the threads
-    for (i = 0; i < NUM_SORT_THREADS; i++) {
-        ret = pthread_create(&(threads[i]), NULL, sorttable, (void *)(i));
-        if (ret) {
-            printf("cannot start sorttable thread %ld\n", i);
-            exit(1);
+int main(int argc, char *argv[]) {
+    int c;
+
+    while ((c = getopt(argc, argv, "m:b:s:n:T:o:h")) != -1) {
+        switch (c) {
+            case 'm':
+                memory_budget = strtoull(optarg, NULL, 0) << 20;
+                break;
+            case 'b':
+                num_build_threads = atoi(optarg);
+                break;
+            case 's':
+                num_sort_threads = atoi(optarg);
+                break;
+            case 'n':
+                index_bits = atoi(optarg);
+                break;
+            case 'T':
+                tmpdir = optarg;
+                break;
+            case 'o':
+                outdir = optarg;
+                break;
+            default:
+                usage(argv[0]);
         }
     }
 
-    if (debug) printf("main, started sorttable threads\n");
+    if (num_build_threads <= 0)
+        num_build_threads = num_CPUs();
+    if (num_sort_threads <= 0)
+        num_sort_threads = num_CPUs();
+    if ((index_bits < 8) || (index_bits > HT2TABLE_INDEX_BITS) || (memory_budget < (16 << 20)))
+        usage(argv[0]);
+
+    // two chunks are in memory, one being generated and one being sorted
+    uint64_t total = 1ULL << index_bits;
+    uint64_t chunk = memory_budget / (2 * sizeof(entry_t));
+    if (chunk > total)
+        chunk = total;
+    uint32_t chunks = (total + chunk - 1) / chunk;
+
+    printf("building 2^%d entries in %u runs of up to %" PRIu64 " entries, %d build and %d sort threads\n",
+           index_bits, chunks, chunk, num_build_threads, num_sort_threads);
+
+    entry_t *bufs[2];
+    bufs[0] = (entry_t *)malloc(chunk * sizeof(entry_t));
+    bufs[1] = (chunks > 1) ? (entry_t *)malloc(chunk * sizeof(entry_t)) : bufs[0];
+    if (!bufs[0] || !bufs[1]) {
+        printf("cannot malloc %" PRIu64 " MB, lower the memory budget with -m\n", (2 * chunk * sizeof(entry_t)) >> 20);
+        exit(1);
+    }
+
+    makedirs();
+    ht2table_build_jumps(jumps);
+    start_time = time(NULL);
+
+    // generate chunk i while chunk i-1 is sorted and written
+    pthread_t sorter;
+    sortjob_t sortjob;
+    int sorting = 0;
+    for (uint32_t i = 0; i < chunks; i++) {
+        uint64_t first = i * chunk;
+        uint64_t count = (total - first < chunk) ? total - first : chunk;
+        entry_t *data = bufs[i & 1];
+
+        buildchunk(data, first, count);
+        printf("[%6lds] chunk %u/%u generated\n", (long)(time(NULL) - start_time), i + 1, chunks);
+
+        if (sorting) {
+            pthread_join(sorter, NULL);
+        }
 
-    // wait for threads to finish
-    for (i = 0; i < NUM_SORT_THREADS; i++) {
-        ret = pthread_join(threads[i], &status);
-        if (ret) {
-            printf("cannot join sorttable thread %ld\n", i);
+        sortjob.data = data;
+        sortjob.count = count;
+        sortjob.run = num_runs++;
+        if (pthread_create(&sorter, NULL, sortchunk, &sortjob)) {
+            printf("cannot start sort thread\n");
             exit(1);
         }
-        printf("sorttable thread %ld finished\n", i);
+        sorting = 1;
     }
+    if (sorting) {
+        pthread_join(sorter, NULL);
+    }
+
+    free(bufs[0]);
+    if (bufs[1] != bufs[0])
+        free(bufs[1]);
 
-    pthread_exit(NULL);
+    // now for the merging
+    mergeall();
+    rmdir(tmpdir);
 
+    printf("[%6lds] table complete\n", (long)(time(NULL) - start_time));
     return 0;
 }
-
-
-
-
@@ -4,10 +4,13 @@
  * PRNG state, checks it is correct, and then rolls back the PRNG to recover the key
  */
 
-#include "ht2crackutils.h"
+#include "ht2crack2table.h"
 
 #define INPUTFILE "sorted/%02x/%02x.bin"
-#define DATASIZE 10
+#define DATASIZE HT2TABLE_LEGACY_ENTRY
+
+// jump tables to recompute PRNG states from table entry numbers
+static ht2table_jumps_t jumps;
 
 struct rngdata {
     unsigned char *data;
@@ -154,12 +157,102 @@ static int testcand(unsigned char *f, unsigned char *rt, int fwd) {
     }
 }
 
+// search a legacy table file, 10 byte entries sorted on the keystream
+static unsigned char *searchlegacy(unsigned char *item, unsigned char *data, size_t size, unsigned char *rt, int fwd) {
+    unsigned char *found = (unsigned char *)bsearch(item, data, size / DATASIZE, DATASIZE, datacmp);
+
+    if (found) {
+
+        // our candidate is in the table
+        // go backwards and see if there are other matches
+        while (((found - data) >= DATASIZE) && (!memcmp(found - DATASIZE, item, 4))) {
+            found = found - DATASIZE;
+        }
+
+        // now test all matches
+        while (((found - data) <= (size - DATASIZE)) && (!memcmp(found, item, 4))) {
+            if (testcand(found, rt, fwd)) {
+                return found;
+            }
+
+            found = found + DATASIZE;
+        }
+    }
+
+    return NULL;
+}
+
+// search a delta coded table file, see ht2crack2table.h.  On a match the entry is
+// rebuilt in the legacy layout in 'entry'.
+static int searchdelta(unsigned char *item, unsigned char *data, size_t size, unsigned char *rt, int fwd, unsigned char *entry) {
+    ht2table_header_t *header = (ht2table_header_t *)data;
+    ht2table_block_t *blocks = (ht2table_block_t *)(data + sizeof(ht2table_header_t));
+    unsigned char *entries = (unsigned char *)(blocks + header->blocks);
+    uint32_t key = ((uint32_t)item[0] << 24) | (item[1] << 16) | (item[2] << 8) | item[3];
+    uint32_t lo = 0;
+    uint32_t hi = header->blocks;
+    uint32_t block;
+    uint32_t i;
+
+    if ((header->version != HT2TABLE_VERSION) || (header->start != HT2TABLE_START) || (header->step != HT2TABLE_STEP) ||
+            (size < sizeof(ht2table_header_t) + header->blocks * sizeof(ht2table_block_t))) {
+        printf("unsupported table file\n");
+        exit(1);
+    }
+
+    // equal keys may spill over from the previous block, so start at the last block
+    // whose first key is below ours
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (blocks[mid].first_key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    block = (lo > 0) ? lo - 1 : 0;
+
+    for (; block < header->blocks; block++) {
+        unsigned char *p = entries + blocks[block].offset;
+        uint32_t count = header->entries - block * header->block_entries;
+        uint64_t cur = blocks[block].first_key;
+
+        if (count > header->block_entries) {
+            count = header->block_entries;
+        }
+        if (cur > key) {
+            break;
+        }
+
+        for (i = 0; i < count; i++) {
+            uint64_t delta;
+            uint64_t n;
+
+            p += ht2table_get_entry(p, &delta, &n);
+            cur += delta;
+            if (cur > key) {
+                return 0;
+            }
+            if (cur == key) {
+                memcpy(entry, item, 4);
+                writebuf(entry + 4, ht2table_state(jumps, n), 6);
+                if (testcand(entry, rt, fwd)) {
+                    return 1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
 static int searchcand(unsigned char *c, unsigned char *rt, int fwd, unsigned char *m, unsigned char *s) {
     int fd;
     struct stat filestat;
     char file[64];
     unsigned char *data;
     unsigned char item[10];
+    unsigned char entry[DATASIZE];
     unsigned char *found = NULL;
 
 
@@ -181,6 +274,11 @@ static int searchcand(unsigned char *c, unsigned char *rt, int fwd, unsigned cha
         exit(1);
     }
 
+    if (filestat.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
     data = mmap((caddr_t)0, filestat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
     if (data == MAP_FAILED) {
         printf("cannot mmap file %s\n", file);
@@ -189,37 +287,24 @@ static int searchcand(unsigned char *c, unsigned char *rt, int fwd, unsigned cha
 
     memcpy(item, c + 2, 4);
 
-    found = (unsigned char *)bsearch(item, data, filestat.st_size / DATASIZE, DATASIZE, datacmp);
-
-    if (found) {
-
-        // our candidate is in the table
-        // go backwards and see if there are other matches
-        while (((found - data) >= DATASIZE) && (!memcmp(found - DATASIZE, item, 4))) {
-            found = found - DATASIZE;
+    if ((filestat.st_size >= sizeof(ht2table_header_t)) && !memcmp(data, HT2TABLE_MAGIC, 4)) {
+        if (searchdelta(item, data, filestat.st_size, rt, fwd, entry)) {
+            found = entry;
         }
+    } else {
+        found = searchlegacy(item, data, filestat.st_size, rt, fwd);
+    }
 
-        // now test all matches
-        while (((found - data) <= (filestat.st_size - DATASIZE)) && (!memcmp(found, item, 4))) {
-            if (testcand(found, rt, fwd)) {
-                memcpy(m, c, 2);
-                memcpy(m + 2, found, 4);
-                memcpy(s, found + 4, 6);
-
-                munmap(data, filestat.st_size);
-                close(fd);
-                return 1;
-            }
-
-            found = found + DATASIZE;
-        }
+    if (found) {
+        memcpy(m, c, 2);
+        memcpy(m + 2, found, 4);
+        memcpy(s, found + 4, 6);
     }
 
     munmap(data, filestat.st_size);
     close(fd);
 
-    return 0;
-
+    return found ? 1 : 0;
 }
 
 static int findmatch(struct rngdata *r, unsigned char *outmatch, unsigned char *outstate, int *bitoffset) {
@@ -372,6 +457,8 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
 
+    ht2table_build_jumps(jumps);
+
     if (!loadrngdata(&rng, argv[1])) {
         printf("loadrngdata failed\n");
         exit(1);
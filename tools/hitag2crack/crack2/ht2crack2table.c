@@ -0,0 +1,89 @@
+/*
+ * ht2crack2table.c
+ * PRNG jump tables and entry coding of the sorted ht2crack2 table.
+ */
+
+#include "ht2crack2table.h"
+
+// the PRNG is linear, so stepping it is a 48x48 bit matrix.  Build the one for
+// HT2TABLE_STEP steps from the unit states and square it for the larger jumps.
+void ht2table_build_jumps(ht2table_jumps_t jumps) {
+    Hitag_State hstate;
+    int i, k;
+
+    for (i = 0; i < 48; i++) {
+        hstate.shiftreg = 1ULL << i;
+        buildlfsr(&hstate);
+        hitag2_nstep(&hstate, HT2TABLE_STEP);
+        jumps[0][i] = hstate.shiftreg;
+    }
+
+    for (k = 1; k < HT2TABLE_INDEX_BITS; k++) {
+        for (i = 0; i < 48; i++) {
+            jumps[k][i] = ht2table_jump(jumps[k - 1], jumps[k - 1][i]);
+        }
+    }
+}
+
+// xor of jump[i] for all bits i set in the state
+uint64_t ht2table_jump(const uint64_t *jump, uint64_t shiftreg) {
+    uint64_t output = 0;
+    int i;
+
+    for (i = 0; i < 48; i++) {
+        if ((shiftreg >> i) & 1) {
+            output ^= jump[i];
+        }
+    }
+    return output;
+}
+
+// the PRNG state of table entry n
+uint64_t ht2table_state(ht2table_jumps_t jumps, uint64_t n) {
+    uint64_t shiftreg = HT2TABLE_START;
+    int k;
+
+    for (k = 0; k < HT2TABLE_INDEX_BITS; k++) {
+        if ((n >> k) & 1) {
+            shiftreg = ht2table_jump(jumps[k], shiftreg);
+        }
+    }
+    return shiftreg;
+}
+
+// writes an entry, returns its length.  The builder uses the same coding with 48 bit
+// deltas for its temporary runs.
+int ht2table_put_entry(unsigned char *p, uint64_t delta, uint64_t n) {
+    int len = 0;
+    int i;
+
+    while (delta >= 0x80) {
+        p[len++] = (delta & 0x7f) | 0x80;
+        delta >>= 7;
+    }
+    p[len++] = delta;
+
+    for (i = 0; i < HT2TABLE_INDEX_BYTES; i++) {
+        p[len++] = (n >> (8 * i)) & 0xff;
+    }
+    return len;
+}
+
+// reads an entry, returns its length
+int ht2table_get_entry(const unsigned char *p, uint64_t *delta, uint64_t *n) {
+    int len = 0;
+    int shift = 0;
+    int i;
+
+    *delta = 0;
+    do {
+        *delta |= (uint64_t)(p[len] & 0x7f) << shift;
+        shift += 7;
+    } while (p[len++] & 0x80);
+
+    *n = 0;
+    for (i = 0; i < HT2TABLE_INDEX_BYTES; i++) {
+        *n |= (uint64_t)p[len++] << (8 * i);
+    }
+    return len;
+}
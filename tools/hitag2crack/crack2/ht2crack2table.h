@@ -0,0 +1,61 @@
+/*
+ * ht2crack2table.h
+ * on-disk format of the sorted ht2crack2 table, shared by the builder and the search.
+ *
+ * The table holds one entry per PRNG state HT2TABLE_START + n * HT2TABLE_STEP, for n below
+ * 2^index_bits, keyed on the 48 bits of keystream the state produces.  The first two
+ * keystream bytes select the bucket file sorted/xx/yy.bin.  Inside a bucket the entries
+ * are sorted on the remaining 32 bits and stored as
+ *
+ *   varint(key - previous key) | n (5 bytes, little endian)
+ *
+ * in blocks of HT2TABLE_BLOCK entries.  Each block restarts the delta from its first key,
+ * which the block index at the start of the file records, so a lookup is a binary search
+ * on the index followed by decoding a single block.  The state itself is not stored, it
+ * is recomputed from n with the jump tables below.
+ */
+
+#ifndef HT2CRACK2TABLE_H
+#define HT2CRACK2TABLE_H
+
+#include "ht2crackutils.h"
+
+#define HT2TABLE_MAGIC          "HT2T"
+#define HT2TABLE_VERSION        1
+#define HT2TABLE_START          0x123456789abcULL   // PRNG state of entry 0
+#define HT2TABLE_STEP           2048                // PRNG steps between two entries
+#define HT2TABLE_INDEX_BITS     37                  // a full table has 2^37 entries
+#define HT2TABLE_INDEX_BYTES    5
+#define HT2TABLE_BLOCK          64                  // entries per delta block
+#define HT2TABLE_MAX_ENTRY      (10 + HT2TABLE_INDEX_BYTES)
+
+// legacy table, raw 10 byte entries: 4 bytes of keystream and 6 bytes of PRNG state
+#define HT2TABLE_LEGACY_ENTRY   10
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t block_entries;
+    uint32_t entries;
+    uint32_t blocks;
+    uint64_t start;
+    uint32_t step;
+    uint32_t index_bits;
+} ht2table_header_t;
+
+typedef struct {
+    uint32_t first_key;
+    uint32_t offset;        // from the end of the block index
+} ht2table_block_t;
+
+// jumps[k][i] is the state reached from state (1 << i) after HT2TABLE_STEP << k steps
+typedef uint64_t ht2table_jumps_t[HT2TABLE_INDEX_BITS][48];
+
+void ht2table_build_jumps(ht2table_jumps_t jumps);
+uint64_t ht2table_jump(const uint64_t *jump, uint64_t shiftreg);
+uint64_t ht2table_state(ht2table_jumps_t jumps, uint64_t n);
+
+int ht2table_put_entry(unsigned char *p, uint64_t delta, uint64_t n);
+int ht2table_get_entry(const unsigned char *p, uint64_t *delta, uint64_t *n);
+
+#endif /* HT2CRACK2TABLE_H */
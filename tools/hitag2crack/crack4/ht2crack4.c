@@ -16,8 +16,9 @@
  *
  * The program reads in up to 32 encrypted nonce and challenge response pairs from
  * the supplied file; the number actually used is specified on the command line
- * (defaults to all those read in).  The default size of the table is 800000 but this
- * can be changed via the command line options.
+ * (defaults to all those read in).  By default the table is sized to half of the
+ * available RAM (up to AUTO_TABLE_MAX guesses) but this can be changed via the command
+ * line options.
  *
  * Using more encrypted nonce and challenge response pairs improves the chances of
  * recovering the key and doesn't significantly add to the time it takes.
@@ -32,9 +33,8 @@
  * a table size of about 3000000 and expect it to take around 4 mins to run, but
  * with a high likelihood of success.
  *
- * Setting table size to a large number (~32000000) will likely blow up the stack
- * during the recursive qsort().  This could be fixed by making the stack space
- * larger but really, you need a smaller table and more encrypted nonces.
+ * Each round prints how long scoring, selecting the best half and expanding took,
+ * to see where the time goes on large tables.
  *
  * The scoring of the guesses is controversial, having been tweaked over and again
  * to find a measure that provides the best results.  Feel free to tweak it yourself
@@ -49,14 +49,21 @@
 #include <inttypes.h>
 #include <math.h>
 #include <pthread.h>
+#include <time.h>
 #include "ht2crackutils.h"
 
 /* you could have more than 32 traces, but you shouldn't really need
  * more than 16.  You can still win with 8 if you're lucky. */
 #define MAX_NONCES 32
 
-/* set this to the number of virtual cores you have */
-#define NUM_THREADS 8
+/* largest table picked automatically; bigger tables need more time than RAM */
+#define AUTO_TABLE_MAX 16000000
+
+/* guesses scored per work item by the scoring threads */
+#define SCORE_BLOCK 1024
+
+/* bit probabilities for up to this many relevant state bits are looked up */
+#define PROB_TABLE_BITS 16
 
 /* encrypted nonce and keystream storage
  * ks is ~enc_aR */
@@ -65,33 +72,46 @@ struct nonce {
     uint64_t ks;
 };
 
-/* guess table entry - we store key guesses and do the maths to convert
+/* guess table, as a structure of arrays so the scoring threads walk straight
+ * through memory - we store key guesses and do the maths to convert
  * to states in the code
- * score is used for sorting purposes
- * b0to31 is an array of the keystream generated from the init state
- * that is later XORed with the encrypted nonce and key guess
+ * score is used for selecting the best guesses
+ * b0to31[j] holds for every guess the keystream generated from the init state
+ * of nonce j, that is later XORed with the encrypted nonce and key guess
  */
-struct guess {
-    uint64_t key;
+struct guess_table {
+    uint64_t *key;
+    double *score;
+    uint32_t *b0to31[MAX_NONCES];
+};
+
+/* score and position of a guess, for selecting the best ones */
+struct ranked {
     double score;
-    uint64_t b0to31[MAX_NONCES];
+    unsigned int idx;
 };
 
 /* thread_data is the data sent to the scoring threads */
 struct thread_data {
-    unsigned int start;
-    unsigned int end;
     unsigned int size;
+    unsigned int next;
 };
 
-/* guess table and encrypted nonce/keystream table */
-struct guess *guesses = NULL;
+/* guess table, spare table the best guesses are gathered into, and
+ * encrypted nonce/keystream table */
+struct guess_table guesses;
+struct guess_table spare;
+struct ranked *ranking = NULL;
 unsigned int num_guesses;
 struct nonce nonces[MAX_NONCES];
 unsigned int num_nRaR;
 uint64_t uid;
-int maxtablesize = 800000;
+int maxtablesize = 0;
 uint64_t supplied_testkey = 0;
+int num_threads = 1;
+
+/* prob_table[n][packed] is the probability of a 1 from a state with n relevant bits */
+double *prob_table[PROB_TABLE_BITS + 1];
 
 static void usage(void) {
     printf("ht2crack4 - K Sheldrake, based on the work of Garcia et al\n\n");
@@ -101,7 +121,7 @@ static void usage(void) {
     printf(" -u UID (required)\n");
     printf(" -n NONCEFILE (required)\n");
     printf(" -N number of nRaR pairs to use (defaults to 32)\n");
-    printf(" -t TABLESIZE (defaults to 800000\n");
+    printf(" -t TABLESIZE (defaults to half the available RAM, up to %u)\n", AUTO_TABLE_MAX);
     printf("Increasing the table size will slow it down but will be more\n");
     printf("successful.\n");
 
@@ -223,31 +243,102 @@ static uint64_t packstate(uint64_t s) {
 }
 
 
-/* create_guess_table mallocs the tables */
-static void create_guess_table(void) {
-    guesses = (struct guess *)malloc(sizeof(struct guess) * maxtablesize);
-    if (!guesses) {
+/* determine number of logical CPU cores (use for multithreaded functions) */
+static int num_CPUs(void) {
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1)
+        count = 1;
+    return count;
+}
+
+
+/* bytes of memory needed per guess table entry */
+static size_t guess_bytes(void) {
+    // key, score and keystreams, twice for the spare table, plus the ranking
+    return 2 * (sizeof(uint64_t) + sizeof(double) + num_nRaR * sizeof(uint32_t)) + sizeof(struct ranked);
+}
+
+
+/* pick a table size from the available RAM */
+static int auto_table_size(void) {
+    uint64_t ram;
+    uint64_t size;
+
+#ifdef _SC_AVPHYS_PAGES
+    ram = (uint64_t)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE);
+#else
+    ram = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+#endif
+
+    size = (ram / 2) / guess_bytes();
+    if (size > AUTO_TABLE_MAX) {
+        size = AUTO_TABLE_MAX;
+    }
+    if (size < 65536) {
+        size = 65536;
+    }
+    return size;
+}
+
+
+static void alloc_guess_table(struct guess_table *t) {
+    unsigned int j;
+
+    t->key = (uint64_t *)malloc(sizeof(uint64_t) * maxtablesize);
+    t->score = (double *)malloc(sizeof(double) * maxtablesize);
+    if (!t->key || !t->score) {
         printf("cannot malloc guess table\n");
         exit(1);
     }
+    for (j = 0; j < num_nRaR; j++) {
+        t->b0to31[j] = (uint32_t *)malloc(sizeof(uint32_t) * maxtablesize);
+        if (!t->b0to31[j]) {
+            printf("cannot malloc guess table\n");
+            exit(1);
+        }
+    }
 }
 
 
-/* init the guess table by reading in the encrypted nR,aR values and
- * setting the first 2^16 key guesses */
-static void init_guess_table(char *filename, char *uidstr) {
+/* create_guess_table mallocs the tables, needs the nonces loaded */
+static void create_guess_table(void) {
     unsigned int i, j;
+
+    if (maxtablesize <= 0) {
+        maxtablesize = auto_table_size();
+    }
+    fprintf(stderr, "Table size %d guesses, %zu MB\n", maxtablesize, (guess_bytes() * maxtablesize) >> 20);
+
+    alloc_guess_table(&guesses);
+    alloc_guess_table(&spare);
+    ranking = (struct ranked *)malloc(sizeof(struct ranked) * maxtablesize);
+    if (!ranking) {
+        printf("cannot malloc guess table\n");
+        exit(1);
+    }
+
+    // set key and clear the keystreams
+    // set score to -1.0 to distinguish them from 0 scores
+    for (i = 0; i < 65536; i++) {
+        guesses.key[i] = i;
+        guesses.score[i] = -1.0;
+        for (j = 0; j < num_nRaR; j++) {
+            guesses.b0to31[j][i] = 0;
+        }
+    }
+
+    num_guesses = 65536;
+}
+
+
+/* read in the encrypted nR,aR values */
+static void init_nonces(char *filename, char *uidstr) {
     FILE *fp;
     char *buf = NULL;
     char *buft1 = NULL;
     char *buft2 = NULL;
     size_t lenbuf = 64;
 
-    if (!guesses) {
-        printf("guesses is NULL\n");
-        exit(1);
-    }
-
     // read uid
     if (!strncmp(uidstr, "0x", 2)) {
         uid = rev32(hexreversetoulong(uidstr + 2));
@@ -295,49 +386,18 @@ static void init_guess_table(char *filename, char *uidstr) {
     }
 
     fclose(fp);
+    free(buf);
     fprintf(stderr, "Loaded %u nRaR pairs\n", num_nRaR);
-
-    // set key and copy in enc_nR and ks values
-    // set score to -1.0 to distinguish them from 0 scores
-    for (i = 0; i < 65536; i++) {
-        guesses[i].key = i;
-        guesses[i].score = -1.0;
-        for (j = 0; j < num_nRaR; j++) {
-            guesses[i].b0to31[j] = 0;
-        }
-    }
-
-    num_guesses = 65536;
 }
 
 
-/* bit_score calculates the ratio of partial states that could generate
- * the resulting bit b to all possible states
- * size is the number of confirmed bits in the state */
-static double bit_score(uint64_t s, uint64_t size, uint64_t b) {
-    uint64_t packed;
-    uint64_t chopped;
-    unsigned int n;
-    uint64_t b1;
+/* bit_prob calculates the ratio of partial states that could generate
+ * a 1 to all possible states
+ * packed is the packed state, n the number of relevant bits in it */
+static double bit_prob(uint64_t packed, unsigned int n) {
     double nibprob1, nibprob0, prob;
     unsigned int fncinput;
 
-
-    // chop away any bits beyond size
-    chopped = s & ((1l << size) - 1);
-    // and pack the remaining bits
-    packed = packstate(chopped);
-
-    // calc size of packed version
-    n = packed_size[size];
-
-    b1 = b & 0x1;
-
-    // calc probability of getting b1
-
-    // start by calculating probability of getting a 1,
-    // then fix if b1==0 (subtract from 1)
-
     if (n == 0) {
         // catch the case where we have no relevant bits and return
         // the default probability
@@ -384,7 +444,51 @@ static double bit_score(uint64_t s, uint64_t size, uint64_t b) {
         prob = f20(packed);
     }
 
-    if (b1) {
+    return prob;
+}
+
+
+/* bit_prob only depends on the packed relevant bits, so look it up
+ * for the smaller states */
+static void create_prob_tables(void) {
+    unsigned int n;
+    uint64_t packed;
+
+    for (n = 0; n <= PROB_TABLE_BITS; n++) {
+        prob_table[n] = (double *)malloc(sizeof(double) << n);
+        if (!prob_table[n]) {
+            printf("cannot malloc probability table\n");
+            exit(1);
+        }
+        for (packed = 0; packed < (1ULL << n); packed++) {
+            prob_table[n][packed] = bit_prob(packed, n);
+        }
+    }
+}
+
+
+/* bit_score calculates the ratio of partial states that could generate
+ * the resulting bit b to all possible states
+ * size is the number of confirmed bits in the state */
+static inline double bit_score(uint64_t s, uint64_t size, uint64_t b) {
+    uint64_t packed;
+    unsigned int n;
+    double prob;
+
+    // chop away any bits beyond size and pack the remaining bits
+    packed = packstate(s & ((1l << size) - 1));
+
+    // calc size of packed version
+    n = packed_size[size];
+
+    // calc probability of getting a 1, then fix if b==0 (subtract from 1)
+    if (n <= PROB_TABLE_BITS) {
+        prob = prob_table[n][packed];
+    } else {
+        prob = bit_prob(packed, n);
+    }
+
+    if (b & 0x1) {
         return prob;
     } else {
         return (1.0 - prob);
@@ -396,98 +500,105 @@ static double bit_score(uint64_t s, uint64_t size, uint64_t b) {
  * bit_score and then shift and then repeat, adding all
  * bit_scores together until no bits remain. bit_scores are
  * multiplied by the number of relevant bits in the scored state
- * to give weight to more complete states. */
+ * to give weight to more complete states.
+ * I've introduced a weighting for each score to
+ * give more significance to bigger windows.
+ * The terms are added up from the last one, as the recursive version did. */
 static double score(uint64_t s, unsigned int size, uint64_t ks, unsigned int kssize) {
+    double terms[48];
     double sc;
+    unsigned int n, i;
 
-    if ((size == 1) || (kssize == 1)) {
-        sc = bit_score(s, size, ks & 0x1);
-        return (sc * (packed_size[size] + 1));
-    } else {
-        // I've introduced a weighting for each score to
-        // give more significance to bigger windows.
-
-        sc = bit_score(s, size, ks & 0x1);
+    n = (size < kssize) ? size : kssize;
+    if (n == 0) {
+        return 0.0;
+    }
+    for (i = 0; i < n; i++) {
+        sc = bit_score(s, size - i, ks & 0x1);
 
         // if a bit_score returns a probability of 0 then this can't be a winner
         if (sc == 0.0) {
             return 0.0;
-        } else {
+        }
+        terms[i] = sc * (packed_size[size - i] + 1);
 
-            double sc2 = score(s >> 1, size - 1, ks >> 1, kssize - 1);
+        s = s >> 1;
+        ks = ks >> 1;
+    }
 
-            // if score returns a probability of 0 then this can't be a winner
-            if (sc2 == 0.0) {
-                return 0.0;
-            } else {
-                return (sc * (packed_size[size] + 1)) + sc2;
-            }
-        }
+    sc = terms[n - 1];
+    for (i = n - 1; i > 0; i--) {
+        sc = terms[i - 1] + sc;
     }
+    return sc;
 }
 
 
-/* score_traces runs score for each encrypted nonce */
-static void score_traces(struct guess *g, unsigned int size) {
+/* score_traces runs score for each encrypted nonce on a block of guesses */
+static void score_traces(unsigned int start, unsigned int end, unsigned int size) {
     uint64_t lfsr;
-    unsigned int i;
+    unsigned int i, g;
     double sc;
-    double total_score = 0.0;
+    double total_score[SCORE_BLOCK];
 
-    // don't bother scoring traces that are already losers
-    if (g->score == 0.0) {
-        return;
+    for (g = start; g < end; g++) {
+        total_score[g - start] = 0.0;
     }
 
+    // go nonce by nonce so each pass streams through one keystream array
     for (i = 0; i < num_nRaR; i++) {
-        // calc next b
-        // create lfsr - lower 32 bits is uid, upper 16 bits are lower 16 bits of key
-        // then shift by size - 16, insert upper key XOR enc_nonce XOR bitstream,
-        // and calc new bit b
-        lfsr = (uid >> (size - 16)) | ((g->key << (48 - size)) ^
-                                       ((nonces[i].enc_nR ^ g->b0to31[i]) << (64 - size)));
-        g->b0to31[i] = g->b0to31[i] | (ht2crypt(lfsr) << (size - 16));
-
-        // create lfsr - lower 16 bits are lower 16 bits of key
-        // bits 16-47 are upper bits of key XOR enc_nonce XOR bitstream
-        lfsr = g->key ^ ((nonces[i].enc_nR ^ g->b0to31[i]) << 16);
+        uint32_t *b0to31 = guesses.b0to31[i];
 
-        sc = score(lfsr, size, nonces[i].ks, 32);
+        for (g = start; g < end; g++) {
 
-        // look out for losers
-        if (sc == 0.0) {
-            g->score = 0.0;
-            return;
-        }
-        total_score = total_score + sc;
-    }
+            // don't bother scoring traces that are already losers
+            if (guesses.score[g] == 0.0) {
+                continue;
+            }
 
-    // save average score
-    g->score = total_score / num_nRaR;
+            // calc next b
+            // create lfsr - lower 32 bits is uid, upper 16 bits are lower 16 bits of key
+            // then shift by size - 16, insert upper key XOR enc_nonce XOR bitstream,
+            // and calc new bit b
+            lfsr = (uid >> (size - 16)) | ((guesses.key[g] << (48 - size)) ^
+                                           ((nonces[i].enc_nR ^ b0to31[g]) << (64 - size)));
+            b0to31[g] = b0to31[g] | (ht2crypt(lfsr) << (size - 16));
 
-}
+            // create lfsr - lower 16 bits are lower 16 bits of key
+            // bits 16-47 are upper bits of key XOR enc_nonce XOR bitstream
+            lfsr = guesses.key[g] ^ ((nonces[i].enc_nR ^ b0to31[g]) << 16);
 
+            sc = score(lfsr, size, nonces[i].ks, 32);
 
-/* score_all_traces runs score_traces for every key guess in the table */
-/* this was used in the non-threaded version */
-/*
-void score_all_traces(unsigned int size)
-{
-    unsigned int i;
+            // look out for losers
+            if (sc == 0.0) {
+                guesses.score[g] = 0.0;
+                continue;
+            }
+            total_score[g - start] = total_score[g - start] + sc;
+        }
+    }
 
-    for (i=0; i<num_guesses; i++) {
-        score_traces(&(guesses[i]), size);
+    // save average score
+    for (g = start; g < end; g++) {
+        if (guesses.score[g] != 0.0) {
+            guesses.score[g] = total_score[g - start] / num_nRaR;
+        }
     }
 }
-*/
 
-/* score_some_traces runs score_traces for every key guess in a section of the table */
+
+/* score_some_traces takes blocks of guesses until the table is done */
 static void *score_some_traces(void *data) {
-    unsigned int i;
     struct thread_data *tdata = (struct thread_data *)data;
+    unsigned int start;
 
-    for (i = tdata->start; i < tdata->end; i++) {
-        score_traces(&(guesses[i]), tdata->size);
+    while ((start = __atomic_fetch_add(&tdata->next, SCORE_BLOCK, __ATOMIC_RELAXED)) < num_guesses) {
+        unsigned int end = start + SCORE_BLOCK;
+        if (end > num_guesses) {
+            end = num_guesses;
+        }
+        score_traces(start, end, tdata->size);
     }
 
     return NULL;
@@ -496,72 +607,122 @@ static void *score_some_traces(void *data) {
 
 /* score_all_traces runs score_traces for every key guess in the table */
 static void score_all_traces(unsigned int size) {
-    pthread_t threads[NUM_THREADS];
+    pthread_t threads[num_threads];
     void *status;
-    struct thread_data tdata[NUM_THREADS];
-    unsigned int i;
-    unsigned int chunk_size;
-
-    chunk_size = num_guesses / NUM_THREADS;
-
-    // create thread data
-    for (i = 0; i < NUM_THREADS; i++) {
-        tdata[i].start = i * chunk_size;
-        tdata[i].end = (i + 1) * chunk_size;
-        tdata[i].size = size;
-    }
+    struct thread_data tdata;
+    int i;
 
-    // fix last chunk
-    tdata[NUM_THREADS - 1].end = num_guesses;
+    tdata.size = size;
+    tdata.next = 0;
 
     // start the threads
-    for (i = 0; i < NUM_THREADS; i++) {
-        if (pthread_create(&(threads[i]), NULL, score_some_traces, (void *)(tdata + i))) {
-            printf("cannot start thread %u\n", i);
+    for (i = 0; i < num_threads; i++) {
+        if (pthread_create(&(threads[i]), NULL, score_some_traces, (void *)&tdata)) {
+            printf("cannot start thread %d\n", i);
             exit(1);
         }
     }
 
     // wait for threads to end
-    for (i = 0; i < NUM_THREADS; i++) {
+    for (i = 0; i < num_threads; i++) {
         if (pthread_join(threads[i], &status)) {
-            printf("cannot join thread %u\n", i);
+            printf("cannot join thread %d\n", i);
             exit(1);
         }
     }
 }
 
 
+/* moves the k best scored entries of r to the front, in no particular order
+ * (quickselect, like nth_element) */
+static void select_best(struct ranked *r, unsigned int count, unsigned int k) {
+    unsigned int lo = 0;
+    unsigned int hi = count - 1;
+
+    while (lo < hi) {
+        // median of three pivot
+        unsigned int mid = lo + (hi - lo) / 2;
+        double a = r[lo].score, b = r[mid].score, c = r[hi].score;
+        double pivot = (a < b) ? ((b < c) ? b : ((a < c) ? c : a)) : ((a < c) ? a : ((b < c) ? c : b));
+        unsigned int i = lo;
+        unsigned int j = hi;
+
+        // partition with higher scores first
+        while (i <= j) {
+            while (r[i].score > pivot) {
+                i++;
+            }
+            while (r[j].score < pivot) {
+                j--;
+            }
+            if (i <= j) {
+                struct ranked tmp = r[i];
+                r[i] = r[j];
+                r[j] = tmp;
+                i++;
+                if (j == 0) {
+                    break;
+                }
+                j--;
+            }
+        }
+
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            return;
+        }
+    }
+}
+
 
+/* keeps the best halfsize guesses, in the front of the table */
+static void keep_best_guesses(unsigned int halfsize) {
+    struct guess_table tmp;
+    unsigned int i, j;
 
+    if (halfsize >= num_guesses) {
+        return;
+    }
 
-/* cmp_guess is the comparison function for qsorting the guess table */
-static int cmp_guess(const void *a, const void *b) {
-    struct guess *a1 = (struct guess *)a;
-    struct guess *b1 = (struct guess *)b;
+    for (i = 0; i < num_guesses; i++) {
+        ranking[i].score = guesses.score[i];
+        ranking[i].idx = i;
+    }
+    select_best(ranking, num_guesses, halfsize);
 
-    if (a1->score < b1->score) {
-        return 1;
-    } else if (a1->score > b1->score) {
-        return -1;
-    } else {
-        return 0;
+    // gather the winners into the spare table and swap
+    for (i = 0; i < halfsize; i++) {
+        spare.key[i] = guesses.key[ranking[i].idx];
+        spare.score[i] = ranking[i].score;
     }
+    for (j = 0; j < num_nRaR; j++) {
+        for (i = 0; i < halfsize; i++) {
+            spare.b0to31[j][i] = guesses.b0to31[j][ranking[i].idx];
+        }
+    }
+
+    tmp = guesses;
+    guesses = spare;
+    spare = tmp;
+    num_guesses = halfsize;
 }
 
 
-/* expand all guesses in first half of (sorted) table by
+/* expand all guesses in first half of the table by
  * copying them into the second half and extending the copied
  * ones with an extra 1, leaving the first half with an extra 0 */
 static void expand_guesses(unsigned int halfsize, unsigned int size) {
     unsigned int i, j;
 
     for (i = 0; i < halfsize; i++) {
-        guesses[i + halfsize].key = guesses[i].key | (1l << size);
-        guesses[i + halfsize].score = guesses[i].score;
-        for (j = 0; j < num_nRaR; j++) {
-            guesses[i + halfsize].b0to31[j] = guesses[i].b0to31[j];
-        }
+        guesses.key[i + halfsize] = guesses.key[i] | (1l << size);
+        guesses.score[i + halfsize] = guesses.score[i];
+    }
+    for (j = 0; j < num_nRaR; j++) {
+        memcpy(guesses.b0to31[j] + halfsize, guesses.b0to31[j], halfsize * sizeof(uint32_t));
     }
 }
 
@@ -570,13 +731,20 @@ static void expand_guesses(unsigned int halfsize, unsigned int size) {
  * is useful when testing different scoring methods */
 static void check_supplied_testkey(unsigned int size) {
     uint64_t partkey;
-    unsigned int i;
+    unsigned int i, j;
+    unsigned int rank;
 
     partkey = supplied_testkey & ((1l << size) - 1);
 
     for (i = 0; i < num_guesses; i++) {
-        if (guesses[i].key == partkey) {
-            fprintf(stderr, " supplied test key score = %1.10f, position = %u\n", guesses[i].score, i);
+        if (guesses.key[i] == partkey) {
+            rank = 0;
+            for (j = 0; j < num_guesses; j++) {
+                if (guesses.score[j] > guesses.score[i]) {
+                    rank++;
+                }
+            }
+            fprintf(stderr, " supplied test key score = %1.10f, position = %u\n", guesses.score[i], rank);
             return;
         }
     }
@@ -586,15 +754,22 @@ static void check_supplied_testkey(unsigned int size) {
 }
 
 
-/* execute_round scores the guesses, sorts them and expands the good half */
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+/* execute_round scores the guesses, keeps the best half and expands it */
 static void execute_round(unsigned int size) {
     unsigned int halfsize;
+    double t0, t1, t2, t3;
 
     // score all the current guesses
+    t0 = now_ms();
     score_all_traces(size);
-
-    // sort the guesses by score
-    qsort(guesses, num_guesses, sizeof(struct guess), cmp_guess);
+    t1 = now_ms();
 
     if (supplied_testkey) {
         check_supplied_testkey(size);
@@ -607,28 +782,50 @@ static void execute_round(unsigned int size) {
         halfsize = (maxtablesize / 2);
     }
 
+    // keep the best guesses, no need to sort them
+    keep_best_guesses(halfsize);
+    t2 = now_ms();
+
     // expand guesses
     expand_guesses(halfsize, size);
+    t3 = now_ms();
 
     num_guesses = halfsize * 2;
+
+    fprintf(stderr, " score %8.1f ms, select %7.1f ms, expand %7.1f ms\n", t1 - t0, t2 - t1, t3 - t2);
 }
 
 
 /* crack is the main cracking algo; it executes the rounds */
 static void crack(void) {
-    unsigned int i;
+    unsigned int i, g;
+    unsigned int top;
+    double min;
     uint64_t revkey;
     uint64_t foundkey;
+    double start = now_ms();
 
     for (i = 16; i <= 48; i++) {
         fprintf(stderr, "round %2u, size=%2u\n", i - 16, i);
         execute_round(i);
 
         // print some metrics
-        revkey = rev64(guesses[0].key);
+        top = 0;
+        min = guesses.score[0];
+        for (g = 1; g < num_guesses; g++) {
+            if (guesses.score[g] > guesses.score[top]) {
+                top = g;
+            }
+            if (guesses.score[g] < min) {
+                min = guesses.score[g];
+            }
+        }
+        revkey = rev64(guesses.key[top]);
         foundkey = ((revkey >> 40) & 0xff) | ((revkey >> 24) & 0xff00) | ((revkey >> 8) & 0xff0000) | ((revkey << 8) & 0xff000000) | ((revkey << 24) & 0xff00000000) | ((revkey << 40) & 0xff0000000000);
-        fprintf(stderr, " guess=%012" PRIx64 ", num_guesses = %u, top score=%1.10f, min score=%1.10f\n", foundkey, num_guesses, guesses[0].score, guesses[num_guesses - 1].score);
+        fprintf(stderr, " guess=%012" PRIx64 ", num_guesses = %u, top score=%1.10f, min score=%1.10f\n", foundkey, num_guesses, guesses.score[top], min);
     }
+
+    fprintf(stderr, "all rounds done in %.1f s\n", (now_ms() - start) / 1000.0);
 }
 
 /* test function to make sure I know how the LFSR works */
@@ -813,27 +1010,29 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    if (!uidstr || !noncefilestr || (maxtablesize <= 0)) {
+    if (!uidstr || !noncefilestr || ((maxtablesize != 0) && (maxtablesize < 65536))) {
         usage();
     }
 
-    create_guess_table();
-
-    init_guess_table(noncefilestr, uidstr);
+    init_nonces(noncefilestr, uidstr);
 
     if ((tot_nRaR > 0) && (tot_nRaR <= num_nRaR)) {
         num_nRaR = tot_nRaR;
     }
     fprintf(stderr, "Using %u nRaR pairs\n", num_nRaR);
 
+    num_threads = num_CPUs();
+    create_prob_tables();
+    create_guess_table();
+
     crack();
 
     // test all key guesses and stop if one works
     for (i = 0; i < num_guesses; i++) {
-        if (check_key(guesses[i].key, nonces[0].enc_nR, nonces[0].ks) &&
-                check_key(guesses[i].key, nonces[1].enc_nR, nonces[1].ks)) {
+        if (check_key(guesses.key[i], nonces[0].enc_nR, nonces[0].ks) &&
+                check_key(guesses.key[i], nonces[1].enc_nR, nonces[1].ks)) {
             printf("WIN!!! :)\n");
-            revkey = rev64(guesses[i].key);
+            revkey = rev64(guesses.key[i]);
             foundkey = ((revkey >> 40) & 0xff) | ((revkey >> 24) & 0xff00) | ((revkey >> 8) & 0xff0000) | ((revkey << 8) & 0xff000000) | ((revkey << 24) & 0xff00000000) | ((revkey << 40) & 0xff0000000000);
             printf("key = %012" PRIX64 "\n", foundkey);
             exit(0);
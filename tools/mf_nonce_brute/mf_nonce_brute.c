@@ -17,11 +17,13 @@
 #include "crapto1/crapto1.h"
 #include "protocol.h"
 #include "iso14443crc.h"
+#include "util_posix.h"
 
-#define odd_parity(i) (( (i) ^ (i)>>1 ^ (i)>>2 ^ (i)>>3 ^ (i)>>4 ^ (i)>>5 ^ (i)>>6 ^ (i)>>7 ^ 1) & 0x01)
+#ifndef MAX
+# define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
 
-// a global mutex to prevent interlaced printing from different threads
-pthread_mutex_t print_lock;
+#define odd_parity(i) (( (i) ^ (i)>>1 ^ (i)>>2 ^ (i)>>3 ^ (i)>>4 ^ (i)>>5 ^ (i)>>6 ^ (i)>>7 ^ 1) & 0x01)
 
 //--------------------- define options here
 uint32_t uid = 0;     // serial number
@@ -35,13 +37,6 @@ uint32_t nt_par_err = 0;
 uint32_t ar_par_err = 0;
 uint32_t at_par_err = 0;
 
-typedef struct thread_args {
-    uint16_t xored;
-    int thread;
-    int idx;
-    bool ev1;
-} targs;
-
 //------------------------------------------------------------------
 uint8_t cmds[] = {
     ISO14443A_CMD_READBLOCK,
@@ -54,11 +49,7 @@ uint8_t cmds[] = {
     MIFARE_CMD_TRANSFER
 };
 
-int global_counter = 0;
-int global_fin_flag = 0;
-int global_found = 0;
-int global_found_candidate = 0;
-size_t thread_count = 2;
+size_t thread_count = 1;
 
 static uint16_t parity_from_err(uint32_t data, uint16_t par_err) {
 
@@ -194,14 +185,6 @@ static bool candidate_nonce(uint32_t xored, uint32_t nt, bool ev1) {
     return true;
 }
 
-static bool checkValidCmd(uint32_t decrypted) {
-    uint8_t cmd = (decrypted >> 24) & 0xFF;
-    for (int i = 0; i < sizeof(cmds); ++i) {
-        if (cmd == cmds[i])
-            return true;
-    }
-    return false;
-}
 
 static bool checkCRC(uint32_t decrypted) {
     uint8_t data[] = {
@@ -213,102 +196,382 @@ static bool checkCRC(uint32_t decrypted) {
     return CheckCrc14443(CRC_14443_A, data, sizeof(data));
 }
 
-static void *brute_thread(void *arguments) {
+//------------------------------------------------------------------
+// Bitsliced candidate filter
+//
+// The tag nonce only holds 16 bits of entropy, nt = count << 16 | prng_successor(count, 16).
+// Instead of calling candidate_nonce() for every count, 512 counts are filtered at once:
+// lane i of a bitslice_t belongs to count (block * 512 + i), and the PRNG stream of all
+// lanes is generated with a handful of XORs per bit.
+typedef uint64_t bitslice_t __attribute__((vector_size(64)));
+
+#define BITSLICE_LANES      512
+#define BITSLICE_WORDS      (BITSLICE_LANES / 64)
+#define BITSLICE_BLOCKS     (0x10000 / BITSLICE_LANES)
+
+// prng_successor() shifts the byte swapped value, bit b of the PRNG value n steps after
+// the seed is stream[n + (b ^ 24)]
+#define NT_STEPS            16
+#define AR_STEPS            (NT_STEPS + 64)
+#define AT_STEPS            (NT_STEPS + 96)
+#define PRNG_STREAM_BITS    (AT_STEPS + 32)
+#define PRNG_BIT(r, n, b)   ((r)[(n) + ((b) ^ 24)])
+
+// the parity checks of candidate_nonce(), in the same order.  Each one compares the
+// parity of a byte against the bit encrypted with the same keystream bit as that parity.
+static const struct {
+    uint8_t byte_steps;
+    uint8_t byte_shift;
+    uint8_t bit_steps;
+    uint8_t bit;
+} parity_checks[10] = {
+    { NT_STEPS, 24, NT_STEPS, 16 },
+    { NT_STEPS, 16, NT_STEPS,  8 },
+    { NT_STEPS,  8, NT_STEPS,  0 },
+    { AR_STEPS, 24, AR_STEPS, 16 },
+    { AR_STEPS, 16, AR_STEPS,  8 },
+    { AR_STEPS,  8, AR_STEPS,  0 },
+    { AR_STEPS,  0, AT_STEPS, 24 },
+    { AT_STEPS, 24, AT_STEPS, 16 },
+    { AT_STEPS, 16, AT_STEPS,  8 },
+    { AT_STEPS,  8, AT_STEPS,  0 },
+};
 
-    //int shift = (int)arg;
-    struct thread_args *args = (struct thread_args *) arguments;
+// the first two checks depend on the plain tag nonce parity, which Ev1 cards don't leak
+#define EV1_SKIPPED_CHECKS  2
 
-    struct Crypto1State *revstate = NULL;
-    uint64_t key;     // recovered key candidate
-    uint32_t ks2;     // keystream used to encrypt reader response
-    uint32_t ks3;     // keystream used to encrypt tag response
-    uint32_t ks4;     // keystream used to encrypt next command
-    uint32_t nt;      // current tag nonce
+// lane patterns of the lowest 6 count bits
+static const uint64_t lane_bits[6] = {
+    0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+    0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL
+};
 
-    uint32_t p64 = 0;
-    uint32_t count;
-    int found = 0;
-    // TC == 4  (
-    // threads calls 0 ev1 == false
-    // threads calls 0,1,2  ev1 == true
-    for (count = args->idx; count < 0xFFFF; count += thread_count - 1) {
+static void count_bit(bitslice_t *v, uint32_t block, int k) {
+    for (int w = 0; w < BITSLICE_WORDS; w++) {
+        if (k < 6)
+            (*v)[w] = lane_bits[k];
+        else
+            (*v)[w] = (((block * BITSLICE_WORDS + w) >> (k - 6)) & 1) ? ~0ULL : 0;
+    }
+}
 
-        found = global_found;
-        if (found) {
-            break;
+// collects the counts passing all checks into strict[] and the ones passing only the
+// Ev1 subset into relaxed[]
+static void filter_candidates(uint16_t xored, uint16_t *strict, size_t *nstrict, uint16_t *relaxed, size_t *nrelaxed) {
+
+    const bitslice_t zero = {0}, ones = ~zero;
+    bitslice_t expect[10];
+    for (int i = 0; i < 10; i++) {
+        // candidate_nonce() rejects when odd_parity(byte) ^ bit ^ xored_bit is set
+        expect[i] = ((xored >> (9 - i)) & 1) ? zero : ones;
+    }
+
+    *nstrict = *nrelaxed = 0;
+
+    for (uint32_t block = 0; block < BITSLICE_BLOCKS; block++) {
+
+        bitslice_t r[PRNG_STREAM_BITS];
+        // seeded with the 16 bit count
+        for (int i = 0; i < 16; i++) {
+            r[i] = zero;
+            count_bit(&r[16 + i], block, (16 + i) ^ 24);
+        }
+        for (int i = 32; i < PRNG_STREAM_BITS; i++) {
+            r[i] = r[i - 16] ^ r[i - 14] ^ r[i - 13] ^ r[i - 11];
         }
 
-        nt = count << 16 | prng_successor(count, 16);
+        bitslice_t fail_ev1 = zero, fail = zero;
+        for (int i = 0; i < 10; i++) {
+            bitslice_t check = expect[i] ^ PRNG_BIT(r, parity_checks[i].bit_steps, parity_checks[i].bit);
+            for (int b = 0; b < 8; b++) {
+                check ^= PRNG_BIT(r, parity_checks[i].byte_steps, parity_checks[i].byte_shift + b);
+            }
+            if (i < EV1_SKIPPED_CHECKS)
+                fail |= check;
+            else
+                fail_ev1 |= check;
+        }
 
-        if (!candidate_nonce(args->xored, nt, args->ev1))
-            continue;
+        bitslice_t pass_ev1 = ~fail_ev1;
+        bitslice_t pass = pass_ev1 & ~fail;
+        pass_ev1 &= fail;
 
-        p64 = prng_successor(nt, 64);
-        ks2 = ar_enc ^ p64;
-        ks3 = at_enc ^ prng_successor(p64, 32);
-        revstate = lfsr_recovery64(ks2, ks3);
-        ks4 = crypto1_word(revstate, 0, 0);
-
-        if (ks4 != 0) {
-
-            // lock this section to avoid interlacing prints from different threats
-            pthread_mutex_lock(&print_lock);
-            if (args->ev1)
-                printf("\n**** Possible key candidate ****\n");
-
-#if 0
-            printf("thread #%d idx %d %s\n", args->thread, args->idx, (args->ev1) ? "(Ev1)" : "");
-            printf("current nt(%08x)  ar_enc(%08x)  at_enc(%08x)\n", nt, ar_enc, at_enc);
-            printf("ks2:%08x\n", ks2);
-            printf("ks3:%08x\n", ks3);
-            printf("ks4:%08x\n", ks4);
+        for (int w = 0; w < BITSLICE_WORDS; w++) {
+            uint32_t base = block * BITSLICE_LANES + w * 64;
+            for (uint64_t m = pass[w]; m; m &= m - 1)
+                strict[(*nstrict)++] = base + __builtin_ctzll(m);
+            for (uint64_t m = pass_ev1[w]; m; m &= m - 1)
+                relaxed[(*nrelaxed)++] = base + __builtin_ctzll(m);
+        }
+    }
+}
+
+static uint32_t count_to_nonce(uint32_t count) {
+    return count << 16 | prng_successor(count, 16);
+}
+
+//------------------------------------------------------------------
+// Key recovery
+//
+// Every candidate nonce costs a full lfsr_recovery64.  Threads pull candidates off a shared
+// index, the strict ones first, and write the outcome into the candidate's own slot, so no
+// locking is needed.  Results are printed by the main thread once all workers are done.
+typedef struct {
+    uint32_t nt;
+    bool ev1;           // only passed the Ev1 parity checks
+    bool valid_cmd;     // decrypted next command has a valid crc, or none was given
+    uint32_t ks4;
+    uint64_t key;
+    uint8_t done;
+} candidate_t;
+
+typedef struct {
+    candidate_t *cand;
+    size_t count;
+    size_t next;
+    uint8_t stop;       // a strict candidate gave a valid key
+} brute_queue_t;
+
+static void
+#ifdef __has_attribute
+#if __has_attribute(force_align_arg_pointer)
+__attribute__((force_align_arg_pointer))
 #endif
-            if (cmd_enc) {
-                uint32_t decrypted = ks4 ^ cmd_enc;
-                printf("CMD enc(%08x)\n", cmd_enc);
-                printf("    dec(%08x)\t", decrypted);
-
-                // check if cmd exists
-                uint8_t isOK = checkValidCmd(decrypted);
-                (void)isOK;
-
-                // Add a crc-check.
-                isOK = checkCRC(decrypted);
-                if (isOK == false) {
-                    printf("<-- not a valid cmd\n");
-                    pthread_mutex_unlock(&print_lock);
-                    free(revstate);
-                    continue;
-                } else {
-                    printf("<-- Valid cmd\n");
-                }
-            }
+#endif
+*brute_thread(void *arguments) {
+
+    brute_queue_t *q = (brute_queue_t *)arguments;
+
+    // state list reused by all recoveries of this thread
+    struct Crypto1State *statelist = NULL;
+    size_t size = 0;
+
+    while (__atomic_load_n(&q->stop, __ATOMIC_ACQUIRE) == 0) {
+
+        size_t i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+        if (i >= q->count)
+            break;
 
-            lfsr_rollback_word(revstate, 0, 0);
-            lfsr_rollback_word(revstate, 0, 0);
-            lfsr_rollback_word(revstate, 0, 0);
-            lfsr_rollback_word(revstate, nr_enc, 1);
-            lfsr_rollback_word(revstate, uid ^ nt, 0);
-            crypto1_get_lfsr(revstate, &key);
-            free(revstate);
-
-            if (args->ev1) {
-                printf("\nKey candidate: [%012" PRIx64 "]\n\n", key);
-                __sync_fetch_and_add(&global_found_candidate, 1);
-            } else {
-                printf("\nValid Key found: [%012" PRIx64 "]\n\n", key);
-                __sync_fetch_and_add(&global_found, 1);
+        candidate_t *c = &q->cand[i];
+
+        uint32_t p64 = prng_successor(c->nt, 64);
+        uint32_t ks2 = ar_enc ^ p64;                        // keystream used to encrypt reader response
+        uint32_t ks3 = at_enc ^ prng_successor(p64, 32);    // keystream used to encrypt tag response
+        if (lfsr_recovery64_buf(ks2, ks3, &statelist, &size) == NULL) {
+            size = 0;
+            continue;
+        }
+
+        struct Crypto1State s = statelist[0];
+        c->ks4 = crypto1_word(&s, 0, 0);                    // keystream used to encrypt next command
+        if (c->ks4 != 0) {
+
+            c->valid_cmd = (cmd_enc == 0) || checkCRC(c->ks4 ^ cmd_enc);
+            if (c->valid_cmd) {
+                lfsr_rollback_word(&s, 0, 0);
+                lfsr_rollback_word(&s, 0, 0);
+                lfsr_rollback_word(&s, 0, 0);
+                lfsr_rollback_word(&s, nr_enc, 1);
+                lfsr_rollback_word(&s, uid ^ c->nt, 0);
+                crypto1_get_lfsr(&s, &c->key);
+
+                if (c->ev1 == false)
+                    __atomic_store_n(&q->stop, 1, __ATOMIC_RELEASE);
             }
-            //release lock
-            pthread_mutex_unlock(&print_lock);
         }
+        __atomic_store_n(&c->done, 1, __ATOMIC_RELEASE);
     }
-    free(args);
+    free(statelist);
     return NULL;
 }
 
+// filters all tag nonces and runs the key recovery on the candidates.  Returns the
+// candidate list, strict candidates first, or NULL when out of memory.
+static candidate_t *brute(uint16_t xored, size_t *count, size_t *nstrict) {
+
+    uint16_t *strict = calloc(0x10000, sizeof(uint16_t));
+    uint16_t *relaxed = calloc(0x10000, sizeof(uint16_t));
+    if (strict == NULL || relaxed == NULL) {
+        free(strict);
+        free(relaxed);
+        return NULL;
+    }
+
+    size_t nrelaxed = 0;
+    filter_candidates(xored, strict, nstrict, relaxed, &nrelaxed);
+    *count = *nstrict + nrelaxed;
+
+    brute_queue_t q = { .cand = calloc(*count + 1, sizeof(candidate_t)), .count = *count };
+    if (q.cand != NULL) {
+        for (size_t i = 0; i < *nstrict; i++)
+            q.cand[i].nt = count_to_nonce(strict[i]);
+        for (size_t i = 0; i < nrelaxed; i++) {
+            q.cand[*nstrict + i].nt = count_to_nonce(relaxed[i]);
+            q.cand[*nstrict + i].ev1 = true;
+        }
+
+        pthread_t threads[thread_count];
+        for (size_t i = 0; i < thread_count; i++)
+            pthread_create(&threads[i], NULL, brute_thread, (void *)&q);
+        for (size_t i = 0; i < thread_count; i++)
+            pthread_join(threads[i], NULL);
+    }
+
+    free(strict);
+    free(relaxed);
+    return q.cand;
+}
+
+//------------------------------------------------------------------
+// Benchmark
+//
+// Runs the recovery on synthetic nested authentications with random keys, and checks the
+// bitsliced filter against candidate_nonce() on every tag nonce.
+static uint64_t rand_bits(int bits) {
+    uint64_t v = 0;
+    for (int i = 0; i < bits; i += 8)
+        v = v << 8 | (rand() & 0xFF);
+    return v & ((bits == 64) ? ~0ULL : ((1ULL << bits) - 1));
+}
+
+// encrypts a word and returns it together with its parity errors, as read from a trace
+static uint32_t bench_encrypt(struct Crypto1State *s, uint32_t in, uint32_t plain, uint32_t *par_err) {
+    uint32_t enc = 0;
+    *par_err = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t p = (plain >> (24 - 8 * i)) & 0xFF;
+        uint8_t e = crypto1_byte(s, (in >> (24 - 8 * i)) & 0xFF, 0) ^ p;
+        uint8_t par = filter(s->odd) ^ odd_parity(p);
+        enc = enc << 8 | e;
+        *par_err = *par_err << 4 | (odd_parity(e) ^ par);
+    }
+    return enc;
+}
+
+static bool bench_check_filter(uint16_t xored) {
+    uint16_t *strict = calloc(0x10000, sizeof(uint16_t));
+    uint16_t *relaxed = calloc(0x10000, sizeof(uint16_t));
+    size_t nstrict = 0, nrelaxed = 0, is = 0, ir = 0;
+    bool ok = (strict != NULL && relaxed != NULL);
+
+    if (ok)
+        filter_candidates(xored, strict, &nstrict, relaxed, &nrelaxed);
+
+    for (uint32_t count = 0; ok && count < 0x10000; count++) {
+        uint32_t nt = count_to_nonce(count);
+        bool s = candidate_nonce(xored, nt, false);
+        bool r = candidate_nonce(xored, nt, true) && s == false;
+        if (s != (is < nstrict && strict[is] == count) || r != (ir < nrelaxed && relaxed[ir] == count))
+            ok = false;
+        is += s;
+        ir += r;
+    }
+    ok = ok && is == nstrict && ir == nrelaxed;
+
+    free(strict);
+    free(relaxed);
+    return ok;
+}
+
+static int bench(int rounds) {
+
+    printf("Benchmark, %d rounds, %zu threads\n\n", rounds, thread_count);
+
+    uint16_t *strict = calloc(0x10000, sizeof(uint16_t));
+    uint16_t *relaxed = calloc(0x10000, sizeof(uint16_t));
+    if (strict == NULL || relaxed == NULL) {
+        free(strict);
+        free(relaxed);
+        printf("failed to allocate memory\n");
+        return 1;
+    }
+
+    srand(0x5EED);
+    uint64_t t_filter = 0, t_scalar = 0, t_brute = 0, filtered = 0, recovered = 0;
+    int errors = 0;
+
+    for (int round = 0; round < rounds; round++) {
+
+        uint64_t key = rand_bits(48);
+        uid = rand_bits(32);
+        uint32_t nt = count_to_nonce(rand_bits(16));
+        uint32_t nr = rand_bits(32);
+        uint8_t cmd[4] = { ISO14443A_CMD_READBLOCK, rand_bits(6) };
+        ComputeCrc14443(CRC_14443_A, cmd, 2, &cmd[2], &cmd[3]);
+
+        struct Crypto1State *s = crypto1_create(key);
+        uint32_t unused;
+        nt_enc = bench_encrypt(s, uid ^ nt, nt, &nt_par_err);
+        nr_enc = bench_encrypt(s, nr, nr, &unused);
+        ar_enc = bench_encrypt(s, 0, prng_successor(nt, 64), &ar_par_err);
+        at_enc = bench_encrypt(s, 0, prng_successor(nt, 96), &at_par_err);
+        cmd_enc = bench_encrypt(s, 0, (uint32_t)cmd[0] << 24 | cmd[1] << 16 | cmd[2] << 8 | cmd[3], &unused);
+        crypto1_destroy(s);
+
+        uint16_t xored = xored_bits(parity_from_err(nt_enc, nt_par_err), nt_enc,
+                                    parity_from_err(ar_enc, ar_par_err), ar_enc,
+                                    parity_from_err(at_enc, at_par_err), at_enc);
+
+        if (bench_check_filter(xored) == false) {
+            printf("round %d: bitsliced filter differs from candidate_nonce()\n", round);
+            errors++;
+        }
+
+        // the filter alone is too quick to time in one go
+        size_t nstrict = 0, nrelaxed = 0;
+        uint64_t t0 = usclock();
+        for (int i = 0; i < 16; i++)
+            filter_candidates(xored, strict, &nstrict, relaxed, &nrelaxed);
+        uint64_t t1 = usclock();
+        volatile size_t scalar = 0;    // keeps the reference loop from being optimized out
+        for (int i = 0; i < 16; i++) {
+            for (uint32_t count = 0; count < 0x10000; count++)
+                scalar += candidate_nonce(xored, count_to_nonce(count), true);
+        }
+        uint64_t t2 = usclock();
+        t_filter += t1 - t0;
+        t_scalar += t2 - t1;
+        filtered += 16 * 0x10000;
+
+        size_t count = 0, processed = 0;
+        candidate_t *cand = brute(xored, &count, &nstrict);
+        uint64_t t3 = usclock();
+        t_brute += t3 - t2;
+
+        bool found = false;
+        for (size_t i = 0; cand && i < count; i++) {
+            processed += cand[i].done;
+            if (cand[i].done && cand[i].ev1 == false && cand[i].ks4 && cand[i].valid_cmd && cand[i].key == key)
+                found = true;
+        }
+        recovered += processed;
+        free(cand);
+
+        printf("round %2d: key %012" PRIx64 "  %4zu candidates, %4zu recovered  %s\n",
+               round, key, count, processed, found ? "ok" : "NOT FOUND");
+        if (found == false)
+            errors++;
+    }
+
+    free(strict);
+    free(relaxed);
+
+    printf("\nfilter, bitsliced   %12.0f nonces/s\n", filtered * 1e6 / MAX(t_filter, 1));
+    printf("filter, scalar      %12.0f nonces/s  ( %.1fx )\n", filtered * 1e6 / MAX(t_scalar, 1), (double)t_scalar / MAX(t_filter, 1));
+    printf("key recovery        %12.1f candidates/s\n", recovered * 1e6 / MAX(t_brute, 1));
+    printf("time per key        %12.1f ms\n\n", t_brute / 1000.0 / rounds);
+
+    if (errors) {
+        printf("%d errors\n", errors);
+        return 1;
+    }
+    printf("all keys found\n");
+    return 0;
+}
+
 static int usage(void) {
-    printf(" syntax: mf_nonce_brute <uid> <nt> <nt_par_err> <nr> <ar> <ar_par_err> <at> <at_par_err> [<next_command>]\n\n");
+    printf(" syntax: mf_nonce_brute <uid> <nt> <nt_par_err> <nr> <ar> <ar_par_err> <at> <at_par_err> [<next_command>]\n");
+    printf("         mf_nonce_brute --bench [<rounds>]\n\n");
     printf(" example:   nt in trace = 8c! 42 e6! 4e!\n");
     printf("                     nt = 8c42e64e\n");
     printf("             nt_par_err = 1011\n\n");
@@ -320,6 +583,16 @@ static int usage(void) {
 int main(int argc, char *argv[]) {
     printf("Mifare classic nested auth key recovery. Phase 1.\n");
 
+#if !defined(_WIN32) || !defined(__WIN32__)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = (cpus < 1) ? 1 : cpus;
+#endif  /* _WIN32 */
+
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        int rounds = (argc > 2) ? atoi(argv[2]) : 5;
+        return bench(MAX(rounds, 1));
+    }
+
     if (argc < 9) return usage();
 
     sscanf(argv[1], "%x", &uid);
@@ -347,7 +620,7 @@ int main(int argc, char *argv[]) {
     if (argc > 9)
         printf("next cmd enc:\t%08x\n\n", cmd_enc);
 
-    clock_t t1 = clock();
+    uint64_t t1 = msclock();
     uint16_t nt_par = parity_from_err(nt_enc, nt_par_err);
     uint16_t ar_par = parity_from_err(ar_enc, ar_par_err);
     uint16_t at_par = parity_from_err(at_enc, at_par_err);
@@ -355,50 +628,48 @@ int main(int argc, char *argv[]) {
     //calc (parity XOR corresponding nonce bit encoded with the same keystream bit)
     uint16_t xored = xored_bits(nt_par, nt_enc, ar_par, ar_enc, at_par, at_enc);
 
-#if !defined(_WIN32) || !defined(__WIN32__)
-    thread_count = sysconf(_SC_NPROCESSORS_CONF);
-    if (thread_count < 2)
-        thread_count = 2;
-#endif  /* _WIN32 */
-
     printf("\nBruteforce using %zu threads to find encrypted tagnonce last bytes\n", thread_count);
 
-    pthread_t threads[thread_count];
-
-    // create a mutex to avoid interlacing print commands from our different threads
-    pthread_mutex_init(&print_lock, NULL);
-
-    // one thread T0 for none EV1.
-    struct thread_args *a = malloc(sizeof(struct thread_args));
-    a->xored = xored;
-    a->thread = 0;
-    a->idx = 0;
-    a->ev1 = false;
-    pthread_create(&threads[0], NULL, brute_thread, (void *)a);
-
-    // the rest of available threads to EV1 scenario
-    for (int i = 0; i < thread_count - 1; ++i) {
-        struct thread_args *b = malloc(sizeof(struct thread_args));
-        b->xored = xored;
-        b->thread = i + 1;
-        b->idx = i;
-        b->ev1 = true;
-        pthread_create(&threads[i + 1], NULL, brute_thread, (void *)b);
+    size_t count = 0, nstrict = 0;
+    candidate_t *cand = brute(xored, &count, &nstrict);
+    if (cand == NULL) {
+        printf("\nFailed to allocate memory\n\n");
+        return 1;
     }
 
-    // wait for threads to terminate:
-    for (int i = 0; i < thread_count; ++i)
-        pthread_join(threads[i], NULL);
+    printf("%zu candidate nonces, %zu of them only for Ev1 cards\n", count, count - nstrict);
 
-    if (!global_found && !global_found_candidate) {
-        printf("\nFailed to find a key\n\n");
+    int found = 0;
+    for (size_t i = 0; i < count; i++) {
+        candidate_t *c = &cand[i];
+        if (c->done == 0 || c->ks4 == 0)
+            continue;
+
+        if (c->ev1)
+            printf("\n**** Possible key candidate ****\n");
+
+        if (cmd_enc) {
+            printf("CMD enc(%08x)\n", cmd_enc);
+            printf("    dec(%08x)\t", c->ks4 ^ cmd_enc);
+            if (c->valid_cmd == false) {
+                printf("<-- not a valid cmd\n");
+                continue;
+            }
+            printf("<-- Valid cmd\n");
+        }
+
+        if (c->ev1)
+            printf("\nKey candidate: [%012" PRIx64 "]\n\n", c->key);
+        else
+            printf("\nValid Key found: [%012" PRIx64 "]\n\n", c->key);
+        found++;
     }
+    free(cand);
 
-    t1 = clock() - t1;
-    if (t1 > 0)
-        printf("Execution time: %.0f ticks\n", (float)t1);
+    if (found == 0) {
+        printf("\nFailed to find a key\n\n");
+    }
 
-    // clean up mutex
-    pthread_mutex_destroy(&print_lock);
+    printf("Execution time: %.1f seconds\n", (msclock() - t1) / 1000.0);
     return 0;
 }
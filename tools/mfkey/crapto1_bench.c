@@ -0,0 +1,280 @@
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "crapto1/crapto1.h"
+#include "crapto1/crypto1_bs.h"
+#include "util_posix.h"
+
+// Compares lfsr_recovery32/64 against their multithreaded versions on random keys, and the
+// bitsliced Crypto1 against crypto1_word().
+
+static int num_cpus(void) {
+#if defined(_WIN32)
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    return sysinfo.dwNumberOfProcessors;
+#else
+    int count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count <= 0) ? 1 : count;
+#endif
+}
+
+static int compare_state(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static size_t count_states(struct Crypto1State *sl) {
+    size_t n = 0;
+    while (sl[n].odd | sl[n].even)
+        n++;
+    return n;
+}
+
+// same set of states, ignoring order
+static bool same_states(struct Crypto1State *a, struct Crypto1State *b) {
+    size_t na = count_states(a), nb = count_states(b);
+    if (na != nb)
+        return false;
+    qsort(a, na, sizeof(uint64_t), compare_state);
+    qsort(b, nb, sizeof(uint64_t), compare_state);
+    return memcmp(a, b, na * sizeof(uint64_t)) == 0;
+}
+
+static bool has_key(struct Crypto1State *sl, uint32_t in, int words, uint64_t key) {
+    for (; sl->odd | sl->even; sl++) {
+        struct Crypto1State s = *sl;
+        uint64_t k = 0;
+        for (int i = 0; i < words; i++)
+            lfsr_rollback_word(&s, in, 0);
+        crypto1_get_lfsr(&s, &k);
+        if (k == key)
+            return true;
+    }
+    return false;
+}
+
+static uint64_t rand_key(void) {
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++)
+        key = key << 8 | (rand() & 0xFF);
+    return key;
+}
+
+static uint8_t odd_parity8(uint8_t x) {
+    x ^= x >> 4;
+    x ^= x >> 2;
+    x ^= x >> 1;
+    return ~x & 1;
+}
+
+// an authentication as a reader with key 0 would see it from a tag with the state s:
+// uid ^ nt fed in plain, nr encrypted, ar encrypted with the parity bits of all three
+#define BS_STATES 100000
+
+static int bench_bitsliced(int rounds) {
+    struct Crypto1State *states = calloc(BS_STATES, sizeof(struct Crypto1State));
+    uint32_t *ks_ser = calloc(BS_STATES * 3, sizeof(uint32_t));
+    uint32_t *ks_bs = calloc(BS_STATES * 3, sizeof(uint32_t));
+    size_t *found = calloc(BS_STATES, sizeof(size_t));
+    if (states == NULL || ks_ser == NULL || ks_bs == NULL || found == NULL) {
+        printf("out of memory\n");
+        free(states);
+        free(ks_ser);
+        free(ks_bs);
+        free(found);
+        return 1;
+    }
+
+    int errors = 0;
+    uint64_t t_ser = 0, t_test = 0;
+    uint64_t t_bs[CRYPTO1_BS_AVX512 + 1] = {0};
+
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < BS_STATES; i++)
+            crypto1_init(&states[i], rand_key());
+
+        crypto1_bs_word_t words[3] = {
+            { .in = ((uint32_t)rand() << 16) ^ rand() },
+            { .in = ((uint32_t)rand() << 16) ^ rand(), .is_encrypted = 1 },
+            { .in = 0 },
+        };
+
+        uint64_t t0 = usclock();
+        for (size_t i = 0; i < BS_STATES; i++) {
+            struct Crypto1State s = states[i];
+            for (int w = 0; w < 3; w++)
+                ks_ser[i * 3 + w] = crypto1_word(&s, words[w].in, words[w].is_encrypted);
+        }
+        uint64_t t1 = usclock();
+        t_ser += t1 - t0;
+
+        // every instruction set the CPU has
+        for (crypto1_bs_simd_t simd = CRYPTO1_BS_NOSIMD; simd <= CRYPTO1_BS_AVX512; simd++) {
+            if (crypto1_bs_simd_supported(simd) == false)
+                continue;
+            crypto1_bs_set_simd(simd);
+            t1 = usclock();
+            crypto1_bs_keystream(states, BS_STATES, words, 3, ks_bs);
+            t_bs[simd] += usclock() - t1;
+
+            if (memcmp(ks_ser, ks_bs, BS_STATES * 3 * sizeof(uint32_t)) != 0) {
+                printf("crypto1_bs_keystream mismatch with %s SIMD\n", crypto1_bs_simd_name(simd));
+                errors++;
+            }
+        }
+        crypto1_bs_set_simd(CRYPTO1_BS_AUTO);
+
+        // encrypt a plain word of the last state with parity, then look for that state
+        size_t target = rand() % BS_STATES;
+        struct Crypto1State s = states[target];
+        uint32_t nt = ((uint32_t)rand() << 16) ^ rand();
+        uint32_t nt_enc = 0;
+        uint8_t par = 0;
+        for (int i = 0; i < 4; i++) {
+            uint8_t p = nt >> (24 - 8 * i);
+            uint8_t e = crypto1_byte(&s, p, 0) ^ p;
+            nt_enc = nt_enc << 8 | e;
+            par = par << 1 | (filter(s.odd) ^ odd_parity8(p));
+        }
+        uint32_t ar = crypto1_word(&s, 0, 0);
+
+        crypto1_bs_word_t check[2] = {
+            { .in = nt, .enc = nt_enc, .par = par, .par_mask = 0x0f },
+            { .in = 0, .ks = ar, .ks_mask = 0xffffffff },
+        };
+        t1 = usclock();
+        size_t n = crypto1_bs_test_states(states, BS_STATES, check, 2, found, BS_STATES);
+        t_test += usclock() - t1;
+
+        size_t expect = 0;
+        for (size_t i = 0; i < BS_STATES; i++) {
+            struct Crypto1State t = states[i];
+            uint8_t ok = 1;
+            for (int j = 0; j < 4; j++) {
+                uint8_t p = (nt_enc >> (24 - 8 * j)) ^ crypto1_byte(&t, nt >> (24 - 8 * j), 0);
+                ok &= ((filter(t.odd) ^ odd_parity8(p)) == ((par >> (3 - j)) & 1));
+            }
+            if (ok && crypto1_word(&t, 0, 0) == ar) {
+                if (expect >= n || found[expect] != i)
+                    break;
+                expect++;
+            }
+        }
+        if (n != expect || n == 0 || found[0] != target) {
+            printf("crypto1_bs_test_states mismatch, %zu states found\n", n);
+            errors++;
+        }
+    }
+
+    printf("crypto1_word        %8.1f ms for %d states x 3 words\n", t_ser / 1000.0 / rounds, BS_STATES);
+    for (crypto1_bs_simd_t simd = CRYPTO1_BS_NOSIMD; simd <= CRYPTO1_BS_AVX512; simd++) {
+        if (t_bs[simd])
+            printf("crypto1_bs %-8s %8.1f ms for %d states x 3 words  ( %.2fx )\n", crypto1_bs_simd_name(simd), t_bs[simd] / 1000.0 / rounds, BS_STATES, (double)t_ser / t_bs[simd]);
+    }
+    printf("crypto1_bs_test     %8.1f ms for %d states, parity and keystream\n\n", t_test / 1000.0 / rounds, BS_STATES);
+
+    free(states);
+    free(ks_ser);
+    free(ks_bs);
+    free(found);
+    return errors;
+}
+
+int main(int argc, char *argv[]) {
+
+    int rounds = 10;
+    int threads = num_cpus();
+
+    if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)) {
+        printf("syntax: %s [rounds] [threads]\n\n", argv[0]);
+        return 1;
+    }
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+    if (argc > 2)
+        threads = atoi(argv[2]);
+    if (rounds < 1)
+        rounds = 1;
+    if (threads < 1)
+        threads = 1;
+
+    srand(0x5EED);
+    printf("crapto1 state recovery benchmark, %d rounds, %d threads\n\n", rounds, threads);
+
+    uint64_t t_ser = 0, t_mt = 0, states = 0;
+    int errors = 0;
+
+    for (int r = 0; r < rounds; r++) {
+        uint64_t key = rand_key();
+        uint32_t in = ((uint32_t)rand() << 16) ^ rand();
+        struct Crypto1State *s = crypto1_create(key);
+        uint32_t ks2 = crypto1_word(s, in, 0);
+        crypto1_destroy(s);
+
+        uint64_t t0 = usclock();
+        struct Crypto1State *a = lfsr_recovery32(ks2, in);
+        uint64_t t1 = usclock();
+        struct Crypto1State *b = lfsr_recovery32_mt(ks2, in, threads);
+        uint64_t t2 = usclock();
+
+        t_ser += t1 - t0;
+        t_mt += t2 - t1;
+        states += count_states(a);
+
+        if (has_key(b, in, 1, key) == false || same_states(a, b) == false) {
+            printf("lfsr_recovery32 mismatch for key %012" PRIx64 "\n", key);
+            errors++;
+        }
+        free(a);
+        free(b);
+    }
+
+    printf("lfsr_recovery32     %8.1f ms/call  %10.0f states/s\n", t_ser / 1000.0 / rounds, states * 1e6 / t_ser);
+    printf("lfsr_recovery32_mt  %8.1f ms/call  %10.0f states/s  ( %.2fx )\n\n", t_mt / 1000.0 / rounds, states * 1e6 / t_mt, (double)t_ser / t_mt);
+
+    t_ser = t_mt = 0;
+    for (int r = 0; r < rounds; r++) {
+        uint64_t key = rand_key();
+        struct Crypto1State *s = crypto1_create(key);
+        uint32_t ks2 = crypto1_word(s, 0, 0);
+        uint32_t ks3 = crypto1_word(s, 0, 0);
+        crypto1_destroy(s);
+
+        uint64_t t0 = usclock();
+        struct Crypto1State *a = lfsr_recovery64(ks2, ks3);
+        uint64_t t1 = usclock();
+        struct Crypto1State *b = lfsr_recovery64_mt(ks2, ks3, threads);
+        uint64_t t2 = usclock();
+
+        t_ser += t1 - t0;
+        t_mt += t2 - t1;
+
+        if (has_key(b, 0, 2, key) == false || same_states(a, b) == false) {
+            printf("lfsr_recovery64 mismatch for key %012" PRIx64 "\n", key);
+            errors++;
+        }
+        free(a);
+        free(b);
+    }
+
+    printf("lfsr_recovery64     %8.1f ms/call\n", t_ser / 1000.0 / rounds);
+    printf("lfsr_recovery64_mt  %8.1f ms/call  ( %.2fx )\n\n", t_mt / 1000.0 / rounds, (double)t_ser / t_mt);
+
+    errors += bench_bitsliced(rounds);
+
+    if (errors) {
+        printf("%d mismatches\n", errors);
+        return 1;
+    }
+    printf("all results identical\n");
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "crapto1/crapto1.h"
+#include "crapto1/crypto1_bs.h"
 #include "util_posix.h"
 
 int main(int argc, char *argv[]) {
@@ -57,13 +58,18 @@ int main(int argc, char *argv[]) {
         lfsr_rollback_word(t, 0, 0);
         lfsr_rollback_word(t, nr0_enc, 1);
         lfsr_rollback_word(t, uid ^ nt, 0);
-        crypto1_get_lfsr(t, &key);
-        crypto1_word(t, uid ^ nt, 0);
-        crypto1_word(t, nr1_enc, 1);
-        if (ar1_enc == (crypto1_word(t, 0, 0) ^ p64)) {
-            printf("\nFound Key: [%012" PRIx64 "]\n\n", key);
-            break;
-        }
+    }
+
+    // run the candidates bitsliced through the second authentication
+    const crypto1_bs_word_t words[] = {
+        { .in = uid ^ nt },
+        { .in = nr1_enc, .is_encrypted = 1 },
+        { .in = 0, .ks = ar1_enc ^ p64, .ks_mask = 0xFFFFFFFF },
+    };
+    size_t found;
+    if (crypto1_bs_test_states(s, t - s, words, sizeof(words) / sizeof(words[0]), &found, 1) > 0) {
+        crypto1_get_lfsr(&s[found], &key);
+        printf("\nFound Key: [%012" PRIx64 "]\n\n", key);
     }
     free(s);
     return 0;
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+
+# Runs the client against a fake Proxmark3 on a TCP port to test the windowed download
+# of device memory when the link loses chunks and acknowledges.
+#
+# The fake device answers the connection handshake and serves CMD_DOWNLOAD_WINDOWED the way
+# armsrc/dlwindowed.c does.  It drops a chunk of the first window and then the acknowledges of
+# the client until the client resumes the download with a new request, while the device still
+# waits for an acknowledge.
+#
+# The client command line is taken from $PM3BIN, or client/proxmark3 next to this directory.
+
+from tempfile import mkdtemp
+from shutil import rmtree
+import os, shlex, socket, struct, subprocess, threading, unittest
+
+CMD_ACK                   = 0x00ff
+CMD_PING                  = 0x0109
+CMD_CAPABILITIES          = 0x0112
+CMD_DOWNLOAD_WINDOWED     = 0x011A
+CMD_DOWNLOADED_WINDOWED   = 0x011B
+CMD_DOWNLOAD_WINDOWED_ACK = 0x011C
+CMD_GET_STANDALONE_DONE_STATUS = 0x1001
+
+COMMANDNG_PREAMBLE_MAGIC   = 0x61334d50
+RESPONSENG_PREAMBLE_MAGIC  = 0x62334d50
+RESPONSENG_POSTAMBLE_MAGIC = 0x3362
+
+CAPABILITIES_VERSION = 5
+DL_WINDOWED_MEM_EML = 1
+DL_WINDOWED_CHUNK_SIZE = 496
+DL_WINDOWED_MAX_WINDOW = 32
+
+# memtype, flags, window, start_index, bytes, first_chunk, filename
+DOWNLOAD_WINDOWED = struct.Struct('<BBHIII32s')
+CARD_MEMORY_SIZE = 4096
+
+
+def crc14443a(data):
+    crc = 0x6363
+    for b in data:
+        b ^= crc & 0xFF
+        b = (b ^ (b << 4)) & 0xFF
+        crc = (crc >> 8) ^ (b << 8) ^ (b << 3) ^ (b >> 4)
+    # compute_crc() returns the low byte first
+    return ((crc & 0xFF) << 8) | (crc >> 8)
+
+
+class FakeDevice(threading.Thread):
+    def __init__(self, memory, drop_chunk, drop_acks):
+        threading.Thread.__init__(self, daemon=True)
+        self.memory = memory
+        self.drop_chunk = drop_chunk
+        self.drop_acks = drop_acks
+        self.dropped_acks = 0
+        self.resumed_at = None
+        self.srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.srv.bind(('127.0.0.1', 0))
+        self.srv.listen(1)
+        self.port = self.srv.getsockname()[1]
+
+    def recv_exact(self, n):
+        buf = b''
+        while len(buf) < n:
+            part = self.conn.recv(n - len(buf))
+            if not part:
+                raise EOFError
+            buf += part
+        return buf
+
+    def receive(self):
+        magic, length, cmd = struct.unpack('<IHH', self.recv_exact(8))
+        if magic != COMMANDNG_PREAMBLE_MAGIC:
+            raise ValueError('bad preamble %08x' % magic)
+        data = self.recv_exact(length & 0x7FFF)
+        self.recv_exact(2)
+        return cmd, data
+
+    def reply_ng(self, cmd, status, data=b''):
+        pre = struct.pack('<IHhH', RESPONSENG_PREAMBLE_MAGIC, len(data) | 0x8000, status, cmd)
+        self.conn.sendall(pre + data + struct.pack('<H', RESPONSENG_POSTAMBLE_MAGIC))
+
+    def reply_mix(self, cmd, arg0, arg1, arg2, data=b''):
+        payload = struct.pack('<QQQ', arg0, arg1, arg2) + data
+        pre = struct.pack('<IHhH', RESPONSENG_PREAMBLE_MAGIC, len(payload), 0, cmd)
+        self.conn.sendall(pre + payload + struct.pack('<H', RESPONSENG_POSTAMBLE_MAGIC))
+
+    def send_chunk(self, mem, seq):
+        raw = mem[seq * DL_WINDOWED_CHUNK_SIZE:(seq + 1) * DL_WINDOWED_CHUNK_SIZE]
+        if seq == self.drop_chunk:
+            self.drop_chunk = None
+            return
+        chunk = struct.pack('<IHHHB', seq, len(raw), len(raw), crc14443a(raw), 0) + raw
+        self.reply_ng(CMD_DOWNLOADED_WINDOWED, 0, chunk)
+
+    # dl_wait_ack()
+    def wait_ack(self, req):
+        while True:
+            cmd, data = self.receive()
+            if cmd == CMD_DOWNLOAD_WINDOWED_ACK and len(data) == 8:
+                if self.dropped_acks < self.drop_acks:
+                    self.dropped_acks += 1
+                    continue
+                return struct.unpack('<II', data), False
+            if cmd == CMD_DOWNLOAD_WINDOWED and len(data) == DOWNLOAD_WINDOWED.size:
+                again = DOWNLOAD_WINDOWED.unpack(data)
+                if again[0] != req[0] or again[3:5] != req[3:5]:
+                    raise ValueError('download of another memory')
+                return (again[5], 0), True
+
+    # DownloadWindowed()
+    def download(self, req):
+        memtype, flags, window, start_index, nbytes, first_chunk, _ = req
+        if memtype != DL_WINDOWED_MEM_EML or start_index + nbytes > CARD_MEMORY_SIZE:
+            self.reply_ng(CMD_DOWNLOAD_WINDOWED, -17, struct.pack('<IHH', 0, 0, 0))
+            return
+        mem = self.memory[start_index:start_index + nbytes]
+        total = (nbytes + DL_WINDOWED_CHUNK_SIZE - 1) // DL_WINDOWED_CHUNK_SIZE
+        window = min(max(window, 1), DL_WINDOWED_MAX_WINDOW)
+        start = struct.pack('<IHH', total, DL_WINDOWED_CHUNK_SIZE, window)
+        self.reply_ng(CMD_DOWNLOAD_WINDOWED, 0, start)
+
+        base, received = first_chunk, 0
+        while base < total:
+            count = min(window, total - base)
+            for i in range(count):
+                if received & (1 << i) == 0:
+                    self.send_chunk(mem, base + i)
+            self.reply_ng(CMD_DOWNLOAD_WINDOWED_ACK, 0, struct.pack('<II', base, (1 << count) - 1))
+
+            (nxt, bitmap), resumed = self.wait_ack(req)
+            if resumed:
+                self.resumed_at = nxt
+                self.reply_ng(CMD_DOWNLOAD_WINDOWED, 0, start)
+                base, received = min(nxt, total), 0
+                continue
+            if nxt < base or nxt > total:
+                received = 0
+                continue
+            base, received = nxt, bitmap
+
+        self.reply_mix(CMD_ACK, 1, 0, 0)
+
+    def run(self):
+        self.conn, _ = self.srv.accept()
+        try:
+            while True:
+                cmd, data = self.receive()
+                if cmd == CMD_PING:
+                    self.reply_ng(CMD_PING, 0, data)
+                elif cmd == CMD_CAPABILITIES:
+                    # version, baudrate, bigbuf_size, via USB-CDC, compiled with ISO14443A
+                    self.reply_ng(CMD_CAPABILITIES, 0, struct.pack('<BII3s', CAPABILITIES_VERSION, 0, 40000, b'\x02\x20\x00'))
+                elif cmd == CMD_GET_STANDALONE_DONE_STATUS:
+                    self.reply_ng(CMD_GET_STANDALONE_DONE_STATUS, 0)
+                elif cmd == CMD_DOWNLOAD_WINDOWED:
+                    self.download(DOWNLOAD_WINDOWED.unpack(data))
+        except (EOFError, OSError):
+            pass
+        finally:
+            self.conn.close()
+            self.srv.close()
+
+
+class TestDownloadWindowed(unittest.TestCase):
+    def setUp(self):
+        self.tmpdir = mkdtemp()
+        here = os.path.dirname(os.path.abspath(__file__))
+        self.client = shlex.split(os.environ.get('PM3BIN', os.path.join(here, '..', 'client', 'proxmark3')))
+
+    def tearDown(self):
+        rmtree(self.tmpdir)
+
+    def test_resume_after_lost_acks(self):
+        memory = bytes((i * 7 + (i >> 8)) & 0xFF for i in range(CARD_MEMORY_SIZE))
+        # the ack of the first window and the two acks the client resends while it waits
+        dev = FakeDevice(memory, drop_chunk=2, drop_acks=3)
+        dev.start()
+
+        dump = os.path.join(self.tmpdir, 'dump')
+        out = subprocess.run(self.client + ['-p', 'tcp:127.0.0.1:%d' % dev.port, '-c', 'hf mf esave 4 ' + dump],
+                             stdout=subprocess.PIPE, stderr=subprocess.STDOUT, timeout=60).stdout.decode(errors='replace')
+        dev.join(5)
+
+        self.assertNotIn('time-out', out)
+        self.assertEqual(dev.dropped_acks, 3)
+        self.assertEqual(dev.resumed_at, 2)
+        with open(dump + '.bin', 'rb') as f:
+            self.assertEqual(f.read(), memory)
+
+
+if __name__ == '__main__':
+    unittest.main()